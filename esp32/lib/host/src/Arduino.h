@@ -0,0 +1,36 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+// Host stand-in for the parts of the Arduino core the portable audio code
+// uses, for the native unit tests. Not built for the device.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+using std::max;
+using std::min;
+
+#ifndef PI
+#define PI 3.1415926535897932384626433832795
+#endif
+
+class HostSerial {
+public:
+    void print(const char *text);
+    void println(const char *text = "");
+    int printf(const char *format, ...);
+};
+
+extern HostSerial Serial;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+
+#endif // HOST_ARDUINO_H
@@ -0,0 +1,88 @@
+#include <Arduino.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+HostSerial Serial;
+
+void HostSerial::print(const char *text) {
+    fputs(text, stdout);
+}
+
+void HostSerial::println(const char *text) {
+    puts(text);
+}
+
+int HostSerial::printf(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int written = vprintf(format, args);
+    va_end(args);
+    return written;
+}
+
+static std::chrono::steady_clock::time_point bootTime() {
+    static const std::chrono::steady_clock::time_point boot = std::chrono::steady_clock::now();
+    return boot;
+}
+
+unsigned long millis() {
+    return (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() -
+                                                                                 bootTime()).count();
+}
+
+unsigned long micros() {
+    return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() -
+                                                                                 bootTime()).count();
+}
+
+void delay(unsigned long ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+TickType_t xTaskGetTickCount() {
+    return (TickType_t)millis();
+}
+
+// The device allocates audio buffers in PSRAM when there is some
+void *audio_malloc(size_t size) {
+    return malloc(size);
+}
+
+struct HostSemaphore {
+    std::mutex lock;
+    std::condition_variable changed;
+    bool given;
+};
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+    HostSemaphore *semaphore = new HostSemaphore;
+    semaphore->given = false;
+    return semaphore;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) {
+    std::unique_lock<std::mutex> hold(semaphore->lock);
+    if (ticks == portMAX_DELAY) {
+        semaphore->changed.wait(hold, [semaphore] { return semaphore->given; });
+    } else if (!semaphore->changed.wait_for(hold, std::chrono::milliseconds(ticks),
+                                            [semaphore] { return semaphore->given; })) {
+        return pdFALSE;
+    }
+    semaphore->given = false;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    std::lock_guard<std::mutex> hold(semaphore->lock);
+    semaphore->given = true;
+    semaphore->changed.notify_one();
+    return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) {
+    delete semaphore;
+}
@@ -0,0 +1,78 @@
+#include "hostWav.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+
+static uint32_t readLe(const uint8_t *bytes, uint8_t count) {
+    uint32_t value = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        value |= (uint32_t)bytes[i] << (8 * i);
+    }
+    return value;
+}
+
+// Walks the chunks for fmt and data; a header-only file is a valid empty one
+bool readWav(const std::string &path, HostWav &wav) {
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    std::vector<uint8_t> bytes;
+    uint8_t block[4096];
+    size_t got;
+    while ((got = fread(block, 1, sizeof(block), file)) > 0) {
+        bytes.insert(bytes.end(), block, block + got);
+    }
+    fclose(file);
+    if (bytes.size() < 12 || memcmp(&bytes[0], "RIFF", 4) != 0 || memcmp(&bytes[8], "WAVE", 4) != 0) {
+        return false;
+    }
+
+    bool haveFormat = false;
+    size_t at = 12;
+    while (at + 8 <= bytes.size()) {
+        uint32_t size = readLe(&bytes[at + 4], 4);
+        size_t body = at + 8;
+        size_t available = bytes.size() - body;
+        if (memcmp(&bytes[at], "fmt ", 4) == 0 && size >= 16 && available >= 16) {
+            if (readLe(&bytes[body], 2) != 1 || readLe(&bytes[body + 14], 2) != 16) {
+                return false; // PCM16 only
+            }
+            wav.channels = (uint8_t)readLe(&bytes[body + 2], 2);
+            wav.sampleRate = readLe(&bytes[body + 4], 4);
+            haveFormat = true;
+        } else if (memcmp(&bytes[at], "data", 4) == 0 && haveFormat) {
+            // Recorders that never patched the size leave it short or huge
+            size_t count = std::min((size_t)size, available) / 2;
+            wav.samples.resize(count);
+            for (size_t i = 0; i < count; i++) {
+                wav.samples[i] = (int16_t)readLe(&bytes[body + i * 2], 2);
+            }
+            return wav.channels > 0;
+        }
+        at = body + size + (size & 1);
+    }
+    if (haveFormat) {
+        wav.samples.clear();
+    }
+    return haveFormat;
+}
+
+std::vector<std::string> listFiles(const std::string &dir, const std::string &prefix, const std::string &suffix) {
+    std::vector<std::string> paths;
+    DIR *handle = opendir(dir.c_str());
+    if (!handle) {
+        return paths;
+    }
+    while (struct dirent *entry = readdir(handle)) {
+        std::string name = entry->d_name;
+        if (name.size() >= prefix.size() + suffix.size() && name.compare(0, prefix.size(), prefix) == 0 &&
+            name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0) {
+            paths.push_back(dir + "/" + name);
+        }
+    }
+    closedir(handle);
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
@@ -0,0 +1,20 @@
+#ifndef HOST_WAV_H
+#define HOST_WAV_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// PCM16 WAV files and test corpora for the native unit tests
+struct HostWav {
+    uint32_t sampleRate;
+    uint8_t channels;
+    std::vector<int16_t> samples; // interleaved
+};
+
+bool readWav(const std::string &path, HostWav &wav);
+// Paths of the files in dir whose names start with prefix and end with
+// suffix, sorted; empty when the directory is missing
+std::vector<std::string> listFiles(const std::string &dir, const std::string &prefix, const std::string &suffix);
+
+#endif // HOST_WAV_H
@@ -0,0 +1,118 @@
+#include "adpcm.h"
+
+static const int16_t STEP_TABLE[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31,
+    34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143,
+    157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658,
+    724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024,
+    3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+
+static const int8_t INDEX_TABLE[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8,
+    -1, -1, -1, -1, 2, 4, 6, 8};
+
+static inline int32_t clampIndex(int32_t index) {
+    return index < 0 ? 0 : (index > 88 ? 88 : index);
+}
+
+static inline int32_t clampSample(int32_t sample) {
+    return sample < -32768 ? -32768 : (sample > 32767 ? 32767 : sample);
+}
+
+// Shared by encoder and decoder so both track the exact same predictor
+static inline void applyNibble(uint8_t nibble, int32_t &predictor, int32_t &index) {
+    int32_t step = STEP_TABLE[index];
+    int32_t delta = step >> 3;
+    if (nibble & 4) {
+        delta += step;
+    }
+    if (nibble & 2) {
+        delta += step >> 1;
+    }
+    if (nibble & 1) {
+        delta += step >> 2;
+    }
+    predictor = clampSample(nibble & 8 ? predictor - delta : predictor + delta);
+    index = clampIndex(index + INDEX_TABLE[nibble]);
+}
+
+AdpcmEncoder::AdpcmEncoder() {
+    reset();
+}
+
+void AdpcmEncoder::reset() {
+    predictor = 0;
+    index = 0;
+}
+
+size_t AdpcmEncoder::encodeBlock(const int16_t *samples, size_t count, uint8_t *out) {
+    if (!samples || !out) {
+        return 0;
+    }
+
+    out[0] = (uint8_t)(predictor & 0xFF);
+    out[1] = (uint8_t)((predictor >> 8) & 0xFF);
+    out[2] = (uint8_t)index;
+    out[3] = (count & 1) ? ADPCM_FLAG_PADDED : 0;
+
+    uint8_t *packed = out + ADPCM_BLOCK_HEADER_BYTES;
+    for (size_t i = 0; i < count; i++) {
+        int32_t diff = samples[i] - predictor;
+        int32_t step = STEP_TABLE[index];
+        uint8_t nibble = 0;
+        if (diff < 0) {
+            nibble = 8;
+            diff = -diff;
+        }
+        if (diff >= step) {
+            nibble |= 4;
+            diff -= step;
+        }
+        if (diff >= step >> 1) {
+            nibble |= 2;
+            diff -= step >> 1;
+        }
+        if (diff >= step >> 2) {
+            nibble |= 1;
+        }
+        applyNibble(nibble, predictor, index);
+
+        if (i & 1) {
+            packed[i >> 1] |= (uint8_t)(nibble << 4);
+        } else {
+            packed[i >> 1] = nibble;
+        }
+    }
+    return adpcmBlockBytes(count);
+}
+
+AdpcmDecoder::AdpcmDecoder() {
+    reset();
+}
+
+void AdpcmDecoder::reset() {
+    predictor = 0;
+    index = 0;
+}
+
+size_t AdpcmDecoder::decodeBlock(const uint8_t *block, size_t bytes, int16_t *out) {
+    if (!block || !out || bytes < ADPCM_BLOCK_HEADER_BYTES) {
+        return 0;
+    }
+
+    predictor = (int16_t)(block[0] | (block[1] << 8));
+    index = clampIndex(block[2]);
+
+    size_t count = adpcmBlockSamples(bytes);
+    if ((block[3] & ADPCM_FLAG_PADDED) && count > 0) {
+        count--;
+    }
+    const uint8_t *packed = block + ADPCM_BLOCK_HEADER_BYTES;
+    for (size_t i = 0; i < count; i++) {
+        uint8_t nibble = (i & 1) ? (packed[i >> 1] >> 4) : (packed[i >> 1] & 0x0F);
+        applyNibble(nibble, predictor, index);
+        out[i] = (int16_t)predictor;
+    }
+    return count;
+}
@@ -0,0 +1,54 @@
+#ifndef ADPCM_H
+#define ADPCM_H
+
+#include <cstdint>
+#include <cstddef>
+
+// Streaming IMA-ADPCM (4 bits per sample).
+//
+// Audio is cut into self-contained blocks so a lost WebSocket message does
+// not desynchronise the decoder:
+//   int16 predictor (LE) | uint8 step index | uint8 flags | nibbles
+// The header holds the codec state before the first sample of the block.
+// Nibbles are packed low nibble first; an odd last sample pads with 0 and
+// sets ADPCM_FLAG_PADDED so the decoder drops the pad. Blocks from before
+// the flag have it clear and decode as before.
+// Plain C++ with no platform dependencies so the decoder builds on a host.
+
+static const size_t ADPCM_BLOCK_HEADER_BYTES = 4;
+static const uint8_t ADPCM_FLAG_PADDED = 0x01;
+
+inline size_t adpcmBlockBytes(size_t samples) {
+    return ADPCM_BLOCK_HEADER_BYTES + (samples + 1) / 2;
+}
+
+// At most; one fewer when the block is padded
+inline size_t adpcmBlockSamples(size_t bytes) {
+    return bytes > ADPCM_BLOCK_HEADER_BYTES ? (bytes - ADPCM_BLOCK_HEADER_BYTES) * 2 : 0;
+}
+
+class AdpcmEncoder {
+public:
+    AdpcmEncoder();
+    void reset();
+    // Returns bytes written to out, which needs adpcmBlockBytes(samples)
+    size_t encodeBlock(const int16_t *samples, size_t count, uint8_t *out);
+
+private:
+    int32_t predictor;
+    int32_t index;
+};
+
+class AdpcmDecoder {
+public:
+    AdpcmDecoder();
+    void reset();
+    // Returns samples written to out, which needs adpcmBlockSamples(bytes)
+    size_t decodeBlock(const uint8_t *block, size_t bytes, int16_t *out);
+
+private:
+    int32_t predictor;
+    int32_t index;
+};
+
+#endif // ADPCM_H
@@ -0,0 +1,86 @@
+#include "agc.h"
+#include <cmath>
+
+static int32_t dbToGain(int8_t db) {
+    return (int32_t)(powf(10.0f, db / 20.0f) * PeakLimiter::UNITY_GAIN);
+}
+
+static int32_t frameCoef(float frameMs, float timeMs) {
+    if (timeMs <= frameMs) {
+        return 32767;
+    }
+    return (int32_t)((1.0f - expf(-frameMs / timeMs)) * 32768.0f);
+}
+
+static uint32_t isqrt(uint32_t value) {
+    uint32_t root = 0;
+    uint32_t bit = 1UL << 30;
+    while (bit > value) {
+        bit >>= 2;
+    }
+    while (bit) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+AutomaticGainControl::AutomaticGainControl()
+    : currentGain(PeakLimiter::UNITY_GAIN), minGain(PeakLimiter::UNITY_GAIN), maxGain(PeakLimiter::UNITY_GAIN),
+      attackCoef(32767), releaseCoef(32767) {
+    cfg = AgcConfig();
+}
+
+void AutomaticGainControl::begin(const AgcConfig &config) {
+    cfg = config;
+    // Q10 gain times a full-scale sample must stay inside int32 in the limiter
+    int8_t ceiling = cfg.maxGainDb > 30 ? 30 : cfg.maxGainDb;
+    maxGain = dbToGain(ceiling);
+    minGain = dbToGain(cfg.minGainDb < ceiling ? cfg.minGainDb : ceiling);
+    attackCoef = frameCoef(cfg.frameMs, cfg.attackMs);
+    releaseCoef = frameCoef(cfg.frameMs, cfg.releaseMs);
+    peakLimiter.begin(cfg.sampleRate, cfg.limitThreshold, cfg.lookaheadMs, cfg.limiterReleaseMs);
+    currentGain = PeakLimiter::UNITY_GAIN < minGain ? minGain
+                  : (PeakLimiter::UNITY_GAIN > maxGain ? maxGain : PeakLimiter::UNITY_GAIN);
+}
+
+// Clears the limiter but keeps the learned gain for the next utterance
+void AutomaticGainControl::reset() {
+    peakLimiter.reset();
+}
+
+void AutomaticGainControl::process(int16_t *frame, size_t count, bool speech) {
+    if (!frame || count == 0) {
+        return;
+    }
+
+    int32_t previous = currentGain;
+    if (speech) {
+        uint64_t sumSquares = 0;
+        for (size_t i = 0; i < count; i++) {
+            int32_t s = frame[i];
+            sumSquares += (uint32_t)(s * s);
+        }
+        uint32_t rms = isqrt((uint32_t)(sumSquares / count));
+        int32_t desired = rms > 0 ? (int32_t)(((int32_t)cfg.targetRms << 10) / (int32_t)rms) : maxGain;
+        if (desired > maxGain) {
+            desired = maxGain;
+        } else if (desired < minGain) {
+            desired = minGain;
+        }
+
+        int32_t coef = desired < currentGain ? attackCoef : releaseCoef;
+        currentGain += (int32_t)(((int64_t)(desired - currentGain) * coef) >> 15);
+    }
+
+    peakLimiter.process(frame, count, previous, currentGain);
+}
+
+int16_t AutomaticGainControl::gainDb10() const {
+    return (int16_t)lrintf(200.0f * log10f((float)currentGain / PeakLimiter::UNITY_GAIN));
+}
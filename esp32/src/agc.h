@@ -0,0 +1,50 @@
+#ifndef AGC_H
+#define AGC_H
+
+#include <cstdint>
+#include <cstddef>
+#include "limiter.h"
+
+struct AgcConfig {
+    uint32_t sampleRate;
+    uint16_t frameMs;         // duration of the frames passed to process()
+    int16_t targetRms;        // level speech frames are steered to
+    int8_t maxGainDb;         // gain ceiling, for quiet far-field talkers
+    int8_t minGainDb;         // gain floor, for shouting up close
+    uint16_t attackMs;        // time constant when the gain has to drop
+    uint16_t releaseMs;       // time constant when the gain may rise
+    int16_t limitThreshold;   // peak ceiling after gain
+    uint16_t lookaheadMs;     // limiter look-ahead, adds this much latency
+    uint16_t limiterReleaseMs;
+};
+
+// Frame-based automatic gain control: measures each speech frame's RMS,
+// steers a Q10 gain toward the target with separate attack and release,
+// and holds it through non-speech so background noise is not pumped up.
+// The gain is ramped across each frame and followed by a look-ahead peak
+// limiter. Fixed-point, no allocation.
+class AutomaticGainControl {
+public:
+    AutomaticGainControl();
+
+    void begin(const AgcConfig &config);
+    void reset();
+
+    // In place; speech gates gain adaptation (typically the VAD decision)
+    void process(int16_t *frame, size_t count, bool speech);
+
+    int32_t gain() const { return currentGain; } // Q10
+    int16_t gainDb10() const;                     // tenths of a dB
+    PeakLimiter &limiter() { return peakLimiter; }
+
+private:
+    AgcConfig cfg;
+    int32_t currentGain;
+    int32_t minGain;
+    int32_t maxGain;
+    int32_t attackCoef;  // Q15 per frame
+    int32_t releaseCoef; // Q15 per frame
+    PeakLimiter peakLimiter;
+};
+
+#endif // AGC_H
@@ -0,0 +1,311 @@
+#include "assetCache.h"
+#include <cstring>
+
+static const uint32_t INDEX_MAGIC = 0x41535431; // "AST1"
+static const uint32_t SECTOR_BYTES = SPI_FLASH_SEC_SIZE;
+static const uint32_t INDEX_SECTORS = 2;
+
+static uint32_t crc32(const uint8_t *data, size_t length) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+class CacheLock {
+public:
+    explicit CacheLock(SemaphoreHandle_t lock) : lock(lock) { xSemaphoreTake(lock, portMAX_DELAY); }
+    ~CacheLock() { xSemaphoreGive(lock); }
+
+private:
+    SemaphoreHandle_t lock;
+};
+
+AssetCache::AssetCache()
+    : partition(NULL), lock(NULL), indexCopy(0), storing(false), writeOffset(0), erasedTo(0) {
+    memset(&index, 0, sizeof(index));
+    memset(pins, 0, sizeof(pins));
+    memset(&pending, 0, sizeof(pending));
+}
+
+AssetCache::~AssetCache() {
+    if (lock) {
+        vSemaphoreDelete(lock);
+    }
+}
+
+uint32_t AssetCache::sectorsFor(uint32_t bytes) {
+    return (bytes + SECTOR_BYTES - 1) / SECTOR_BYTES;
+}
+
+bool AssetCache::begin(const char *partitionLabel) {
+    if (!lock) {
+        lock = xSemaphoreCreateMutex();
+        if (!lock) {
+            return false;
+        }
+    }
+    const esp_partition_t *found =
+        esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, partitionLabel);
+    if (!found || found->size < (INDEX_SECTORS + 1) * SECTOR_BYTES) {
+        return false;
+    }
+    CacheLock hold(lock);
+    partition = found;
+    if (!loadIndex()) {
+        // Blank or foreign partition: start empty
+        memset(&index, 0, sizeof(index));
+        index.magic = INDEX_MAGIC;
+        indexCopy = 1;
+        if (!writeIndex()) {
+            partition = NULL;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Picks the newer of the two index copies that pass their CRC
+bool AssetCache::loadIndex() {
+    static Index candidate;
+    bool loaded = false;
+    for (uint8_t copy = 0; copy < INDEX_SECTORS; copy++) {
+        if (esp_partition_read(partition, copy * SECTOR_BYTES, &candidate, sizeof(candidate)) != ESP_OK) {
+            continue;
+        }
+        if (candidate.magic != INDEX_MAGIC || candidate.count > MAX_ASSETS ||
+            candidate.crc != crc32((const uint8_t *)&candidate, offsetof(Index, crc))) {
+            continue;
+        }
+        if (!loaded || (int32_t)(candidate.sequence - index.sequence) > 0) {
+            index = candidate;
+            indexCopy = copy;
+            loaded = true;
+        }
+    }
+    return loaded;
+}
+
+// Writes the other copy, so the current one survives a cut mid-write
+bool AssetCache::writeIndex() {
+    uint8_t copy = indexCopy ^ 1;
+    index.sequence++;
+    index.crc = crc32((const uint8_t *)&index, offsetof(Index, crc));
+    if (esp_partition_erase_range(partition, copy * SECTOR_BYTES, SECTOR_BYTES) != ESP_OK ||
+        esp_partition_write(partition, copy * SECTOR_BYTES, &index, sizeof(index)) != ESP_OK) {
+        return false;
+    }
+    indexCopy = copy;
+    return true;
+}
+
+int AssetCache::find(const uint8_t *hash) const {
+    for (int slot = 0; slot < MAX_ASSETS; slot++) {
+        const Entry &entry = index.entries[slot];
+        if (entry.bytes > 0 && memcmp(entry.hash, hash, ASSET_HASH_BYTES) == 0) {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+bool AssetCache::contains(const uint8_t *hash) {
+    if (!partition || !hash) {
+        return false;
+    }
+    CacheLock hold(lock);
+    return find(hash) >= 0;
+}
+
+bool AssetCache::map(const uint8_t *hash, AssetView *view) {
+    if (!partition || !hash || !view) {
+        return false;
+    }
+    CacheLock hold(lock);
+    int slot = find(hash);
+    if (slot < 0 || pins[slot] == UINT8_MAX) {
+        return false;
+    }
+    Entry &entry = index.entries[slot];
+    const void *data = NULL;
+    if (esp_partition_mmap(partition, entry.firstSector * SECTOR_BYTES, entry.bytes, ESP_PARTITION_MMAP_DATA, &data,
+                           &view->handle) != ESP_OK) {
+        return false;
+    }
+    entry.lastUsed = ++index.useClock;
+    pins[slot]++;
+    view->samples = (const int16_t *)data;
+    view->channels = entry.channels;
+    view->frames = entry.bytes / (sizeof(int16_t) * entry.channels);
+    view->sampleRate = entry.sampleRate;
+    view->slot = (int8_t)slot;
+    return true;
+}
+
+void AssetCache::release(AssetView &view) {
+    if (!view.samples) {
+        return;
+    }
+    spi_flash_munmap(view.handle);
+    CacheLock hold(lock);
+    if (view.slot >= 0 && view.slot < MAX_ASSETS && pins[view.slot] > 0) {
+        pins[view.slot]--;
+    }
+    view.samples = NULL;
+    view.slot = -1;
+}
+
+// First fit between the extents in use
+bool AssetCache::findSpace(uint32_t sectors, uint32_t *firstSector) const {
+    uint32_t total = partition->size / SECTOR_BYTES;
+    uint32_t start = INDEX_SECTORS;
+    while (start + sectors <= total) {
+        uint32_t next = start;
+        for (int slot = 0; slot < MAX_ASSETS; slot++) {
+            const Entry &entry = index.entries[slot];
+            uint32_t end = entry.firstSector + sectorsFor(entry.bytes);
+            if (entry.bytes > 0 && entry.firstSector < start + sectors && end > next) {
+                next = end;
+            }
+        }
+        if (next == start) {
+            *firstSector = start;
+            return true;
+        }
+        start = next;
+    }
+    return false;
+}
+
+bool AssetCache::hasFreeSlot() const {
+    for (int slot = 0; slot < MAX_ASSETS; slot++) {
+        if (index.entries[slot].bytes == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Drops the least recently used asset that is not mapped, in RAM only
+bool AssetCache::evictOldest() {
+    int oldest = -1;
+    for (int slot = 0; slot < MAX_ASSETS; slot++) {
+        const Entry &entry = index.entries[slot];
+        if (entry.bytes > 0 && pins[slot] == 0 &&
+            (oldest < 0 || (int32_t)(entry.lastUsed - index.entries[oldest].lastUsed) < 0)) {
+            oldest = slot;
+        }
+    }
+    if (oldest < 0) {
+        return false;
+    }
+    memset(&index.entries[oldest], 0, sizeof(Entry));
+    index.count--;
+    return true;
+}
+
+bool AssetCache::beginStore(const uint8_t *hash, uint32_t sampleRate, uint8_t channels, uint32_t bytes) {
+    if (!partition || !hash || bytes == 0 || channels < 1 || channels > 2 || sampleRate == 0 ||
+        sectorsFor(bytes) > partition->size / SECTOR_BYTES - INDEX_SECTORS) {
+        return false;
+    }
+    CacheLock hold(lock);
+    if (storing || find(hash) >= 0) {
+        return false;
+    }
+    bool evicted = false;
+    uint32_t first = 0;
+    while (!hasFreeSlot() || !findSpace(sectorsFor(bytes), &first)) {
+        if (!evictOldest()) {
+            return false;
+        }
+        evicted = true;
+    }
+    // Dropped entries must be gone from flash before their sectors are
+    // reused, or a cut mid-store would leave the index pointing at them
+    if (evicted && !writeIndex()) {
+        return false;
+    }
+
+    memset(&pending, 0, sizeof(pending));
+    memcpy(pending.hash, hash, ASSET_HASH_BYTES);
+    pending.firstSector = first;
+    pending.bytes = bytes;
+    pending.sampleRate = sampleRate;
+    pending.channels = channels;
+    writeOffset = 0;
+    erasedTo = 0;
+    storing = true;
+    return true;
+}
+
+bool AssetCache::append(const uint8_t *data, size_t length) {
+    if (!storing || writeOffset + length > pending.bytes) {
+        return false;
+    }
+    uint32_t base = pending.firstSector * SECTOR_BYTES;
+    while (erasedTo < writeOffset + length) {
+        if (esp_partition_erase_range(partition, base + erasedTo, SECTOR_BYTES) != ESP_OK) {
+            return false;
+        }
+        erasedTo += SECTOR_BYTES;
+    }
+    if (esp_partition_write(partition, base + writeOffset, data, length) != ESP_OK) {
+        return false;
+    }
+    writeOffset += length;
+    return true;
+}
+
+bool AssetCache::finishStore(bool keep) {
+    CacheLock hold(lock);
+    if (!storing) {
+        return false;
+    }
+    storing = false;
+    if (!keep || writeOffset != pending.bytes) {
+        return false;
+    }
+    for (int slot = 0; slot < MAX_ASSETS; slot++) {
+        if (index.entries[slot].bytes == 0) {
+            pending.lastUsed = ++index.useClock;
+            index.entries[slot] = pending;
+            index.count++;
+            if (writeIndex()) {
+                return true;
+            }
+            memset(&index.entries[slot], 0, sizeof(Entry));
+            index.count--;
+            return false;
+        }
+    }
+    return false;
+}
+
+uint8_t AssetCache::count() {
+    if (!partition) {
+        return 0;
+    }
+    CacheLock hold(lock);
+    return (uint8_t)index.count;
+}
+
+uint32_t AssetCache::usedBytes() {
+    if (!partition) {
+        return 0;
+    }
+    CacheLock hold(lock);
+    uint32_t used = 0;
+    for (int slot = 0; slot < MAX_ASSETS; slot++) {
+        used += sectorsFor(index.entries[slot].bytes) * SECTOR_BYTES;
+    }
+    return used;
+}
+
+uint32_t AssetCache::capacityBytes() const {
+    return partition ? partition->size - INDEX_SECTORS * SECTOR_BYTES : 0;
+}
@@ -0,0 +1,97 @@
+#ifndef ASSET_CACHE_H
+#define ASSET_CACHE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <esp_partition.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+static const size_t ASSET_HASH_BYTES = 32; // SHA-256 of the asset file
+
+// A cached asset mapped into the address space; samples point at flash
+struct AssetView {
+    const int16_t *samples;
+    size_t frames;
+    uint32_t sampleRate;
+    uint8_t channels;
+    int8_t slot;
+    spi_flash_mmap_handle_t handle;
+};
+
+// Prompt and earcon cache on a raw flash partition, keyed by content hash.
+// The first two sectors hold alternating copies of the index, so a power
+// cut while storing leaves the previous one intact; each asset is PCM16 in
+// whole sectors after them. Playback maps the asset instead of copying it.
+// Use order is tracked in RAM and written with the next store, which keeps
+// plays from wearing the flash; eviction is least recently used, skipping
+// assets that are mapped. All methods may be called from any task.
+class AssetCache {
+public:
+    static const uint8_t MAX_ASSETS = 64;
+
+    AssetCache();
+    ~AssetCache();
+
+    bool begin(const char *partitionLabel);
+    bool ready() const { return partition != NULL; }
+
+    bool contains(const uint8_t *hash);
+    // Maps the asset and marks it used; release() the view when done
+    bool map(const uint8_t *hash, AssetView *view);
+    void release(AssetView &view);
+
+    // One store at a time: reserve space (evicting if needed), append the
+    // PCM, then finish. Nothing is visible until finishStore(true).
+    bool beginStore(const uint8_t *hash, uint32_t sampleRate, uint8_t channels, uint32_t bytes);
+    bool append(const uint8_t *data, size_t length);
+    bool finishStore(bool keep);
+
+    uint8_t count();
+    uint32_t usedBytes();
+    uint32_t capacityBytes() const;
+
+private:
+    // Slots keep their place so a mapped view stays valid; bytes 0 is free
+    struct Entry {
+        uint8_t hash[ASSET_HASH_BYTES];
+        uint32_t firstSector;
+        uint32_t bytes;
+        uint32_t sampleRate;
+        uint32_t lastUsed;
+        uint8_t channels;
+        uint8_t reserved[3];
+    };
+    struct Index {
+        uint32_t magic;
+        uint32_t sequence;
+        uint32_t useClock;
+        uint32_t count;
+        Entry entries[MAX_ASSETS];
+        uint32_t crc;
+    };
+
+    int find(const uint8_t *hash) const;
+    bool loadIndex();
+    bool writeIndex();
+    bool findSpace(uint32_t sectors, uint32_t *firstSector) const;
+    bool hasFreeSlot() const;
+    bool evictOldest();
+    static uint32_t sectorsFor(uint32_t bytes);
+
+    const esp_partition_t *partition;
+    SemaphoreHandle_t lock;
+    Index index;
+    uint8_t pins[MAX_ASSETS]; // mapped views per slot
+    uint8_t indexCopy;        // sector holding the current index
+
+    bool storing;
+    Entry pending;
+    uint32_t writeOffset; // bytes into the pending asset
+    uint32_t erasedTo;    // bytes of the pending extent erased so far
+
+    AssetCache(const AssetCache &);
+    AssetCache &operator=(const AssetCache &);
+};
+
+#endif // ASSET_CACHE_H
@@ -0,0 +1,307 @@
+#include "audioHal.h"
+#include <cstring>
+#include <esp_attr.h>
+#include <esp_timer.h>
+
+AudioChannel::AudioChannel()
+    : handle(NULL), tx(false), running(false), rate(0), count(0), frameBytes(0), done(0), epoch(0), position(0),
+      bufferBytes(0), consumer(NULL), nextSequence(0), consumerEpoch(0), activeNow(false), blocks(0), activeBlocks(0),
+      underruns(0), idleUnderruns(0), overruns(0), lastCompletion(0), maxInterval(0) {
+    memset((void *)buffers, 0, sizeof(buffers));
+    memset((void *)completedUs, 0, sizeof(completedUs));
+    memset((void *)filled, 0, sizeof(filled));
+}
+
+AudioChannel::~AudioChannel() {
+    end();
+}
+
+#if AUDIO_HAL_STD_AVAILABLE
+esp_err_t AudioChannel::begin(Direction direction, i2s_port_t port, uint32_t sampleRate, uint8_t slotBits,
+                              bool stereo, const DmaGeometry &geometry, const AudioPins &pins) {
+    if (handle) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (geometry.count < 2 || geometry.count > MAX_BLOCKS || sampleRate == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    i2s_chan_config_t channelConfig = I2S_CHANNEL_DEFAULT_CONFIG(port, I2S_ROLE_MASTER);
+    channelConfig.dma_desc_num = geometry.count;
+    channelConfig.dma_frame_num = geometry.frames;
+    channelConfig.auto_clear = false; // the callback clears what has played
+    i2s_chan_handle_t channel = NULL;
+    bool isTx = direction == TX;
+    esp_err_t err = i2s_new_channel(&channelConfig, isTx ? &channel : NULL, isTx ? NULL : &channel);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    i2s_std_clk_config_t clock = I2S_STD_CLK_DEFAULT_CONFIG(sampleRate);
+    i2s_std_slot_config_t slots =
+        I2S_STD_PHILIPS_SLOT_DEFAULT_CONFIG((i2s_data_bit_width_t)slotBits, stereo ? I2S_SLOT_MODE_STEREO : I2S_SLOT_MODE_MONO);
+    if (!stereo) {
+        slots.slot_mask = I2S_STD_SLOT_LEFT;
+    }
+    i2s_std_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.clk_cfg = clock;
+    config.slot_cfg = slots;
+    config.gpio_cfg.mclk = I2S_GPIO_UNUSED;
+    config.gpio_cfg.bclk = (gpio_num_t)pins.bclk;
+    config.gpio_cfg.ws = (gpio_num_t)pins.ws;
+    config.gpio_cfg.dout = pins.dout < 0 ? I2S_GPIO_UNUSED : (gpio_num_t)pins.dout;
+    config.gpio_cfg.din = pins.din < 0 ? I2S_GPIO_UNUSED : (gpio_num_t)pins.din;
+
+    i2s_event_callbacks_t callbacks;
+    memset(&callbacks, 0, sizeof(callbacks));
+    if (isTx) {
+        callbacks.on_sent = onCompleted;
+    } else {
+        callbacks.on_recv = onCompleted;
+    }
+    err = i2s_channel_init_std_mode(channel, &config);
+    if (err == ESP_OK) {
+        err = i2s_channel_register_event_callback(channel, &callbacks, this);
+    }
+    if (err != ESP_OK) {
+        i2s_del_channel(channel);
+        return err;
+    }
+
+    tx = isTx;
+    rate = sampleRate;
+    count = geometry.count;
+    frameBytes = (uint8_t)(slotBits / 8 * (stereo ? 2 : 1));
+    bufferBytes = (size_t)geometry.frames * frameBytes;
+    memset((void *)buffers, 0, sizeof(buffers));
+    running = false;
+    handle = channel;
+    err = setRunning(true);
+    if (err != ESP_OK) {
+        end();
+    }
+    return err;
+}
+
+void AudioChannel::end() {
+    if (!handle) {
+        return;
+    }
+    setRunning(false);
+    i2s_del_channel((i2s_chan_handle_t)handle);
+    handle = NULL;
+    epoch = epoch + 1;
+}
+
+esp_err_t AudioChannel::setRunning(bool run) {
+    if (!handle) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (run == running) {
+        return ESP_OK;
+    }
+    esp_err_t err;
+    if (run) {
+        // The DMA starts again from the first descriptor
+        silence();
+        done = 0;
+        position = 0;
+        lastCompletion = 0;
+        epoch = epoch + 1;
+        err = i2s_channel_enable((i2s_chan_handle_t)handle);
+    } else {
+        err = i2s_channel_disable((i2s_chan_handle_t)handle);
+    }
+    if (err == ESP_OK) {
+        running = run;
+    }
+    return err;
+}
+
+esp_err_t AudioChannel::setRate(uint32_t sampleRate) {
+    if (!handle) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    bool wasRunning = running;
+    // The clock can only change while the channel is stopped
+    esp_err_t err = setRunning(false);
+    if (err == ESP_OK) {
+        i2s_std_clk_config_t clock = I2S_STD_CLK_DEFAULT_CONFIG(sampleRate);
+        err = i2s_channel_reconfig_std_clock((i2s_chan_handle_t)handle, &clock);
+    }
+    if (err == ESP_OK) {
+        rate = sampleRate;
+    }
+    if (wasRunning) {
+        esp_err_t restarted = setRunning(true);
+        if (err == ESP_OK) {
+            err = restarted;
+        }
+    }
+    return err;
+}
+
+// event->data is the address of the descriptor's buffer pointer
+bool IRAM_ATTR AudioChannel::onCompleted(i2s_chan_handle_t channel, i2s_event_data_t *event, void *context) {
+    return static_cast<AudioChannel *>(context)->completed(*(uint8_t **)event->data, event->size);
+}
+
+// Runs in the DMA interrupt once per descriptor. The time is when the DMA
+// finished the block; the I2S FIFO adds a fixed few frames after that.
+bool IRAM_ATTR AudioChannel::completed(uint8_t *buffer, size_t bytes) {
+    int64_t now = esp_timer_get_time();
+    uint32_t sequence = done;
+    uint8_t slot = position;
+    if (tx) {
+        // What just played was the refill of the block freed a lap ago
+        if (sequence >= count && !filled[slot]) {
+            if (activeNow) {
+                underruns++;
+            } else {
+                idleUnderruns++;
+            }
+        }
+        filled[slot] = false;
+        memset(buffer, 0, bytes);
+    }
+    if (lastCompletion) {
+        uint32_t interval = (uint32_t)(now - lastCompletion);
+        if (interval > maxInterval) {
+            maxInterval = interval;
+        }
+    }
+    lastCompletion = now;
+    blocks++;
+    if (activeNow) {
+        activeBlocks++;
+    }
+    buffers[slot] = buffer;
+    completedUs[slot] = now;
+    bufferBytes = bytes;
+    position = slot + 1 == count ? 0 : slot + 1;
+    done = sequence + 1;
+
+    BaseType_t woken = pdFALSE;
+    TaskHandle_t task = consumer;
+    if (task) {
+        vTaskNotifyGiveFromISR(task, &woken);
+    }
+    return woken == pdTRUE;
+}
+#else
+esp_err_t AudioChannel::begin(Direction, i2s_port_t, uint32_t, uint8_t, bool, const DmaGeometry &, const AudioPins &) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+void AudioChannel::end() {
+}
+
+esp_err_t AudioChannel::setRunning(bool) {
+    return ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t AudioChannel::setRate(uint32_t) {
+    return ESP_ERR_INVALID_STATE;
+}
+#endif
+
+void AudioChannel::silence() {
+    if (!tx) {
+        return;
+    }
+    size_t bytes = bufferBytes;
+    for (uint8_t slot = 0; slot < count; slot++) {
+        if (buffers[slot]) {
+            memset(buffers[slot], 0, bytes);
+        }
+        filled[slot] = false;
+    }
+}
+
+bool AudioChannel::acquire(AudioBlock *block, TickType_t timeout) {
+    if (!handle || !block) {
+        return false;
+    }
+    consumer = xTaskGetCurrentTaskHandle();
+    while (true) {
+        uint32_t current = epoch;
+        if (consumerEpoch != current) {
+            consumerEpoch = current;
+            nextSequence = 0;
+        }
+        uint32_t completions = done;
+        if ((int32_t)(completions - nextSequence) <= 0) {
+            if (ulTaskNotifyTake(pdTRUE, timeout) == 0) {
+                return false;
+            }
+            continue;
+        }
+        if (completions - nextSequence >= count) {
+            // Lapped: RX keeps the newest block, which has the longest to
+            // live; on TX only the buffers freed in the last lap can be filled
+            uint32_t skipTo = tx ? completions - count + 1 : completions - 1;
+            if (!tx) {
+                overruns += skipTo - nextSequence;
+            }
+            nextSequence = skipTo;
+        }
+
+        uint32_t sequence = nextSequence;
+        uint8_t slot = sequence % count;
+        block->data = buffers[slot];
+        block->frames = blockFrames();
+        block->sequence = sequence;
+        block->epoch = current;
+        int64_t blockUs = (int64_t)block->frames * 1000000 / rate;
+        if (tx) {
+            // Freed at completion n, it plays again after the count - 1
+            // buffers queued ahead of it
+            block->frameIndex = (uint64_t)(sequence + count) * block->frames;
+            block->timeUs = completedUs[slot] + (count - 1) * blockUs;
+        } else {
+            block->frameIndex = (uint64_t)sequence * block->frames;
+            block->timeUs = completedUs[slot] - blockUs;
+        }
+        // The callback may have come round to it while it was read
+        if (inTime(*block)) {
+            nextSequence = sequence + 1;
+            return true;
+        }
+    }
+}
+
+bool AudioChannel::inTime(const AudioBlock &block) const {
+    return handle && block.epoch == epoch && done - block.sequence < count;
+}
+
+bool AudioChannel::release(const AudioBlock &block) {
+    if (!inTime(block)) {
+        if (!tx) {
+            overruns++;
+        }
+        return false;
+    }
+    if (tx) {
+        uint8_t slot = block.sequence % count;
+        filled[slot] = true;
+        // Too late if it started playing between the check and the flag
+        if (!inTime(block)) {
+            filled[slot] = false;
+            return false;
+        }
+    }
+    return true;
+}
+
+I2sHealthStats AudioChannel::stats() const {
+    I2sHealthStats s;
+    s.blocks = blocks;
+    s.activeBlocks = activeBlocks;
+    s.underruns = underruns;
+    s.idleUnderruns = idleUnderruns;
+    s.overruns = overruns;
+    s.dmaErrors = 0;
+    s.lastCompletionUs = lastCompletion;
+    s.maxIntervalUs = maxInterval;
+    return s;
+}
@@ -0,0 +1,123 @@
+#ifndef AUDIO_HAL_H
+#define AUDIO_HAL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <esp_idf_version.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "i2sHealth.h"
+
+// The channel-based driver arrived with IDF 5; on 4.x begin() fails
+#define AUDIO_HAL_STD_AVAILABLE (ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0))
+
+#if AUDIO_HAL_STD_AVAILABLE
+#include <driver/i2s_std.h>
+#endif
+
+// One DMA buffer lent to the pipeline: on RX the frames just captured, on
+// TX a buffer that has played out and can be filled again. Either way it
+// is good until the DMA comes round to it again, count - 1 blocks later.
+struct AudioBlock {
+    void *data;          // the DMA buffer itself
+    size_t frames;
+    uint32_t sequence;   // blocks since the channel was enabled
+    uint32_t epoch;      // bumped by every enable; older blocks are dead
+    uint64_t frameIndex; // first frame, counted from the enable
+    int64_t timeUs;      // esp_timer time the first frame is on the wire
+};
+
+struct AudioPins {
+    int bclk;
+    int ws;
+    int dout; // -1 when unused
+    int din;
+};
+
+// One standard-mode I2S channel on the channel-based driver. Nothing is
+// copied: the completion callback records which DMA buffer finished and
+// when, and wakes the consumer task; acquire() hands that buffer out by
+// reference with its position in the stream. On TX the callback zeroes a
+// buffer once it has played, so one nobody refilled is heard as silence.
+// acquire() and release() belong to one consumer task at a time.
+class AudioChannel {
+public:
+    enum Direction { RX, TX };
+
+    AudioChannel();
+    ~AudioChannel();
+
+    esp_err_t begin(Direction direction, i2s_port_t port, uint32_t sampleRate, uint8_t slotBits, bool stereo,
+                    const DmaGeometry &geometry, const AudioPins &pins);
+    void end();
+    bool ready() const { return handle != NULL; }
+
+    // Stopping and starting again restarts the stream: a new epoch
+    esp_err_t setRunning(bool running);
+    esp_err_t setRate(uint32_t sampleRate);
+    // TX: zeroes every buffer, including those filled but not yet played
+    void silence();
+
+    // RX: the oldest block not yet taken; when the DMA has lapped the
+    // consumer it skips to the newest and counts the rest as overruns.
+    // TX: the next buffer to fill, the first that is still ahead of the DMA.
+    bool acquire(AudioBlock *block, TickType_t timeout);
+    // Whether the DMA has yet to come back to the block
+    bool inTime(const AudioBlock &block) const;
+    // RX: done reading; false if it was overwritten meanwhile. TX: the
+    // block holds audio, so leaving it unfilled is no longer an underrun.
+    // A TX block may be written and released again until it plays.
+    bool release(const AudioBlock &block);
+
+    // As I2sMonitor, so the playback and capture code read either
+    void setActive(bool active) { activeNow = active; }
+    I2sHealthStats stats() const;
+    void resetPeaks() { maxInterval = 0; }
+
+    uint32_t sampleRate() const { return rate; }
+
+private:
+    static const uint8_t MAX_BLOCKS = 64;
+
+    size_t blockFrames() const { return frameBytes ? bufferBytes / frameBytes : 0; }
+
+#if AUDIO_HAL_STD_AVAILABLE
+    static bool onCompleted(i2s_chan_handle_t channel, i2s_event_data_t *event, void *context);
+    bool completed(uint8_t *buffer, size_t bytes);
+#endif
+
+    void *handle;
+    bool tx;
+    bool running;
+    uint32_t rate;
+    uint8_t count;
+    uint8_t frameBytes;
+
+    // Written by the completion callback
+    volatile uint32_t done;     // completions since the enable
+    volatile uint32_t epoch;
+    volatile uint8_t position;  // done % count
+    volatile size_t bufferBytes;
+    uint8_t *volatile buffers[MAX_BLOCKS];
+    volatile int64_t completedUs[MAX_BLOCKS];
+    volatile bool filled[MAX_BLOCKS]; // TX: released since it last played
+    volatile TaskHandle_t consumer;
+
+    // Owned by the consumer
+    uint32_t nextSequence;
+    uint32_t consumerEpoch;
+
+    volatile bool activeNow;
+    volatile uint32_t blocks;
+    volatile uint32_t activeBlocks;
+    volatile uint32_t underruns;
+    volatile uint32_t idleUnderruns;
+    volatile uint32_t overruns;
+    volatile int64_t lastCompletion;
+    volatile uint32_t maxInterval;
+
+    AudioChannel(const AudioChannel &);
+    AudioChannel &operator=(const AudioChannel &);
+};
+
+#endif // AUDIO_HAL_H
@@ -0,0 +1,231 @@
+#include "audioRing.h"
+#include <Arduino.h>
+#include "utils.h"
+
+AudioRing::AudioRing()
+    : buffer(NULL), mask(0), policy(DROP_NEWEST), blockTicks(0),
+      head(0), tail(0), overflowCount(0), droppedCount(0),
+      dataReady(NULL), spaceReady(NULL) {
+}
+
+AudioRing::~AudioRing() {
+    free(buffer);
+    if (dataReady) {
+        vSemaphoreDelete(dataReady);
+    }
+    if (spaceReady) {
+        vSemaphoreDelete(spaceReady);
+    }
+}
+
+bool AudioRing::begin(size_t minSamples, OverflowPolicy overflowPolicy, uint32_t blockTimeoutMs) {
+    size_t size = 1;
+    while (size < minSamples) {
+        size <<= 1;
+    }
+    if (size > (INDEX_MASK >> 1)) {
+        return false;
+    }
+
+    free(buffer);
+    buffer = (int16_t *)audio_malloc(size * sizeof(int16_t));
+    if (!buffer) {
+        Serial.println("Failed to allocate audio ring memory");
+        mask = 0;
+        return false;
+    }
+
+    if (!dataReady) {
+        dataReady = xSemaphoreCreateBinary();
+    }
+    if (!spaceReady) {
+        spaceReady = xSemaphoreCreateBinary();
+    }
+
+    mask = size - 1;
+    head.store(0);
+    tail.store(0);
+    overflowCount.store(0);
+    droppedCount.store(0);
+    setPolicy(overflowPolicy, blockTimeoutMs);
+    return true;
+}
+
+void AudioRing::setPolicy(OverflowPolicy overflowPolicy, uint32_t blockTimeoutMs) {
+    policy = overflowPolicy;
+    blockTicks = pdMS_TO_TICKS(blockTimeoutMs);
+}
+
+size_t AudioRing::used(uint32_t headIndex, uint32_t tailIndex) const {
+    return (headIndex - (tailIndex & INDEX_MASK)) & INDEX_MASK;
+}
+
+size_t AudioRing::available() const {
+    if (!buffer) {
+        return 0;
+    }
+    return used(head.load(std::memory_order_acquire), tail.load(std::memory_order_acquire));
+}
+
+size_t AudioRing::space() const {
+    if (!buffer) {
+        return 0;
+    }
+    return capacity() - available();
+}
+
+// Producer only. Moves tail forward over samples the consumer has not
+// claimed; returns how many were discarded.
+size_t AudioRing::reclaimOldest(size_t samples) {
+    uint32_t headIndex = head.load(std::memory_order_relaxed);
+    uint32_t tailIndex = tail.load(std::memory_order_acquire);
+    while (true) {
+        if (tailIndex & CLAIM_BIT) {
+            return 0;
+        }
+        size_t count = min(samples, used(headIndex, tailIndex));
+        uint32_t next = (tailIndex + count) & INDEX_MASK;
+        if (tail.compare_exchange_weak(tailIndex, next, std::memory_order_acq_rel)) {
+            if (count > 0) {
+                overflowCount.fetch_add(1, std::memory_order_relaxed);
+                droppedCount.fetch_add(count, std::memory_order_relaxed);
+            }
+            return count;
+        }
+    }
+}
+
+size_t AudioRing::reserve(int16_t **span, size_t samples) {
+    if (!buffer || !span || samples == 0) {
+        return 0;
+    }
+
+    uint32_t headIndex = head.load(std::memory_order_relaxed);
+    size_t room = capacity() - available();
+
+    if (room < samples && policy == DROP_OLDEST) {
+        room += reclaimOldest(samples - room);
+    } else if (room < samples && policy == BLOCK && blockTicks > 0) {
+        TickType_t start = xTaskGetTickCount();
+        while (room < samples) {
+            TickType_t waited = xTaskGetTickCount() - start;
+            if (waited >= blockTicks) {
+                break;
+            }
+            xSemaphoreTake(spaceReady, blockTicks - waited);
+            room = capacity() - available();
+        }
+    }
+
+    size_t offset = headIndex & mask;
+    size_t count = min(samples, min(room, capacity() - offset));
+    *span = buffer + offset;
+    return count;
+}
+
+void AudioRing::commit(size_t samples) {
+    if (samples == 0) {
+        return;
+    }
+    uint32_t headIndex = head.load(std::memory_order_relaxed);
+    head.store((headIndex + samples) & INDEX_MASK, std::memory_order_release);
+    xSemaphoreGive(dataReady);
+}
+
+size_t AudioRing::write(const int16_t *data, size_t samples) {
+    if (!buffer || !data) {
+        return 0;
+    }
+
+    size_t written = 0;
+    while (written < samples) {
+        int16_t *span;
+        size_t count = reserve(&span, samples - written);
+        if (count == 0) {
+            break;
+        }
+        memcpy(span, data + written, count * sizeof(int16_t));
+        commit(count);
+        written += count;
+    }
+
+    if (written < samples) {
+        overflowCount.fetch_add(1, std::memory_order_relaxed);
+        droppedCount.fetch_add(samples - written, std::memory_order_relaxed);
+    }
+    return written;
+}
+
+size_t AudioRing::peek(const int16_t **span, size_t maxSamples) {
+    if (!buffer || !span) {
+        return 0;
+    }
+
+    // Claim the current tail so a DROP_OLDEST producer leaves it alone
+    uint32_t tailIndex = tail.load(std::memory_order_acquire);
+    while (!(tailIndex & CLAIM_BIT)) {
+        if (tail.compare_exchange_weak(tailIndex, tailIndex | CLAIM_BIT, std::memory_order_acq_rel)) {
+            break;
+        }
+    }
+    tailIndex &= INDEX_MASK;
+
+    size_t offset = tailIndex & mask;
+    size_t count = min(maxSamples, min(used(head.load(std::memory_order_acquire), tailIndex), capacity() - offset));
+    *span = buffer + offset;
+    if (count == 0) {
+        tail.store(tailIndex, std::memory_order_release);
+    }
+    return count;
+}
+
+void AudioRing::release(size_t samples) {
+    // The claim bit keeps the producer off tail, so a plain store is enough
+    uint32_t tailIndex = tail.load(std::memory_order_relaxed) & INDEX_MASK;
+    tail.store((tailIndex + samples) & INDEX_MASK, std::memory_order_release);
+    if (policy == BLOCK) {
+        xSemaphoreGive(spaceReady);
+    }
+}
+
+size_t AudioRing::read(int16_t *data, size_t samples) {
+    if (!buffer || !data) {
+        return 0;
+    }
+
+    size_t done = 0;
+    while (done < samples) {
+        const int16_t *span;
+        size_t count = peek(&span, samples - done);
+        if (count == 0) {
+            break;
+        }
+        memcpy(data + done, span, count * sizeof(int16_t));
+        release(count);
+        done += count;
+    }
+    return done;
+}
+
+bool AudioRing::waitForData(size_t samples, uint32_t timeoutMs) {
+    TickType_t timeout = pdMS_TO_TICKS(timeoutMs);
+    TickType_t start = xTaskGetTickCount();
+    while (available() < samples) {
+        TickType_t waited = xTaskGetTickCount() - start;
+        if (waited >= timeout) {
+            return false;
+        }
+        xSemaphoreTake(dataReady, timeout - waited);
+    }
+    return true;
+}
+
+// Consumer only. Drops everything unread without touching the samples.
+void AudioRing::clear() {
+    if (!buffer) {
+        return;
+    }
+    uint32_t tailIndex = tail.load(std::memory_order_acquire);
+    while (!tail.compare_exchange_weak(tailIndex, head.load(std::memory_order_acquire), std::memory_order_acq_rel)) {
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef AUDIO_RING_H
+#define AUDIO_RING_H
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+// Single-producer/single-consumer sample ring, safe across cores.
+//
+// Capacity is rounded up to a power of two so indices wrap with a mask.
+// Both sides can work zero-copy: the producer reserve()s a contiguous span,
+// fills it (e.g. straight from i2s_read) and commit()s; the consumer peek()s
+// a contiguous span, uses it in place and release()s it.
+class AudioRing {
+public:
+    enum OverflowPolicy {
+        DROP_NEWEST, // reserve/write only what fits, the rest is dropped
+        DROP_OLDEST, // discard unread samples to make room (not ones the consumer holds)
+        BLOCK        // wait up to the block timeout for space, then drop newest
+    };
+
+    AudioRing();
+    ~AudioRing();
+
+    bool begin(size_t minSamples, OverflowPolicy policy = DROP_NEWEST, uint32_t blockTimeoutMs = 0);
+    void setPolicy(OverflowPolicy policy, uint32_t blockTimeoutMs = 0);
+
+    // Producer side
+    size_t reserve(int16_t **span, size_t samples);
+    void commit(size_t samples);
+    size_t write(const int16_t *data, size_t samples);
+
+    // Consumer side
+    size_t peek(const int16_t **span, size_t maxSamples);
+    void release(size_t samples);
+    size_t read(int16_t *data, size_t samples);
+    bool waitForData(size_t samples, uint32_t timeoutMs);
+    void clear();
+
+    size_t available() const;
+    size_t space() const;
+    size_t capacity() const { return mask + 1; }
+    uint32_t overflows() const { return overflowCount.load(std::memory_order_relaxed); }
+    uint32_t droppedSamples() const { return droppedCount.load(std::memory_order_relaxed); }
+
+private:
+    // The top bit of tail marks samples the consumer is holding via peek(),
+    // which a DROP_OLDEST producer must not reclaim.
+    static const uint32_t CLAIM_BIT = 0x80000000u;
+    static const uint32_t INDEX_MASK = 0x7FFFFFFFu;
+
+    size_t reclaimOldest(size_t samples);
+    size_t used(uint32_t headIndex, uint32_t tailIndex) const;
+
+    int16_t *buffer;
+    uint32_t mask;
+    OverflowPolicy policy;
+    TickType_t blockTicks;
+    std::atomic<uint32_t> head;
+    std::atomic<uint32_t> tail;
+    std::atomic<uint32_t> overflowCount;
+    std::atomic<uint32_t> droppedCount;
+    SemaphoreHandle_t dataReady;
+    SemaphoreHandle_t spaceReady;
+
+    AudioRing(const AudioRing &);
+    AudioRing &operator=(const AudioRing &);
+};
+
+#endif // AUDIO_RING_H
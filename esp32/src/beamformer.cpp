@@ -0,0 +1,174 @@
+#include "beamformer.h"
+#include <Arduino.h>
+#include "utils.h"
+
+static const size_t BLOCK = 256;
+static const uint8_t MAX_LAG_LIMIT = 32;
+static const float SPEED_OF_SOUND = 343.0f;
+static const float CORRELATION_SMOOTHING = 0.2f;
+static const float LAG_HYSTERESIS = 0.05f;   // a new peak must beat the current lag by this much
+static const float SPEECH_OVER_FLOOR = 4.0f; // 6 dB
+static const float MIN_ENERGY = 400.0f;
+static const float FLOOR_RISE = 0.01f;
+static const float FLOOR_UNKNOWN = 0.0f;
+
+Beamformer::Beamformer()
+    : rate(0), spacing(0), maxLag(0), lag(0), firstWork(NULL), secondWork(NULL), correlation(NULL),
+      noiseFloor(FLOOR_UNKNOWN) {
+}
+
+Beamformer::~Beamformer() {
+    release();
+}
+
+void Beamformer::release() {
+    free(firstWork);
+    free(secondWork);
+    free(correlation);
+    firstWork = secondWork = NULL;
+    correlation = NULL;
+}
+
+bool Beamformer::begin(uint32_t sampleRate, uint16_t spacingMm) {
+    release();
+    if (sampleRate == 0 || spacingMm == 0) {
+        return false;
+    }
+    float lagLimit = ceilf(spacingMm / 1000.0f / SPEED_OF_SOUND * sampleRate);
+    if (lagLimit < 1.0f || lagLimit > MAX_LAG_LIMIT) {
+        return false;
+    }
+    rate = sampleRate;
+    spacing = spacingMm;
+    maxLag = (uint8_t)lagLimit;
+
+    size_t workSamples = 2 * maxLag + BLOCK;
+    firstWork = (int16_t *)audio_malloc(workSamples * sizeof(int16_t));
+    secondWork = (int16_t *)audio_malloc(workSamples * sizeof(int16_t));
+    correlation = (float *)audio_malloc((2 * maxLag + 1) * sizeof(float));
+    if (!firstWork || !secondWork || !correlation) {
+        release();
+        return false;
+    }
+    reset();
+    return true;
+}
+
+void Beamformer::reset() {
+    if (!correlation) {
+        return;
+    }
+    memset(firstWork, 0, 2 * maxLag * sizeof(int16_t));
+    memset(secondWork, 0, 2 * maxLag * sizeof(int16_t));
+    memset(correlation, 0, (2 * maxLag + 1) * sizeof(float));
+    lag = 0;
+    noiseFloor = FLOOR_UNKNOWN;
+}
+
+int8_t Beamformer::angleDegrees() const {
+    if (!correlation) {
+        return 0;
+    }
+    float s = lag * SPEED_OF_SOUND * 1000.0f / ((float)rate * spacing);
+    s = s > 1.0f ? 1.0f : (s < -1.0f ? -1.0f : s);
+    return (int8_t)lrintf(asinf(s) * 180.0f / PI);
+}
+
+uint8_t Beamformer::coherence() const {
+    if (!correlation) {
+        return 0;
+    }
+    float c = correlation[maxLag + lag];
+    return (uint8_t)(c <= 0.0f ? 0 : (c >= 1.0f ? 100 : lrintf(c * 100.0f)));
+}
+
+void Beamformer::process(const int16_t *first, const int16_t *second, int16_t *out, size_t count, bool adapt) {
+    if (!correlation) {
+        // Not configured: pass the first channel through
+        memcpy(out, first, count * sizeof(int16_t));
+        return;
+    }
+    size_t history = 2 * maxLag;
+    while (count > 0) {
+        size_t take = count < BLOCK ? count : BLOCK;
+        memcpy(firstWork + history, first, take * sizeof(int16_t));
+        memcpy(secondWork + history, second, take * sizeof(int16_t));
+        processBlock(take, out, adapt);
+        memmove(firstWork, firstWork + take, history * sizeof(int16_t));
+        memmove(secondWork, secondWork + take, history * sizeof(int16_t));
+        first += take;
+        second += take;
+        out += take;
+        count -= take;
+    }
+}
+
+void Beamformer::processBlock(size_t count, int16_t *out, bool adapt) {
+    const int16_t *x = firstWork + 2 * maxLag;
+    const int16_t *y = secondWork + 2 * maxLag;
+    int8_t previousLag = lag;
+
+    if (adapt) {
+        int64_t xx = 0;
+        int64_t yy = 0;
+        for (size_t n = 0; n < count; n++) {
+            xx += (int32_t)x[n] * x[n];
+            yy += (int32_t)y[n] * y[n];
+        }
+        float meanSquare = (float)(xx + yy) / (2.0f * count);
+        // The first block seeds the floor rather than rising to it from
+        // MIN_ENERGY, which in a noisy room would steer on the noise for
+        // the first seconds and leave a wrong lag the hysteresis then holds
+        if (noiseFloor == FLOOR_UNKNOWN) {
+            noiseFloor = meanSquare < MIN_ENERGY ? MIN_ENERGY : meanSquare;
+        } else if (meanSquare < noiseFloor) {
+            noiseFloor = meanSquare < MIN_ENERGY ? MIN_ENERGY : meanSquare;
+        } else {
+            noiseFloor += (meanSquare - noiseFloor) * FLOOR_RISE;
+        }
+
+        // Only blocks that stand out of the floor steer; x leads y by d
+        // when y[n] ~ x[n - d]. Correlated maxLag samples back so that
+        // negative lags stay inside the history.
+        if (meanSquare > noiseFloor * SPEECH_OVER_FLOOR && xx > 0 && yy > 0) {
+            float norm = 1.0f / sqrtf((float)xx * (float)yy);
+            const int16_t *ys = y - maxLag;
+            for (int d = -maxLag; d <= maxLag; d++) {
+                int64_t xy = 0;
+                const int16_t *xs = x - maxLag - d;
+                for (size_t n = 0; n < count; n++) {
+                    xy += (int32_t)xs[n] * ys[n];
+                }
+                float &c = correlation[maxLag + d];
+                c += ((float)xy * norm - c) * CORRELATION_SMOOTHING;
+            }
+            int peak = -maxLag;
+            for (int d = -maxLag + 1; d <= maxLag; d++) {
+                if (correlation[maxLag + d] > correlation[maxLag + peak]) {
+                    peak = d;
+                }
+            }
+            if (peak != lag && correlation[maxLag + peak] > correlation[maxLag + lag] + LAG_HYSTERESIS) {
+                lag = (int8_t)peak;
+            }
+        }
+    }
+
+    // Delay whichever mic heard the source first, then average
+    int firstDelay = lag > 0 ? lag : 0;
+    int secondDelay = lag < 0 ? -lag : 0;
+    if (lag == previousLag) {
+        for (size_t n = 0; n < count; n++) {
+            out[n] = (int16_t)(((int32_t)x[n - firstDelay] + y[n - secondDelay]) >> 1);
+        }
+        return;
+    }
+    int oldFirstDelay = previousLag > 0 ? previousLag : 0;
+    int oldSecondDelay = previousLag < 0 ? -previousLag : 0;
+    for (size_t n = 0; n < count; n++) {
+        int32_t before = (int32_t)x[n - oldFirstDelay] + y[n - oldSecondDelay];
+        int32_t after = (int32_t)x[n - firstDelay] + y[n - secondDelay];
+        int32_t w = (int32_t)(((n + 1) << 15) / count);
+        out[n] = (int16_t)((before * (32768 - w) + after * w) >> 16);
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef BEAMFORMER_H
+#define BEAMFORMER_H
+
+#include <cstdint>
+#include <cstddef>
+
+// Two-mic delay-and-sum beamformer. The steering delay is the lag of the
+// peak of a normalised cross-correlation between the capsules, smoothed
+// over blocks that are well above the noise floor, so it follows the
+// talker and holds through pauses. Lag changes are crossfaded over one
+// block. Coherent speech keeps its level while diffuse noise drops by up
+// to 3 dB, more off-axis.
+class Beamformer {
+public:
+    Beamformer();
+    ~Beamformer();
+
+    // spacingMm: distance between the two capsules
+    bool begin(uint32_t sampleRate, uint16_t spacingMm);
+    void reset();
+
+    // Sums both channels into out, any block size. With adapt false the
+    // steering holds, e.g. while the speaker plays into the room.
+    void process(const int16_t *first, const int16_t *second, int16_t *out, size_t count, bool adapt);
+
+    // Samples the second channel lags the first; positive when the source
+    // is on the first mic's side
+    int8_t steeringLag() const { return lag; }
+    // Direction of arrival from broadside, degrees
+    int8_t angleDegrees() const;
+    // Smoothed normalised correlation at the steering lag, percent
+    uint8_t coherence() const;
+
+private:
+    void processBlock(size_t count, int16_t *out, bool adapt);
+    void release();
+
+    uint32_t rate;
+    uint16_t spacing;
+    uint8_t maxLag;
+    int8_t lag;
+    int16_t *firstWork;   // 2 * maxLag history, then the block
+    int16_t *secondWork;
+    float *correlation;   // 2 * maxLag + 1, smoothed
+    float noiseFloor;     // mean-square of quiet blocks
+
+    Beamformer(const Beamformer &);
+    Beamformer &operator=(const Beamformer &);
+};
+
+#endif // BEAMFORMER_H
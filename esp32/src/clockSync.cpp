@@ -0,0 +1,158 @@
+#include "clockSync.h"
+#include <math.h>
+
+// Crystals are specified to tens of ppm; more than this is a bad fit
+static const double MAX_SKEW = 500e-6;
+// Exchanges this much over the best round trip still count as fast
+static const uint32_t RTT_SLACK_US = 1000;
+// Excess round trip at which an exchange has half the weight in the fit
+static const double RTT_SCALE_US = 500.0;
+
+ClockSync::ClockSync() : resets(0) {
+    reset();
+}
+
+void ClockSync::reset() {
+    count = 0;
+    head = 0;
+    stepsSeen = 0;
+    baseLocal = 0;
+    baseOffset = 0;
+    skew = 0.0;
+    skewValid = false;
+    lastRtt = 0;
+    minRtt = 0;
+    accepted = 0;
+    rejected = 0;
+}
+
+bool ClockSync::addSample(int64_t t0, int64_t t1, int64_t t2, int64_t t3) {
+    if (t3 < t0 || t2 < t1) {
+        rejected++;
+        return false;
+    }
+    int64_t rtt = (t3 - t0) - (t2 - t1);
+    if (rtt < 0) {
+        rtt = 0;
+    }
+    Sample sample;
+    sample.localUs = t0 + (t3 - t0) / 2;
+    sample.offsetUs = ((t1 - t0) + (t2 - t3)) / 2;
+    sample.rttUs = (uint32_t)rtt;
+    lastRtt = sample.rttUs;
+
+    // A fast exchange is good to half its round trip; one that misses the
+    // line by far more is a step, or a fluke if the next one agrees again
+    if (count > 0 && sample.rttUs <= minRtt * 2 + RTT_SLACK_US) {
+        int64_t miss = sample.offsetUs - predict(sample.localUs);
+        if (miss > STEP_US + rtt / 2 || miss < -(STEP_US + rtt / 2)) {
+            if (++stepsSeen < 2) {
+                rejected++;
+                return false;
+            }
+            uint32_t seen = rejected;
+            reset();
+            rejected = seen;
+            resets++;
+        } else {
+            stepsSeen = 0;
+        }
+    }
+
+    window[head] = sample;
+    head = (uint8_t)((head + 1) % WINDOW);
+    if (count < WINDOW) {
+        count++;
+    }
+    accepted++;
+    fit();
+    return true;
+}
+
+void ClockSync::fit() {
+    minRtt = UINT32_MAX;
+    for (uint8_t i = 0; i < count; i++) {
+        if (window[i].rttUs < minRtt) {
+            minRtt = window[i].rttUs;
+        }
+    }
+
+    // Weighted least squares, an exchange counting less the more its
+    // round trip exceeds the best; sums relative to the newest sample so
+    // doubles keep every microsecond
+    const Sample &ref = window[(head + WINDOW - 1) % WINDOW];
+    double sumW = 0.0;
+    double sumX = 0.0;
+    double sumY = 0.0;
+    int64_t first = ref.localUs;
+    double trusted = 0.0;
+    for (uint8_t i = 0; i < count; i++) {
+        const Sample &s = window[i];
+        double excess = (double)(s.rttUs - minRtt) / RTT_SCALE_US;
+        double w = 1.0 / (1.0 + excess * excess);
+        sumW += w;
+        sumX += w * (double)(s.localUs - ref.localUs);
+        sumY += w * (double)(s.offsetUs - ref.offsetUs);
+        if (w >= 0.5) {
+            trusted += 1.0;
+            first = s.localUs < first ? s.localUs : first;
+        }
+    }
+    double meanX = sumX / sumW;
+    double meanY = sumY / sumW;
+
+    if (trusted >= 3.0 && ref.localUs - first >= MIN_SKEW_SPAN_US) {
+        double sxx = 0.0;
+        double sxy = 0.0;
+        for (uint8_t i = 0; i < count; i++) {
+            const Sample &s = window[i];
+            double excess = (double)(s.rttUs - minRtt) / RTT_SCALE_US;
+            double w = 1.0 / (1.0 + excess * excess);
+            double dx = (double)(s.localUs - ref.localUs) - meanX;
+            sxx += w * dx * dx;
+            sxy += w * dx * ((double)(s.offsetUs - ref.offsetUs) - meanY);
+        }
+        if (sxx > 0.0) {
+            double slope = sxy / sxx;
+            skew = slope > MAX_SKEW ? MAX_SKEW : (slope < -MAX_SKEW ? -MAX_SKEW : slope);
+            skewValid = true;
+        }
+    }
+
+    // The line goes through the weighted mean whether the slope was
+    // fitted or carried over
+    baseLocal = ref.localUs + (int64_t)llround(meanX);
+    baseOffset = ref.offsetUs + (int64_t)llround(meanY);
+}
+
+int64_t ClockSync::predict(int64_t localUs) const {
+    return baseOffset + (int64_t)llround(skew * (double)(localUs - baseLocal));
+}
+
+int64_t ClockSync::toServer(int64_t localUs) const {
+    return localUs + predict(localUs);
+}
+
+// The offset barely changes over the difference, so one step is exact
+// to well under a microsecond
+int64_t ClockSync::toLocal(int64_t serverUs) const {
+    return serverUs - predict(serverUs - baseOffset);
+}
+
+int32_t ClockSync::skewPpm() const {
+    return (int32_t)lrint(skew * 1e6);
+}
+
+ClockSyncStats ClockSync::stats() const {
+    ClockSyncStats s;
+    s.synced = synced();
+    s.skewKnown = skewValid;
+    s.offsetUs = count ? predict(window[(head + WINDOW - 1) % WINDOW].localUs) : 0;
+    s.skewPpm = skewPpm();
+    s.rttUs = lastRtt;
+    s.minRttUs = count ? minRtt : 0;
+    s.samples = accepted;
+    s.rejected = rejected;
+    s.resets = resets;
+    return s;
+}
@@ -0,0 +1,84 @@
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <cstdint>
+#include <cstddef>
+
+struct ClockSyncStats {
+    bool synced;
+    bool skewKnown;
+    int64_t offsetUs;  // server minus local, at the last exchange
+    int32_t skewPpm;   // server clock rate over the local one, minus one
+    uint32_t rttUs;    // last exchange
+    uint32_t minRttUs; // best in the window
+    uint32_t samples;
+    uint32_t rejected; // implausible, or off the line without a step
+    uint32_t resets;   // server clock steps
+};
+
+// Estimates a remote clock from NTP-style exchanges: the device stamps t0
+// when it sends, the server t1 on receipt and t2 on reply, the device t3
+// when the reply arrives. Each exchange gives an offset, good to half its
+// round trip, and the round trip itself.
+//
+// Queueing only ever adds delay, and unevenly, so an exchange is weighted
+// down the more its round trip exceeds the window's best. A weighted
+// least-squares line through the offsets against local time gives the
+// offset as its intercept and the skew as its slope. The skew is only
+// trusted once the well-weighted exchanges span MIN_SKEW_SPAN_US; a short
+// span turns round-trip noise into ppm.
+// An offset far off the line on two fast exchanges in a row means the
+// server clock stepped (a restart), and the window starts over.
+//
+// Times are microseconds. Not locked: one task feeds and reads it.
+class ClockSync {
+public:
+    ClockSync();
+
+    void reset();
+    // False when the exchange was rejected as implausible
+    bool addSample(int64_t t0, int64_t t1, int64_t t2, int64_t t3);
+
+    bool synced() const { return count > 0; }
+    bool skewKnown() const { return skewValid; }
+    int64_t toServer(int64_t localUs) const;
+    int64_t toLocal(int64_t serverUs) const;
+    int32_t skewPpm() const;
+    ClockSyncStats stats() const;
+
+private:
+    static const uint8_t WINDOW = 64;
+    static const int64_t MIN_SKEW_SPAN_US = 20000000;
+    static const int64_t STEP_US = 20000;
+
+    struct Sample {
+        int64_t localUs; // midpoint of t0 and t3
+        int64_t offsetUs;
+        uint32_t rttUs;
+    };
+
+    void fit();
+    int64_t predict(int64_t localUs) const;
+
+    Sample window[WINDOW];
+    uint8_t count;
+    uint8_t head; // next slot to write
+    uint8_t stepsSeen;
+
+    // offset(local) = baseOffset + skew * (local - baseLocal)
+    int64_t baseLocal;
+    int64_t baseOffset;
+    double skew;
+    bool skewValid;
+
+    uint32_t lastRtt;
+    uint32_t minRtt;
+    uint32_t accepted;
+    uint32_t rejected;
+    uint32_t resets;
+
+    ClockSync(const ClockSync &);
+    ClockSync &operator=(const ClockSync &);
+};
+
+#endif // CLOCK_SYNC_H
@@ -22,24 +22,189 @@ extern const char* WEBSOCKET_HOST;
 #define LED_SPKR 18 // BLUE LED for speaker activity
 // Button pin
 #define BUTTON_PIN 4
+#define BUTTON_DEBOUNCE_MS 30       // edges this soon after a change are contact bounce
+#define BUTTON_TAP_MS 300           // a press this short may start a double press
+#define BUTTON_LONG_PRESS_MS 800    // held this long: INPUT_LONG_PRESS
+#define BUTTON_DOUBLE_PRESS_MS 350  // tap release to next press
+#define BUTTON_EDGE_QUEUE 16        // raw edges from the ISR
+#define BUTTON_EVENT_QUEUE 8        // gestures waiting for loop()
+#define BUTTON_TASK_PRIORITY 4
+#define BUTTON_TASK_CORE 0
 
 // I2S Microphone configuration
 // #define SAMPLE_RATE 44100
 #define SAMPLE_RATE 16000
-#define SAMPLE_BITS 32
+#define SAMPLE_BITS 32  // 32: native INMP441 slots, 24-bit extraction; 16: legacy truncated read
 #define CHANNELS 1
+#define MIC_GAIN_SHIFT 2      // 6 dB steps over plain 24 -> 16 bit truncation (0..8)
+#define MIC_DC_BLOCK_SHIFT 8  // high-pass pole 1 - 2^-8, ~27 Hz at 44.1 kHz
+// Second INMP441 on the same bus with L/R tied high: capture both slots and
+// beamform them to one channel. false reads the first slot only.
+#define MIC_BEAMFORMING false
+#define MIC_SPACING_MM 60             // between the two capsules
+#define BEAM_SPEAKER_HOLDOFF_MS 300   // steering holds this long after playback
 
 #define I2S_PORT_MIC I2S_NUM_0
 #define I2S_PORT_SPEAKER I2S_NUM_1
 
-// Buffer configuration
+// Buffer configuration (legacy read sizes; DMA rings use the profiles below)
 #define bufferCnt 10
 #define bufferLen 1024
 
+// Microphone capture/sender pipeline
+#define MIC_RING_MS 500          // PSRAM ring between capture and sender, absorbs WiFi stalls
+#define MIC_READ_SAMPLES 256     // samples per i2s_read in the capture task
+#define MIC_CAPTURE_PRIORITY 5
+#define MIC_CAPTURE_CORE 1
+#define MIC_SENDER_PRIORITY 1
+#define MIC_SENDER_CORE 0
+#define MIC_PREROLL_MS 500       // audio sent from before the press; >0 keeps the mic always on
+
 // Audio detection thresholds
 #define MIC_THRESHOLD 2300 // Adjust based on testing
 #define LED_DELAY 1        // ms to keep LED on after sound stops
 
+// Voice activity detection on the uplink (one frame per WebSocket message)
+#define VAD_FRAME_MS 20
+#define VAD_HANGOVER_MS 300      // speech kept after the last loud frame
+#define VAD_ENDPOINT_MS 800      // trailing silence after hangover that ends the turn
+#define VAD_CALIBRATION_MS 500   // noise floor measurement at boot
+#define VAD_SPEECH_RATIO 4       // frame energy over noise floor to count as speech
+#define VAD_MIN_ENERGY 400       // mean-square floor (~20 LSB rms)
+#define VAD_MAX_ZCR 450          // zero crossings per 1000 samples for hiss rejection
+#define VAD_DTX_ENABLED true     // replace silent frames with a silence marker
+#define VAD_AUTO_STOP_ENABLED true
+
+// Spectral noise suppression on the uplink, ahead of VAD (adds 20 ms latency)
+#define NS_ENABLED true
+#define NS_MIN_GAIN_DB -15     // attenuation floor; deeper sounds watery
+
+// Acoustic echo cancellation against the speaker feed, ahead of the noise
+// suppressor. Lets the mic run during playback so the user can barge in.
+#define AEC_ENABLED true
+#define AEC_FILTER_MS 64       // room tail the adaptive filter models
+#define AEC_MAX_DELAY_MS 200   // bulk speaker-to-mic delay the estimator searches
+#define BARGE_IN_MS 200        // speech over playback that interrupts the answer
+
+// Hands-free turns: keyword spotting between turns on the cleaned-up uplink.
+// Needs a model (see keywordSpotter.h): point WAKE_WORD_MODEL_HEADER at a
+// generated header defining `const KwsModel wakeWordModel`, then turn it on.
+// `pio test -e native` scores a model against the server's recordings.
+#define WAKE_WORD_ENABLED false
+#define WAKE_WORD_THRESHOLD 85            // smoothed keyword posterior, percent
+#define WAKE_WORD_SPEAKER_HOLDOFF_MS 300  // deaf this long after playback when there is no AEC
+// #define WAKE_WORD_MODEL_HEADER "wakeWordModel.h"
+
+// Automatic gain control on the uplink, after VAD, adapting only on speech
+#define AGC_ENABLED true
+#define AGC_TARGET_RMS 3000        // ~-21 dBFS
+#define AGC_MAX_GAIN_DB 24
+#define AGC_MIN_GAIN_DB -6
+#define AGC_ATTACK_MS 60
+#define AGC_RELEASE_MS 800
+#define AGC_LIMIT_THRESHOLD 29000  // ~-1 dBFS peak ceiling
+#define AGC_LOOKAHEAD_MS 2
+#define AGC_LIMITER_RELEASE_MS 80
+
+// Uplink encoding: UPLINK_PCM16 or UPLINK_IMA_ADPCM (4:1), switchable at runtime
+#define UPLINK_CODEC_DEFAULT UPLINK_IMA_ADPCM
+
+// Uplink sample rate: the mic is decimated to what the backend consumes.
+// Multiples of 50 Hz keep 20 ms frames whole; AUDIO_QUALITY_MIC disables it.
+#define UPLINK_SAMPLE_RATE_DEFAULT 24000
+
+// Downlink decoding: pooled PCM frames, each the largest Opus packet
+// (120 ms, 5760 samples per channel at 48 kHz) in stereo, 23 KB. Smaller
+// frames make opus_decode reject valid long packets; at 2880 a frame held
+// only 30 ms of 48 kHz stereo.
+#define DOWNLINK_POOL_FRAMES 3
+#define DOWNLINK_FRAME_SAMPLES (5760 * 2)
+#define DOWNLINK_DEFAULT_RATE 24000  // PCM without a stream_start: OpenAI pcm16, mono
+#define SPEAKER_FOLLOW_STREAM_RATE true  // reclock the speaker to each stream between responses
+#define SPEAKER_MAX_RATE 48000
+#define SPEAKER_RECLOCK_WAIT_MS 100      // for the playback task to take the new clock
+
+// Prompt cache on the "assets" flash partition, filled over HTTP from the
+// WebSocket host in the background
+#define ASSET_PARTITION_LABEL "assets"
+#define ASSET_MAX_BYTES (512 * 1024)  // largest single asset fetched
+#define ASSET_FETCH_QUEUE 8
+#define ASSET_FETCH_TIMEOUT_MS 5000
+#define ASSET_FETCH_PRIORITY 1
+#define ASSET_FETCH_CORE 0
+
+// Playout: the socket only queues audio, a task plays it to I2S
+#define PLAYOUT_BUFFER_MS 3000       // PSRAM; a faster-than-real-time stream waits for room
+#define PLAYOUT_MIN_TARGET_MS 40     // depth playback starts at, before any jitter is seen
+#define PLAYOUT_MAX_TARGET_MS 1000
+#define PLAYOUT_MARGIN_MS 40         // on top of measured jitter and one chunk
+#define PLAYBACK_BLOCK_FRAMES 256    // per i2s_write
+#define SPEAKER_VOLUME_PERCENT 70   // applied after loudness normalisation
+#define SPEECH_RATE_PERCENT 100      // pitch-preserving playback speed, 75..150
+#define PLAYOUT_RATE_NUDGE_PERCENT 4 // speed change that steers the buffer towards its target
+#define PLAYBACK_BENCHMARK false     // time the render kernel at boot
+#define PLAYBACK_GUARD_MS 40         // conceal when the DMA queue is this close to empty
+#define PLAYBACK_TASK_PRIORITY 4
+#define PLAYBACK_TASK_CORE 1
+
+// Clock sync with the server (time_sync exchanges on the socket) and the
+// drift trim it drives: the render resampler runs a few ppm fast or slow so
+// a long stream neither fills nor drains the playout buffer
+#define CLOCK_SYNC_INTERVAL_MS 2000   // the fit holds 64, about two minutes
+#define CLOCK_SYNC_BURST 8            // quick exchanges after connecting
+#define CLOCK_SYNC_BURST_MS 250
+#define PLAYBACK_DRIFT_TRIM true      // costs the passthrough at equal rates
+#define PLAYBACK_TRIM_MAX_PPM 1000
+#define I2S_RATE_MIN_SPAN_MS 10000    // DMA completions timed before the speaker's own error counts
+// Streams with a presentation time play on the server's timeline, so
+// speakers sharing a stream stay in step; the server only sends one when
+// several devices share it, and it costs the lead (about 500 ms) before the
+// first audio. Off, or with no pts, a stream plays on arrival. The channel
+// driver (IDF 5) knows when each DMA block plays; the legacy driver's
+// estimate is good to about one descriptor, a few milliseconds.
+#define SCHEDULED_PLAYBACK_ENABLED false
+
+// I2S DMA rings: LATENCY_LOW, LATENCY_BALANCED or LATENCY_ROBUST (see
+// i2sHealth.h). The speaker used to queue 10 x 1024 frames, over 600 ms.
+#define SPEAKER_LATENCY_PROFILE LATENCY_BALANCED
+#define MIC_LATENCY_PROFILE LATENCY_LOW    // close to the old 8 x 64
+#define SPEAKER_DMA_AUTOTUNE false         // walk the speaker ring down until it glitches
+#define DMA_AUTOTUNE_QUIET_MS 20000        // clean playback before each step down
+#define I2S_EVENT_QUEUE_LENGTH 16
+#define I2S_MONITOR_PRIORITY 6             // above the audio tasks, it only counts
+
+// Audio I/O driver. false: the legacy driver, i2s_read/i2s_write copying
+// through its own buffers. true: the channel-based i2s_std driver through
+// AudioChannel (audioHal.h), DMA buffers by reference with timestamps.
+// Needs IDF 5 (arduino-esp32 3.x), which refuses to link both drivers
+// into one image, so A/B testing is two builds: pio run -e
+// esp32-ai-assistant-idf5 sets -DAUDIO_HAL_I2S_STD=1 on that core.
+#ifndef AUDIO_HAL_I2S_STD
+#define AUDIO_HAL_I2S_STD false
+#endif
+
+// Playback loudness: a short-term level steered to a target, then a
+// look-ahead brick-wall limiter so loud responses cannot clip the speaker
+#define PLAYBACK_LOUDNESS_ENABLED true
+#define PLAYBACK_LOUDNESS_WINDOW_MS 400  // momentary loudness, updated every 100 ms
+#define PLAYBACK_TARGET_RMS 4000         // ~-18 dBFS before volume
+#define PLAYBACK_GATE_RMS 300            // ~-40 dBFS; pauses hold the gain
+#define PLAYBACK_MAX_GAIN_DB 12
+#define PLAYBACK_MIN_GAIN_DB -12
+#define PLAYBACK_ATTACK_MS 200
+#define PLAYBACK_RELEASE_MS 2000
+#define PLAYBACK_LIMIT_THRESHOLD 29000   // ~-1 dBFS peak ceiling
+#define PLAYBACK_LOOKAHEAD_MS 3
+#define PLAYBACK_LIMITER_RELEASE_MS 60
+
+// Playback mixer: speech and earcons duck the radio and test tone
+#define MIXER_DUCK_DB -18
+#define MIXER_DUCK_ATTACK_MS 30
+#define MIXER_DUCK_RELEASE_MS 400
+#define RADIO_GAIN_PERCENT 60
+#define EARCONS_ENABLED true
+#define EARCON_LEVEL_PERCENT 25
+
 // Test tone configuration
 #define TONE_FREQUENCY 440 // Hz (A4 note)
 #define TONE_DURATION 2000 // ms
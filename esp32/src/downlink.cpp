@@ -0,0 +1,662 @@
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <opus.h>
+#include <HTTPClient.h>
+#include <mbedtls/sha256.h>
+#include <esp_timer.h>
+#include "config.h"
+#include "downlink.h"
+#include "framePool.h"
+#include "adpcm.h"
+#include "wavHeader.h"
+#include "assetCache.h"
+#include "clockSync.h"
+#include "mic.h"
+#include "lib_speaker.h"
+#include "lib_websocket.h"
+
+static const StreamFormat DEFAULT_FORMAT = {DOWNLINK_PCM16, DOWNLINK_DEFAULT_RATE, 1};
+
+// What PCM without a stream_start is taken to be; the server can change it
+// in its config reply to the hello
+static StreamFormat sessionFormat = DEFAULT_FORMAT;
+static StreamFormat currentFormat = DEFAULT_FORMAT;
+static bool dropStream = false;
+static uint32_t decodeErrors = 0;
+
+// Decoded audio goes into pooled frames, never a per-message allocation
+static FramePool decodePool;
+static AdpcmDecoder adpcmDecoder;
+static OpusDecoder *opusDecoder = NULL;
+static uint32_t opusRate = 0;
+static uint8_t opusChannels = 0;
+static bool opusAvailable = true;
+
+// Canned prompts, fetched once and then played from flash
+static AssetCache assetCache;
+static QueueHandle_t assetFetches = NULL;
+
+// Server clock, from time_sync exchanges that loop() starts. One is in
+// flight at a time; a reply that is lost is simply never matched.
+static ClockSync serverClock;
+static int64_t syncSentUs = 0;
+static int64_t nextSyncUs = 0;
+static uint8_t syncBurst = CLOCK_SYNC_BURST;
+static bool skewReported = false;
+
+static void assetFetchTask(void *parameter);
+
+esp_err_t setupDownlink()
+{
+  if (!decodePool.begin(DOWNLINK_POOL_FRAMES, DOWNLINK_FRAME_SAMPLES))
+  {
+    return ESP_ERR_NO_MEM;
+  }
+  if (!assetCache.begin(ASSET_PARTITION_LABEL))
+  {
+    // Everything still plays, it just all comes over the socket
+    Serial.println("No asset partition, prompt cache off");
+    return ESP_OK;
+  }
+  assetFetches = xQueueCreate(ASSET_FETCH_QUEUE, ASSET_HASH_BYTES);
+  if (!assetFetches ||
+      xTaskCreatePinnedToCore(assetFetchTask, "assets", 6144, NULL, ASSET_FETCH_PRIORITY, NULL, ASSET_FETCH_CORE) !=
+          pdPASS)
+  {
+    return ESP_ERR_NO_MEM;
+  }
+  Serial.printf("Asset cache: %u prompts, %u of %u KB\n", (unsigned)assetCache.count(),
+                (unsigned)(assetCache.usedBytes() / 1024), (unsigned)(assetCache.capacityBytes() / 1024));
+  return ESP_OK;
+}
+
+uint8_t getCachedAssetCount()
+{
+  return assetCache.count();
+}
+
+const char *downlinkCapabilities()
+{
+  return opusAvailable ? "\"pcm16\",\"ima_adpcm\",\"opus\"" : "\"pcm16\",\"ima_adpcm\"";
+}
+
+StreamFormat getDownlinkFormat()
+{
+  return currentFormat;
+}
+
+StreamFormat getDownlinkSessionFormat()
+{
+  return sessionFormat;
+}
+
+uint32_t getDownlinkDecodeErrors()
+{
+  return decodeErrors;
+}
+
+static bool isOpusRate(uint32_t rate)
+{
+  return rate == 8000 || rate == 12000 || rate == 16000 || rate == 24000 || rate == 48000;
+}
+
+static bool openOpus(uint32_t rate, uint8_t channels)
+{
+  if (!isOpusRate(rate) || channels < 1 || channels > 2)
+  {
+    return false;
+  }
+
+  if (opusDecoder && opusRate == rate && opusChannels == channels)
+  {
+    opus_decoder_ctl(opusDecoder, OPUS_RESET_STATE);
+    return true;
+  }
+
+  if (opusDecoder)
+  {
+    opus_decoder_destroy(opusDecoder);
+    opusDecoder = NULL;
+  }
+
+  int err = OPUS_OK;
+  opusDecoder = opus_decoder_create(rate, channels, &err);
+  if (err != OPUS_OK || !opusDecoder)
+  {
+    Serial.printf("Opus decoder init failed: %s\n", opus_strerror(err));
+    opusDecoder = NULL;
+    opusAvailable = false;
+    return false;
+  }
+  opusRate = rate;
+  opusChannels = channels;
+  return true;
+}
+
+static bool openStream(const StreamFormat &format)
+{
+  switch (format.codec)
+  {
+  case DOWNLINK_OPUS:
+    return openOpus(format.sampleRate, format.channels);
+  case DOWNLINK_IMA_ADPCM:
+    adpcmDecoder.reset();
+    return format.channels == 1;
+  default:
+    return true;
+  }
+}
+
+// Between responses the speaker takes the stream's own clock, so the
+// render kernel passes it through; mid-response it stays and converts
+static void followStreamRate(uint32_t rate)
+{
+  if (!SPEAKER_FOLLOW_STREAM_RATE)
+  {
+    return;
+  }
+  esp_err_t err = setSpeakerSampleRate(rate);
+  if (err != ESP_OK && err != ESP_ERR_INVALID_STATE && err != ESP_ERR_NOT_SUPPORTED)
+  {
+    Serial.printf("Speaker stays at %u Hz for a %u Hz stream: %s\n", (unsigned)getSpeakerSampleRate(),
+                  (unsigned)rate, esp_err_to_name(err));
+  }
+}
+
+static DownlinkCodec parseCodec(const char *name)
+{
+  if (strcmp(name, "opus") == 0)
+  {
+    return DOWNLINK_OPUS;
+  }
+  if (strcmp(name, "ima_adpcm") == 0)
+  {
+    return DOWNLINK_IMA_ADPCM;
+  }
+  return DOWNLINK_PCM16;
+}
+
+// The server's answer to the hello: the uplink it wants and the format of
+// PCM it sends without a stream_start. Whatever could not be applied is
+// left as is; the hello sent back reports what the device now uses.
+static void applySessionConfig(JsonDocument &doc)
+{
+  JsonObject uplink = doc["uplink"];
+  if (!uplink.isNull())
+  {
+    if (uplink.containsKey("codec"))
+    {
+      const char *codec = uplink["codec"] | "pcm16";
+      setUplinkCodec(strcmp(codec, "ima_adpcm") == 0 ? UPLINK_IMA_ADPCM : UPLINK_PCM16);
+    }
+    uint32_t rate = uplink["rate"] | (uint32_t)0;
+    if (rate && !setUplinkSampleRate(rate))
+    {
+      Serial.printf("Uplink rate %u Hz not supported\n", (unsigned)rate);
+    }
+  }
+
+  JsonObject downlink = doc["downlink"];
+  if (!downlink.isNull())
+  {
+    StreamFormat format;
+    format.codec = parseCodec(downlink["codec"] | "pcm16");
+    format.sampleRate = downlink["rate"] | sessionFormat.sampleRate;
+    format.channels = downlink["channels"] | sessionFormat.channels;
+    // Streams without a descriptor are PCM; a codec needs its stream_start
+    if (format.codec == DOWNLINK_PCM16 && format.sampleRate > 0 && format.channels >= 1 && format.channels <= 2)
+    {
+      sessionFormat = format;
+      currentFormat = format;
+      followStreamRate(format.sampleRate);
+    }
+  }
+  sendHello();
+}
+
+static bool parseAssetHash(const char *hex, uint8_t *hash)
+{
+  if (!hex || strlen(hex) != ASSET_HASH_BYTES * 2)
+  {
+    return false;
+  }
+  for (size_t i = 0; i < ASSET_HASH_BYTES; i++)
+  {
+    char pair[3] = {hex[i * 2], hex[i * 2 + 1], 0};
+    char *end = NULL;
+    hash[i] = (uint8_t)strtoul(pair, &end, 16);
+    if (end != pair + 2)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void formatAssetHash(const uint8_t *hash, char *hex)
+{
+  for (size_t i = 0; i < ASSET_HASH_BYTES; i++)
+  {
+    sprintf(hex + i * 2, "%02x", hash[i]);
+  }
+}
+
+static void requestAsset(const uint8_t *hash)
+{
+  if (assetFetches && xQueueSend(assetFetches, hash, 0) != pdTRUE)
+  {
+    Serial.println("Asset fetch queue full");
+  }
+}
+
+// Plays a cached prompt, or tells the server it has to send the audio and
+// fetches the prompt for next time
+static void playAsset(const char *hex)
+{
+  uint8_t hash[ASSET_HASH_BYTES];
+  if (!parseAssetHash(hex, hash))
+  {
+    Serial.println("Bad asset hash");
+    return;
+  }
+  AssetView view;
+  if (assetCache.map(hash, &view))
+  {
+    if (speaker_playAsset(assetCache, view))
+    {
+      return;
+    }
+    assetCache.release(view);
+  }
+  char reply[128];
+  snprintf(reply, sizeof(reply), "{\"type\":\"asset_missing\",\"hash\":\"%s\"}", hex);
+  sendMessage(reply);
+  if (assetCache.ready())
+  {
+    requestAsset(hash);
+  }
+}
+
+static size_t readAssetBody(WiFiClient *stream, uint8_t *buffer, size_t length)
+{
+  size_t got = 0;
+  while (got < length)
+  {
+    size_t n = stream->readBytes(buffer + got, length - got);
+    if (n == 0)
+    {
+      break;
+    }
+    got += n;
+  }
+  return got;
+}
+
+// GET /assets/<hash>.wav from the WebSocket host. The WAV header and every
+// byte after it are hashed; the PCM is only kept if the hash is the name.
+static bool fetchAsset(const uint8_t *hash)
+{
+  static uint8_t chunk[1024];
+  char hex[ASSET_HASH_BYTES * 2 + 1];
+  formatAssetHash(hash, hex);
+  char url[160];
+  snprintf(url, sizeof(url), "http://%s:%d/assets/%s.wav", WEBSOCKET_HOST, WEBSOCKET_PORT, hex);
+
+  HTTPClient http;
+  http.setTimeout(ASSET_FETCH_TIMEOUT_MS);
+  if (!http.begin(url))
+  {
+    return false;
+  }
+  int status = http.GET();
+  int size = http.getSize();
+  if (status != HTTP_CODE_OK || size <= 0 || size > ASSET_MAX_BYTES)
+  {
+    Serial.printf("Asset %.8s: HTTP %d, %d bytes\n", hex, status, size);
+    http.end();
+    return false;
+  }
+  WiFiClient *stream = http.getStreamPtr();
+  stream->setTimeout(ASSET_FETCH_TIMEOUT_MS);
+
+  size_t remaining = (size_t)size;
+  size_t got = readAssetBody(stream, chunk, remaining < sizeof(chunk) ? remaining : sizeof(chunk));
+  WavInfo info;
+  if (!parseWavHeader(chunk, got, &info) || !wavIsPcm16(info) || info.dataOffset + info.dataBytes > remaining)
+  {
+    Serial.printf("Asset %.8s: not a PCM16 WAV\n", hex);
+    http.end();
+    return false;
+  }
+  if (!assetCache.beginStore(hash, info.sampleRate, info.channels, info.dataBytes))
+  {
+    Serial.printf("Asset %.8s: no room\n", hex);
+    http.end();
+    return false;
+  }
+
+  mbedtls_sha256_context sha;
+  mbedtls_sha256_init(&sha);
+  mbedtls_sha256_starts(&sha, 0);
+  size_t offset = 0; // into the file
+  size_t dataEnd = info.dataOffset + info.dataBytes;
+  bool stored = true;
+  while (got > 0 && stored)
+  {
+    mbedtls_sha256_update(&sha, chunk, got);
+    // The part of this chunk inside the data chunk
+    size_t from = offset > info.dataOffset ? offset : info.dataOffset;
+    size_t to = offset + got < dataEnd ? offset + got : dataEnd;
+    if (to > from)
+    {
+      stored = assetCache.append(chunk + (from - offset), to - from);
+    }
+    offset += got;
+    remaining -= got;
+    got = readAssetBody(stream, chunk, remaining < sizeof(chunk) ? remaining : sizeof(chunk));
+  }
+  uint8_t digest[ASSET_HASH_BYTES];
+  mbedtls_sha256_finish(&sha, digest);
+  mbedtls_sha256_free(&sha);
+  http.end();
+
+  bool valid = stored && remaining == 0 && memcmp(digest, hash, ASSET_HASH_BYTES) == 0;
+  if (!assetCache.finishStore(valid))
+  {
+    Serial.printf("Asset %.8s: %s\n", hex, valid ? "index write failed" : "download corrupt");
+    return false;
+  }
+  Serial.printf("Asset %.8s cached: %u bytes at %u Hz\n", hex, (unsigned)info.dataBytes, (unsigned)info.sampleRate);
+  return true;
+}
+
+// Fetches run one at a time, below the audio tasks, and never touch the socket
+static void assetFetchTask(void *parameter)
+{
+  uint8_t hash[ASSET_HASH_BYTES];
+  while (true)
+  {
+    if (xQueueReceive(assetFetches, hash, portMAX_DELAY) == pdTRUE && !assetCache.contains(hash))
+    {
+      fetchAsset(hash);
+    }
+  }
+}
+
+// A new connection may be a new server: start over with a quick burst
+void restartClockSync()
+{
+  serverClock.reset();
+  syncSentUs = 0;
+  nextSyncUs = 0;
+  syncBurst = CLOCK_SYNC_BURST;
+  skewReported = false;
+  setPlaybackClockSkew(0, false);
+}
+
+// Called from loop(), which also polls the socket the reply comes in on
+void serviceClockSync()
+{
+  int64_t now = esp_timer_get_time();
+  if (now < nextSyncUs || !webSocketAvailable())
+  {
+    return;
+  }
+  char ping[64];
+  snprintf(ping, sizeof(ping), "{\"type\":\"time_sync\",\"t0\":%lld}", (long long)now);
+  syncSentUs = now;
+  sendMessage(ping);
+  uint32_t waitMs = CLOCK_SYNC_INTERVAL_MS;
+  if (syncBurst > 0)
+  {
+    syncBurst--;
+    waitMs = CLOCK_SYNC_BURST_MS;
+  }
+  nextSyncUs = now + (int64_t)waitMs * 1000;
+}
+
+static void handleTimeSync(const JsonDocument &doc, int64_t receivedUs)
+{
+  int64_t t0 = doc["t0"].as<int64_t>();
+  if (syncSentUs == 0 || t0 != syncSentUs)
+  {
+    return; // stale or not ours
+  }
+  syncSentUs = 0;
+  serverClock.addSample(t0, doc["t1"].as<int64_t>(), doc["t2"].as<int64_t>(), receivedUs);
+  setPlaybackClockSkew(serverClock.skewPpm(), serverClock.skewKnown());
+  setPlaybackClockAnchor(receivedUs, serverClock.toServer(receivedUs));
+  if (serverClock.skewKnown() && !skewReported)
+  {
+    skewReported = true;
+    logClockSync();
+  }
+}
+
+ClockSyncStats getServerClockStats()
+{
+  return serverClock.stats();
+}
+
+bool serverClockSynced()
+{
+  return serverClock.synced();
+}
+
+int64_t serverTimeUs(int64_t localUs)
+{
+  return serverClock.toServer(localUs);
+}
+
+int64_t localTimeUs(int64_t serverUs)
+{
+  return serverClock.toLocal(serverUs);
+}
+
+void logClockSync()
+{
+  ClockSyncStats stats = serverClock.stats();
+  Serial.printf("Server clock: offset %lld us, skew %+d ppm%s, rtt %u us (best %u), %u exchanges, %u rejected, %u steps\n",
+                (long long)stats.offsetUs, (int)stats.skewPpm, stats.skewKnown ? "" : " (not yet)",
+                (unsigned)stats.rttUs, (unsigned)stats.minRttUs, (unsigned)stats.samples, (unsigned)stats.rejected,
+                (unsigned)stats.resets);
+}
+
+// Returns true when the message was a stream descriptor
+bool handleDownlinkControl(const char *json, size_t length)
+{
+  // Before parsing, as close to the reply's arrival as this gets
+  int64_t receivedUs = esp_timer_get_time();
+  StaticJsonDocument<256> doc;
+  if (deserializeJson(doc, json, length))
+  {
+    return false;
+  }
+
+  const char *type = doc["type"] | "";
+  if (strcmp(type, "time_sync") == 0)
+  {
+    handleTimeSync(doc, receivedUs);
+    return true;
+  }
+
+  if (strcmp(type, "stream_start") == 0)
+  {
+    StreamFormat format;
+    format.codec = parseCodec(doc["codec"] | "pcm16");
+    format.sampleRate = doc["rate"] | sessionFormat.sampleRate;
+    format.channels = doc["channels"] | 1;
+
+    if (openStream(format))
+    {
+      currentFormat = format;
+      dropStream = false;
+      followStreamRate(format.sampleRate);
+      // A presentation time puts the stream on the server's timeline,
+      // shared with every speaker it was sent to
+      int64_t pts = doc["pts"].as<int64_t>();
+      if (pts && !(SCHEDULED_PLAYBACK_ENABLED && serverClockSynced()))
+      {
+        Serial.println(SCHEDULED_PLAYBACK_ENABLED ? "Stream has a presentation time but the clock is not synced; playing on arrival"
+                                                  : "Scheduled playback off; playing on arrival");
+        pts = 0;
+      }
+      speakerStreamStart(pts);
+    }
+    else
+    {
+      // Can't decode it: drop the stream rather than play noise, and
+      // re-announce capabilities so the server falls back to PCM
+      Serial.printf("Unsupported downlink stream: %s\n", doc["codec"] | "?");
+      currentFormat = sessionFormat;
+      dropStream = true;
+      sendHello();
+    }
+    return true;
+  }
+
+  if (strcmp(type, "speech_rate") == 0)
+  {
+    setSpeechRate(doc["percent"] | (uint16_t)SPEECH_RATE_PERCENT);
+    return true;
+  }
+
+  if (strcmp(type, "config") == 0)
+  {
+    applySessionConfig(doc);
+    return true;
+  }
+
+  if (strcmp(type, "latency") == 0)
+  {
+    LatencyProfile profile;
+    if (parseLatencyProfile(doc["profile"] | "", &profile))
+    {
+      setSpeakerLatencyProfile(profile, doc["autotune"] | false);
+    }
+    return true;
+  }
+
+  if (strcmp(type, "play_asset") == 0)
+  {
+    playAsset(doc["hash"] | "");
+    return true;
+  }
+
+  if (strcmp(type, "cache_asset") == 0)
+  {
+    uint8_t hash[ASSET_HASH_BYTES];
+    if (parseAssetHash(doc["hash"] | "", hash) && !assetCache.contains(hash))
+    {
+      requestAsset(hash);
+    }
+    return true;
+  }
+
+  if (strcmp(type, "stream_end") == 0)
+  {
+    currentFormat = sessionFormat;
+    dropStream = false;
+    speakerStreamEnd();
+    return true;
+  }
+
+  return false;
+}
+
+// Barge-in: drop the rest of the current response until the server opens
+// a new stream
+void cancelDownlinkStream()
+{
+  dropStream = true;
+}
+
+// Returns the offset of the first sample, or 0 when the file can't be played
+static size_t startWavStream(const uint8_t *payload, size_t length)
+{
+  WavInfo info;
+  if (!parseWavHeader(payload, length, &info))
+  {
+    Serial.println("WAV header cut short, dropping the message");
+    decodeErrors++;
+    return 0;
+  }
+  if (!wavIsPcm16(info))
+  {
+    Serial.printf("Unsupported WAV: format %u, %u bit, %u ch\n", (unsigned)info.format,
+                  (unsigned)info.bitsPerSample, (unsigned)info.channels);
+    dropStream = true;
+    return 0;
+  }
+  dropStream = false;
+  currentFormat.codec = DOWNLINK_PCM16;
+  currentFormat.sampleRate = info.sampleRate;
+  currentFormat.channels = info.channels;
+  followStreamRate(info.sampleRate);
+  speakerStreamStart();
+  return info.dataOffset;
+}
+
+void handleDownlinkAudio(const uint8_t *payload, size_t length)
+{
+  // Servers that send whole WAV files: the header describes this and the
+  // following messages, and must not be played. A new file is a new
+  // response, so it also ends a barge-in drop.
+  if (currentFormat.codec == DOWNLINK_PCM16 && isWavHeader(payload, length))
+  {
+    size_t offset = startWavStream(payload, length);
+    if (offset == 0)
+    {
+      return;
+    }
+    payload += offset;
+    length -= offset;
+  }
+
+  if (dropStream)
+  {
+    return;
+  }
+
+  if (currentFormat.codec == DOWNLINK_PCM16)
+  {
+    speaker_play((const int16_t *)payload, length / (sizeof(int16_t) * currentFormat.channels),
+                 currentFormat.sampleRate, currentFormat.channels);
+    return;
+  }
+
+  AudioFrame *frame = decodePool.acquire();
+  if (!frame)
+  {
+    decodeErrors++;
+    return;
+  }
+
+  int decoded = -1;
+  if (currentFormat.codec == DOWNLINK_IMA_ADPCM)
+  {
+    if (adpcmBlockSamples(length) <= frame->capacity)
+    {
+      decoded = adpcmDecoder.decodeBlock(payload, length, frame->samples);
+    }
+  }
+  else if (opusDecoder)
+  {
+    int perChannel = opus_decode(opusDecoder, payload, length, frame->samples,
+                                 frame->capacity / currentFormat.channels, 0);
+    decoded = perChannel < 0 ? -1 : perChannel * currentFormat.channels;
+  }
+
+  if (decoded > 0)
+  {
+    frame->count = decoded;
+    frame->sampleRate = currentFormat.sampleRate;
+    frame->channels = currentFormat.channels;
+    speaker_play(frame->samples, frame->count / frame->channels, frame->sampleRate, frame->channels);
+  }
+  else
+  {
+    decodeErrors++;
+  }
+  decodePool.release(frame);
+}
@@ -0,0 +1,73 @@
+#ifndef DOWNLINK_H
+#define DOWNLINK_H
+
+#include <Arduino.h>
+#include "clockSync.h"
+
+// Encoding of audio the server streams to the device
+enum DownlinkCodec
+{
+  DOWNLINK_PCM16,
+  DOWNLINK_IMA_ADPCM,
+  DOWNLINK_OPUS
+};
+
+struct StreamFormat
+{
+  DownlinkCodec codec;
+  uint32_t sampleRate;
+  uint8_t channels;
+};
+
+// Downlink protocol (text frames are JSON):
+//   {"type":"stream_start","codec":"opus","rate":24000,"channels":1}
+//   <binary frames: one Opus packet / one ADPCM block / raw PCM each>
+//   {"type":"stream_end"}
+//   {"type":"speech_rate","percent":90}   playback speed, pitch kept
+//   {"type":"latency","profile":"low","autotune":true}   speaker DMA ring
+//       (low, balanced or robust), applied at the next pause
+//   {"type":"play_asset","hash":"<sha256 hex>"}   cached prompt from flash;
+//       the device answers {"type":"asset_missing","hash":...} if it has
+//       none, and fetches it for next time
+//   {"type":"cache_asset","hash":"<sha256 hex>"}  fetch in the background
+// Assets are PCM16 WAV files served at /assets/<hash>.wav by the same host,
+// named by the SHA-256 of the whole file.
+// Audio without a stream_start is raw PCM16, which is what servers that
+// predate the descriptor send, or a WAV file whose RIFF header sets the
+// format of it and what follows.
+//
+// Handshake: the device opens with a hello (see sendHello()); the server
+// may answer with
+//   {"type":"config","uplink":{"codec":"pcm16","rate":24000},
+//    "downlink":{"codec":"pcm16","rate":24000,"channels":1}}
+// and the device applies what it can and sends its hello again.
+//
+// Clock sync, NTP-style: the device sends
+//   {"type":"time_sync","t0":<device us>}
+// a few times a second after connecting, then every few seconds, and the
+// server echoes t0 with its own clock in microseconds when it received the
+// request and when it replied:
+//   {"type":"time_sync","t0":...,"t1":<server us>,"t2":<server us>}
+// The fitted skew trims playback so it keeps pace with the server's clock.
+// A stream_start may carry "pts":<server us>, when its first sample is
+// due; later samples follow from the sample count. Speakers given the same
+// pts play the stream in step, each against its own estimate of the
+// server clock. Without a synced clock the stream plays on arrival.
+esp_err_t setupDownlink();
+bool handleDownlinkControl(const char *json, size_t length);
+void handleDownlinkAudio(const uint8_t *payload, size_t length);
+void cancelDownlinkStream();
+StreamFormat getDownlinkFormat();
+StreamFormat getDownlinkSessionFormat();
+const char *downlinkCapabilities();
+uint32_t getDownlinkDecodeErrors();
+uint8_t getCachedAssetCount();
+void restartClockSync();
+void serviceClockSync();
+ClockSyncStats getServerClockStats();
+bool serverClockSynced();
+int64_t serverTimeUs(int64_t localUs);
+int64_t localTimeUs(int64_t serverUs);
+void logClockSync();
+
+#endif
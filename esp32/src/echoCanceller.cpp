@@ -0,0 +1,416 @@
+#include "echoCanceller.h"
+#include <Arduino.h>
+#include "utils.h"
+
+static const uint16_t ENVELOPE_BINS = 256;       // ~0.7 s of history at 24 kHz
+static const uint16_t ENVELOPES_PER_BLOCK = 4;
+static const uint16_t ESTIMATE_EVERY_BLOCKS = 32;
+static const float MIN_CORRELATION = 0.4f;
+static const float REFERENCE_ACTIVE_POWER = 100.0f; // mean square, ~10 LSB rms
+static const float STEP = 0.5f;
+static const float REGULARISATION_POWER = 100.0f;
+static const uint32_t REFERENCE_HISTORY_MS = 1000; // covers the speaker DMA lead plus the echo delay
+
+static inline int16_t saturate(float value) {
+    return (int16_t)(value > 32767.0f ? 32767 : (value < -32768.0f ? -32768 : (int32_t)value));
+}
+
+EchoCanceller::EchoCanceller()
+    : block(0), bins(0), partitions(0), maxLagBins(0), reference(NULL), referenceMask(0), referenceEnd(0),
+      input(NULL), output(NULL), referencePrev(NULL), referenceNew(NULL), fill(0), xRe(NULL), xIm(NULL), wRe(NULL),
+      wIm(NULL), re(NULL), im(NULL), power(NULL), xHead(0), constrainNext(0), activeBlocks(0), micEnvelope(NULL),
+      refEnvelope(NULL), envelopeHead(0), envelopeFilled(0), blocksSinceEstimate(0), delaySamples(0), candidateDelay(0),
+      echoPower(0.0f), errorPower(1.0f), micPower(1.0f), erle(0) {
+}
+
+EchoCanceller::~EchoCanceller() {
+    release();
+}
+
+void EchoCanceller::release() {
+    free(reference);
+    free(input);
+    free(output);
+    free(referencePrev);
+    free(referenceNew);
+    free(xRe);
+    free(xIm);
+    free(wRe);
+    free(wIm);
+    free(re);
+    free(im);
+    free(power);
+    free(micEnvelope);
+    free(refEnvelope);
+    reference = input = output = referencePrev = referenceNew = NULL;
+    xRe = xIm = wRe = wIm = re = im = power = NULL;
+    micEnvelope = refEnvelope = NULL;
+}
+
+bool EchoCanceller::begin(uint32_t sampleRate, uint16_t filterMs, uint16_t maxDelayMs) {
+    release();
+
+    // Power-of-two blocks of about 10 ms
+    uint8_t log2Block = 4;
+    while ((1u << log2Block) < sampleRate / 100) {
+        log2Block++;
+    }
+    if (log2Block > 10 || !fft.begin(log2Block + 1)) {
+        return false;
+    }
+    block = 1u << log2Block;
+    bins = block + 1;
+    uint32_t filterSamples = sampleRate * filterMs / 1000;
+    partitions = (uint16_t)((filterSamples + block - 1) / block);
+    if (partitions == 0) {
+        partitions = 1;
+    }
+    uint32_t lag = sampleRate * maxDelayMs / 1000 / (block / ENVELOPES_PER_BLOCK);
+    maxLagBins = (uint16_t)(lag < ENVELOPE_BINS / 2 ? lag : ENVELOPE_BINS / 2);
+
+    uint32_t history = 1;
+    while (history < sampleRate * REFERENCE_HISTORY_MS / 1000) {
+        history <<= 1;
+    }
+    referenceMask = history - 1;
+
+    size_t spectrum = (size_t)partitions * bins * sizeof(float);
+    reference = (int16_t *)audio_malloc(history * sizeof(int16_t));
+    input = (int16_t *)audio_malloc(block * sizeof(int16_t));
+    output = (int16_t *)audio_malloc(block * sizeof(int16_t));
+    referencePrev = (int16_t *)audio_malloc(block * sizeof(int16_t));
+    referenceNew = (int16_t *)audio_malloc(block * sizeof(int16_t));
+    xRe = (float *)audio_malloc(spectrum);
+    xIm = (float *)audio_malloc(spectrum);
+    wRe = (float *)audio_malloc(spectrum);
+    wIm = (float *)audio_malloc(spectrum);
+    re = (float *)audio_malloc(2 * block * sizeof(float));
+    im = (float *)audio_malloc(2 * block * sizeof(float));
+    power = (float *)audio_malloc(bins * sizeof(float));
+    micEnvelope = (float *)audio_malloc(ENVELOPE_BINS * sizeof(float));
+    refEnvelope = (float *)audio_malloc(ENVELOPE_BINS * sizeof(float));
+    if (!reference || !input || !output || !referencePrev || !referenceNew || !xRe || !xIm || !wRe || !wIm || !re ||
+        !im || !power || !micEnvelope || !refEnvelope) {
+        release();
+        return false;
+    }
+
+    memset(reference, 0, history * sizeof(int16_t));
+    referenceEnd.store(0);
+    delaySamples = 0;
+    candidateDelay = 0;
+    clearFilter();
+    reset();
+    return true;
+}
+
+// Clears buffered audio; the filter and delay estimate are kept
+void EchoCanceller::reset() {
+    if (!input) {
+        return;
+    }
+    memset(input, 0, block * sizeof(int16_t));
+    memset(output, 0, block * sizeof(int16_t));
+    memset(referencePrev, 0, block * sizeof(int16_t));
+    memset(xRe, 0, (size_t)partitions * bins * sizeof(float));
+    memset(xIm, 0, (size_t)partitions * bins * sizeof(float));
+    fill = 0;
+    activeBlocks = 0;
+    envelopeHead = 0;
+    envelopeFilled = 0;
+    blocksSinceEstimate = 0;
+}
+
+void EchoCanceller::clearFilter() {
+    memset(wRe, 0, (size_t)partitions * bins * sizeof(float));
+    memset(wIm, 0, (size_t)partitions * bins * sizeof(float));
+    echoPower = 0.0f;
+    errorPower = 1.0f;
+    micPower = 1.0f;
+    erle = 0;
+}
+
+void EchoCanceller::pushReference(const int16_t *samples, size_t count, uint32_t now) {
+    if (!reference || count == 0) {
+        return;
+    }
+
+    uint32_t size = referenceMask + 1;
+    uint32_t start = referenceEnd.load(std::memory_order_relaxed);
+    int32_t idle = (int32_t)(now - start);
+    if (idle > 0) {
+        // Speaker ran dry: silence up to now, then this block starts playing
+        uint32_t gap = (uint32_t)idle < size ? (uint32_t)idle : size;
+        for (uint32_t i = 0; i < gap; i++) {
+            reference[(now - gap + i) & referenceMask] = 0;
+        }
+        start = now;
+    }
+
+    if (count > size) {
+        samples += count - size;
+        start += count - size;
+        count = size;
+    }
+    for (size_t i = 0; i < count; i++) {
+        reference[(start + i) & referenceMask] = samples[i];
+    }
+    referenceEnd.store(start + count, std::memory_order_release);
+}
+
+void EchoCanceller::cancelReference(uint32_t now) {
+    if ((int32_t)(referenceEnd.load(std::memory_order_relaxed) - now) > 0) {
+        referenceEnd.store(now, std::memory_order_release);
+    }
+}
+
+bool EchoCanceller::referenceActive(uint32_t position) const {
+    int32_t queued = (int32_t)(referenceEnd.load(std::memory_order_acquire) - position);
+    return queued > -(int32_t)(partitions * block) || activeBlocks > 0;
+}
+
+void EchoCanceller::readReference(uint32_t position, int16_t *out, size_t count) const {
+    uint32_t end = referenceEnd.load(std::memory_order_acquire);
+    for (size_t i = 0; i < count; i++) {
+        // Not yet queued, or old enough to have been overwritten: silence
+        int32_t ahead = (int32_t)(end - (position + i));
+        out[i] = ahead > 0 && ahead <= (int32_t)(referenceMask + 1) ? reference[(position + i) & referenceMask] : 0;
+    }
+}
+
+void EchoCanceller::process(int16_t *samples, size_t count, uint32_t position) {
+    if (!input) {
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        int16_t sample = samples[i];
+        samples[i] = output[fill];
+        input[fill] = sample;
+        if (++fill == block) {
+            fill = 0;
+            processBlock(position + (uint32_t)i + 1 - block);
+        }
+    }
+}
+
+void EchoCanceller::updateEnvelopes(const int16_t *mic, uint32_t blockPosition) {
+    // Undelayed reference: the estimator searches the lag itself
+    readReference(blockPosition, referenceNew, block);
+    uint16_t binSamples = block / ENVELOPES_PER_BLOCK;
+    for (uint16_t b = 0; b < ENVELOPES_PER_BLOCK; b++) {
+        uint32_t micSum = 0;
+        uint32_t refSum = 0;
+        for (uint16_t i = b * binSamples; i < (b + 1) * binSamples; i++) {
+            micSum += abs(mic[i]);
+            refSum += abs(referenceNew[i]);
+        }
+        micEnvelope[envelopeHead] = (float)micSum / binSamples;
+        refEnvelope[envelopeHead] = (float)refSum / binSamples;
+        envelopeHead = (envelopeHead + 1) % ENVELOPE_BINS;
+        if (envelopeFilled < ENVELOPE_BINS) {
+            envelopeFilled++;
+        }
+    }
+}
+
+// Pearson correlation of the mic envelope against the reference envelope
+// at each lag; a confident peak moves the bulk delay
+void EchoCanceller::estimateDelay() {
+    if (envelopeFilled < ENVELOPE_BINS) {
+        return;
+    }
+
+    float bestCorrelation = MIN_CORRELATION;
+    int32_t bestLag = -1;
+    for (uint16_t lag = 0; lag <= maxLagBins; lag++) {
+        uint16_t n = ENVELOPE_BINS - lag;
+        float sumM = 0, sumR = 0, sumMM = 0, sumRR = 0, sumMR = 0;
+        for (uint16_t i = lag; i < ENVELOPE_BINS; i++) {
+            float m = micEnvelope[(envelopeHead + i) % ENVELOPE_BINS];
+            float r = refEnvelope[(envelopeHead + i - lag) % ENVELOPE_BINS];
+            sumM += m;
+            sumR += r;
+            sumMM += m * m;
+            sumRR += r * r;
+            sumMR += m * r;
+        }
+        float covariance = sumMR - sumM * sumR / n;
+        float varianceM = sumMM - sumM * sumM / n;
+        float varianceR = sumRR - sumR * sumR / n;
+        if (varianceM <= 0.0f || varianceR < n * REFERENCE_ACTIVE_POWER) {
+            continue;
+        }
+        float correlation = covariance / sqrtf(varianceM * varianceR);
+        if (correlation > bestCorrelation) {
+            bestCorrelation = correlation;
+            bestLag = lag;
+        }
+    }
+    if (bestLag < 0) {
+        return;
+    }
+
+    // Keep the current delay while the echo onset lands inside the first
+    // quarter of the filter; moving costs the converged taps
+    uint32_t binSamples = block / ENVELOPES_PER_BLOCK;
+    uint32_t onset = (uint32_t)bestLag * binSamples;
+    uint32_t slack = (uint32_t)partitions * block / 4;
+    if (delaySamples <= onset && onset - delaySamples <= slack) {
+        candidateDelay = delaySamples;
+        return;
+    }
+
+    // Aim two envelope bins early, and only after the same onset is seen twice
+    uint32_t estimate = onset > 2 * binSamples ? onset - 2 * binSamples : 0;
+    uint32_t drift = estimate > candidateDelay ? estimate - candidateDelay : candidateDelay - estimate;
+    candidateDelay = estimate;
+    if (drift <= binSamples) {
+        delaySamples = estimate;
+        clearFilter();
+    }
+}
+
+// Gradient constraint: keep the partition's impulse response to B taps so
+// circular wrap-around does not build up
+void EchoCanceller::constrain(uint16_t partition) {
+    uint16_t n = 2 * block;
+    float *pr = wRe + partition * bins;
+    float *pi = wIm + partition * bins;
+    for (uint16_t k = 0; k < bins; k++) {
+        re[k] = pr[k];
+        im[k] = pi[k];
+    }
+    for (uint16_t k = 1; k < block; k++) {
+        re[n - k] = re[k];
+        im[n - k] = -im[k];
+    }
+    fft.inverse(re, im);
+    float scale = 1.0f / n;
+    for (uint16_t i = 0; i < block; i++) {
+        re[i] *= scale;
+        im[i] = 0.0f;
+    }
+    for (uint16_t i = block; i < n; i++) {
+        re[i] = 0.0f;
+        im[i] = 0.0f;
+    }
+    fft.forward(re, im);
+    for (uint16_t k = 0; k < bins; k++) {
+        pr[k] = re[k];
+        pi[k] = im[k];
+    }
+}
+
+void EchoCanceller::processBlock(uint32_t blockPosition) {
+    updateEnvelopes(input, blockPosition);
+    if (++blocksSinceEstimate >= ESTIMATE_EVERY_BLOCKS) {
+        blocksSinceEstimate = 0;
+        estimateDelay();
+    }
+
+    readReference(blockPosition - delaySamples, referenceNew, block);
+    float referencePower = 0.0f;
+    for (uint16_t i = 0; i < block; i++) {
+        referencePower += (float)referenceNew[i] * referenceNew[i];
+    }
+    referencePower /= block;
+    bool fresh = referencePower > REFERENCE_ACTIVE_POWER;
+    if (fresh) {
+        activeBlocks = partitions + 1;
+    }
+
+    if (activeBlocks == 0) {
+        // Nothing playing and the echo tail has died out: pass through
+        memcpy(output, input, block * sizeof(int16_t));
+        memcpy(referencePrev, referenceNew, block * sizeof(int16_t));
+        return;
+    }
+    if (--activeBlocks == 0) {
+        memset(xRe, 0, (size_t)partitions * bins * sizeof(float));
+        memset(xIm, 0, (size_t)partitions * bins * sizeof(float));
+    }
+
+    uint16_t n = 2 * block;
+
+    // Spectrum of the latest 2B reference samples becomes the newest partition
+    xHead = (xHead + partitions - 1) % partitions;
+    for (uint16_t i = 0; i < block; i++) {
+        re[i] = referencePrev[i];
+        re[block + i] = referenceNew[i];
+        im[i] = 0.0f;
+        im[block + i] = 0.0f;
+    }
+    memcpy(referencePrev, referenceNew, block * sizeof(int16_t));
+    fft.forward(re, im);
+    memcpy(xRe + xHead * bins, re, bins * sizeof(float));
+    memcpy(xIm + xHead * bins, im, bins * sizeof(float));
+
+    // Echo estimate Y = sum over partitions of X_p W_p
+    for (uint16_t k = 0; k < bins; k++) {
+        float yr = 0.0f, yi = 0.0f, pw = 0.0f;
+        for (uint16_t p = 0; p < partitions; p++) {
+            uint32_t x = ((xHead + p) % partitions) * bins + k;
+            uint32_t w = p * bins + k;
+            yr += xRe[x] * wRe[w] - xIm[x] * wIm[w];
+            yi += xRe[x] * wIm[w] + xIm[x] * wRe[w];
+            pw += xRe[x] * xRe[x] + xIm[x] * xIm[x];
+        }
+        re[k] = yr;
+        im[k] = yi;
+        power[k] = pw;
+    }
+    for (uint16_t k = 1; k < block; k++) {
+        re[n - k] = re[k];
+        im[n - k] = -im[k];
+    }
+    fft.inverse(re, im);
+
+    // Overlap-save: the last B samples are valid
+    float scale = 1.0f / n;
+    float blockMic = 0.0f, blockEcho = 0.0f, blockError = 0.0f;
+    for (uint16_t i = 0; i < block; i++) {
+        float echo = re[block + i] * scale;
+        float error = input[i] - echo;
+        output[i] = saturate(error);
+        blockMic += (float)input[i] * input[i];
+        blockEcho += echo * echo;
+        blockError += error * error;
+        re[block + i] = error;
+        re[i] = 0.0f;
+    }
+    for (uint16_t i = 0; i < n; i++) {
+        im[i] = 0.0f;
+    }
+
+    if (!fresh) {
+        return;
+    }
+
+    // Step size follows how much of the error is explained echo, so near-end
+    // speech (large error, small echo estimate) slows adaptation down
+    echoPower = 0.9f * echoPower + 0.1f * blockEcho;
+    errorPower = 0.9f * errorPower + 0.1f * blockError;
+    micPower = 0.9f * micPower + 0.1f * blockMic;
+    erle = (int16_t)(100.0f * log10f((micPower + 1.0f) / (errorPower + 1.0f)));
+    float ratio = echoPower / (errorPower + 1.0f);
+    float floor = erle < 60 ? 0.25f : 0.02f;
+    float mu = STEP * (ratio < floor ? floor : (ratio > 1.0f ? 1.0f : ratio));
+
+    fft.forward(re, im);
+    float delta = (float)partitions * n * REGULARISATION_POWER;
+    for (uint16_t k = 0; k < bins; k++) {
+        float g = mu / (power[k] + delta);
+        float er = re[k] * g;
+        float ei = im[k] * g;
+        for (uint16_t p = 0; p < partitions; p++) {
+            uint32_t x = ((xHead + p) % partitions) * bins + k;
+            uint32_t w = p * bins + k;
+            // W += mu conj(X) E / |X|^2
+            wRe[w] += xRe[x] * er + xIm[x] * ei;
+            wIm[w] += xRe[x] * ei - xIm[x] * er;
+        }
+    }
+
+    constrain(constrainNext);
+    constrainNext = (constrainNext + 1) % partitions;
+}
@@ -0,0 +1,99 @@
+#ifndef ECHO_CANCELLER_H
+#define ECHO_CANCELLER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include "fft.h"
+
+// Acoustic echo canceller: a partitioned-block frequency-domain NLMS
+// filter (overlap-save, one partition gradient-constrained per block) that
+// subtracts the speaker feed as heard by the mic.
+//
+// Both sides share one sample clock, the uplink position. The playback
+// side queues reference audio at the position it will start playing (right
+// after anything still queued, or "now" if the speaker went idle); the mic
+// side passes the position of its first sample. The bulk delay between the
+// two (DMA, pipeline, air) is found by correlating their envelopes, so the
+// adaptive filter only has to model the room.
+//
+// pushReference() may run on a different task than process(); only the
+// reference write position is shared.
+class EchoCanceller {
+public:
+    EchoCanceller();
+    ~EchoCanceller();
+
+    bool begin(uint32_t sampleRate, uint16_t filterMs, uint16_t maxDelayMs);
+    void reset();
+
+    void pushReference(const int16_t *samples, size_t count, uint32_t now);
+    // Drops reference queued past `now`, e.g. when playback is cancelled
+    void cancelReference(uint32_t now);
+
+    // In place, any block size; output lags input by latency() samples
+    void process(int16_t *samples, size_t count, uint32_t position);
+
+    bool referenceActive(uint32_t position) const;
+    uint16_t latency() const { return block; }
+    uint32_t delay() const { return delaySamples; }
+    int16_t erleDb10() const { return erle; }
+
+private:
+    void processBlock(uint32_t blockPosition);
+    void readReference(uint32_t position, int16_t *out, size_t count) const;
+    void updateEnvelopes(const int16_t *mic, uint32_t blockPosition);
+    void estimateDelay();
+    void constrain(uint16_t partition);
+    void clearFilter();
+    void release();
+
+    FloatFft fft;
+    uint16_t block;      // B new samples per block, FFT size 2B
+    uint16_t bins;       // B + 1
+    uint16_t partitions;
+    uint16_t maxLagBins;
+
+    // Reference history on the shared clock
+    int16_t *reference;
+    uint32_t referenceMask;
+    std::atomic<uint32_t> referenceEnd;
+
+    // Block FIFO
+    int16_t *input;
+    int16_t *output;
+    int16_t *referencePrev;
+    int16_t *referenceNew;
+    uint16_t fill;
+
+    // Spectra, half-complex (bins each)
+    float *xRe;          // partitions x bins, newest at xHead
+    float *xIm;
+    float *wRe;
+    float *wIm;
+    float *re;           // FFT scratch, 2B
+    float *im;
+    float *power;        // per-bin reference power summed over partitions
+    uint16_t xHead;
+    uint16_t constrainNext;
+    uint16_t activeBlocks; // blocks left in which the echo tail may still arrive
+
+    // Delay estimation on 1/4-block envelopes
+    float *micEnvelope;
+    float *refEnvelope;
+    uint16_t envelopeHead;
+    uint16_t envelopeFilled;
+    uint16_t blocksSinceEstimate;
+    uint32_t delaySamples;
+    uint32_t candidateDelay; // last estimate, confirms a move
+
+    float echoPower;
+    float errorPower;
+    float micPower;
+    int16_t erle;
+
+    EchoCanceller(const EchoCanceller &);
+    EchoCanceller &operator=(const EchoCanceller &);
+};
+
+#endif // ECHO_CANCELLER_H
@@ -0,0 +1,170 @@
+#include "fft.h"
+#include <Arduino.h>
+#include "utils.h"
+
+FixedFft::FixedFft() : n(0), bits(0), cosTable(NULL), sinTable(NULL) {
+}
+
+FixedFft::~FixedFft() {
+    free(cosTable);
+    free(sinTable);
+}
+
+bool FixedFft::begin(uint8_t log2Size) {
+    if (log2Size < 1 || log2Size > 15) {
+        return false;
+    }
+    if (n == (1u << log2Size)) {
+        return true;
+    }
+
+    free(cosTable);
+    free(sinTable);
+    n = 1u << log2Size;
+    bits = log2Size;
+    cosTable = (int16_t *)audio_malloc(n / 2 * sizeof(int16_t));
+    sinTable = (int16_t *)audio_malloc(n / 2 * sizeof(int16_t));
+    if (!cosTable || !sinTable) {
+        free(cosTable);
+        free(sinTable);
+        cosTable = NULL;
+        sinTable = NULL;
+        n = 0;
+        return false;
+    }
+
+    for (uint16_t i = 0; i < n / 2; i++) {
+        float angle = 2.0f * PI * i / n;
+        cosTable[i] = (int16_t)lrintf(cosf(angle) * 32767.0f);
+        sinTable[i] = (int16_t)lrintf(sinf(angle) * 32767.0f);
+    }
+    return true;
+}
+
+void FixedFft::forward(int32_t *re, int32_t *im) const {
+    transform(re, im, false);
+}
+
+void FixedFft::inverse(int32_t *re, int32_t *im) const {
+    transform(re, im, true);
+}
+
+template <typename T>
+static void bitReverse(T *re, T *im, uint16_t n) {
+    for (uint16_t i = 1, j = 0; i < n; i++) {
+        uint16_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j) {
+            T t = re[i];
+            re[i] = re[j];
+            re[j] = t;
+            t = im[i];
+            im[i] = im[j];
+            im[j] = t;
+        }
+    }
+}
+
+void FixedFft::transform(int32_t *re, int32_t *im, bool inverse) const {
+    if (!cosTable) {
+        return;
+    }
+
+    bitReverse(re, im, n);
+
+    // Decimation-in-time butterflies, twiddle e^(-+j 2 pi k / len)
+    for (uint32_t len = 2; len <= n; len <<= 1) {
+        uint16_t half = len >> 1;
+        uint16_t stride = n / len;
+        for (uint16_t start = 0; start < n; start += len) {
+            for (uint16_t k = 0; k < half; k++) {
+                int32_t wr = cosTable[k * stride];
+                int32_t wi = inverse ? sinTable[k * stride] : -sinTable[k * stride];
+                uint16_t a = start + k;
+                uint16_t b = a + half;
+                int32_t tr = (int32_t)(((int64_t)re[b] * wr - (int64_t)im[b] * wi) >> 15);
+                int32_t ti = (int32_t)(((int64_t)re[b] * wi + (int64_t)im[b] * wr) >> 15);
+                re[b] = re[a] - tr;
+                im[b] = im[a] - ti;
+                re[a] += tr;
+                im[a] += ti;
+            }
+        }
+    }
+}
+
+FloatFft::FloatFft() : n(0), cosTable(NULL), sinTable(NULL) {
+}
+
+FloatFft::~FloatFft() {
+    free(cosTable);
+    free(sinTable);
+}
+
+bool FloatFft::begin(uint8_t log2Size) {
+    if (log2Size < 1 || log2Size > 15) {
+        return false;
+    }
+    if (n == (1u << log2Size)) {
+        return true;
+    }
+
+    free(cosTable);
+    free(sinTable);
+    n = 1u << log2Size;
+    cosTable = (float *)audio_malloc(n / 2 * sizeof(float));
+    sinTable = (float *)audio_malloc(n / 2 * sizeof(float));
+    if (!cosTable || !sinTable) {
+        free(cosTable);
+        free(sinTable);
+        cosTable = NULL;
+        sinTable = NULL;
+        n = 0;
+        return false;
+    }
+
+    for (uint16_t i = 0; i < n / 2; i++) {
+        float angle = 2.0f * PI * i / n;
+        cosTable[i] = cosf(angle);
+        sinTable[i] = sinf(angle);
+    }
+    return true;
+}
+
+void FloatFft::forward(float *re, float *im) const {
+    transform(re, im, false);
+}
+
+void FloatFft::inverse(float *re, float *im) const {
+    transform(re, im, true);
+}
+
+void FloatFft::transform(float *re, float *im, bool inverse) const {
+    if (!cosTable) {
+        return;
+    }
+
+    bitReverse(re, im, n);
+
+    for (uint32_t len = 2; len <= n; len <<= 1) {
+        uint16_t half = len >> 1;
+        uint16_t stride = n / len;
+        for (uint16_t start = 0; start < n; start += len) {
+            for (uint16_t k = 0; k < half; k++) {
+                float wr = cosTable[k * stride];
+                float wi = inverse ? sinTable[k * stride] : -sinTable[k * stride];
+                uint16_t a = start + k;
+                uint16_t b = a + half;
+                float tr = re[b] * wr - im[b] * wi;
+                float ti = re[b] * wi + im[b] * wr;
+                re[b] = re[a] - tr;
+                im[b] = im[a] - ti;
+                re[a] += tr;
+                im[a] += ti;
+            }
+        }
+    }
+}
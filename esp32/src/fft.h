@@ -0,0 +1,58 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <cstdint>
+
+// In-place radix-2 complex FFT on int32 data with Q15 twiddles. No scaling
+// between stages: 16-bit input grows by at most log2(n) bits, so sizes up
+// to 2^15 stay inside int32. The inverse is unnormalised; divide by size().
+class FixedFft {
+public:
+    FixedFft();
+    ~FixedFft();
+
+    bool begin(uint8_t log2Size);
+    uint16_t size() const { return n; }
+    uint8_t log2Size() const { return bits; }
+
+    void forward(int32_t *re, int32_t *im) const;
+    void inverse(int32_t *re, int32_t *im) const;
+
+private:
+    void transform(int32_t *re, int32_t *im, bool inverse) const;
+
+    uint16_t n;
+    uint8_t bits;
+    int16_t *cosTable; // n/2 entries
+    int16_t *sinTable;
+
+    FixedFft(const FixedFft &);
+    FixedFft &operator=(const FixedFft &);
+};
+
+// Same transform in single precision, for adaptive filters whose weights
+// need more dynamic range than a fixed Q format gives. The ESP32 FPU makes
+// this about as fast as the fixed-point version.
+class FloatFft {
+public:
+    FloatFft();
+    ~FloatFft();
+
+    bool begin(uint8_t log2Size);
+    uint16_t size() const { return n; }
+
+    void forward(float *re, float *im) const;
+    void inverse(float *re, float *im) const; // unnormalised
+
+private:
+    void transform(float *re, float *im, bool inverse) const;
+
+    uint16_t n;
+    float *cosTable;
+    float *sinTable;
+
+    FloatFft(const FloatFft &);
+    FloatFft &operator=(const FloatFft &);
+};
+
+#endif // FFT_H
@@ -0,0 +1,48 @@
+#include "framePool.h"
+#include <Arduino.h>
+#include "utils.h"
+
+FramePool::FramePool() : frames(NULL), storage(NULL), samplesPerFrame(0), freeList(NULL) {
+}
+
+bool FramePool::begin(size_t frameCount, size_t frameSamples) {
+    if (frames || frameCount == 0 || frameSamples == 0) {
+        return frames != NULL;
+    }
+
+    frames = (AudioFrame *)calloc(frameCount, sizeof(AudioFrame));
+    storage = (int16_t *)audio_malloc(frameCount * frameSamples * sizeof(int16_t));
+    freeList = xQueueCreate(frameCount, sizeof(AudioFrame *));
+    if (!frames || !storage || !freeList) {
+        Serial.println("Failed to allocate frame pool");
+        return false;
+    }
+
+    samplesPerFrame = frameSamples;
+    for (size_t i = 0; i < frameCount; i++) {
+        AudioFrame *frame = &frames[i];
+        frame->samples = storage + i * frameSamples;
+        frame->capacity = frameSamples;
+        xQueueSend(freeList, &frame, 0);
+    }
+    return true;
+}
+
+AudioFrame *FramePool::acquire(TickType_t wait) {
+    AudioFrame *frame = NULL;
+    if (!freeList || xQueueReceive(freeList, &frame, wait) != pdTRUE) {
+        return NULL;
+    }
+    frame->count = 0;
+    return frame;
+}
+
+void FramePool::release(AudioFrame *frame) {
+    if (frame && freeList) {
+        xQueueSend(freeList, &frame, 0);
+    }
+}
+
+size_t FramePool::freeFrames() const {
+    return freeList ? uxQueueMessagesWaiting(freeList) : 0;
+}
@@ -0,0 +1,41 @@
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+
+// A block of PCM owned by a FramePool. Producers fill samples/count and the
+// format fields, consumers hand the frame back with FramePool::release().
+struct AudioFrame {
+    int16_t *samples;
+    size_t capacity;    // in samples, all channels
+    size_t count;       // valid samples, all channels
+    uint32_t sampleRate;
+    uint8_t channels;
+};
+
+// Fixed set of equally sized frames allocated once (PSRAM when available),
+// so the playback path never touches the heap per message. acquire() and
+// release() are safe from any task.
+class FramePool {
+public:
+    FramePool();
+    bool begin(size_t frameCount, size_t samplesPerFrame);
+    AudioFrame *acquire(TickType_t wait = 0);
+    void release(AudioFrame *frame);
+    size_t frameSamples() const { return samplesPerFrame; }
+    size_t freeFrames() const;
+
+private:
+    AudioFrame *frames;
+    int16_t *storage;
+    size_t samplesPerFrame;
+    QueueHandle_t freeList;
+
+    FramePool(const FramePool &);
+    FramePool &operator=(const FramePool &);
+};
+
+#endif // FRAME_POOL_H
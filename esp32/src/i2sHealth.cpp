@@ -0,0 +1,211 @@
+#include "i2sHealth.h"
+#include <cstring>
+#include <freertos/task.h>
+#include <esp_timer.h>
+
+static const uint16_t MAX_DMA_FRAMES = 1024; // legacy driver limits per descriptor
+static const uint16_t MAX_DMA_BYTES = 4092;
+static const uint16_t MIN_DMA_FRAMES = 8;
+static const uint32_t EVENT_WAIT_MS = 20;    // bounds how long detach() waits
+
+struct ProfileShape {
+    uint16_t outMs;
+    uint8_t outCount;
+    uint16_t inMs;
+    uint8_t inCount;
+};
+
+static const ProfileShape PROFILES[] = {
+    {20, 4, 12, 4},   // LATENCY_LOW
+    {60, 6, 32, 8},   // LATENCY_BALANCED
+    {240, 8, 128, 8}, // LATENCY_ROBUST
+};
+
+static const char *const PROFILE_NAMES[] = {"low", "balanced", "robust"};
+
+DmaGeometry dmaGeometry(LatencyProfile profile, bool out, uint32_t sampleRate, uint8_t bytesPerFrame) {
+    const ProfileShape &shape = PROFILES[profile <= LATENCY_ROBUST ? profile : LATENCY_BALANCED];
+    uint32_t maxFrames = MAX_DMA_BYTES / (bytesPerFrame ? bytesPerFrame : 1);
+    if (maxFrames > MAX_DMA_FRAMES) {
+        maxFrames = MAX_DMA_FRAMES;
+    }
+    DmaGeometry geometry;
+    geometry.count = out ? shape.outCount : shape.inCount;
+    uint32_t frames = (uint32_t)(out ? shape.outMs : shape.inMs) * sampleRate / 1000 / geometry.count;
+    // Keep the total when a descriptor would be too long
+    while (frames > maxFrames && geometry.count < 64) {
+        geometry.count *= 2;
+        frames /= 2;
+    }
+    if (frames < MIN_DMA_FRAMES) {
+        frames = MIN_DMA_FRAMES;
+    }
+    geometry.frames = (uint16_t)(frames > maxFrames ? maxFrames : frames);
+    return geometry;
+}
+
+uint32_t dmaLatencyMs(const DmaGeometry &geometry, uint32_t sampleRate) {
+    return sampleRate ? (uint32_t)geometry.count * geometry.frames * 1000 / sampleRate : 0;
+}
+
+const char *latencyProfileName(LatencyProfile profile) {
+    return profile <= LATENCY_ROBUST ? PROFILE_NAMES[profile] : "?";
+}
+
+bool parseLatencyProfile(const char *name, LatencyProfile *profile) {
+    for (uint8_t p = 0; p <= LATENCY_ROBUST; p++) {
+        if (name && strcmp(name, PROFILE_NAMES[p]) == 0) {
+            *profile = (LatencyProfile)p;
+            return true;
+        }
+    }
+    return false;
+}
+
+I2sMonitor::I2sMonitor()
+    : parked(NULL), queue(NULL), activeNow(false), blocks(0), activeBlocks(0), underruns(0), idleUnderruns(0),
+      overruns(0), dmaErrors(0), lastCompletion(0), maxInterval(0) {
+}
+
+bool I2sMonitor::begin(const char *name, uint8_t priority, int core) {
+    if (parked) {
+        return true;
+    }
+    parked = xSemaphoreCreateBinary();
+    if (!parked) {
+        return false;
+    }
+    return xTaskCreatePinnedToCore(taskEntry, name, 2048, this, priority, NULL, core) == pdPASS;
+}
+
+void I2sMonitor::attach(QueueHandle_t events) {
+    lastCompletion = 0;
+    queue = events;
+}
+
+// Returns once the task is no longer waiting on the old queue. It only
+// waits in bounded slices, so this takes at most one slice.
+void I2sMonitor::detach() {
+    if (!queue) {
+        return;
+    }
+    xSemaphoreTake(parked, 0);
+    queue = NULL;
+    xSemaphoreTake(parked, pdMS_TO_TICKS(2 * EVENT_WAIT_MS));
+}
+
+I2sHealthStats I2sMonitor::stats() const {
+    I2sHealthStats s;
+    s.blocks = blocks;
+    s.activeBlocks = activeBlocks;
+    s.underruns = underruns;
+    s.idleUnderruns = idleUnderruns;
+    s.overruns = overruns;
+    s.dmaErrors = dmaErrors;
+    s.lastCompletionUs = lastCompletion;
+    s.maxIntervalUs = maxInterval;
+    return s;
+}
+
+void I2sMonitor::taskEntry(void *monitor) {
+    static_cast<I2sMonitor *>(monitor)->run();
+}
+
+void I2sMonitor::run() {
+    i2s_event_t event;
+    bool acknowledged = false;
+    while (true) {
+        QueueHandle_t events = queue;
+        if (!events) {
+            if (!acknowledged) {
+                xSemaphoreGive(parked);
+                acknowledged = true;
+            }
+            vTaskDelay(pdMS_TO_TICKS(EVENT_WAIT_MS));
+            continue;
+        }
+        acknowledged = false;
+        if (xQueueReceive(events, &event, pdMS_TO_TICKS(EVENT_WAIT_MS)) != pdTRUE) {
+            continue;
+        }
+
+        switch (event.type) {
+        case I2S_EVENT_TX_DONE:
+        case I2S_EVENT_RX_DONE: {
+            int64_t now = esp_timer_get_time();
+            if (lastCompletion) {
+                uint32_t interval = (uint32_t)(now - lastCompletion);
+                if (interval > maxInterval) {
+                    maxInterval = interval;
+                }
+            }
+            lastCompletion = now;
+            blocks++;
+            if (activeNow) {
+                activeBlocks++;
+            }
+            break;
+        }
+        case I2S_EVENT_TX_Q_OVF:
+            // Every buffer the writer had filled was played: the DMA
+            // moved on to a stale one, which auto-clear turns into silence
+            if (activeNow) {
+                underruns++;
+            } else {
+                idleUnderruns++;
+            }
+            break;
+        case I2S_EVENT_RX_Q_OVF:
+            overruns++;
+            break;
+        case I2S_EVENT_DMA_ERROR:
+            dmaErrors++;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+DmaTuner::DmaTuner()
+    : current(0), minimum(0), maximum(0), quiet(0), sinceChange(0), lastBlocks(0), lastUnderruns(0), primed(false) {
+}
+
+void DmaTuner::begin(uint8_t count, uint8_t minCount, uint8_t maxCount, uint32_t quietBlocks) {
+    minimum = minCount < 2 ? 2 : minCount;
+    maximum = maxCount < minimum ? minimum : maxCount;
+    current = count < minimum ? minimum : (count > maximum ? maximum : count);
+    quiet = quietBlocks;
+    sinceChange = 0;
+    primed = false;
+}
+
+uint8_t DmaTuner::update(uint32_t activeBlocks, uint32_t underruns) {
+    // Counters run from boot; only what happens after begin() counts
+    if (!primed) {
+        lastBlocks = activeBlocks;
+        lastUnderruns = underruns;
+        primed = true;
+        return current;
+    }
+    uint32_t played = activeBlocks - lastBlocks;
+    uint32_t glitches = underruns - lastUnderruns;
+    lastBlocks = activeBlocks;
+    lastUnderruns = underruns;
+
+    if (glitches > 0) {
+        // One below what just glitched is never tried again
+        if (current + 1 > minimum) {
+            minimum = current + 1 > maximum ? maximum : current + 1;
+        }
+        current = current + BACKOFF > maximum ? maximum : current + BACKOFF;
+        sinceChange = 0;
+        return current;
+    }
+    sinceChange += played;
+    if (sinceChange >= quiet && current > minimum) {
+        current--;
+        sinceChange = 0;
+    }
+    return current;
+}
@@ -0,0 +1,106 @@
+#ifndef I2S_HEALTH_H
+#define I2S_HEALTH_H
+
+#include <cstdint>
+#include <cstddef>
+#include <driver/i2s.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+
+// How much audio the DMA ring holds: latency traded against tolerance to
+// a late task. The geometry is worked out from the port's rate.
+enum LatencyProfile {
+    LATENCY_LOW,      // ~20 ms out, ~12 ms in
+    LATENCY_BALANCED, // ~60 ms out, ~32 ms in
+    LATENCY_ROBUST    // ~240 ms out, ~128 ms in
+};
+
+struct DmaGeometry {
+    uint8_t count;   // descriptors
+    uint16_t frames; // per descriptor
+};
+
+// Out is playback; in is capture. bytesPerFrame is every slot of one frame
+// as the DMA sees it, which bounds how long a descriptor can be.
+DmaGeometry dmaGeometry(LatencyProfile profile, bool out, uint32_t sampleRate, uint8_t bytesPerFrame);
+uint32_t dmaLatencyMs(const DmaGeometry &geometry, uint32_t sampleRate);
+const char *latencyProfileName(LatencyProfile profile);
+bool parseLatencyProfile(const char *name, LatencyProfile *profile);
+
+struct I2sHealthStats {
+    uint32_t blocks;          // DMA descriptors completed
+    uint32_t activeBlocks;    // of those, while the owner had audio
+    uint32_t underruns;       // TX queue overflow while active: the writer was late
+    uint32_t idleUnderruns;   // the same while idle, which is expected
+    uint32_t overruns;        // RX queue overflow: the reader was late
+    uint32_t dmaErrors;
+    int64_t lastCompletionUs; // esp_timer time the last descriptor finished
+    uint32_t maxIntervalUs;   // longest gap between completions since reset
+};
+
+// Consumes the event queue of one legacy I2S driver on its own task and
+// keeps counters. The driver's queue goes away when the driver is
+// uninstalled, so detach() before that and attach() the new one after.
+class I2sMonitor {
+public:
+    I2sMonitor();
+
+    bool begin(const char *name, uint8_t priority, int core);
+    void attach(QueueHandle_t events);
+    void detach();
+
+    // The owner says whether it has audio queued, so a TX underrun can be
+    // told from the ring simply running out at the end of a response
+    void setActive(bool active) { activeNow = active; }
+
+    I2sHealthStats stats() const;
+    void resetPeaks() { maxInterval = 0; }
+
+private:
+    static void taskEntry(void *monitor);
+    void run();
+
+    SemaphoreHandle_t parked; // given when the task has let go of the queue
+    volatile QueueHandle_t queue;
+    volatile bool activeNow;
+    volatile uint32_t blocks;
+    volatile uint32_t activeBlocks;
+    volatile uint32_t underruns;
+    volatile uint32_t idleUnderruns;
+    volatile uint32_t overruns;
+    volatile uint32_t dmaErrors;
+    volatile int64_t lastCompletion;
+    volatile uint32_t maxInterval;
+
+    I2sMonitor(const I2sMonitor &);
+    I2sMonitor &operator=(const I2sMonitor &);
+};
+
+// Walks the descriptor count down while playback stays clean and steps it
+// back up on the first underrun. The count that glitched becomes a floor,
+// so the tuner settles instead of oscillating.
+class DmaTuner {
+public:
+    DmaTuner();
+
+    void begin(uint8_t count, uint8_t minCount, uint8_t maxCount, uint32_t quietBlocks);
+    // Totals from the monitor; returns the count the port should have
+    uint8_t update(uint32_t activeBlocks, uint32_t underruns);
+    uint8_t count() const { return current; }
+    uint8_t floor() const { return minimum; }
+
+private:
+    static const uint8_t BACKOFF = 2;
+
+    uint8_t current;
+    uint8_t minimum;
+    uint8_t maximum;
+    uint32_t quiet;
+    uint32_t sinceChange; // active blocks without an underrun
+    uint32_t lastBlocks;
+    uint32_t lastUnderruns;
+    bool primed;
+};
+
+#endif // I2S_HEALTH_H
@@ -0,0 +1,290 @@
+#include "jitterBuffer.h"
+#include <Arduino.h>
+#include "utils.h"
+
+static const uint16_t CONCEAL_PERIOD_MS = 10; // repeated while concealing
+static const uint16_t CONCEAL_FADE_MS = 20;   // concealment fades to silence over this
+static const uint16_t FADE_IN_MS = 5;
+static const uint16_t STREAM_GAP_MS = 1000;   // a longer pause starts a new stream
+static const uint8_t JITTER_DECAY_SHIFT = 7;  // peak loses 1/128 per chunk
+static const uint32_t FULL_WAIT_MS = 200;     // longest push() waits for room
+
+JitterBuffer::JitterBuffer()
+    : rate(0), channels(1), minTarget(0), maxTarget(0), margin(0), rateNudge(0), streamOpen(false), streamStartMs(0),
+      streamSamples(0), minTransitMs(0), jitterPeakUs(0), targetSamples(0), lastPushMs(0), ended(false),
+      starved(false), flushRequested(false), underrunCount(0), lateCount(0), concealedCount(0), peakDepth(0),
+      state(BUFFERING), fadeIn(false), history(NULL), historyLength(0), concealPosition(0), concealLength(0) {
+}
+
+JitterBuffer::~JitterBuffer() {
+    free(history);
+}
+
+bool JitterBuffer::begin(uint32_t sampleRate, uint8_t channelCount, uint16_t capacityMs, uint16_t minTargetMs,
+                         uint16_t maxTargetMs, uint16_t marginMs) {
+    if (sampleRate == 0 || channelCount == 0 || minTargetMs > maxTargetMs || maxTargetMs >= capacityMs) {
+        return false;
+    }
+    rate = sampleRate;
+    channels = channelCount;
+    minTarget = minTargetMs;
+    maxTarget = maxTargetMs;
+    margin = marginMs;
+
+    // A stream faster than real time fills the buffer; waiting for room
+    // pushes back on TCP instead of dropping speech
+    size_t capacity = (size_t)rate * channels * capacityMs / 1000;
+    if (!ring.begin(capacity, AudioRing::BLOCK, FULL_WAIT_MS)) {
+        return false;
+    }
+    historyLength = (size_t)rate * CONCEAL_PERIOD_MS / 1000 * channels;
+    free(history);
+    history = (int16_t *)audio_malloc(historyLength * sizeof(int16_t));
+    if (!history) {
+        return false;
+    }
+    memset(history, 0, historyLength * sizeof(int16_t));
+    concealLength = concealSamples();
+    targetSamples.store((uint32_t)((uint64_t)rate * channels * (minTarget + margin) / 1000));
+    return true;
+}
+
+uint16_t JitterBuffer::toMs(size_t samples) const {
+    return rate ? (uint16_t)((uint64_t)samples * 1000 / ((uint64_t)rate * channels)) : 0;
+}
+
+void JitterBuffer::startStream() {
+    streamOpen = false;
+    ended.store(false);
+}
+
+void JitterBuffer::endStream() {
+    ended.store(true);
+    streamOpen = false;
+}
+
+void JitterBuffer::flush() {
+    flushRequested.store(true);
+    streamOpen = false;
+}
+
+size_t JitterBuffer::push(const int16_t *samples, size_t count, uint32_t nowMs) {
+    arrival(count, nowMs);
+    return write(samples, count);
+}
+
+void JitterBuffer::arrival(size_t count, uint32_t nowMs) {
+    if (!history || count == 0) {
+        return;
+    }
+    if (streamOpen && nowMs - lastPushMs.load() > STREAM_GAP_MS) {
+        streamOpen = false;
+    }
+    if (!streamOpen) {
+        streamOpen = true;
+        streamStartMs = nowMs;
+        streamSamples = 0;
+        minTransitMs = 0;
+        ended.store(false);
+        starved.store(false);
+    } else if (starved.exchange(false)) {
+        // The player ran dry waiting for this one
+        underrunCount.fetch_add(1);
+        lateCount.fetch_add(1);
+    }
+
+    // Transit relative to the fastest chunk of the stream; anything the
+    // network adds on top of that is what the buffer has to cover
+    int32_t mediaMs = (int32_t)(streamSamples * 1000 / ((uint64_t)rate * channels));
+    int32_t transit = (int32_t)(nowMs - streamStartMs) - mediaMs;
+    if (transit < minTransitMs) {
+        minTransitMs = transit;
+    }
+    uint32_t variationUs = (uint32_t)(transit - minTransitMs) * 1000;
+    jitterPeakUs -= jitterPeakUs >> JITTER_DECAY_SHIFT;
+    if (variationUs > jitterPeakUs) {
+        jitterPeakUs = variationUs;
+    }
+    // Until the next chunk lands only this one is there to play
+    uint32_t target = jitterPeakUs / 1000 + toMs(count) + margin;
+    target = target < minTarget ? minTarget : (target > maxTarget ? maxTarget : target);
+    targetSamples.store((uint32_t)((uint64_t)rate * channels * target / 1000));
+
+    streamSamples += count;
+    lastPushMs.store(nowMs);
+}
+
+size_t JitterBuffer::write(const int16_t *samples, size_t count) {
+    if (!history) {
+        return 0;
+    }
+    size_t written = ring.write(samples, count);
+    uint32_t depth = (uint32_t)ring.available();
+    if (depth > peakDepth.load()) {
+        peakDepth.store(depth);
+    }
+    return written;
+}
+
+bool JitterBuffer::waitForData(uint32_t timeoutMs) {
+    return ring.waitForData(ring.available() + 1, timeoutMs);
+}
+
+size_t JitterBuffer::readAudio(int16_t *out, size_t count) {
+    size_t got = ring.read(out, count);
+    if (fadeIn && got > 0) {
+        size_t fade = (size_t)rate * FADE_IN_MS / 1000 * channels;
+        fade = fade < got ? fade : got;
+        for (size_t i = 0; i < fade; i++) {
+            out[i] = (int16_t)((int32_t)out[i] * (int32_t)i / (int32_t)fade);
+        }
+        fadeIn = false;
+    }
+    // Keep the newest period for concealment
+    if (got >= historyLength) {
+        memcpy(history, out + got - historyLength, historyLength * sizeof(int16_t));
+    } else if (got > 0) {
+        memmove(history, history + got, (historyLength - got) * sizeof(int16_t));
+        memcpy(history + historyLength - got, out, got * sizeof(int16_t));
+    }
+    return got;
+}
+
+size_t JitterBuffer::concealSamples() const {
+    return (size_t)rate * CONCEAL_FADE_MS / 1000 * channels;
+}
+
+void JitterBuffer::conceal(int16_t *out, size_t count) {
+    size_t fade = concealSamples();
+    for (size_t i = 0; i < count; i++) {
+        if (concealLength >= fade) {
+            out[i] = 0;
+            continue;
+        }
+        int32_t gain = (int32_t)(fade - concealLength);
+        out[i] = (int16_t)((int32_t)history[concealPosition] * gain / (int32_t)fade);
+        concealPosition = concealPosition + 1 < historyLength ? concealPosition + 1 : 0;
+        concealLength++;
+    }
+}
+
+size_t JitterBuffer::pull(int16_t *out, size_t count, uint32_t nowMs, bool mustFill) {
+    if (!history) {
+        return 0;
+    }
+    if (flushRequested.exchange(false)) {
+        ring.clear();
+        state = BUFFERING;
+        concealLength = concealSamples();
+        starved.store(false);
+        return 0;
+    }
+
+    size_t available = ring.available();
+    if (state == BUFFERING) {
+        // Start at the target depth, or with whatever there is once the
+        // stream has ended or gone quiet for longer than the target
+        uint32_t target = targetSamples.load();
+        bool stalled = nowMs - lastPushMs.load() > toMs(target);
+        if (available == 0 || (available < target && !ended.load() && !stalled)) {
+            // Finish the concealment fade before going quiet
+            if (concealLength < concealSamples()) {
+                conceal(out, count);
+                concealedCount.fetch_add((uint32_t)count);
+                return count;
+            }
+            return 0;
+        }
+        state = PLAYING;
+    }
+
+    if (available >= count) {
+        readAudio(out, count);
+    } else if (ended.load()) {
+        // End of stream: the tail, then silence
+        size_t got = readAudio(out, available);
+        memset(out + got, 0, (count - got) * sizeof(int16_t));
+        state = BUFFERING;
+    } else if (mustFill) {
+        size_t got = readAudio(out, available);
+        concealPosition = 0;
+        concealLength = 0;
+        conceal(out + got, count - got);
+        concealedCount.fetch_add((uint32_t)(count - got));
+        starved.store(true);
+        fadeIn = true;
+        state = BUFFERING;
+    } else {
+        return 0;
+    }
+
+    uint32_t depth = (uint32_t)ring.available();
+    if (depth > peakDepth.load()) {
+        peakDepth.store(depth);
+    }
+    return count;
+}
+
+size_t JitterBuffer::take(int16_t *out, size_t count) {
+    if (!history) {
+        return 0;
+    }
+    if (flushRequested.exchange(false)) {
+        ring.clear();
+        state = BUFFERING;
+        starved.store(false);
+        return 0;
+    }
+    size_t got = ring.read(out, count);
+    uint32_t depth = (uint32_t)ring.available();
+    if (depth > peakDepth.load()) {
+        peakDepth.store(depth);
+    }
+    return got;
+}
+
+size_t JitterBuffer::discard(size_t count) {
+    size_t done = 0;
+    while (done < count) {
+        const int16_t *span;
+        size_t got = ring.peek(&span, count - done);
+        if (got == 0) {
+            break;
+        }
+        ring.release(got);
+        done += got;
+    }
+    return done;
+}
+
+int8_t JitterBuffer::rateAdjustPercent() const {
+    if (state != PLAYING || ended.load()) {
+        return 0;
+    }
+    size_t depth = ring.available();
+    uint32_t target = targetSamples.load();
+    if (depth > 2 * (size_t)target) {
+        return (int8_t)rateNudge;
+    }
+    if (depth < target / 2) {
+        return -(int8_t)rateNudge;
+    }
+    return 0;
+}
+
+JitterStats JitterBuffer::stats() const {
+    JitterStats s;
+    s.underruns = underrunCount.load();
+    s.lateChunks = lateCount.load();
+    s.concealedSamples = concealedCount.load();
+    s.overflowSamples = ring.droppedSamples();
+    s.depthMs = toMs(ring.available());
+    s.peakDepthMs = toMs(peakDepth.load());
+    s.targetMs = toMs(targetSamples.load());
+    s.jitterMs = (uint16_t)(jitterPeakUs / 1000);
+    return s;
+}
+
+void JitterBuffer::resetPeaks() {
+    peakDepth.store(0);
+}
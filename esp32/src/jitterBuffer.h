@@ -0,0 +1,121 @@
+#ifndef JITTER_BUFFER_H
+#define JITTER_BUFFER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include "audioRing.h"
+
+struct JitterStats {
+    uint32_t underruns;        // playback starved mid-stream and had to conceal
+    uint32_t lateChunks;       // chunks that arrived after the player starved
+    uint32_t concealedSamples;
+    uint32_t overflowSamples;  // dropped because the buffer stayed full
+    uint16_t depthMs;          // audio waiting now
+    uint16_t peakDepthMs;
+    uint16_t targetMs;         // depth playback starts at
+    uint16_t jitterMs;         // peak arrival delay variation
+};
+
+// Playout buffer between the network and the speaker. The receive side
+// only copies into a sample ring; a playback task pulls fixed blocks.
+//
+// Arrival jitter is measured per chunk as the transit time (arrival minus
+// media time since the stream started) over the stream's fastest transit,
+// tracked as a slowly decaying peak. Playback starts, and restarts after a
+// gap, once that much audio plus one chunk and a margin is buffered. When the player
+// would run dry mid-stream the last few milliseconds are repeated with a
+// fade-out, and the first block after it fades back in.
+//
+// Samples are interleaved frames at the output rate. Times are millis().
+class JitterBuffer {
+public:
+    JitterBuffer();
+    ~JitterBuffer();
+
+    bool begin(uint32_t sampleRate, uint8_t channels, uint16_t capacityMs, uint16_t minTargetMs,
+               uint16_t maxTargetMs, uint16_t marginMs);
+
+    // Producer side. push() is arrival() plus write(); a chunk rendered in
+    // several blocks is timed once with arrival() and then written.
+    size_t push(const int16_t *samples, size_t count, uint32_t nowMs);
+    void arrival(size_t count, uint32_t nowMs);
+    size_t write(const int16_t *samples, size_t count);
+    // Starts the media clock over for the next push
+    void startStream();
+    // Plays out what is buffered without waiting for the target
+    void endStream();
+    // Drops everything queued; applied by the consumer on its next pull
+    void flush();
+
+    // Consumer side. Fills `out` with `count` samples and returns count, or
+    // returns 0 while there is nothing to play yet. With mustFill (the
+    // output is about to run dry) a short buffer is topped up with
+    // concealment rather than waited on.
+    size_t pull(int16_t *out, size_t count, uint32_t nowMs, bool mustFill);
+    // Consumer side for scheduled playback, where the caller keeps time:
+    // whatever is buffered up to `count` samples, with no start target and
+    // no concealment. discard() drops up to `count` unplayed samples.
+    size_t take(int16_t *out, size_t count);
+    size_t discard(size_t count);
+    // The stream has ended and everything in it has been read
+    bool drained() const { return ended.load() && ring.available() == 0; }
+    // Waits for more than is buffered now
+    bool waitForData(uint32_t timeoutMs);
+    bool playing() const { return state == PLAYING; }
+    // Playout speed nudge for a time stretcher, in percent: positive when
+    // the buffer holds well over its target (latency to shed), negative
+    // when it is close to running dry
+    int8_t rateAdjustPercent() const;
+    void setRateNudge(uint8_t percent) { rateNudge = percent; }
+
+    JitterStats stats() const;
+    void resetPeaks();
+
+private:
+    enum State { BUFFERING, PLAYING };
+
+    size_t readAudio(int16_t *out, size_t count);
+    void conceal(int16_t *out, size_t count);
+    size_t concealSamples() const;
+    uint16_t toMs(size_t samples) const;
+
+    AudioRing ring;
+    uint32_t rate;
+    uint8_t channels;
+    uint16_t minTarget;
+    uint16_t maxTarget;
+    uint16_t margin;
+    uint8_t rateNudge;
+
+    // Producer state
+    bool streamOpen;
+    uint32_t streamStartMs;
+    uint64_t streamSamples;
+    int32_t minTransitMs;
+    uint32_t jitterPeakUs;
+
+    // Shared
+    std::atomic<uint32_t> targetSamples;
+    std::atomic<uint32_t> lastPushMs;
+    std::atomic<bool> ended;
+    std::atomic<bool> starved;
+    std::atomic<bool> flushRequested;
+    std::atomic<uint32_t> underrunCount;
+    std::atomic<uint32_t> lateCount;
+    std::atomic<uint32_t> concealedCount;
+    std::atomic<uint32_t> peakDepth;
+
+    // Consumer state
+    volatile State state;
+    bool fadeIn;
+    int16_t *history;   // last output period, repeated to conceal
+    size_t historyLength;
+    size_t concealPosition;
+    size_t concealLength;
+
+    JitterBuffer(const JitterBuffer &);
+    JitterBuffer &operator=(const JitterBuffer &);
+};
+
+#endif // JITTER_BUFFER_H
@@ -0,0 +1,231 @@
+#include "keywordSpotter.h"
+#include <Arduino.h>
+#include "utils.h"
+
+static const uint8_t INFERENCE_EVERY_HOPS = 2;
+static const uint8_t SMOOTHING_INFERENCES = 3;
+static const uint16_t REFRACTORY_MS = 1000;
+
+static inline int8_t saturate8(int32_t value, bool relu) {
+    int32_t low = relu ? 0 : -128;
+    return (int8_t)(value > 127 ? 127 : (value < low ? low : value));
+}
+
+KeywordSpotter::KeywordSpotter()
+    : net(NULL), threshold(100), hop(0), window(NULL), fill(0), mfcc(NULL), features(NULL), framesFilled(0),
+      activationA(NULL), activationB(NULL), widest(0), hopsSinceInference(0), historyCount(0), historyHead(0),
+      smoothedScore(0), refractoryHops(0), inferenceCount(0) {
+}
+
+KeywordSpotter::~KeywordSpotter() {
+    release();
+}
+
+void KeywordSpotter::release() {
+    free(window);
+    free(mfcc);
+    free(features);
+    free(activationA);
+    free(activationB);
+    window = NULL;
+    mfcc = NULL;
+    features = activationA = activationB = NULL;
+    net = NULL;
+}
+
+bool KeywordSpotter::begin(const KwsModel *model, uint8_t thresholdPercent) {
+    release();
+    if (!model || model->layerCount == 0 || !model->layers || model->frames == 0) {
+        return false;
+    }
+
+    // The layers must chain, from the feature window to one logit per class
+    uint16_t width = (uint16_t)model->frames * model->coeffs;
+    widest = width;
+    for (uint8_t l = 0; l < model->layerCount; l++) {
+        const KwsLayer &layer = model->layers[l];
+        if (layer.inputs != width || !layer.weights || !layer.bias || layer.shift > 31) {
+            return false;
+        }
+        width = layer.outputs;
+        if (width > widest) {
+            widest = width;
+        }
+    }
+    if (model->keywordClass >= width) {
+        return false;
+    }
+
+    uint16_t windowSamples = (uint16_t)(model->sampleRate * model->windowMs / 1000);
+    hop = (uint16_t)(model->sampleRate * model->hopMs / 1000);
+    if (hop == 0 || hop > windowSamples ||
+        !frontEnd.begin(model->sampleRate, windowSamples, model->melBands, model->coeffs)) {
+        return false;
+    }
+
+    window = (int16_t *)audio_malloc(windowSamples * sizeof(int16_t));
+    mfcc = (int16_t *)audio_malloc(model->coeffs * sizeof(int16_t));
+    features = (int8_t *)audio_malloc((size_t)model->frames * model->coeffs);
+    activationA = (int8_t *)audio_malloc(widest);
+    activationB = (int8_t *)audio_malloc(widest);
+    if (!window || !mfcc || !features || !activationA || !activationB) {
+        release();
+        return false;
+    }
+
+    net = model;
+    threshold = thresholdPercent;
+    inferenceCount = 0;
+    reset();
+    return true;
+}
+
+void KeywordSpotter::reset() {
+    if (!net) {
+        return;
+    }
+    memset(window, 0, frontEnd.windowSamples() * sizeof(int16_t));
+    memset(features, 0, (size_t)net->frames * net->coeffs);
+    fill = 0;
+    framesFilled = 0;
+    hopsSinceInference = 0;
+    historyCount = 0;
+    historyHead = 0;
+    smoothedScore = 0;
+    refractoryHops = 0;
+}
+
+size_t KeywordSpotter::memoryBytes() const {
+    if (!net) {
+        return 0;
+    }
+    size_t bytes = frontEnd.memoryBytes() + frontEnd.windowSamples() * sizeof(int16_t) +
+                   net->coeffs * sizeof(int16_t) + (size_t)net->frames * net->coeffs + 2 * widest;
+    for (uint8_t l = 0; l < net->layerCount; l++) {
+        const KwsLayer &layer = net->layers[l];
+        bytes += (size_t)layer.inputs * layer.outputs + layer.outputs * sizeof(int32_t);
+    }
+    return bytes;
+}
+
+bool KeywordSpotter::process(const int16_t *samples, size_t count, bool listen) {
+    if (!net) {
+        return false;
+    }
+    uint16_t windowSamples = frontEnd.windowSamples();
+    bool detected = false;
+    while (count > 0) {
+        // New samples fill the last hop of the window
+        size_t take = hop - fill;
+        if (take > count) {
+            take = count;
+        }
+        memcpy(window + windowSamples - hop + fill, samples, take * sizeof(int16_t));
+        fill += take;
+        samples += take;
+        count -= take;
+        if (fill == hop) {
+            detected |= processHop(listen);
+            memmove(window, window + hop, (windowSamples - hop) * sizeof(int16_t));
+            fill = 0;
+        }
+    }
+    return detected;
+}
+
+bool KeywordSpotter::processHop(bool listen) {
+    uint8_t coeffs = net->coeffs;
+    frontEnd.compute(window, mfcc);
+    memmove(features, features + coeffs, (size_t)(net->frames - 1) * coeffs);
+    int8_t *newest = features + (size_t)(net->frames - 1) * coeffs;
+    for (uint8_t c = 0; c < coeffs; c++) {
+        newest[c] = saturate8((int32_t)(((int64_t)mfcc[c] * net->inputMultiplier + (1 << 14)) >> 15), false);
+    }
+    if (framesFilled < net->frames) {
+        framesFilled++;
+    }
+
+    if (refractoryHops > 0) {
+        refractoryHops--;
+        return false;
+    }
+    if (!listen) {
+        // Nobody talking: skip the net and start the average over
+        historyCount = 0;
+        historyHead = 0;
+        smoothedScore = 0;
+        return false;
+    }
+    if (framesFilled < net->frames || ++hopsSinceInference < INFERENCE_EVERY_HOPS) {
+        return false;
+    }
+    hopsSinceInference = 0;
+
+    history[historyHead] = infer();
+    historyHead = (historyHead + 1) % SMOOTHING_INFERENCES;
+    if (historyCount < SMOOTHING_INFERENCES) {
+        historyCount++;
+    }
+    // Averaged over a full history, so one confident inference is not enough
+    uint16_t sum = 0;
+    for (uint8_t i = 0; i < historyCount; i++) {
+        sum += history[i];
+    }
+    smoothedScore = (uint8_t)(sum / SMOOTHING_INFERENCES);
+
+    if (smoothedScore >= threshold) {
+        refractoryHops = REFRACTORY_MS / net->hopMs;
+        historyCount = 0;
+        historyHead = 0;
+        return true;
+    }
+    return false;
+}
+
+// Runs the network on the feature window; returns the keyword posterior in percent
+uint8_t KeywordSpotter::infer() {
+    const int8_t *x = features;
+    int8_t *y = activationA;
+    for (uint8_t l = 0; l < net->layerCount; l++) {
+        const KwsLayer &layer = net->layers[l];
+        for (uint16_t o = 0; o < layer.outputs; o++) {
+            const int8_t *w = layer.weights + (size_t)o * layer.inputs;
+            int32_t acc = layer.bias[o];
+            uint16_t i = 0;
+            for (; i + 4 <= layer.inputs; i += 4) {
+                acc += w[i] * x[i];
+                acc += w[i + 1] * x[i + 1];
+                acc += w[i + 2] * x[i + 2];
+                acc += w[i + 3] * x[i + 3];
+            }
+            for (; i < layer.inputs; i++) {
+                acc += w[i] * x[i];
+            }
+            int64_t scaled = (int64_t)acc * layer.multiplier;
+            int64_t rounding = (int64_t)1 << (30 + layer.shift);
+            y[o] = saturate8((int32_t)((scaled + rounding) >> (31 + layer.shift)), layer.relu);
+        }
+        x = y;
+        y = y == activationA ? activationB : activationA;
+    }
+    inferenceCount++;
+
+    // Softmax over the few class logits
+    const KwsLayer &last = net->layers[net->layerCount - 1];
+    float peak = x[0];
+    for (uint16_t k = 1; k < last.outputs; k++) {
+        if (x[k] > peak) {
+            peak = x[k];
+        }
+    }
+    float total = 0.0f;
+    float keyword = 0.0f;
+    for (uint16_t k = 0; k < last.outputs; k++) {
+        float p = expf((x[k] - peak) * net->outputScale);
+        total += p;
+        if (k == net->keywordClass) {
+            keyword = p;
+        }
+    }
+    return (uint8_t)(100.0f * keyword / total);
+}
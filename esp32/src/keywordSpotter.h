@@ -0,0 +1,96 @@
+#ifndef KEYWORD_SPOTTER_H
+#define KEYWORD_SPOTTER_H
+
+#include <cstdint>
+#include <cstddef>
+#include "mfcc.h"
+
+// One fully connected int8 layer: out = requant(bias + W x), optionally
+// clamped at zero. Weights are row-major, outputs x inputs, symmetric
+// (zero point 0), as are all activations. The int32 accumulator is scaled
+// by multiplier / 2^(31 + shift), the usual TFLite fixed-point multiplier.
+struct KwsLayer {
+    uint16_t inputs;
+    uint16_t outputs;
+    const int8_t *weights;
+    const int32_t *bias;
+    int32_t multiplier;
+    uint8_t shift;
+    bool relu;
+};
+
+// A keyword model: the front end it was trained on plus its layers. The
+// input is `frames` MFCC vectors oldest first, each quantised as
+// int8 = mfccQ7 * inputMultiplier / 2^15. The last layer emits one logit
+// per class, dequantised with outputScale for the softmax.
+//
+// Models are plain const data, normally a generated header; swap one in
+// with setWakeWordModel().
+struct KwsModel {
+    const char *name;
+    uint32_t sampleRate;
+    uint16_t windowMs;
+    uint16_t hopMs;
+    uint8_t melBands;
+    uint8_t coeffs;
+    uint8_t frames;
+    int32_t inputMultiplier;
+    uint8_t layerCount;
+    const KwsLayer *layers;
+    float outputScale;
+    uint8_t keywordClass;
+};
+
+// Streaming keyword spotter. MFCCs are computed every hop so the feature
+// window is always current, but the network only runs every few hops and
+// only while the caller says someone may be talking (the VAD), which keeps
+// the duty cycle low in a quiet room. Posteriors are averaged over a few
+// inferences and a detection is followed by a refractory period.
+class KeywordSpotter {
+public:
+    KeywordSpotter();
+    ~KeywordSpotter();
+
+    bool begin(const KwsModel *model, uint8_t thresholdPercent);
+    void reset();
+
+    // Audio at model()->sampleRate, any block size. Returns true on a detection.
+    bool process(const int16_t *samples, size_t count, bool listen);
+
+    const KwsModel *model() const { return net; }
+    // Smoothed keyword posterior, percent
+    uint8_t score() const { return smoothedScore; }
+    uint32_t inferences() const { return inferenceCount; }
+    // Heap used by the front end and activations, plus the model's weights
+    size_t memoryBytes() const;
+
+private:
+    bool processHop(bool listen);
+    uint8_t infer();
+    void release();
+
+    MfccFrontEnd frontEnd;
+    const KwsModel *net;
+    uint8_t threshold;
+    uint16_t hop;
+    int16_t *window;     // windowSamples, newest at the end
+    uint16_t fill;
+    int16_t *mfcc;       // one frame of coefficients
+    int8_t *features;    // frames x coeffs, oldest first
+    uint8_t framesFilled;
+    int8_t *activationA; // ping-pong buffers sized for the widest layer
+    int8_t *activationB;
+    uint16_t widest;
+    uint8_t hopsSinceInference;
+    uint8_t history[4];  // recent posteriors, percent
+    uint8_t historyCount;
+    uint8_t historyHead;
+    uint8_t smoothedScore;
+    uint16_t refractoryHops;
+    uint32_t inferenceCount;
+
+    KeywordSpotter(const KeywordSpotter &);
+    KeywordSpotter &operator=(const KeywordSpotter &);
+};
+
+#endif // KEYWORD_SPOTTER_H
@@ -1,21 +1,154 @@
-#include <esp32-hal-gpio.h>
-#include "config.h"
-class ButtonChecker {
-public:
-    void loop() {
-        lastTickState = thisTickState;
-        thisTickState = !digitalRead(BUTTON_PIN);  // Input pullup means pressed = LOW
+#include "lib_button.h"
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+// Raw edges from the ISR; the gesture task debounces them
+struct ButtonEdge {
+    bool pressed;
+    int64_t timeUs;
+};
+
+static const int64_t DEBOUNCE_US = (int64_t)BUTTON_DEBOUNCE_MS * 1000;
+static const int64_t TAP_US = (int64_t)BUTTON_TAP_MS * 1000;
+static const int64_t LONG_PRESS_US = (int64_t)BUTTON_LONG_PRESS_MS * 1000;
+static const int64_t DOUBLE_PRESS_US = (int64_t)BUTTON_DOUBLE_PRESS_MS * 1000;
+
+static QueueHandle_t edgeQueue = NULL;
+static QueueHandle_t eventQueue = NULL;
+
+static void IRAM_ATTR onButtonEdge() {
+    ButtonEdge edge;
+    edge.pressed = !digitalRead(BUTTON_PIN);  // Input pullup means pressed = LOW
+    edge.timeUs = esp_timer_get_time();
+    BaseType_t woken = pdFALSE;
+    // A full queue drops the edge; the settle check re-reads the pin
+    xQueueSendFromISR(edgeQueue, &edge, &woken);
+    if (woken) {
+        portYIELD_FROM_ISR();
     }
+}
 
-    bool justPressed() {
-        return thisTickState && !lastTickState;
+static void postEvent(InputEventType type, int64_t timeUs) {
+    InputEvent event;
+    event.type = type;
+    event.timeUs = timeUs;
+    if (xQueueSend(eventQueue, &event, 0) != pdTRUE) {
+        Serial.printf("Input event %s dropped, queue full\n", inputEventName(type));
     }
+}
 
-    bool justReleased() {
-        return !thisTickState && lastTickState;
+static TickType_t ticksUntil(int64_t deadlineUs, int64_t nowUs) {
+    if (deadlineUs <= nowUs) {
+        return 0;
     }
+    return pdMS_TO_TICKS((deadlineUs - nowUs + 999) / 1000) + 1;
+}
 
-private:
-    bool lastTickState = false;
-    bool thisTickState = false;
-};
\ No newline at end of file
+// The first edge of a burst is taken at once, so a press costs no debounce
+// latency; edges in the next BUTTON_DEBOUNCE_MS are contact bounce. When the
+// window closes the pin is read again, which catches a release that happened
+// inside it.
+static void buttonTask(void *parameter) {
+    bool pressed = !digitalRead(BUTTON_PIN);
+    bool settling = false;
+    bool longSent = true; // not for a press the task started under
+    bool secondHalf = false;
+    int64_t changedUs = esp_timer_get_time() - DEBOUNCE_US;
+    int64_t pressUs = 0;
+    int64_t tapReleaseUs = INT64_MIN / 2;
+
+    while (true) {
+        int64_t now = esp_timer_get_time();
+        TickType_t wait = portMAX_DELAY;
+        if (settling) {
+            wait = ticksUntil(changedUs + DEBOUNCE_US, now);
+        }
+        if (pressed && !longSent) {
+            TickType_t untilLong = ticksUntil(pressUs + LONG_PRESS_US, now);
+            wait = untilLong < wait ? untilLong : wait;
+        }
+
+        ButtonEdge edge;
+        bool level = pressed;
+        int64_t edgeUs = 0;
+        if (xQueueReceive(edgeQueue, &edge, wait) == pdTRUE) {
+            if (edge.timeUs - changedUs < DEBOUNCE_US) {
+                continue;
+            }
+            level = edge.pressed;
+            edgeUs = edge.timeUs;
+        } else {
+            now = esp_timer_get_time();
+            if (settling && now - changedUs >= DEBOUNCE_US) {
+                settling = false;
+                level = !digitalRead(BUTTON_PIN);
+                edgeUs = changedUs + DEBOUNCE_US;
+            }
+            if (pressed && !longSent && now - pressUs >= LONG_PRESS_US) {
+                longSent = true;
+                postEvent(INPUT_LONG_PRESS, pressUs + LONG_PRESS_US);
+            }
+        }
+        if (level == pressed) {
+            continue;
+        }
+
+        pressed = level;
+        changedUs = edgeUs;
+        settling = true;
+        if (pressed) {
+            // Only a tap can be the first half of a double press, and the
+            // second half cannot start a third
+            secondHalf = edgeUs - tapReleaseUs <= DOUBLE_PRESS_US;
+            postEvent(secondHalf ? INPUT_DOUBLE_PRESS : INPUT_PRESS, edgeUs);
+            tapReleaseUs = INT64_MIN / 2;
+            pressUs = edgeUs;
+            longSent = false;
+        } else {
+            postEvent(INPUT_RELEASE, edgeUs);
+            if (!secondHalf && edgeUs - pressUs <= TAP_US) {
+                tapReleaseUs = edgeUs;
+            }
+        }
+    }
+}
+
+esp_err_t setupButtonInput() {
+    if (eventQueue) {
+        return ESP_OK;
+    }
+    pinMode(BUTTON_PIN, INPUT_PULLUP);
+    edgeQueue = xQueueCreate(BUTTON_EDGE_QUEUE, sizeof(ButtonEdge));
+    eventQueue = xQueueCreate(BUTTON_EVENT_QUEUE, sizeof(InputEvent));
+    if (!edgeQueue || !eventQueue) {
+        Serial.println("Failed to allocate button queues");
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreatePinnedToCore(buttonTask, "button", 2048, NULL, BUTTON_TASK_PRIORITY, NULL, BUTTON_TASK_CORE) !=
+        pdPASS) {
+        Serial.println("Failed to start button task");
+        return ESP_FAIL;
+    }
+    attachInterrupt(BUTTON_PIN, onButtonEdge, CHANGE);
+    return ESP_OK;
+}
+
+bool nextInputEvent(InputEvent *event, TickType_t wait) {
+    return eventQueue && xQueueReceive(eventQueue, event, wait) == pdTRUE;
+}
+
+const char *inputEventName(InputEventType type) {
+    switch (type) {
+    case INPUT_PRESS:
+        return "press";
+    case INPUT_RELEASE:
+        return "release";
+    case INPUT_LONG_PRESS:
+        return "long press";
+    case INPUT_DOUBLE_PRESS:
+        return "double press";
+    }
+    return "unknown";
+}
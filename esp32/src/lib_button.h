@@ -2,9 +2,36 @@
 #define LIB_BUTTON_H
 
 #include <esp32-hal-gpio.h>
+#include <freertos/FreeRTOS.h>
 #include "config.h"
 
+// Debounced button gestures, stamped with esp_timer_get_time() at the edge
+// that caused them. A press within BUTTON_DOUBLE_PRESS_MS of releasing a tap
+// (a press no longer than BUTTON_TAP_MS) is an INPUT_DOUBLE_PRESS instead of
+// an INPUT_PRESS; every press still ends in an INPUT_RELEASE. Holding past
+// BUTTON_LONG_PRESS_MS adds an INPUT_LONG_PRESS, stamped at the threshold,
+// before that release; push-to-talk holds that long too, so consumers
+// decide when it means anything.
+enum InputEventType {
+    INPUT_PRESS,
+    INPUT_RELEASE,
+    INPUT_LONG_PRESS,
+    INPUT_DOUBLE_PRESS
+};
+
+struct InputEvent {
+    InputEventType type;
+    int64_t timeUs;
+};
+
+// Installs the GPIO interrupt and the gesture task
+esp_err_t setupButtonInput();
+// Takes the next gesture, waiting up to `wait` ticks; false if none came
+bool nextInputEvent(InputEvent *event, TickType_t wait);
+const char *inputEventName(InputEventType type);
 
+// Polled reader, kept for sketches that call it from loop(); it misses
+// presses shorter than a loop pass and sees every bounce
 class ButtonChecker {
 public:
     ButtonChecker() {
@@ -38,4 +65,4 @@ private:
     bool thisTickState;
 };
 
-#endif
\ No newline at end of file
+#endif
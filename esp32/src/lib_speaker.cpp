@@ -1,18 +1,30 @@
 #include <Audio.h>
 #include <Arduino.h>
 #include <driver/i2s.h>
-#include <audioMemoryBuffer.h>
+#include <esp_timer.h>
+#include "audioRing.h"
 #include <math.h>
 #include "config.h"
 #include "lib_speaker.h"
 #include "lib_websocket.h"
 #include "lib_button.h"
 #include "mic.h"
-// At the top of the file
-static bool is_speaker_installed = false;
-static bool is_mic_installed = false;
+#include "jitterBuffer.h"
+#include "resampler.h"
+#include "timeStretch.h"
+#include "scheduledPlayout.h"
+#include "loudness.h"
+#include "mixer.h"
+#include "toneSynth.h"
+#include "assetCache.h"
+#include "i2sHealth.h"
+#include "audioHal.h"
+
+#if AUDIO_HAL_I2S_STD && !AUDIO_HAL_STD_AVAILABLE
+#error "AUDIO_HAL_I2S_STD needs IDF 5 (arduino-esp32 3.x)"
+#endif
 // Constants
-const size_t SAMPLES_PER_WRITE = 1024;
+const size_t SPEAKER_RING_SAMPLES = 16384;
 const float TONE_VOLUME_PERCENT = 0.02;
 const float MAX_AMPLITUDE = 32767.0f;
 
@@ -22,32 +34,127 @@ unsigned long lastSpkrActivity = 0;
 unsigned long lastToneTime = 0;
 bool isPlayingTone = false;
 unsigned long toneStartTime = 0;
-AudioMemoryBuffer audioMemoryBuffer = AudioMemoryBuffer();
-Audio audio;
-uint8_t speakerdata0[1024 * 1];
-int speaker_offset;
-int data_offset;
-void writeToAudioBuffer(int16_t *buffer, size_t samples)
+// Radio samples from the Audio library, stereo at its decoder's rate
+AudioRing speakerRing;
+
+// Rendered frames wait here for the playback task
+static JitterBuffer playoutBuffer;
+static bool playoutReady = false;
+#if !AUDIO_HAL_I2S_STD
+static int16_t playbackBlock[PLAYBACK_BLOCK_FRAMES * 2];
+#endif
+
+// Between the playout buffer and I2S: speech rate, plus the buffer's nudges
+static TimeStretcher stretcher;
+static const size_t STRETCH_FEED_FRAMES = PLAYBACK_BLOCK_FRAMES / 2;
+static int16_t stretchFeed[STRETCH_FEED_FRAMES * 2];
+static volatile uint16_t speechRate = SPEECH_RATE_PERCENT;
+static volatile bool stretchReset = false;
+
+// Last stage before I2S: loudness normalisation, volume and a brick-wall
+// limiter, in place on the playback block
+static LoudnessNormalizer loudness;
+static volatile bool loudnessEnabled = PLAYBACK_LOUDNESS_ENABLED;
+
+// Clock of the speaker port. It follows the stream rate when the playback
+// task can switch it between responses; otherwise the kernel converts.
+static volatile uint32_t outputRate = AUDIO_QUALITY_SPEAKER;
+static volatile uint32_t pendingRate = 0;
+static volatile esp_err_t reclockResult = ESP_OK;
+static SemaphoreHandle_t reclockDone = NULL;
+
+// Stream rate to I2S rate and mono-to-stereo in one pass, into a block
+// allocated once. Only a change of stream rate rebuilds the filter. Level
+// is left to the normaliser, so the kernel runs at unity gain.
+static Resampler renderResampler;
+static int16_t renderBlock[PLAYBACK_BLOCK_FRAMES * 2];
+static const int32_t RENDER_GAIN_Q12 = 4096;
+
+// Drift trim for the render resampler. The server clock against ours comes
+// from the downlink's clock sync; the speaker clock against ours from
+// timing the DMA completions, which shows the divider's error at this rate.
+// The playback task re-anchors the measurement when the port restarts.
+static volatile int32_t serverSkewPpm = 0;
+static volatile bool serverSkewKnown = false;
+static volatile int32_t i2sErrorPpm = 0;
+static volatile bool i2sErrorKnown = false;
+static volatile int32_t playbackTrimPpm = 0;
+static volatile bool rateAnchorStale = true;
+static uint32_t rateAnchorBlocks = 0;
+static int64_t rateAnchorUs = 0;
+static int64_t rateCheckedUs = 0;
+
+// A stream with a presentation time plays on the server's timeline rather
+// than on arrival. The producer asks the playback task to start or stop it
+// (pts, 0 to stop) and waits, so the new stream is never written while the
+// last one's tail is still buffered. Anchors come from the clock sync.
+struct ClockAnchor
 {
-  // Write samples to both left and right channels
-  int16_t stereoBuffer[samples * 2];
-  for (size_t i = 0; i < samples; i++)
-  {
-    stereoBuffer[i * 2] = buffer[i];     // Left channel
-    stereoBuffer[i * 2 + 1] = buffer[i]; // Right channel
-  }
+  int64_t localUs;
+  int64_t serverUs;
+};
+static ScheduledPlayout scheduled;
+static QueueHandle_t scheduleRequests = NULL;
+static SemaphoreHandle_t scheduleDone = NULL;
+static QueueHandle_t clockAnchors = NULL;
+static volatile bool streamScheduled = false;
+static int64_t mixPlayAtUs = 0; // when the block being mixed reaches the wire
 
-  size_t bytes_written = 0;
-  esp_err_t result = i2s_write(I2S_PORT_SPEAKER, stereoBuffer, samples * 4, &bytes_written, portMAX_DELAY);
+// The mixer owns the speaker port; everything that plays is a source.
+// Speech and earcons share the top priority so neither ducks the other.
+static AudioMixer mixer;
+static ToneSynth earcons;
+static ToneSynth testTone;
+static Resampler radioResampler;
+static volatile bool radioRouted = false;
+static bool speechMustFill = false;
+static int radioSourceId = -1;
+static const uint8_t PRIORITY_SPEECH = 2;
+static const uint8_t PRIORITY_TEST_TONE = 1;
+static const uint8_t PRIORITY_RADIO = 0;
 
-  if (result != ESP_OK)
-  {
-    Serial.println("Error writing to I2S speaker");
-  }
+// Cached prompts play in place from flash; a request with no cache stops
+struct AssetRequest
+{
+  AssetCache *cache;
+  AssetView view;
+};
+static QueueHandle_t assetRequests = NULL;
+static AssetRequest assetPlaying = {};
+static size_t assetPosition = 0;
+static Resampler assetResampler;
+static TaskHandle_t speakerTaskHandle = NULL;
+
+// DMA ring of the speaker port. A new geometry waits in pendingDma
+// (count << 16 | frames) until the playback task finds the port idle.
+static LatencyProfile speakerProfile = SPEAKER_LATENCY_PROFILE;
+static DmaGeometry speakerDma = {0, 0};
+static volatile uint32_t pendingDma = 0;
+#if AUDIO_HAL_I2S_STD
+// The playback task mixes straight into the DMA buffers it lends out
+static AudioChannel speakerChannel;
+static AudioChannel &speakerHealth = speakerChannel;
+#else
+static I2sMonitor speakerMonitor;
+static I2sMonitor &speakerHealth = speakerMonitor;
+#endif
+static DmaTuner dmaTuner;
+static volatile bool dmaAutoTune = SPEAKER_DMA_AUTOTUNE;
+static const uint8_t SPEAKER_FRAME_BYTES = 2 * sizeof(int16_t);
 
+static const ToneStep EARCON_START_STEPS[] = {{880, 60}, {0, 25}, {1320, 90}};
+static const ToneStep EARCON_STOP_STEPS[] = {{1320, 60}, {0, 25}, {880, 90}};
+static const ToneStep EARCON_ERROR_STEPS[] = {{330, 120}, {0, 50}, {330, 120}};
+
+Audio audio;
+// Mono samples at the I2S rate, played through the mixer
+void writeToAudioBuffer(int16_t *buffer, size_t samples)
+{
+  speaker_play(buffer, samples, outputRate, 1);
   lastSpkrActivity = millis();
 }
 
+#if !AUDIO_HAL_I2S_STD
 // I2S configuration helper
 esp_err_t configureI2S(const i2s_config_t &config, const i2s_pin_config_t &pins)
 {
@@ -67,163 +174,197 @@ esp_err_t configureI2S(const i2s_config_t &config, const i2s_pin_config_t &pins)
 
   return ESP_OK;
 }
-
-/*
-void InitI2SSpeakerOrMic(AudioMode mode)
-{
-    Serial.printf("Initializing I2S for mode: %s\n", mode == MODE_MIC ? "Microphone" : "Speaker");
-    try {
-        // if (mode == MODE_MIC && is_speaker_installed) {
-        //     i2s_stop(I2S_PORT_SPEAKER);
-        //     i2s_driver_uninstall(I2S_PORT_SPEAKER);
-        //     is_speaker_installed = false;
-        // } else if (mode == MODE_SPK && is_mic_installed) {
-        //     i2s_stop(I2S_PORT_MIC);
-        //     i2s_driver_uninstall(I2S_PORT_MIC);
-        //     is_mic_installed = false;
-        // }
-        
-        delay(50);
-
-        if (mode == MODE_MIC && !is_mic_installed)
-        {
-            if (setupMicrophone() == ESP_OK) {
-                i2s_start(I2S_PORT_MIC);
-                is_mic_installed = true;
-                digitalWrite(LED_MIC, HIGH);
-                digitalWrite(LED_SPKR, LOW);
-            }
-        }
-        else if (mode == MODE_SPK && !is_speaker_installed)
-        {
-            if (setupSpeakerI2S() == ESP_OK) {
-                i2s_start(I2S_PORT_SPEAKER);
-                is_speaker_installed = true;
-                digitalWrite(LED_MIC, LOW);
-                digitalWrite(LED_SPKR, HIGH);
-            }
-        }
-    } catch (const std::exception& e) {
-        Serial.printf("Error initializing I2S: %s\n", e.what());
+#endif
+// Speech: the playout buffer through the time stretcher and the loudness
+// stage. speechMustFill is set by the playback task for each block.
+static size_t speechSource(void *context, int16_t *out, size_t frames)
+{
+  // On a timeline the scheduler paces the buffer instead of the stretcher
+  if (scheduled.active())
+  {
+    scheduled.setClock(serverSkewKnown ? serverSkewPpm : 0, playbackTrimPpm);
+    size_t produced = scheduled.render(playoutBuffer, out, frames, mixPlayAtUs);
+    if (produced > 0)
+    {
+      loudness.process(out, produced, loudnessEnabled);
+    }
+    return produced;
+  }
+  stretcher.setSpeed((uint16_t)(speechRate * (100 + playoutBuffer.rateAdjustPercent()) / 100));
+  size_t produced = stretcher.read(out, frames);
+  while (produced < frames && stretcher.space() >= STRETCH_FEED_FRAMES)
+  {
+    if (playoutBuffer.pull(stretchFeed, STRETCH_FEED_FRAMES * 2, millis(), speechMustFill) == 0)
+    {
+      break;
     }
+    stretcher.write(stretchFeed, STRETCH_FEED_FRAMES);
+    produced += stretcher.read(out + produced * 2, frames - produced);
+  }
+  if (produced > 0)
+  {
+    loudness.process(out, produced, loudnessEnabled);
+  }
+  return produced;
 }
-*/
-// ... existing code ...
 
-void InitI2SSpeakerOrMic(AudioMode mode)
+// Radio: whatever the Audio library decoded, converted to the port's rate
+static size_t radioSource(void *context, int16_t *out, size_t frames)
 {
-    Serial.printf("Initializing I2S for mode: %s\n", mode == MODE_MIC ? "Microphone" : "Speaker");
-    esp_err_t err = ESP_OK;
-
-    // Use different ports for mic and speaker
-    i2s_port_t port = (mode == MODE_MIC) ? I2S_PORT_MIC : I2S_PORT_SPEAKER;
-    
-    // Uninstall existing driver for the specific port only
-    i2s_driver_uninstall(port);
-
-    // Base I2S config
-    i2s_config_t i2s_config = {
-        .bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT,
-#if ESP_IDF_VERSION > ESP_IDF_VERSION_VAL(4, 1, 0)
-        .communication_format = I2S_COMM_FORMAT_STAND_I2S,
-#else
-        .communication_format = I2S_COMM_FORMAT_I2S,
-#endif
-        .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
-        .dma_buf_count = bufferCnt,
-        .dma_buf_len = bufferLen,
-        .use_apll = false,
-        .tx_desc_auto_clear = true,
-        .fixed_mclk = 0
-    };
-
-    // Mode-specific configurations
-    if (mode == MODE_MIC)
+  uint32_t rate = audio.getSampleRate();
+  if (!radioRouted || rate == 0)
+  {
+    return 0;
+  }
+  if ((radioResampler.inputRate() != rate || radioResampler.outputRate() != outputRate) &&
+      !radioResampler.begin(rate, outputRate))
+  {
+    return 0;
+  }
+  size_t produced = 0;
+  while (produced < frames)
+  {
+    const int16_t *span = NULL;
+    size_t samples = speakerRing.peek(&span, PLAYBACK_BLOCK_FRAMES * 2) & ~(size_t)1;
+    if (samples == 0)
     {
-        i2s_config.mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_RX);
-        i2s_config.sample_rate = AUDIO_QUALITY_MIC;
-        i2s_config.channel_format = I2S_CHANNEL_FMT_ONLY_LEFT;
+      break;
     }
-    else
+    size_t used = 0;
+    produced += radioResampler.renderStereo(span, samples / 2, 2, RENDER_GAIN_Q12, out + produced * 2,
+                                            frames - produced, &used);
+    speakerRing.release(used * 2);
+    if (used == 0)
     {
-        i2s_config.mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_TX);
-        i2s_config.sample_rate = AUDIO_QUALITY_SPEAKER;
-        i2s_config.channel_format = I2S_CHANNEL_FMT_RIGHT_LEFT;
-    }
-
-    // Install I2S driver for the specific port
-    err = i2s_driver_install(port, &i2s_config, 0, NULL);
-    if (err != ESP_OK) {
-        Serial.printf("Failed to install I2S driver: %s\n", esp_err_to_name(err));
-        return;
+      break;
     }
+  }
+  return produced;
+}
 
-    // Configure pins
-    i2s_pin_config_t pin_config;
-#if (ESP_IDF_VERSION > ESP_IDF_VERSION_VAL(4, 3, 0))
-    pin_config.mck_io_num = I2S_PIN_NO_CHANGE;
-#endif
+static void finishAsset()
+{
+  if (assetPlaying.cache)
+  {
+    assetPlaying.cache->release(assetPlaying.view);
+    assetPlaying.cache = NULL;
+  }
+}
 
-    if (mode == MODE_MIC) {
-        pin_config.bck_io_num = I2S_SCK;
-        pin_config.ws_io_num = I2S_WS;
-        pin_config.data_out_num = I2S_PIN_NO_CHANGE;
-        pin_config.data_in_num = I2S_SD;
-    } else {
-        pin_config.bck_io_num = I2S_SPEAKER_BCLK;
-        pin_config.ws_io_num = I2S_SPEAKER_LRC;
-        pin_config.data_out_num = I2S_SPEAKER_DIN;
-        pin_config.data_in_num = I2S_PIN_NO_CHANGE;
+// Cached prompt: read straight from the mapped flash, converted to the port's rate
+static size_t assetSource(void *context, int16_t *out, size_t frames)
+{
+  AssetRequest request;
+  while (assetRequests && xQueueReceive(assetRequests, &request, 0) == pdTRUE)
+  {
+    finishAsset();
+    assetPlaying = request;
+    assetPosition = 0;
+    if (assetPlaying.cache)
+    {
+      if (assetResampler.inputRate() == request.view.sampleRate && assetResampler.outputRate() == outputRate)
+      {
+        assetResampler.reset();
+      }
+      else if (!assetResampler.begin(request.view.sampleRate, outputRate))
+      {
+        finishAsset();
+      }
     }
+  }
+  if (!assetPlaying.cache)
+  {
+    return 0;
+  }
+  const AssetView &view = assetPlaying.view;
+  size_t used = 0;
+  size_t produced = assetResampler.renderStereo(view.samples + assetPosition * view.channels, view.frames - assetPosition,
+                                                view.channels, RENDER_GAIN_Q12, out, frames, &used);
+  assetPosition += used;
+  if (assetPosition >= view.frames || (produced == 0 && used == 0))
+  {
+    finishAsset();
+  }
+  return produced;
+}
 
-    err = i2s_set_pin(port, &pin_config);
-    if (err != ESP_OK) {
-        Serial.printf("Failed to set I2S pins: %s\n", esp_err_to_name(err));
-        i2s_driver_uninstall(port);
-        return;
-    }
+// Wakes the playback task so a new source starts on the next block
+static void kickPlayback()
+{
+  if (speakerTaskHandle)
+  {
+    xTaskNotifyGive(speakerTaskHandle);
+  }
+}
 
-    // Set clock
-    err = i2s_set_clk(port, 
-                      (mode == MODE_MIC) ? AUDIO_QUALITY_MIC : AUDIO_QUALITY_SPEAKER,
-                      I2S_BITS_PER_SAMPLE_16BIT,
-                      (mode == MODE_MIC) ? I2S_CHANNEL_MONO : I2S_CHANNEL_STEREO);
-    if (err != ESP_OK) {
-        Serial.printf("Failed to set I2S clock: %s\n", esp_err_to_name(err));
-        i2s_driver_uninstall(port);
-        return;
-    }
+// Everything after the render kernel runs at the port's rate
+static bool beginPlaybackChain(uint32_t rate)
+{
+  if (!playoutBuffer.begin(rate, 2, PLAYOUT_BUFFER_MS, PLAYOUT_MIN_TARGET_MS, PLAYOUT_MAX_TARGET_MS,
+                           PLAYOUT_MARGIN_MS))
+  {
+    return false;
+  }
+  playoutBuffer.setRateNudge(PLAYOUT_RATE_NUDGE_PERCENT);
 
-    // Start I2S
-    err = i2s_start(port);
-    if (err != ESP_OK) {
-        Serial.printf("Failed to start I2S: %s\n", esp_err_to_name(err));
-        i2s_driver_uninstall(port);
-        return;
-    }
+  LoudnessConfig levels;
+  levels.sampleRate = rate;
+  levels.channels = 2;
+  levels.windowMs = PLAYBACK_LOUDNESS_WINDOW_MS;
+  levels.targetRms = PLAYBACK_TARGET_RMS;
+  levels.gateRms = PLAYBACK_GATE_RMS;
+  levels.maxGainDb = PLAYBACK_MAX_GAIN_DB;
+  levels.minGainDb = PLAYBACK_MIN_GAIN_DB;
+  levels.attackMs = PLAYBACK_ATTACK_MS;
+  levels.releaseMs = PLAYBACK_RELEASE_MS;
+  levels.limitThreshold = PLAYBACK_LIMIT_THRESHOLD;
+  levels.lookaheadMs = PLAYBACK_LOOKAHEAD_MS;
+  levels.limiterReleaseMs = PLAYBACK_LIMITER_RELEASE_MS;
+  loudness.begin(levels);
+  return stretcher.begin(rate, 2) && scheduled.begin(rate) && earcons.begin(rate) && testTone.begin(rate) &&
+         mixer.begin(rate, PLAYBACK_BLOCK_FRAMES, MIXER_DUCK_DB, MIXER_DUCK_ATTACK_MS, MIXER_DUCK_RELEASE_MS);
+}
 
-    // Update state flags
-    if (mode == MODE_MIC) {
-        is_mic_installed = true;
-        digitalWrite(LED_MIC, HIGH);
-    } else {
-        is_speaker_installed = true;
-        digitalWrite(LED_SPKR, HIGH);
-    }
+#if AUDIO_HAL_I2S_STD
+// Starts the speaker channel; as with the legacy driver a new DMA geometry
+// means a new channel
+static esp_err_t installSpeakerDriver(uint32_t rate, const DmaGeometry &geometry)
+{
+  AudioPins pins = {I2S_SPEAKER_BCLK, I2S_SPEAKER_LRC, I2S_SPEAKER_DIN, -1};
+  esp_err_t err = speakerChannel.begin(AudioChannel::TX, I2S_PORT_SPEAKER, rate, 16, true, geometry, pins);
+  if (err != ESP_OK)
+  {
+    Serial.printf("Failed to start I2S channel: %s\n", esp_err_to_name(err));
+    return err;
+  }
+  speakerDma = geometry;
+  return ESP_OK;
+}
 
-    Serial.println("I2S initialized successfully");
+static void uninstallSpeakerDriver()
+{
+  speakerChannel.end();
 }
-esp_err_t setupSpeakerI2S()
+
+// Retimes the running port in place
+static esp_err_t retimeSpeaker(uint32_t rate)
+{
+  return speakerChannel.setRate(rate);
+}
+#else
+// Installs the speaker port with its event queue handed to the monitor.
+// The legacy driver only takes a DMA geometry here, not in i2s_set_clk.
+static esp_err_t installSpeakerDriver(uint32_t rate, const DmaGeometry &geometry)
 {
   i2s_config_t i2s_config = {
       .mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_TX),
-      .sample_rate = AUDIO_QUALITY_SPEAKER,
+      .sample_rate = (int)rate,
       .bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT,
       .channel_format = I2S_CHANNEL_FMT_RIGHT_LEFT,
       .communication_format = I2S_COMM_FORMAT_I2S,
       .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
-      .dma_buf_count = bufferCnt,
-      .dma_buf_len = bufferLen,
+      .dma_buf_count = geometry.count,
+      .dma_buf_len = geometry.frames,
       .use_apll = false,
       .tx_desc_auto_clear = true,
       .fixed_mclk = 0};
@@ -234,15 +375,8 @@ esp_err_t setupSpeakerI2S()
       .data_out_num = I2S_SPEAKER_DIN,
       .data_in_num = I2S_PIN_NO_CHANGE};
 
-  // Check if I2S port is valid
-  if (I2S_PORT_SPEAKER < I2S_NUM_0 || I2S_PORT_SPEAKER >= I2S_NUM_MAX)
-  {
-    Serial.println("Invalid I2S port");
-    return ESP_ERR_INVALID_ARG;
-  }
-
-  // Install I2S driver
-  esp_err_t i2s_err = i2s_driver_install(I2S_PORT_SPEAKER, &i2s_config, 0, NULL);
+  QueueHandle_t events = NULL;
+  esp_err_t i2s_err = i2s_driver_install(I2S_PORT_SPEAKER, &i2s_config, I2S_EVENT_QUEUE_LENGTH, &events);
   if (i2s_err != ESP_OK)
   {
     Serial.printf("Failed to install I2S driver: %s\n", esp_err_to_name(i2s_err));
@@ -257,8 +391,70 @@ esp_err_t setupSpeakerI2S()
     i2s_driver_uninstall(I2S_PORT_SPEAKER);
     return i2s_err;
   }
+  speakerDma = geometry;
+  speakerMonitor.attach(events);
+  return ESP_OK;
+}
+
+static void uninstallSpeakerDriver()
+{
+  speakerMonitor.detach();
+  i2s_driver_uninstall(I2S_PORT_SPEAKER);
+}
+
+static esp_err_t retimeSpeaker(uint32_t rate)
+{
+  return i2s_set_clk(I2S_PORT_SPEAKER, rate, I2S_BITS_PER_SAMPLE_16BIT, I2S_CHANNEL_STEREO);
+}
+#endif
+
+esp_err_t setupSpeakerI2S()
+{
+  // Check if I2S port is valid
+  if (I2S_PORT_SPEAKER < I2S_NUM_0 || I2S_PORT_SPEAKER >= I2S_NUM_MAX)
+  {
+    Serial.println("Invalid I2S port");
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  if (!speakerRing.begin(SPEAKER_RING_SAMPLES, AudioRing::DROP_OLDEST))
+  {
+    return ESP_ERR_NO_MEM;
+  }
+  playoutReady = beginPlaybackChain(AUDIO_QUALITY_SPEAKER);
+  loudness.setVolume(SPEAKER_VOLUME_PERCENT);
+  if (!playoutReady)
+  {
+    return ESP_ERR_NO_MEM;
+  }
+  if (mixer.sourceCount() == 0)
+  {
+    mixer.addSource("speech", speechSource, NULL, PRIORITY_SPEECH, 4096);
+    mixer.addSource("earcons", ToneSynth::fillSource, &earcons, PRIORITY_SPEECH, 4096);
+    mixer.addSource("test tone", ToneSynth::fillSource, &testTone, PRIORITY_TEST_TONE, 4096);
+    mixer.addSource("asset", assetSource, NULL, PRIORITY_SPEECH, SPEAKER_VOLUME_PERCENT * 4096 / 100);
+    radioSourceId = mixer.addSource("radio", radioSource, NULL, PRIORITY_RADIO, RADIO_GAIN_PERCENT * 4096 / 100);
+  }
+
+#if !AUDIO_HAL_I2S_STD
+  if (!speakerMonitor.begin("spk events", I2S_MONITOR_PRIORITY, PLAYBACK_TASK_CORE))
+  {
+    return ESP_ERR_NO_MEM;
+  }
+#endif
+  DmaGeometry geometry = dmaGeometry(speakerProfile, true, AUDIO_QUALITY_SPEAKER, SPEAKER_FRAME_BYTES);
+  uint32_t quietBlocks = (uint32_t)DMA_AUTOTUNE_QUIET_MS * AUDIO_QUALITY_SPEAKER / 1000 / geometry.frames;
+  dmaTuner.begin(geometry.count, 2, geometry.count * 4 > 64 ? 64 : geometry.count * 4, quietBlocks);
+
+  esp_err_t i2s_err = installSpeakerDriver(AUDIO_QUALITY_SPEAKER, geometry);
+  if (i2s_err != ESP_OK)
+  {
+    return i2s_err;
+  }
 
-  Serial.println("I2S initialized successfully");
+  Serial.printf("I2S initialized successfully, DMA %u x %u frames, %u ms (%s)\n", (unsigned)geometry.count,
+                (unsigned)geometry.frames, (unsigned)dmaLatencyMs(geometry, AUDIO_QUALITY_SPEAKER),
+                latencyProfileName(speakerProfile));
   return ESP_OK;
 }
 
@@ -312,112 +508,643 @@ esp_err_t setupSpeakerI2S()
 //   Serial.println("I2S speaker initialized successfully");
 // }
 
+// Both generators run an NCO on the sine table instead of sin() per sample
 void generateSimpleTone(int16_t *buffer, size_t samples)
 {
-  const float amplitude = MAX_AMPLITUDE * TONE_VOLUME_PERCENT;
-  const float angular_frequency = 2 * PI * TONE_FREQUENCY;
-  static float phase = 0;
+  const int32_t amplitude = (int32_t)(MAX_AMPLITUDE * TONE_VOLUME_PERCENT);
+  static uint32_t phase = 0;
+  uint32_t step = ncoStep(TONE_FREQUENCY, outputRate);
 
-  int16_t tempBuffer[samples];
   for (size_t i = 0; i < samples; i++)
   {
-    tempBuffer[i] = amplitude * sin(phase);
-    phase += angular_frequency / AUDIO_QUALITY_SPEAKER;
-    if (phase >= 2 * PI)
-    {
-      phase -= 2 * PI;
-    }
+    buffer[i] = (int16_t)((ncoSine(phase) * amplitude) >> 15);
+    phase += step;
   }
-
-  audioMemoryBuffer.write(tempBuffer, samples);
-  audioMemoryBuffer.read(buffer, samples);
 }
 void generateTone(int16_t *buffer, size_t samples)
 {
-  const float amplitude = MAX_AMPLITUDE * TONE_VOLUME_PERCENT;
-  static float time = 0;
-  static float phase = 0;
+  const int32_t amplitude = (int32_t)(MAX_AMPLITUDE * TONE_VOLUME_PERCENT);
+  static uint32_t phase = 0;
+  static uint32_t modPhase = 0;
 
   // Base frequency modulated by a slow sine wave
-  const float base_freq = 440.0f;  // Base frequency in Hz
-  const float mod_freq = 0.5f;     // Modulation frequency in Hz
-  const float freq_depth = 200.0f; // Frequency deviation in Hz
+  const uint32_t base_freq = 440;  // Base frequency in Hz
+  const uint32_t mod_freq_mhz = 500; // Modulation frequency, 0.5 Hz
+  const int32_t freq_depth = 200;  // Frequency deviation in Hz
 
-  int16_t tempBuffer[samples];
+  uint32_t rate = outputRate;
+  uint32_t baseStep = ncoStep(base_freq, rate);
+  int32_t depthStep = (int32_t)ncoStep(freq_depth, rate);
+  uint32_t modStep = (uint32_t)(((uint64_t)mod_freq_mhz << 32) / ((uint64_t)rate * 1000));
   for (size_t i = 0; i < samples; i++)
   {
-    // Calculate current frequency using sinusoidal modulation
-    float current_freq = base_freq + freq_depth * sin(2 * PI * mod_freq * time);
+    // Current frequency, as a phase step, follows the modulator
+    int32_t deviation = (int32_t)(((int64_t)depthStep * ncoSine(modPhase)) >> 15);
+    buffer[i] = (int16_t)((ncoSine(phase) * amplitude) >> 15);
+    phase += baseStep + deviation;
+    modPhase += modStep;
+  }
+}
+// Raw stereo payload at the port's rate, through the mixer like the rest
+void playBufferWithOffset(uint8_t *payload, size_t length)
+{
+  speaker_play((const int16_t *)payload, length / (2 * sizeof(int16_t)), outputRate, 2);
+}
+
+// Mono samples at the port's rate, through the mixer like the rest
+void playBuffer(int16_t *buffer, size_t samples)
+{
+  speaker_play(buffer, samples, outputRate, 1);
+}
+// Renders one downlink chunk into the playout buffer. Queued, not played:
+// the playback task owns the I2S port, so the WebSocket callback returns
+// straight away.
+void speaker_play(const int16_t *samples, size_t frames, uint32_t sampleRate, uint8_t channels)
+{
+  if (frames == 0 || channels < 1 || channels > 2)
+  {
+    return;
+  }
+  uint32_t rate = outputRate;
+  if ((renderResampler.inputRate() != sampleRate || renderResampler.outputRate() != rate) &&
+      !renderResampler.begin(sampleRate, rate, 0, PLAYBACK_DRIFT_TRIM))
+  {
+    Serial.printf("No playback resampler for %u Hz\n", (unsigned)sampleRate);
+    return;
+  }
+  // A scheduled stream is trimmed on the way out, against its timeline
+  int32_t trim = streamScheduled ? 0 : playbackTrimPpm;
+  if (renderResampler.trimPpm() != trim)
+  {
+    renderResampler.setTrimPpm(trim);
+  }
 
-    tempBuffer[i] = amplitude * sin(phase);
-    phase += (2 * PI * current_freq) / AUDIO_QUALITY_SPEAKER;
-    if (phase >= 2 * PI)
+  size_t outFrames = (size_t)((uint64_t)frames * rate / sampleRate);
+  playoutBuffer.arrival(outFrames * 2, millis());
+  while (frames > 0)
+  {
+    size_t used = 0;
+    size_t produced = renderResampler.renderStereo(samples, frames, channels, RENDER_GAIN_Q12, renderBlock,
+                                                   PLAYBACK_BLOCK_FRAMES, &used);
+    playoutBuffer.write(renderBlock, produced * 2);
+    samples += used * channels;
+    frames -= used;
+  }
+  kickPlayback();
+}
+
+// Times the render kernel on a 24 kHz mono sweep, the usual TTS stream
+void benchmarkPlaybackRender()
+{
+  static const uint32_t BENCH_RATE = 24000;
+  static const size_t BENCH_FRAMES = BENCH_RATE / 50; // 20 ms chunks
+  static int16_t input[BENCH_FRAMES];
+  for (size_t i = 0; i < BENCH_FRAMES; i++)
+  {
+    input[i] = (int16_t)(16000.0f * sinf(2.0f * PI * (200.0f + 10.0f * i) * i / BENCH_RATE));
+  }
+
+  Resampler bench;
+  if (!bench.begin(BENCH_RATE, outputRate))
+  {
+    Serial.println("Render benchmark: resampler setup failed");
+    return;
+  }
+  const int rounds = 500;
+  size_t outFrames = 0;
+  int64_t start = esp_timer_get_time();
+  for (int r = 0; r < rounds; r++)
+  {
+    const int16_t *in = input;
+    size_t left = BENCH_FRAMES;
+    while (left > 0)
     {
-      phase -= 2 * PI;
+      size_t used = 0;
+      outFrames += bench.renderStereo(in, left, 1, RENDER_GAIN_Q12, renderBlock, PLAYBACK_BLOCK_FRAMES, &used);
+      in += used;
+      left -= used;
     }
-
-    time += 1.0f / AUDIO_QUALITY_SPEAKER;
   }
+  int64_t elapsed = esp_timer_get_time() - start;
+  float audioUs = (float)rounds * BENCH_FRAMES * 1e6f / BENCH_RATE;
+  Serial.printf("Render benchmark: %u -> %u Hz, %.1f us per 20 ms chunk, %.0fx real time, %u frames out\n",
+                (unsigned)BENCH_RATE, (unsigned)outputRate, (float)elapsed / rounds, audioUs / elapsed,
+                (unsigned)outFrames);
+}
 
-  audioMemoryBuffer.write(tempBuffer, samples);
-  audioMemoryBuffer.read(buffer, samples); // Uncommented this line to properly output the sound
+// Server skew less the speaker's own error: positive when the server's
+// audio arrives faster than the port plays it
+static void updatePlaybackTrim()
+{
+  int32_t trim = (serverSkewKnown ? serverSkewPpm : 0) - (i2sErrorKnown ? i2sErrorPpm : 0);
+  playbackTrimPpm = trim < -PLAYBACK_TRIM_MAX_PPM ? -PLAYBACK_TRIM_MAX_PPM
+                                                   : (trim > PLAYBACK_TRIM_MAX_PPM ? PLAYBACK_TRIM_MAX_PPM : trim);
 }
-void playBufferWithOffset(uint8_t *payload, size_t length)
+
+// Runs on the playback task. Frames completed over esp_timer time since
+// the anchor; the longer the span, the less the completion jitter counts.
+static void measureSpeakerClock(int64_t nowUs)
 {
-  memcpy(speakerdata0 + speaker_offset, payload, length);
-  speaker_offset += length;
-  size_t bytes_written;
-  i2s_write(I2S_PORT_SPEAKER, speakerdata0, speaker_offset, &bytes_written, portMAX_DELAY);
-  speaker_offset = 0;
+  if (nowUs - rateCheckedUs < 1000000 && !rateAnchorStale)
+  {
+    return;
+  }
+  rateCheckedUs = nowUs;
+  I2sHealthStats health = speakerHealth.stats();
+  if (health.lastCompletionUs == 0)
+  {
+    return;
+  }
+  if (rateAnchorStale)
+  {
+    rateAnchorStale = false;
+    rateAnchorBlocks = health.blocks;
+    rateAnchorUs = health.lastCompletionUs;
+    return;
+  }
+  int64_t spanUs = health.lastCompletionUs - rateAnchorUs;
+  if (spanUs < (int64_t)I2S_RATE_MIN_SPAN_MS * 1000)
+  {
+    return;
+  }
+  double frames = (double)(health.blocks - rateAnchorBlocks) * speakerDma.frames;
+  int32_t ppm = (int32_t)lround((frames * 1e6 / spanUs / outputRate - 1.0) * 1e6);
+  if (ppm < -PLAYBACK_TRIM_MAX_PPM || ppm > PLAYBACK_TRIM_MAX_PPM)
+  {
+    // Lost completions or a stall, not a clock: start over
+    rateAnchorStale = true;
+    return;
+  }
+  i2sErrorPpm = ppm;
+  i2sErrorKnown = true;
+  updatePlaybackTrim();
 }
 
-void playBuffer(int16_t *buffer, size_t samples)
+// The profile's geometry at this rate, with the tuner's count when it runs
+static DmaGeometry wantedSpeakerDma(uint32_t rate)
 {
-  size_t bytes_written = 0;
-  esp_err_t result = i2s_write(I2S_PORT_SPEAKER, buffer, samples * sizeof(int16_t), &bytes_written, portMAX_DELAY);
-  // sendBinaryData(buffer, samples * sizeof(int16_t));
+  DmaGeometry geometry = dmaGeometry(speakerProfile, true, rate, SPEAKER_FRAME_BYTES);
+  if (dmaAutoTune)
+  {
+    geometry.count = dmaTuner.count();
+  }
+  return geometry;
+}
 
-  if (result != ESP_OK)
+static void requestSpeakerDma(const DmaGeometry &geometry)
+{
+  if (geometry.count != speakerDma.count || geometry.frames != speakerDma.frames)
   {
-    Serial.println("Error writing to I2S");
+    pendingDma = ((uint32_t)geometry.count << 16) | geometry.frames;
+    kickPlayback();
   }
 }
-void speaker_play(uint8_t *payload, uint32_t len)
+
+// Runs on the playback task with nothing queued. Reinstalling the port
+// takes a few milliseconds of silence, which nobody hears between
+// responses; on failure the old geometry is put back.
+static esp_err_t applySpeakerDma(const DmaGeometry &geometry)
+{
+  DmaGeometry previous = speakerDma;
+  uninstallSpeakerDriver();
+  esp_err_t err = installSpeakerDriver(outputRate, geometry);
+  if (err != ESP_OK)
+  {
+    // Retrying at every pause would not fare better; stay where it worked
+    installSpeakerDriver(outputRate, previous);
+    dmaAutoTune = false;
+    return err;
+  }
+  rateAnchorStale = true;
+  Serial.printf("Speaker DMA %u x %u -> %u x %u frames, %u ms\n", (unsigned)previous.count, (unsigned)previous.frames,
+                (unsigned)geometry.count, (unsigned)geometry.frames, (unsigned)dmaLatencyMs(geometry, outputRate));
+  return ESP_OK;
+}
+
+// Runs on the playback task with nothing queued. Retiming the running port
+// takes milliseconds; on failure the old clock
+// and chain come back and the kernel converts instead.
+static esp_err_t applyOutputRate(uint32_t rate)
 {
-  const float volume = 0.7f;
-  const float pitch = 0.8f; // 1.0 = normal speed, >1 = faster, <1 = slower
-  Serial.printf("received %lu bytes", len);
-  Serial.println();
-  size_t bytes_written;
+  uint32_t previous = outputRate;
+  int64_t start = esp_timer_get_time();
+  esp_err_t err = retimeSpeaker(rate);
+  if (err == ESP_OK && !beginPlaybackChain(rate))
+  {
+    err = ESP_ERR_NO_MEM;
+  }
+  if (err != ESP_OK)
+  {
+    Serial.printf("Speaker reclock to %u Hz failed: %s\n", (unsigned)rate, esp_err_to_name(err));
+    retimeSpeaker(previous);
+    beginPlaybackChain(previous);
+    rateAnchorStale = true;
+    return err;
+  }
+  outputRate = rate;
+  // The divider rounds differently at another rate
+  i2sErrorKnown = false;
+  rateAnchorStale = true;
+  updatePlaybackTrim();
+  setEchoReferenceRate(rate);
+  // Descriptors hold frames, so keep the profile's milliseconds
+  requestSpeakerDma(wantedSpeakerDma(rate));
+  Serial.printf("Speaker reclocked %u -> %u Hz in %u us\n", (unsigned)previous, (unsigned)rate,
+                (unsigned)(esp_timer_get_time() - start));
+  return ESP_OK;
+}
 
-  // Create a buffer to store modified samples
-  int16_t *samples = (int16_t *)payload;
-  size_t num_samples = len / sizeof(int16_t);
+#if AUDIO_HAL_I2S_STD
+static AudioBlock txBlock; // DMA buffer being filled
+static size_t txFill = 0;  // frames of it mixed so far
+static bool txHeld = false;
 
-  // Calculate new buffer size based on pitch
-  size_t new_num_samples = (size_t)(num_samples / pitch);
-  int16_t *pitched_samples = new int16_t[new_num_samples];
+// Mixes straight into the next DMA buffer, waiting for one to play out if
+// all are full. A buffer is kept across calls until it is full, so a
+// source that runs dry for a moment continues where it left off, unless
+// the DMA got there first. Moves dryAtUs to when the frames play out.
+static size_t mixIntoDma(int64_t *dryAtUs)
+{
+  if (txHeld && !speakerChannel.inTime(txBlock))
+  {
+    txHeld = false;
+  }
+  if (!txHeld)
+  {
+    if (!speakerChannel.acquire(&txBlock, pdMS_TO_TICKS(PLAYBACK_GUARD_MS)))
+    {
+      return 0;
+    }
+    txHeld = true;
+    txFill = 0;
+  }
+  size_t room = txBlock.frames - txFill;
+  int16_t *target = (int16_t *)txBlock.data + txFill * 2;
+  mixPlayAtUs = txBlock.timeUs + (int64_t)txFill * 1000000 / outputRate;
+  size_t frames = mixer.mix(target, room < PLAYBACK_BLOCK_FRAMES ? room : PLAYBACK_BLOCK_FRAMES);
+  if (frames == 0)
+  {
+    return 0;
+  }
+  speakerChannel.release(txBlock);
+  pushEchoReference(target, frames, 2);
+  txFill += frames;
+  *dryAtUs = txBlock.timeUs + (int64_t)txFill * 1000000 / outputRate;
+  if (txFill == txBlock.frames)
+  {
+    txHeld = false;
+  }
+  return frames;
+}
+#endif
 
-  // Resample audio for pitch/speed adjustment
-  for (size_t i = 0; i < new_num_samples; i++)
+// Runs on the playback task, which owns the scheduler and the reading side
+// of the playout buffer
+static void applyScheduleRequests()
+{
+  ClockAnchor anchor;
+  if (clockAnchors && xQueueReceive(clockAnchors, &anchor, 0) == pdTRUE)
+  {
+    scheduled.setAnchor(anchor.localUs, anchor.serverUs);
+  }
+  int64_t ptsUs = 0;
+  if (!scheduleRequests || xQueueReceive(scheduleRequests, &ptsUs, 0) != pdTRUE)
+  {
+    return;
+  }
+  if (ptsUs)
   {
-    float original_index = i * pitch;
-    size_t index = (size_t)original_index;
-    if (index < num_samples)
+    // Leftovers of the last response would shift the new timeline
+    while (playoutBuffer.discard(PLAYBACK_BLOCK_FRAMES * 2) > 0)
     {
-      pitched_samples[i] = (int16_t)(samples[index] * volume);
     }
+    stretcher.reset();
+    scheduled.start(ptsUs);
+  }
+  else
+  {
+    scheduled.stop();
+  }
+  xSemaphoreGive(scheduleDone);
+}
+
+// Plays the mix of all sources to I2S, paced by the blocking write or, on
+// the channel driver, by waiting for a free DMA buffer. dryAtUs is when
+// the DMA queue will have played out everything written so far; the
+// buffer only conceals a gap once that is close.
+static void speakerTask(void *parameter)
+{
+  int64_t dryAtUs = esp_timer_get_time();
+  while (true)
+  {
+    if (stretchReset)
+    {
+      stretchReset = false;
+      stretcher.reset();
+      loudness.reset();
+    }
+    applyScheduleRequests();
+    int64_t nowUs = esp_timer_get_time();
+    uint32_t requested = pendingRate;
+    uint32_t dma = pendingDma;
+    if (requested || dma)
+    {
+      // Only between responses, once the DMA queue has played out
+      bool idle = !playoutBuffer.playing() && playoutBuffer.stats().depthMs == 0 && !earcons.active() &&
+                  !testTone.active() && !scheduled.active() && !assetPlaying.cache && uxQueueMessagesWaiting(assetRequests) == 0 &&
+                  nowUs >= dryAtUs;
+      if (requested)
+      {
+        pendingRate = 0;
+        reclockResult = idle ? applyOutputRate(requested) : ESP_ERR_INVALID_STATE;
+        xSemaphoreGive(reclockDone);
+      }
+      // A new geometry waits for the next pause instead of failing
+      dma = pendingDma;
+      if (dma && idle)
+      {
+        pendingDma = 0;
+        DmaGeometry geometry = {(uint8_t)(dma >> 16), (uint16_t)(dma & 0xFFFF)};
+        applySpeakerDma(geometry);
+      }
+      nowUs = esp_timer_get_time();
+    }
+    measureSpeakerClock(nowUs);
+    if (dryAtUs < nowUs)
+    {
+      dryAtUs = nowUs;
+    }
+    int32_t queuedMs = (int32_t)((dryAtUs - nowUs) / 1000);
+    // A short DMA ring is never that full, so the guard shrinks with it
+    int32_t guardMs = (int32_t)dmaLatencyMs(speakerDma, outputRate) / 2;
+    speechMustFill = queuedMs <= (guardMs < PLAYBACK_GUARD_MS ? guardMs : PLAYBACK_GUARD_MS);
+
+#if AUDIO_HAL_I2S_STD
+    size_t frames = mixIntoDma(&dryAtUs);
+#else
+    // The legacy driver gives no block times; the queue estimate stands in
+    mixPlayAtUs = dryAtUs;
+    size_t frames = mixer.mix(playbackBlock, PLAYBACK_BLOCK_FRAMES);
+#endif
+    speakerHealth.setActive(frames > 0);
+    if (dmaAutoTune && !pendingDma)
+    {
+      I2sHealthStats health = speakerHealth.stats();
+      uint8_t count = dmaTuner.update(health.activeBlocks, health.underruns);
+      if (count != speakerDma.count)
+      {
+        Serial.printf("DMA tuner: %u -> %u descriptors (floor %u)\n", (unsigned)speakerDma.count, (unsigned)count,
+                      (unsigned)dmaTuner.floor());
+        requestSpeakerDma(wantedSpeakerDma(outputRate));
+      }
+    }
+    if (frames == 0)
+    {
+      // Nothing due: sleep until a source is kicked or the DMA queue runs
+      // low. The radio, which is not kicked, is polled every 20 ms.
+      uint32_t waitMs = queuedMs > PLAYBACK_GUARD_MS ? queuedMs - PLAYBACK_GUARD_MS : 20;
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(waitMs < 20 ? waitMs : 20));
+      continue;
+    }
+
+#if !AUDIO_HAL_I2S_STD
+    // The port is stereo: each pair of samples is one frame on the wire
+    pushEchoReference(playbackBlock, frames, 2);
+    size_t bytes_written = 0;
+    if (i2s_write(I2S_PORT_SPEAKER, playbackBlock, frames * 2 * sizeof(int16_t), &bytes_written, portMAX_DELAY) != ESP_OK)
+    {
+      Serial.println("Error writing to I2S speaker");
+    }
+    nowUs = esp_timer_get_time();
+    dryAtUs = (dryAtUs > nowUs ? dryAtUs : nowUs) + (int64_t)frames * 1000000 / outputRate;
+#endif
+    lastSpkrActivity = millis();
+  }
+}
+
+// Pitch-preserving playback speed, percent of real time
+void setSpeechRate(uint16_t percent)
+{
+  speechRate = percent < 75 ? 75 : (percent > 150 ? 150 : percent);
+}
+
+uint16_t getSpeechRate()
+{
+  return speechRate;
+}
+
+void setPlaybackLoudnessEnabled(bool enabled)
+{
+  loudnessEnabled = enabled;
+}
+
+LoudnessStats getLoudnessStats()
+{
+  return loudness.stats();
+}
+
+// Switches the speaker port to the stream's rate so the kernel can pass it
+// straight through. Called from the producer side (the WebSocket callback)
+// so nothing is rendered while the chain is rebuilt. ESP_ERR_INVALID_STATE
+// means audio is still playing; it is then resampled as before.
+esp_err_t setSpeakerSampleRate(uint32_t rate)
+{
+  if (rate == outputRate)
+  {
+    return ESP_OK;
+  }
+  if (rate < AUDIO_QUALITY_SPEAKER || rate > SPEAKER_MAX_RATE)
+  {
+    return ESP_ERR_NOT_SUPPORTED;
+  }
+  if (!reclockDone)
+  {
+    return ESP_ERR_INVALID_STATE;
+  }
+  xSemaphoreTake(reclockDone, 0);
+  pendingRate = rate;
+  kickPlayback();
+  if (xSemaphoreTake(reclockDone, pdMS_TO_TICKS(SPEAKER_RECLOCK_WAIT_MS)) != pdTRUE)
+  {
+    pendingRate = 0;
+    return ESP_ERR_TIMEOUT;
+  }
+  return reclockResult;
+}
+
+uint32_t getSpeakerSampleRate()
+{
+  return outputRate;
+}
+
+// Takes effect at the next pause in playback. With auto-tuning the profile
+// only sets the descriptor length; the tuner picks how many.
+void setSpeakerLatencyProfile(LatencyProfile profile, bool autoTune)
+{
+  speakerProfile = profile;
+  DmaGeometry geometry = dmaGeometry(profile, true, outputRate, SPEAKER_FRAME_BYTES);
+  if (autoTune && !dmaAutoTune)
+  {
+    uint32_t quietBlocks = (uint32_t)DMA_AUTOTUNE_QUIET_MS * outputRate / 1000 / geometry.frames;
+    dmaTuner.begin(geometry.count, 2, geometry.count * 4 > 64 ? 64 : geometry.count * 4, quietBlocks);
+  }
+  dmaAutoTune = autoTune;
+  requestSpeakerDma(wantedSpeakerDma(outputRate));
+}
+
+I2sHealthStats getSpeakerHealth()
+{
+  return speakerHealth.stats();
+}
+
+// From the downlink's clock sync; known is false until it has a fit
+void setPlaybackClockSkew(int32_t ppm, bool known)
+{
+  serverSkewPpm = ppm;
+  serverSkewKnown = known;
+  updatePlaybackTrim();
+}
+
+// A pair of readings of our clock and the server's, taken together
+void setPlaybackClockAnchor(int64_t localUs, int64_t serverUs)
+{
+  if (clockAnchors)
+  {
+    ClockAnchor anchor = {localUs, serverUs};
+    xQueueOverwrite(clockAnchors, &anchor);
   }
+}
+
+ScheduleStats getScheduleStats()
+{
+  return scheduled.stats();
+}
+
+PlaybackClockStats getPlaybackClockStats()
+{
+  PlaybackClockStats stats;
+  stats.serverSkewKnown = serverSkewKnown;
+  stats.serverSkewPpm = serverSkewPpm;
+  stats.i2sErrorKnown = i2sErrorKnown;
+  stats.i2sErrorPpm = i2sErrorPpm;
+  stats.trimPpm = playbackTrimPpm;
+  stats.trimEnabled = PLAYBACK_DRIFT_TRIM;
+  return stats;
+}
 
-  // InitI2SSpeakerOrMic(MODE_SPK);
-  i2s_write(I2S_PORT_SPEAKER, pitched_samples, new_num_samples * sizeof(int16_t),
-            &bytes_written, portMAX_DELAY);
+// Pauses the speaker port while the mic has the bus
+void setSpeakerPortRunning(bool running)
+{
+  rateAnchorStale = true;
+#if AUDIO_HAL_I2S_STD
+  speakerChannel.setRunning(running);
+#else
+  if (running)
+  {
+    i2s_start(I2S_PORT_SPEAKER);
+  }
+  else
+  {
+    i2s_stop(I2S_PORT_SPEAKER);
+  }
+#endif
+}
 
-  delete[] pitched_samples;
+esp_err_t startSpeakerTask()
+{
+  if (!playoutReady)
+  {
+    return ESP_ERR_INVALID_STATE;
+  }
+  reclockDone = xSemaphoreCreateBinary();
+  assetRequests = xQueueCreate(2, sizeof(AssetRequest));
+  scheduleDone = xSemaphoreCreateBinary();
+  scheduleRequests = xQueueCreate(1, sizeof(int64_t));
+  clockAnchors = xQueueCreate(1, sizeof(ClockAnchor));
+  if (!reclockDone || !assetRequests || !scheduleDone || !scheduleRequests || !clockAnchors)
+  {
+    return ESP_ERR_NO_MEM;
+  }
+  if (xTaskCreatePinnedToCore(speakerTask, "speaker", 4096, NULL, PLAYBACK_TASK_PRIORITY, &speakerTaskHandle,
+                              PLAYBACK_TASK_CORE) != pdPASS)
+  {
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+}
 
-  // After playback completes, switch back to mic mode
-  // InitI2SSpeakerOrMic(MODE_MIC);
-  Serial.println("Playback complete, switched back to mic mode");
+// Hands the playback task a start (ptsUs) or a stop (0) and waits for it
+static bool requestSchedule(int64_t ptsUs)
+{
+  if (!scheduleRequests)
+  {
+    return false;
+  }
+  xSemaphoreTake(scheduleDone, 0);
+  xQueueOverwrite(scheduleRequests, &ptsUs);
+  kickPlayback();
+  return xSemaphoreTake(scheduleDone, pdMS_TO_TICKS(SPEAKER_RECLOCK_WAIT_MS)) == pdTRUE;
+}
+
+// ptsUs is the server time the stream's first frame is due, 0 to play it
+// on arrival
+void speakerStreamStart(int64_t ptsUs)
+{
+  renderResampler.reset();
+  playoutBuffer.startStream();
+  if ((ptsUs || streamScheduled) && !requestSchedule(ptsUs))
+  {
+    // Still queued: applied within a block, at worst clipping the start
+    Serial.println("Playback schedule request timed out");
+  }
+  streamScheduled = ptsUs != 0;
+}
+
+// The server is done: play out the tail without waiting for the target
+void speakerStreamEnd()
+{
+  playoutBuffer.endStream();
+  kickPlayback();
+  logPlayoutStats();
+  playoutBuffer.resetPeaks();
+  loudness.clearPeaks();
+}
+
+JitterStats getPlayoutStats()
+{
+  return playoutBuffer.stats();
+}
+
+void logPlayoutStats()
+{
+  JitterStats stats = playoutBuffer.stats();
+  Serial.printf("Playout: depth %u ms (peak %u), target %u ms, jitter %u ms, underruns %u, late chunks %u, concealed %u, overflow %u\n",
+                (unsigned)stats.depthMs, (unsigned)stats.peakDepthMs, (unsigned)stats.targetMs, (unsigned)stats.jitterMs,
+                (unsigned)stats.underruns, (unsigned)stats.lateChunks, (unsigned)stats.concealedSamples,
+                (unsigned)stats.overflowSamples);
+  I2sHealthStats health = speakerHealth.stats();
+  Serial.printf("Speaker DMA: %u x %u frames (%u ms, %s%s), underruns %u, max gap %u us, errors %u\n",
+                (unsigned)speakerDma.count, (unsigned)speakerDma.frames,
+                (unsigned)dmaLatencyMs(speakerDma, outputRate), latencyProfileName(speakerProfile),
+                dmaAutoTune ? ", tuned" : "", (unsigned)health.underruns, (unsigned)health.maxIntervalUs,
+                (unsigned)health.dmaErrors);
+  speakerHealth.resetPeaks();
+  if (streamScheduled)
+  {
+    ScheduleStats schedule = scheduled.stats();
+    Serial.printf("Scheduled: error %+d us, trim %+d ppm, resyncs %u, skipped %u ms, silence %u ms\n",
+                  (int)schedule.errorUs, (int)schedule.trimPpm, (unsigned)schedule.resyncs,
+                  (unsigned)((uint64_t)schedule.droppedFrames * 1000 / outputRate),
+                  (unsigned)((uint64_t)schedule.silentFrames * 1000 / outputRate));
+  }
+  PlaybackClockStats clock = getPlaybackClockStats();
+  Serial.printf("Playback clock: server %+d ppm%s, speaker %+d ppm%s, trim %+d ppm%s\n", (int)clock.serverSkewPpm,
+                clock.serverSkewKnown ? "" : " (not yet)", (int)clock.i2sErrorPpm, clock.i2sErrorKnown ? "" : " (not yet)",
+                (int)clock.trimPpm, clock.trimEnabled ? "" : " (off)");
+  LoudnessStats levels = loudness.stats();
+  Serial.printf("Playback level: %.1f dBFS, gain %.1f dB, limiter peak reduction %.1f dB (%u samples)\n",
+                levels.levelDb10 / 10.0f, levels.gainDb10 / 10.0f, levels.peakReductionDb10 / 10.0f,
+                (unsigned)levels.limitedSamples);
 }
 
 void updateToneState()
@@ -438,12 +1165,27 @@ void updateToneState()
     digitalWrite(LED_SPKR, LOW);
   }
 }
+// The Audio library hands every decoded sample here before its own I2S
+// write; taking it routes the radio through the mixer, ducked under speech
+void audio_process_i2s(uint32_t *sample, bool *continueI2S)
+{
+  if (!radioRouted)
+  {
+    *continueI2S = true;
+    return;
+  }
+  int16_t frame[2] = {(int16_t)(*sample >> 16), (int16_t)(*sample & 0xFFFF)};
+  speakerRing.write(frame, 2);
+  *continueI2S = false;
+}
+
 void setupAudio()
 {
   // setupSpeakerI2S();  // Call this first
   delay(100);
 
-  audio.setPinout(I2S_SPEAKER_BCLK, I2S_SPEAKER_LRC, I2S_SPEAKER_DIN);
+  // Its output goes through the mixer, so it needs no pins of its own
+  radioRouted = true;
   audio.setVolume(2);
   // audio.
   audio.connecttohost("http://vis.media-ice.musicradio.com/CapitalMP3");
@@ -469,30 +1211,86 @@ void setVolume(int volume)
 
 void playTestTone()
 {
-  static int16_t tone_buffer[SAMPLES_PER_WRITE];
+  static const ToneStep TEST_TONE_STEPS[] = {{TONE_FREQUENCY, TONE_DURATION}};
+  bool wasPlaying = isPlayingTone;
 
   updateToneState();
 
-  if (isPlayingTone)
+  if (isPlayingTone && !wasPlaying)
   {
-    generateTone(tone_buffer, SAMPLES_PER_WRITE);
-    playBuffer(tone_buffer, SAMPLES_PER_WRITE);
-
-    // delayMicroseconds(100);
+    testTone.play(TEST_TONE_STEPS, 1, (uint8_t)(TONE_VOLUME_PERCENT * 100));
+    kickPlayback();
   }
 }
 
 void handleSpeaker()
 {
-  static int16_t audio_buffer[SAMPLES_PER_WRITE];
+  playTestTone();
+}
 
-  if (audioMemoryBuffer.available() > 0 && audioMemoryBuffer.read(audio_buffer, SAMPLES_PER_WRITE))
+// Start/stop beeps, mixed over whatever plays; they reach the speaker
+// within one playback block
+void playEarcon(Earcon earcon)
+{
+  if (!EARCONS_ENABLED)
   {
-    // playBuffer(audio_buffer, SAMPLES_PER_WRITE);
+    return;
   }
-  else
+  switch (earcon)
   {
-    playTestTone();
+  case EARCON_START:
+    earcons.play(EARCON_START_STEPS, 3, EARCON_LEVEL_PERCENT);
+    break;
+  case EARCON_STOP:
+    earcons.play(EARCON_STOP_STEPS, 3, EARCON_LEVEL_PERCENT);
+    break;
+  case EARCON_ERROR:
+    earcons.play(EARCON_ERROR_STEPS, 3, EARCON_LEVEL_PERCENT);
+    break;
   }
-  // delay(10);
+  kickPlayback();
+}
+
+// Plays a mapped asset in place of any other; the view is released back to
+// its cache by the playback task when it ends or is cut
+bool speaker_playAsset(AssetCache &cache, const AssetView &view)
+{
+  AssetRequest request = {&cache, view};
+  if (!assetRequests || xQueueSend(assetRequests, &request, 0) != pdTRUE)
+  {
+    return false;
+  }
+  kickPlayback();
+  return true;
+}
+
+void setRadioGain(uint8_t percent)
+{
+  mixer.setGain(radioSourceId, (uint16_t)percent * 4096 / 100);
+}
+
+// Cuts playback short: drops what is queued for playout and in the DMA
+// buffers, and tells the echo canceller it will not be heard
+void speaker_stop()
+{
+  AssetRequest stop = {};
+  if (assetRequests)
+  {
+    xQueueSend(assetRequests, &stop, 0);
+  }
+  playoutBuffer.flush();
+  stretchReset = true;
+  if (scheduleRequests)
+  {
+    int64_t none = 0;
+    xQueueOverwrite(scheduleRequests, &none);
+    streamScheduled = false;
+  }
+#if AUDIO_HAL_I2S_STD
+  speakerChannel.silence();
+#else
+  i2s_zero_dma_buffer(I2S_PORT_SPEAKER);
+#endif
+  cancelEchoReference();
+  lastSpkrActivity = millis();
 }
@@ -3,13 +3,29 @@
 
 #include <Audio.h>
 #include <Arduino.h>
+#include "jitterBuffer.h"
+#include "loudness.h"
+#include "assetCache.h"
+#include "i2sHealth.h"
+#include "scheduledPlayout.h"
 // #include "audioBuffer.h"
-enum AudioMode {
-  MODE_MIC,
-  MODE_SPK
+// Playback drift: the server's clock and the speaker's against esp_timer,
+// and the trim on the render resampler that makes up the difference
+struct PlaybackClockStats {
+  bool serverSkewKnown;
+  bool i2sErrorKnown;
+  bool trimEnabled;
+  int32_t serverSkewPpm; // server clock rate over ours, minus one
+  int32_t i2sErrorPpm;   // frames played over the nominal rate, minus one
+  int32_t trimPpm;       // faster consumption of the stream
+};
+enum Earcon {
+  EARCON_START,
+  EARCON_STOP,
+  EARCON_ERROR
 };
-void InitI2SSpeakerOrMic(AudioMode mode);
 esp_err_t setupSpeakerI2S();
+void setSpeakerPortRunning(bool running);
 void loopAudio();
 void setupAudio();
 void generateTone(int16_t *buffer, size_t samples);
@@ -17,7 +33,29 @@ void writeToAudioBuffer(int16_t *buffer, size_t samples);
 void playBuffer(int16_t *buffer, size_t samples);
 void handleSpeaker();
 void playBufferWithOffset(uint8_t *payload, size_t length);
-void speaker_play(uint8_t *payload, uint32_t len);
+void speaker_play(const int16_t *samples, size_t frames, uint32_t sampleRate, uint8_t channels);
+void speaker_stop();
+esp_err_t startSpeakerTask();
+void speakerStreamStart(int64_t ptsUs = 0);
+void speakerStreamEnd();
+JitterStats getPlayoutStats();
+void logPlayoutStats();
+void benchmarkPlaybackRender();
+void setSpeechRate(uint16_t percent);
+uint16_t getSpeechRate();
+void setPlaybackLoudnessEnabled(bool enabled);
+LoudnessStats getLoudnessStats();
+esp_err_t setSpeakerSampleRate(uint32_t rate);
+uint32_t getSpeakerSampleRate();
+void setSpeakerLatencyProfile(LatencyProfile profile, bool autoTune);
+I2sHealthStats getSpeakerHealth();
+void setPlaybackClockSkew(int32_t ppm, bool known);
+PlaybackClockStats getPlaybackClockStats();
+void setPlaybackClockAnchor(int64_t localUs, int64_t serverUs);
+ScheduleStats getScheduleStats();
+void playEarcon(Earcon earcon);
+void setRadioGain(uint8_t percent);
+bool speaker_playAsset(AssetCache &cache, const AssetView &view);
 
 extern unsigned long lastMicActivity;
 extern unsigned long lastSpkrActivity; 
@@ -1,20 +1,60 @@
 #include <Arduino.h>
 #include <ArduinoWebsockets.h>
+#include "lib_websocket.h"
 #include "lib_speaker.h"
+#include "mic.h"
+#include "downlink.h"
 #include "config.h"
 
 using namespace websockets;
 
 WebsocketsClient client;
 
+// The client is polled from loop() and written from the mic sender task.
+// The lock covers the socket I/O only: what a message sets off (decoding,
+// jitter buffer writes, a speaker reclock) runs without it, so the sender
+// never waits behind it.
+static SemaphoreHandle_t wsMutex = NULL;
+
+class WsLock
+{
+public:
+    WsLock() { xSemaphoreTakeRecursive(wsMutex, portMAX_DELAY); }
+    ~WsLock() { xSemaphoreGiveRecursive(wsMutex); }
+};
+
+// Hands back the lock poll() holds while a message callback runs. A task
+// that does not hold it gives nothing and takes nothing back.
+class WsUnlock
+{
+public:
+    WsUnlock() : released(xSemaphoreGiveRecursive(wsMutex) == pdTRUE) {}
+    ~WsUnlock()
+    {
+        if (released)
+        {
+            xSemaphoreTakeRecursive(wsMutex, portMAX_DELAY);
+        }
+    }
+
+private:
+    bool released;
+};
+
 void onMessageCallback(WebsocketsMessage message)
 {
+    // The message is a copy; poll() reads nothing more until this returns
+    WsUnlock unlock;
     Serial.print("Got Message: ");
     // Serial.println(message.data());
 
     if (!message.isBinary())
     {
-        Serial.println("Received non-binary message: " + message.data());
+        String data = message.data();
+        if (!handleDownlinkControl(data.c_str(), data.length()))
+        {
+            Serial.println("Received non-binary message: " + data);
+        }
         // isSpeakerBusy = false;
         return;
     }
@@ -29,10 +69,9 @@ void onMessageCallback(WebsocketsMessage message)
     }
 
     Serial.printf("Received binary audio data of length: %zu bytes\n", length);
-    speaker_play(payload, length);
+    handleDownlinkAudio(payload, length);
     // playBufferWithOffset(payload, length);
     // playBuffer((int16_t*)payload, length);
-    delay(10);
     // InitI2SSpeakerOrMic(MODE_MIC);
 }
 
@@ -58,44 +97,57 @@ void onEventsCallback(WebsocketsEvent event, String data)
 
 void connectToWebSocket()
 {
-    // Configure WebSocket callbacks
-    client.onMessage(onMessageCallback);
-    client.onEvent(onEventsCallback);
+    if (!wsMutex)
+    {
+        wsMutex = xSemaphoreCreateRecursiveMutex();
+    }
 
     const char *websockets_server_host = WEBSOCKET_HOST;
     const uint16_t websockets_server_port = WEBSOCKET_PORT;
 
-    // Try to connect to WebSocket server
-    bool connected = false;
-    while (!connected)
+    // Try to connect to WebSocket server. Unlocked between attempts, so the
+    // sender sees the socket down and drops rather than waiting.
+    while (true)
     {
-        if (client.connect(websockets_server_host, websockets_server_port, "/device"))
         {
-            connected = true;
-            Serial.println("WebSocket Connected!");
-            client.send("Hello Server");
-            client.ping();
-        }
-        else
-        {
-            Serial.println("WebSocket Connection Failed! Retrying in 2 seconds...");
-            delay(2000);
+            WsLock lock;
+            // Configure WebSocket callbacks
+            client.onMessage(onMessageCallback);
+            client.onEvent(onEventsCallback);
+            if (client.connect(websockets_server_host, websockets_server_port, "/device"))
+            {
+                Serial.println("WebSocket Connected!");
+                sendHello();
+                restartClockSync();
+                client.ping();
+                return;
+            }
         }
+        Serial.println("WebSocket Connection Failed! Retrying in 2 seconds...");
+        delay(2000);
     }
 }
 
+bool webSocketAvailable()
+{
+    WsLock lock;
+    return client.available();
+}
+
 void checkWebSocketConnection()
 {
-    if (!client.available())
+    if (!webSocketAvailable())
     {
         Serial.println("WebSocket connection lost. Reconnecting...");
         connectToWebSocket();
     }
+    WsLock lock;
     client.poll();
 }
 
 void sendMessage(const char *message)
 {
+    WsLock lock;
     if (client.available())
     {
         client.send(message);
@@ -106,8 +158,24 @@ void sendMessage(const char *message)
     }
 }
 
+// Capabilities and the current uplink format, so the server knows how to
+// decode what follows. Sent on connect and whenever the uplink codec changes.
+void sendHello()
+{
+    char hello[384];
+    StreamFormat downlink = getDownlinkSessionFormat();
+    snprintf(hello, sizeof(hello),
+             "{\"type\":\"hello\",\"caps\":{\"uplink\":[\"pcm16\",\"ima_adpcm\"],\"downlink\":[%s],\"wav\":true},"
+             "\"uplink\":{\"codec\":\"%s\",\"rate\":%u,\"channels\":1,\"frameMs\":%u},"
+             "\"downlink\":{\"codec\":\"pcm16\",\"rate\":%u,\"channels\":%u},\"speaker\":{\"rate\":%u}}",
+             downlinkCapabilities(), uplinkCodecName(getUplinkCodec()), (unsigned)getUplinkSampleRate(), (unsigned)VAD_FRAME_MS,
+             (unsigned)downlink.sampleRate, (unsigned)downlink.channels, (unsigned)getSpeakerSampleRate());
+    sendMessage(hello);
+}
+
 void sendButtonState(bool buttonState)
 {
+    WsLock lock;
     if (client.available())
     {
         uint8_t buttonMessage = buttonState ? 1 : 0;
@@ -119,23 +187,21 @@ void sendButtonState(bool buttonState)
     }
 }
 
-void sendBinaryData(const int16_t *buffer, size_t bytesIn)
+bool sendBinaryData(const void *buffer, size_t bytesIn)
 {
+    WsLock lock;
     if (client.available())
     {
-        // Convert int16_t buffer to char buffer
         const char *charBuffer = reinterpret_cast<const char *>(buffer);
-        client.sendBinary(charBuffer, bytesIn);
-    }
-    else
-    {
-        Serial.println("WebSocket not connected - cannot send binary data");
-        delay(1000);
+        return client.sendBinary(charBuffer, bytesIn);
     }
+
+    // The caller counts the drop; no delay here so the ring keeps draining
+    return false;
 }
 void reconnectWSServer()
 {
-    if (!client.available())
+    if (!webSocketAvailable())
     {
         Serial.println("WebSocket connection lost. Attempting to reconnect...");
         connectToWebSocket();
@@ -144,6 +210,7 @@ void reconnectWSServer()
 
 void loopWebsocket()
 {
+    WsLock lock;
     client.poll();
     //   static unsigned long lastReconnectAttempt = 0;
     //   unsigned long currentMillis = millis();
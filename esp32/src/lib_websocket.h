@@ -11,7 +11,9 @@ void onMessageCallback(WebsocketsMessage message);
 void onEventsCallback(WebsocketsEvent event, String data);
 void connectToWebSocket();
 void checkWebSocketConnection();
-void sendBinaryData(const int16_t* buffer, size_t bytesIn);
+bool webSocketAvailable();
+bool sendBinaryData(const void* buffer, size_t bytesIn);
+void sendHello();
 void sendMessage(const char* message);
 void loopWebsocket();
 void sendButtonState(bool buttonState);
@@ -0,0 +1,114 @@
+#include "limiter.h"
+#include <cmath>
+
+static const int32_t Q15_ONE = 32767;
+
+static int32_t onePoleCoef(float samples) {
+    if (samples < 1.0f) {
+        return Q15_ONE;
+    }
+    return (int32_t)((1.0f - expf(-1.0f / samples)) * 32768.0f);
+}
+
+PeakLimiter::PeakLimiter()
+    : threshold(32767), length(0), pos(0), windowMin(Q15_ONE), minAge(0), env(Q15_ONE), minEnv(Q15_ONE),
+      attackCoef(Q15_ONE), releaseCoef(Q15_ONE), overs(0) {
+}
+
+void PeakLimiter::begin(uint32_t sampleRate, int16_t limit, uint16_t lookaheadMs, uint16_t releaseMs) {
+    threshold = limit > 0 ? limit : 32767;
+    uint32_t samples = sampleRate * lookaheadMs / 1000;
+    length = (uint16_t)(samples > MAX_LOOKAHEAD ? MAX_LOOKAHEAD : samples);
+    // Reach ~99% of the needed reduction within the look-ahead
+    attackCoef = onePoleCoef(length / 5.0f);
+    releaseCoef = onePoleCoef(sampleRate * releaseMs / 1000.0f);
+    overs = 0;
+    reset();
+}
+
+void PeakLimiter::reset() {
+    for (uint16_t i = 0; i <= MAX_LOOKAHEAD; i++) {
+        delay[i] = 0;
+    }
+    pos = 0;
+    windowMin = Q15_ONE;
+    minAge = 0;
+    env = Q15_ONE;
+    minEnv = Q15_ONE;
+}
+
+// Q15 gain that brings this sample down to the threshold
+int32_t PeakLimiter::required(int32_t sample) const {
+    int32_t magnitude = sample < 0 ? -sample : sample;
+    if (magnitude <= threshold) {
+        return Q15_ONE;
+    }
+    return (int32_t)(((int64_t)threshold << 15) / magnitude);
+}
+
+// The minimum just aged out of the window; find the next one
+void PeakLimiter::rescan() {
+    windowMin = Q15_ONE;
+    minAge = 0;
+    for (uint16_t age = 0; age <= length; age++) {
+        uint16_t index = (uint16_t)((pos + length + 1 - age) % (length + 1));
+        int32_t needed = required(delay[index]);
+        if (needed < windowMin) {
+            windowMin = needed;
+            minAge = age;
+        }
+    }
+}
+
+void PeakLimiter::process(int16_t *samples, size_t count, int32_t gainFrom, int32_t gainTo) {
+    // Gain ramp in Q22 so small changes still move per sample
+    int32_t gain = gainFrom << 12;
+    int32_t gainStep = count > 0 ? (int32_t)(((int64_t)(gainTo - gainFrom) << 12) / (int32_t)count) : 0;
+
+    for (size_t i = 0; i < count; i++) {
+        int32_t amplified = (int32_t)(((int64_t)samples[i] * (gain >> 12)) >> 10);
+        gain += gainStep;
+
+        if (length == 0) {
+            // No look-ahead: plain saturation at the threshold
+            if (amplified > threshold || amplified < -threshold) {
+                overs++;
+                amplified = amplified > 0 ? threshold : -threshold;
+            }
+            samples[i] = (int16_t)amplified;
+            continue;
+        }
+
+        // The delay line holds the window: newest at pos, the one to output
+        // `length` samples older right after it
+        pos = pos == length ? 0 : pos + 1;
+        delay[pos] = amplified;
+        int32_t leaving = delay[pos == length ? 0 : pos + 1];
+
+        int32_t needed = required(amplified);
+        if (needed < Q15_ONE) {
+            overs++;
+        }
+        if (needed <= windowMin) {
+            windowMin = needed;
+            minAge = 0;
+        } else if (++minAge > length) {
+            rescan();
+        }
+
+        int32_t coef = windowMin < env ? attackCoef : releaseCoef;
+        env += (int32_t)(((int64_t)(windowMin - env) * coef) >> 15);
+        if (env < minEnv) {
+            minEnv = env;
+        }
+
+        // Envelope can trail the last few percent of a fast attack; clamp
+        int32_t out = (int32_t)(((int64_t)leaving * env) >> 15);
+        if (out > threshold) {
+            out = threshold;
+        } else if (out < -threshold) {
+            out = -threshold;
+        }
+        samples[i] = (int16_t)out;
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef LIMITER_H
+#define LIMITER_H
+
+#include <cstdint>
+#include <cstddef>
+
+// Look-ahead peak limiter with a built-in gain stage. The signal is delayed
+// by the look-ahead so the gain envelope is already down when a peak leaves;
+// the envelope then recovers with a one-pole release. Gain is Q10, envelope
+// Q15, fixed-size state, no allocation.
+class PeakLimiter {
+public:
+    static const uint16_t MAX_LOOKAHEAD = 128; // samples
+    static const int32_t UNITY_GAIN = 1 << 10;
+
+    PeakLimiter();
+
+    void begin(uint32_t sampleRate, int16_t threshold, uint16_t lookaheadMs, uint16_t releaseMs);
+    void reset();
+
+    // In place; gain ramps linearly from gainFrom to gainTo (Q10) over the
+    // block before limiting. Output lags input by lookahead() samples.
+    void process(int16_t *samples, size_t count, int32_t gainFrom, int32_t gainTo);
+
+    uint16_t lookahead() const { return length; }
+    uint16_t envelope() const { return (uint16_t)env; } // Q15, 32767 = no reduction
+    uint16_t peakReduction() const { return (uint16_t)minEnv; }
+    void clearPeakReduction() { minEnv = 32767; }
+    uint32_t limitedSamples() const { return overs; }
+
+private:
+    int32_t required(int32_t sample) const;
+    void rescan();
+
+    int32_t threshold;
+    uint16_t length;
+    uint16_t pos;
+    int32_t delay[MAX_LOOKAHEAD + 1];
+    int32_t windowMin; // lowest gain needed by any sample in the delay line
+    uint16_t minAge;
+    int32_t env;
+    int32_t minEnv;
+    int32_t attackCoef;  // Q15 per sample
+    int32_t releaseCoef; // Q15 per sample
+    uint32_t overs;
+};
+
+#endif // LIMITER_H
@@ -0,0 +1,150 @@
+#include "loudness.h"
+#include <cmath>
+
+static const float HIGH_PASS_HZ = 100.0f;
+
+static int32_t dbToGain(int8_t db) {
+    return (int32_t)(powf(10.0f, db / 20.0f) * PeakLimiter::UNITY_GAIN);
+}
+
+static int32_t stepCoef(float stepMs, float timeMs) {
+    if (timeMs <= stepMs) {
+        return 32767;
+    }
+    return (int32_t)((1.0f - expf(-stepMs / timeMs)) * 32768.0f);
+}
+
+static uint32_t isqrt(uint32_t value) {
+    uint32_t root = 0;
+    uint32_t bit = 1UL << 30;
+    while (bit > value) {
+        bit >>= 2;
+    }
+    while (bit) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+LoudnessNormalizer::LoudnessNormalizer()
+    : currentGain(PeakLimiter::UNITY_GAIN), minGain(PeakLimiter::UNITY_GAIN), maxGain(PeakLimiter::UNITY_GAIN),
+      volume(PeakLimiter::UNITY_GAIN), appliedGain(PeakLimiter::UNITY_GAIN), attackCoef(32767), releaseCoef(32767),
+      highPassCoef(0), lastInput(0), lastOutput(0), stepFrames(0), stepFill(0), stepEnergy(0), stepIndex(0),
+      stepsFilled(0), windowRms(0) {
+    cfg = LoudnessConfig();
+}
+
+void LoudnessNormalizer::begin(const LoudnessConfig &config) {
+    cfg = config;
+    if (cfg.channels == 0) {
+        cfg.channels = 1;
+    }
+    // Q10 gain times a full-scale sample must stay inside int32 in the limiter
+    int8_t ceiling = cfg.maxGainDb > 30 ? 30 : cfg.maxGainDb;
+    maxGain = dbToGain(ceiling);
+    minGain = dbToGain(cfg.minGainDb < ceiling ? cfg.minGainDb : ceiling);
+    currentGain = PeakLimiter::UNITY_GAIN < minGain ? minGain
+                  : (PeakLimiter::UNITY_GAIN > maxGain ? maxGain : PeakLimiter::UNITY_GAIN);
+
+    float stepMs = cfg.windowMs / (float)STEPS;
+    stepFrames = (uint32_t)(cfg.sampleRate * stepMs / 1000.0f);
+    if (stepFrames == 0) {
+        stepFrames = 1;
+    }
+    attackCoef = stepCoef(stepMs, cfg.attackMs);
+    releaseCoef = stepCoef(stepMs, cfg.releaseMs);
+    highPassCoef = (int32_t)(expf(-2.0f * (float)M_PI * HIGH_PASS_HZ / cfg.sampleRate) * 32768.0f);
+
+    // Interleaved channels run through the limiter as one stream, so its
+    // look-ahead is counted in samples of all channels
+    peakLimiter.begin(cfg.sampleRate * cfg.channels, cfg.limitThreshold, cfg.lookaheadMs, cfg.limiterReleaseMs);
+    appliedGain = (int32_t)(((int64_t)currentGain * volume) >> 10);
+    reset();
+}
+
+void LoudnessNormalizer::reset() {
+    peakLimiter.reset();
+    lastInput = 0;
+    lastOutput = 0;
+    stepFill = 0;
+    stepEnergy = 0;
+    for (uint8_t i = 0; i < STEPS; i++) {
+        energies[i] = 0;
+    }
+    stepIndex = 0;
+    stepsFilled = 0;
+    windowRms = 0;
+}
+
+void LoudnessNormalizer::setVolume(uint8_t percent) {
+    volume = (int32_t)(percent > 100 ? 100 : percent) * PeakLimiter::UNITY_GAIN / 100;
+}
+
+// One step of the window is complete: update the level and steer the gain
+void LoudnessNormalizer::step(bool normalize) {
+    energies[stepIndex] = stepEnergy;
+    stepIndex = (stepIndex + 1) % STEPS;
+    if (stepsFilled < STEPS) {
+        stepsFilled++;
+    }
+    stepEnergy = 0;
+    stepFill = 0;
+
+    uint64_t total = 0;
+    for (uint8_t i = 0; i < stepsFilled; i++) {
+        total += energies[i];
+    }
+    uint64_t meanSquare = total / ((uint64_t)stepsFilled * stepFrames);
+    windowRms = isqrt(meanSquare > 0xFFFFFFFFULL ? 0xFFFFFFFFUL : (uint32_t)meanSquare);
+
+    if (!normalize || windowRms < (uint32_t)cfg.gateRms || windowRms == 0) {
+        return;
+    }
+    int64_t desired = ((int64_t)cfg.targetRms << 10) / windowRms;
+    if (desired > maxGain) {
+        desired = maxGain;
+    } else if (desired < minGain) {
+        desired = minGain;
+    }
+    int32_t coef = desired < currentGain ? attackCoef : releaseCoef;
+    currentGain += (int32_t)(((int64_t)desired - currentGain) * coef >> 15);
+}
+
+void LoudnessNormalizer::process(int16_t *frames, size_t count, bool normalize) {
+    if (!frames || count == 0 || stepFrames == 0) {
+        return;
+    }
+
+    // Meter the block before it is scaled
+    uint8_t channels = cfg.channels;
+    for (size_t i = 0; i < count; i++) {
+        int32_t x = frames[i * channels];
+        lastOutput = (int32_t)(((int64_t)(lastOutput + x - lastInput) * highPassCoef) >> 15);
+        lastInput = x;
+        stepEnergy += (uint64_t)((int64_t)lastOutput * lastOutput);
+        if (++stepFill == stepFrames) {
+            step(normalize);
+        }
+    }
+
+    int32_t previous = appliedGain;
+    int32_t gain = normalize ? currentGain : PeakLimiter::UNITY_GAIN;
+    appliedGain = (int32_t)(((int64_t)gain * volume) >> 10);
+    peakLimiter.process(frames, count * channels, previous, appliedGain);
+}
+
+LoudnessStats LoudnessNormalizer::stats() const {
+    LoudnessStats stats;
+    stats.levelDb10 = windowRms > 0 ? (int16_t)lrintf(200.0f * log10f(windowRms / 32768.0f)) : -1000;
+    stats.gainDb10 = (int16_t)lrintf(200.0f * log10f((float)currentGain / PeakLimiter::UNITY_GAIN));
+    uint16_t reduction = peakLimiter.peakReduction();
+    stats.peakReductionDb10 = (int16_t)lrintf(200.0f * log10f((reduction > 0 ? reduction : 1) / 32767.0f));
+    stats.limitedSamples = peakLimiter.limitedSamples();
+    return stats;
+}
@@ -0,0 +1,84 @@
+#ifndef LOUDNESS_H
+#define LOUDNESS_H
+
+#include <cstdint>
+#include <cstddef>
+#include "limiter.h"
+
+struct LoudnessConfig {
+    uint32_t sampleRate;
+    uint8_t channels;         // interleaved; all channels share one gain
+    uint16_t windowMs;        // short-term loudness window
+    int16_t targetRms;        // level the window is steered to
+    int16_t gateRms;          // quieter windows hold the gain
+    int8_t maxGainDb;
+    int8_t minGainDb;
+    uint16_t attackMs;        // time constant when the gain has to drop
+    uint16_t releaseMs;       // time constant when the gain may rise
+    int16_t limitThreshold;   // brick-wall ceiling after gain
+    uint16_t lookaheadMs;     // limiter look-ahead, adds this much latency
+    uint16_t limiterReleaseMs;
+};
+
+struct LoudnessStats {
+    int16_t levelDb10;          // short-term level of the input, tenths of a dBFS
+    int16_t gainDb10;           // normalisation gain, volume excluded
+    int16_t peakReductionDb10;  // deepest limiter gain reduction since clearPeaks(), <= 0
+    uint32_t limitedSamples;
+};
+
+// Streaming loudness normaliser for playback. The level is the mean square
+// of the first channel after a ~100 Hz high-pass (the rumble stage of
+// BS.1770 K-weighting), over a window slid in quarter-window steps, as a
+// momentary loudness meter does. Each step steers a Q10 gain toward the
+// target with separate attack and release; windows below the gate hold it,
+// so pauses are not pumped up. The gain, times the volume, is ramped
+// across each block and followed by a look-ahead brick-wall limiter whose
+// envelope all channels share. Fixed-point, no allocation.
+class LoudnessNormalizer {
+public:
+    static const uint8_t STEPS = 4; // per window
+
+    LoudnessNormalizer();
+
+    void begin(const LoudnessConfig &config);
+    // Clears the meter and limiter but keeps the learned gain
+    void reset();
+
+    void setVolume(uint8_t percent);
+
+    // In place on interleaved frames. With normalize false only volume and
+    // limiter apply.
+    void process(int16_t *frames, size_t count, bool normalize);
+
+    LoudnessStats stats() const;
+    void clearPeaks() { peakLimiter.clearPeakReduction(); }
+
+private:
+    void step(bool normalize);
+
+    LoudnessConfig cfg;
+    int32_t currentGain; // Q10
+    int32_t minGain;
+    int32_t maxGain;
+    int32_t volume;      // Q10
+    int32_t appliedGain; // Q10, gain times volume at the end of the last block
+    int32_t attackCoef;  // Q15 per step
+    int32_t releaseCoef; // Q15 per step
+    int32_t highPassCoef; // Q15
+    int32_t lastInput;
+    int32_t lastOutput;
+    uint32_t stepFrames;
+    uint32_t stepFill;
+    uint64_t stepEnergy;
+    uint64_t energies[STEPS];
+    uint8_t stepIndex;
+    uint8_t stepsFilled;
+    uint32_t windowRms;
+    PeakLimiter peakLimiter;
+
+    LoudnessNormalizer(const LoudnessNormalizer &);
+    LoudnessNormalizer &operator=(const LoudnessNormalizer &);
+};
+
+#endif // LOUDNESS_H
@@ -4,6 +4,7 @@
 #include <ArduinoWebsockets.h>
 #include <driver/i2s.h>
 #include <math.h>
+#include <esp_timer.h>
 #include "mic.h"
 #include "config.h"
 #include "lib_wifi.h"
@@ -11,13 +12,34 @@
 #include "lib_speaker.h"
 #include "lib_button.h"
 #include "lib_websocket.h"
+#include "downlink.h"
+#ifdef WAKE_WORD_MODEL_HEADER
+#include "keywordSpotter.h"
+#include WAKE_WORD_MODEL_HEADER
+#endif
+
+// Opus decoding runs in the WebSocket callback on the loop task
+SET_LOOP_TASK_STACK_SIZE(16 * 1024);
 
 int16_t sBuffer[bufferLen];
-ButtonChecker button;
+bool isTurnActive = false;
+bool wakeWordOn = WAKE_WORD_ENABLED;
+// A tap's turn waits out the double-press window before it goes to the
+// server, so the first half of a double press is dropped, not answered
+bool tapPending = false;
+int64_t tapDecidedUs = 0;
+int64_t lastPressUs = 0;
 
 // Function declarations
 void setupLEDs();
 void setupAudioIO();
+void startRecording(uint32_t pressSample);
+void stopRecording(uint32_t releaseSample);
+void endCapture(uint32_t releaseSample);
+void finishTurn(bool send);
+void settleTap();
+void bargeIn();
+void handleInputEvent(const InputEvent &event);
 
 void setupLEDs()
 {
@@ -28,10 +50,13 @@ void setupLEDs()
 }
 void setupAudioIO()
 {
+#if !AUDIO_HAL_I2S_STD
   // Uninstall any existing I2S drivers
   // i2s_driver_uninstall(I2S_PORT_SPEAKER);
   i2s_driver_uninstall(I2S_PORT_MIC);
-  
+#endif
+  Serial.printf("Audio I/O on the %s I2S driver\n", AUDIO_HAL_I2S_STD ? "channel" : "legacy");
+
   // Setup speaker first
   setupSpeakerI2S();
   // i2s_start(I2S_PORT_SPEAKER);
@@ -53,45 +78,215 @@ void setup()
   
   setRecording(false);
   setupAudioIO();
+  if (setupDownlink() != ESP_OK)
+  {
+    Serial.println("Failed to allocate downlink decode buffers");
+  }
+  calibrateMicNoiseFloor(VAD_CALIBRATION_MS);
 
-  xTaskCreatePinnedToCore(micTask, "micTask", 16000, NULL, 1, NULL, 0);
+  if (startMicTasks() != ESP_OK)
+  {
+    Serial.println("Failed to start microphone tasks");
+  }
+#if PLAYBACK_BENCHMARK
+  benchmarkPlaybackRender();
+#endif
+  if (startSpeakerTask() != ESP_OK)
+  {
+    Serial.println("Failed to start playback task");
+  }
+  if (setupButtonInput() != ESP_OK)
+  {
+    Serial.println("Failed to start button input");
+  }
+#ifdef WAKE_WORD_MODEL_HEADER
+  setWakeWordModel(&wakeWordModel);
+#endif
 }
 
-void loop()
+// The turn starts at pressSample (minus the pre-roll), however long the
+// messages below take
+void startRecording(uint32_t pressSample)
 {
-  button.loop();
-  if (button.justPressed())
-  {
-    Serial.println("Recording...");
-    sendMessage("START_RECORD");
-    sendButtonState(1);
-    
-    // Stop speaker and clear buffer before starting mic
-    i2s_stop(I2S_PORT_SPEAKER);
-    i2s_zero_dma_buffer(I2S_PORT_SPEAKER);
+  Serial.println("Recording...");
+  sendMessage("START_RECORD");
+  sendButtonState(1);
+
+  // With echo cancellation or a wake word both ports stay running;
+  // otherwise hand the bus over from speaker to mic
+  if (!micAlwaysOn())
+  {
+    // Stop speaker and drop what was queued before starting mic
+    speaker_stop();
+    setSpeakerPortRunning(false);
     delay(100);  // Added delay for buffer clearing
-    
-    i2s_start(I2S_PORT_MIC);
+
+    setMicPortRunning(true);
     delay(100);  // Added delay for stable startup
-    
-    setRecording(true);
-    Serial.println("Recording ready.");
   }
-  else if (button.justReleased())
+  else
+  {
+    // The speaker stays up, so the user hears the turn start
+    playEarcon(EARCON_START);
+  }
+
+  setRecordingAt(true, pressSample);
+  isTurnActive = true;
+  Serial.println("Recording ready.");
+}
+
+void stopRecording(uint32_t releaseSample)
+{
+  endCapture(releaseSample);
+  finishTurn(true);
+}
+
+// Capture ends at releaseSample; the turn is sent or dropped separately
+void endCapture(uint32_t releaseSample)
+{
+  Serial.println("Stopped recording.");
+  setRecordingAt(false, releaseSample);
+  isTurnActive = false;
+}
+
+// Hands the captured turn to the server, or tells it to drop the turn,
+// and the bus back to the speaker
+void finishTurn(bool send)
+{
+  // Let the sender flush what was captured before the release
+  if (!waitMicDrained(500))
+  {
+    Serial.println("Mic ring not drained before STOP_RECORD");
+  }
+  if (send)
   {
-    Serial.println("Stopped recording.");
     sendButtonState(0);
     sendMessage("STOP_RECORD");
-    setRecording(false);
+  }
+  else
+  {
+    sendMessage("{\"type\":\"cancel_turn\"}");
+  }
+  logMicStats();
 
+  if (!micAlwaysOn())
+  {
     // Stop microphone and clear buffer before starting speaker
-    i2s_stop(I2S_PORT_MIC);
-    i2s_zero_dma_buffer(I2S_PORT_MIC);
+    setMicPortRunning(false);
     delay(100);  // Added delay for buffer clearing
-    
-    i2s_start(I2S_PORT_SPEAKER);
+
+    setSpeakerPortRunning(true);
     delay(100);  // Added delay for stable startup
   }
+  playEarcon(EARCON_STOP);
+}
+
+// The user talked over the answer: cut playback and take the turn
+void bargeIn()
+{
+  Serial.println("Barge-in detected.");
+  speaker_stop();
+  cancelDownlinkStream();
+  sendMessage("{\"type\":\"barge_in\"}");
+  startRecording(micSampleClock());
+}
+
+// Sends the held tap's turn once no second press can make it a double press
+void settleTap()
+{
+  if (tapPending)
+  {
+    tapPending = false;
+    finishTurn(true);
+  }
+}
 
+// Button gestures arrive stamped at the edge, so a turn starts and ends
+// where the user pressed and released even if loop() was busy playing audio
+void handleInputEvent(const InputEvent &event)
+{
+  switch (event.type)
+  {
+  case INPUT_PRESS:
+    settleTap();
+    lastPressUs = event.timeUs;
+    if (!isTurnActive)
+    {
+      startRecording(micSampleAt(event.timeUs));
+    }
+    break;
+  case INPUT_RELEASE:
+    if (!isTurnActive)
+    {
+      break;
+    }
+    // Capture stops at the release either way; a tap (BUTTON_TAP_MS, as
+    // lib_button judges it) holds the rest until the window has passed
+    if (event.timeUs - lastPressUs <= (int64_t)BUTTON_TAP_MS * 1000)
+    {
+      endCapture(micSampleAt(event.timeUs));
+      tapPending = true;
+      tapDecidedUs = event.timeUs + (int64_t)BUTTON_DOUBLE_PRESS_MS * 1000;
+    }
+    else
+    {
+      stopRecording(micSampleAt(event.timeUs));
+    }
+    break;
+  case INPUT_DOUBLE_PRESS:
+    // Toggles hands-free listening; the tap before it was no turn
+    if (tapPending)
+    {
+      tapPending = false;
+      finishTurn(false);
+    }
+    wakeWordOn = !wakeWordOn;
+    setWakeWordEnabled(wakeWordOn);
+    Serial.printf("Wake word %s.\n", wakeWordOn ? "on" : "off");
+    break;
+  case INPUT_LONG_PRESS:
+    // Push-to-talk holds past the threshold on every turn; only a hold
+    // with no turn open, such as the second half of a double press, is one
+    if (!isTurnActive)
+    {
+      Serial.println("Long press.");
+    }
+    break;
+  }
+}
+
+void loop()
+{
+  InputEvent event;
+  if (nextInputEvent(&event, 0))
+  {
+    handleInputEvent(event);
+  }
+  else if (tapPending)
+  {
+    // Nothing else starts a turn until the held tap is settled
+    if (esp_timer_get_time() > tapDecidedUs)
+    {
+      settleTap();
+    }
+  }
+  else if (!isTurnActive && micWakeWordDetected())
+  {
+    // Hands-free: same start as the button; VAD endpointing ends the turn
+    Serial.println("Wake word detected.");
+    startRecording(micSampleClock());
+  }
+  else if (isTurnActive && micEndpointDetected())
+  {
+    // VAD heard the user finish; don't wait for the button release
+    Serial.println("End of speech detected.");
+    stopRecording(micSampleClock());
+  }
+  else if (!isTurnActive && micBargeInDetected())
+  {
+    bargeIn();
+  }
+
+  serviceClockSync();
   loopWebsocket();
-}
\ No newline at end of file
+}
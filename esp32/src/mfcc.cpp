@@ -0,0 +1,199 @@
+#include "mfcc.h"
+#include <Arduino.h>
+#include "utils.h"
+
+// Extra fraction bits through the FFT; 16-bit input plus log2(n) <= 10 of
+// growth still fits int32
+static const uint8_t PRECISION_BITS = 4;
+static const uint8_t MAX_LOG2_SIZE = 10;
+static const float LOW_HZ = 20.0f;
+static const int32_t LN2_Q15 = 22713;
+
+static float hzToMel(float hz) {
+    return 2595.0f * log10f(1.0f + hz / 700.0f);
+}
+
+static float melToHz(float mel) {
+    return 700.0f * (powf(10.0f, mel / 2595.0f) - 1.0f);
+}
+
+// log2 in Q8. The mantissa's log is approximated as f + 0.3465 f (1 - f),
+// within 0.01 of the true value, which is well under a quantisation step
+// of the model input.
+static int32_t log2Q8(uint64_t value) {
+    if (value == 0) {
+        return 0;
+    }
+    int msb = 63;
+    while (!(value >> msb)) {
+        msb--;
+    }
+    uint32_t f = msb >= 16 ? (uint32_t)(value >> (msb - 16)) & 0xFFFF : (uint32_t)(value << (16 - msb)) & 0xFFFF;
+    uint32_t correction = (uint32_t)(((uint64_t)f * (65536 - f) >> 16) * 22708 >> 16); // 0.3465 in Q16
+    return (msb << 8) + (int32_t)((f + correction) >> 8);
+}
+
+MfccFrontEnd::MfccFrontEnd()
+    : windowLength(0), bins(0), bandCount(0), coeffCount(0), hann(NULL), bandStart(NULL), weightStart(NULL),
+      weights(NULL), dct(NULL), re(NULL), im(NULL), logMel(NULL) {
+}
+
+MfccFrontEnd::~MfccFrontEnd() {
+    release();
+}
+
+void MfccFrontEnd::release() {
+    free(hann);
+    free(bandStart);
+    free(weightStart);
+    free(weights);
+    free(dct);
+    free(re);
+    free(im);
+    free(logMel);
+    hann = NULL;
+    bandStart = weightStart = weights = NULL;
+    dct = NULL;
+    re = im = logMel = NULL;
+}
+
+size_t MfccFrontEnd::memoryBytes() const {
+    if (!hann) {
+        return 0;
+    }
+    uint16_t n = fft.size();
+    return windowLength * sizeof(int16_t) + 2 * (bandCount + 1) * sizeof(uint16_t) +
+           weightStart[bandCount] * sizeof(uint16_t) + coeffCount * bandCount * sizeof(int16_t) +
+           2 * n * sizeof(int32_t) + bandCount * sizeof(int32_t) + n * sizeof(int16_t); // + FFT tables
+}
+
+bool MfccFrontEnd::begin(uint32_t sampleRate, uint16_t windowSamples, uint8_t melBands, uint8_t coeffCountIn) {
+    release();
+    if (windowSamples == 0 || melBands == 0 || coeffCountIn == 0 || coeffCountIn > melBands) {
+        return false;
+    }
+
+    uint8_t log2Size = 1;
+    while ((1u << log2Size) < windowSamples) {
+        log2Size++;
+    }
+    if (log2Size > MAX_LOG2_SIZE || !fft.begin(log2Size)) {
+        return false;
+    }
+    uint16_t n = fft.size();
+    windowLength = windowSamples;
+    bins = n / 2 + 1;
+    bandCount = melBands;
+    coeffCount = coeffCountIn;
+
+    // Band edges evenly spaced in mel between LOW_HZ and Nyquist, as bins
+    float lowMel = hzToMel(LOW_HZ);
+    float highMel = hzToMel(sampleRate / 2.0f);
+    float edges[257];
+    for (uint16_t b = 0; b < bandCount + 2; b++) {
+        float hz = melToHz(lowMel + (highMel - lowMel) * b / (bandCount + 1));
+        edges[b] = hz * n / sampleRate;
+    }
+
+    bandStart = (uint16_t *)audio_malloc((bandCount + 1) * sizeof(uint16_t));
+    weightStart = (uint16_t *)audio_malloc((bandCount + 1) * sizeof(uint16_t));
+    hann = (int16_t *)audio_malloc(windowLength * sizeof(int16_t));
+    dct = (int16_t *)audio_malloc(coeffCount * bandCount * sizeof(int16_t));
+    re = (int32_t *)audio_malloc(n * sizeof(int32_t));
+    im = (int32_t *)audio_malloc(n * sizeof(int32_t));
+    logMel = (int32_t *)audio_malloc(bandCount * sizeof(int32_t));
+    if (!bandStart || !weightStart || !hann || !dct || !re || !im || !logMel) {
+        release();
+        return false;
+    }
+
+    // Each band covers the bins strictly between its outer edges
+    uint16_t total = 0;
+    for (uint8_t b = 0; b < bandCount; b++) {
+        uint16_t first = (uint16_t)floorf(edges[b]) + 1;
+        uint16_t last = (uint16_t)ceilf(edges[b + 2]) - 1;
+        if (last >= bins) {
+            last = bins - 1;
+        }
+        bandStart[b] = first;
+        weightStart[b] = total;
+        total += last >= first ? last - first + 1 : 0;
+    }
+    bandStart[bandCount] = 0;
+    weightStart[bandCount] = total;
+
+    weights = (uint16_t *)audio_malloc((total ? total : 1) * sizeof(uint16_t));
+    if (!weights) {
+        release();
+        return false;
+    }
+    for (uint8_t b = 0; b < bandCount; b++) {
+        uint16_t count = weightStart[b + 1] - weightStart[b];
+        for (uint16_t i = 0; i < count; i++) {
+            float k = bandStart[b] + i;
+            float w = k <= edges[b + 1] ? (k - edges[b]) / (edges[b + 1] - edges[b])
+                                        : (edges[b + 2] - k) / (edges[b + 2] - edges[b + 1]);
+            w = w < 0.0f ? 0.0f : (w > 1.0f ? 1.0f : w);
+            weights[weightStart[b] + i] = (uint16_t)lrintf(w * 32767.0f);
+        }
+    }
+
+    // Periodic Hann
+    for (uint16_t i = 0; i < windowLength; i++) {
+        hann[i] = (int16_t)lrintf((0.5f - 0.5f * cosf(2.0f * PI * i / windowLength)) * 32767.0f);
+    }
+
+    // Orthonormal DCT-II
+    for (uint8_t c = 0; c < coeffCount; c++) {
+        float scale = c == 0 ? sqrtf(1.0f / bandCount) : sqrtf(2.0f / bandCount);
+        for (uint8_t b = 0; b < bandCount; b++) {
+            float value = scale * cosf(PI * c * (b + 0.5f) / bandCount);
+            dct[c * bandCount + b] = (int16_t)lrintf(value * 32767.0f);
+        }
+    }
+    return true;
+}
+
+void MfccFrontEnd::compute(const int16_t *window, int16_t *out) {
+    if (!hann) {
+        return;
+    }
+    uint16_t n = fft.size();
+    for (uint16_t i = 0; i < windowLength; i++) {
+        re[i] = ((int32_t)window[i] * hann[i]) >> (15 - PRECISION_BITS);
+        im[i] = 0;
+    }
+    for (uint16_t i = windowLength; i < n; i++) {
+        re[i] = 0;
+        im[i] = 0;
+    }
+    fft.forward(re, im);
+
+    // Filterbank straight from the 64-bit power; quiet bands would not
+    // survive narrowing it to 32 bits first
+    for (uint8_t b = 0; b < bandCount; b++) {
+        uint64_t energy = 1;
+        const uint16_t *w = weights + weightStart[b];
+        uint16_t count = weightStart[b + 1] - weightStart[b];
+        for (uint16_t i = 0; i < count; i++) {
+            uint16_t k = bandStart[b] + i;
+            uint64_t power = (uint64_t)((int64_t)re[k] * re[k]) + (uint64_t)((int64_t)im[k] * im[k]);
+            energy += (power >> 15) * w[i];
+        }
+        // Undo the window/precision gain so levels match float MFCCs on
+        // samples in [-32768, 32767]: power carries 2^(2 PRECISION_BITS)
+        int32_t log2Energy = log2Q8(energy) - ((2 * PRECISION_BITS) << 8);
+        logMel[b] = (int32_t)(((int64_t)log2Energy * LN2_Q15) >> 15);
+    }
+
+    for (uint8_t c = 0; c < coeffCount; c++) {
+        const int16_t *row = dct + c * bandCount;
+        int64_t sum = 0;
+        for (uint8_t b = 0; b < bandCount; b++) {
+            sum += (int64_t)logMel[b] * row[b];
+        }
+        // Q8 log energies times Q15 coefficients, down to Q7
+        int32_t value = (int32_t)((sum + (1 << 15)) >> 16);
+        out[c] = (int16_t)(value > 32767 ? 32767 : (value < -32768 ? -32768 : value));
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef MFCC_H
+#define MFCC_H
+
+#include <cstdint>
+#include <cstddef>
+#include "fft.h"
+
+// Fixed-point MFCC front end for keyword spotting: Hann window, power
+// spectrum on the fixed-point FFT, triangular mel filterbank with Q15
+// weights, integer log2 and a Q15 DCT-II. One call turns one window of
+// samples into `coeffs` cepstral coefficients in Q7 natural-log units (c0 of
+// a full-scale window still fits int16), so a model trained on float MFCCs
+// sees the same scale.
+class MfccFrontEnd {
+public:
+    MfccFrontEnd();
+    ~MfccFrontEnd();
+
+    bool begin(uint32_t sampleRate, uint16_t windowSamples, uint8_t melBands, uint8_t coeffs);
+
+    // window holds windowSamples() samples, out receives coeffs() values
+    void compute(const int16_t *window, int16_t *out);
+
+    uint16_t windowSamples() const { return windowLength; }
+    uint8_t coeffs() const { return coeffCount; }
+    size_t memoryBytes() const;
+
+private:
+    void release();
+
+    FixedFft fft;
+    uint16_t windowLength;
+    uint16_t bins;
+    uint8_t bandCount;
+    uint8_t coeffCount;
+    int16_t *hann;        // Q15
+    uint16_t *bandStart;  // first bin of each band, bandCount + 1 entries into weights
+    uint16_t *weightStart;
+    uint16_t *weights;    // Q15, concatenated per band
+    int16_t *dct;         // coeffs x bands, Q15
+    int32_t *re;
+    int32_t *im;
+    int32_t *logMel;      // Q8
+
+    MfccFrontEnd(const MfccFrontEnd &);
+    MfccFrontEnd &operator=(const MfccFrontEnd &);
+};
+
+#endif // MFCC_H
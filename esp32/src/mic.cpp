@@ -5,20 +5,460 @@
 #include "utils.h"
 #include "config.h"
 #include <esp_task_wdt.h>
+#include <esp_timer.h>
+#include "audioRing.h"
+#include "vad.h"
+#include "adpcm.h"
+#include "resampler.h"
+#include "micConvert.h"
+#include "agc.h"
+#include "noiseSuppressor.h"
+#include "echoCanceller.h"
+#include "keywordSpotter.h"
+#include "beamformer.h"
+#include "i2sHealth.h"
+#include "audioHal.h"
+#include "mic.h"
 
 // Global flags for system state
 bool isSpeakerBusy = false;
 bool isWebSocketConnected = true;
-int16_t soundBuffer[bufferLen];
+int16_t soundBuffer[MIC_READ_SAMPLES];
 
-bool isRecording = false;
+#if MIC_BEAMFORMING
+// Both slots of the bus, one INMP441 each, summed to mono before the ring
+static const size_t MIC_SLOTS = 2;
+static Beamformer beamformer;
+static bool beamReady = false;
+static int16_t beamFirst[MIC_READ_SAMPLES];
+static int16_t beamSecond[MIC_READ_SAMPLES];
+#else
+static const size_t MIC_SLOTS = 1;
+#endif
 
-void setRecording(bool recording)
+#if SAMPLE_BITS == 32
+// Native 32-bit DMA slots, converted to 16-bit on the way into the ring
+typedef int32_t MicSlot;
+static MicSampleConverter micConverter;
+#if MIC_BEAMFORMING
+static int32_t rawSecond[MIC_READ_SAMPLES];
+static MicSampleConverter secondConverter;
+#endif
+#else
+typedef int16_t MicSlot;
+#endif
+#if !AUDIO_HAL_I2S_STD && (SAMPLE_BITS == 32 || MIC_BEAMFORMING)
+// The legacy driver copies each DMA block here first
+static MicSlot rawBuffer[MIC_READ_SAMPLES * MIC_SLOTS];
+#endif
+
+volatile bool isRecording = false;
+static volatile bool isSending = false;
+
+// Turn boundaries are stamped on the ring's sample counters, not by task
+// timing. With an always-on mic the sender consumes everything but only
+// sends from turnStart (the press, minus the pre-roll) up to sendUntil
+// (the last sample captured before the release).
+static volatile uint32_t capturedSamples = 0;
+#if AUDIO_HAL_I2S_STD
+static volatile int64_t capturedAtUs = 0; // when the newest ring sample was captured
+#endif
+static volatile uint32_t consumedSamples = 0;
+static volatile uint32_t turnStart = 0;
+static volatile uint32_t sendUntil = 0;
+
+// Capture -> sender ring, storage in PSRAM when available
+static AudioRing micRing;
+static volatile MicStats micStats = {};
+
+// The sender works in VAD frames; one frame per WebSocket message
+static const size_t MIC_FRAME_SAMPLES = (size_t)AUDIO_QUALITY_MIC * VAD_FRAME_MS / 1000;
+static const size_t UPLINK_CAPACITY = MIC_FRAME_SAMPLES + 1; // any uplink rate fits
+static int16_t *frameScratch = NULL;
+static int16_t *paddingFrame = NULL;
+
+// Processed frames from between turns, stamped with their first ring
+// sample, so a turn can reach back before the press
+static const size_t PREROLL_FRAMES = MIC_PREROLL_MS / VAD_FRAME_MS + 1;
+static int16_t *prerollFrames = NULL;
+static uint32_t prerollStamps[PREROLL_FRAMES];
+static bool prerollSpeech[PREROLL_FRAMES];
+static size_t prerollHead = 0;
+static size_t prerollCount = 0;
+
+// Mic-rate frames are decimated to the uplink rate before VAD and encoding
+static Resampler uplinkResampler;
+static int16_t *uplinkFrame = NULL;
+static size_t uplinkFrameSamples = MIC_FRAME_SAMPLES;
+static volatile uint32_t uplinkRate = UPLINK_SAMPLE_RATE_DEFAULT;
+
+static VoiceActivityDetector vad;
+static bool vadReady = false;
+static volatile bool dtxEnabled = VAD_DTX_ENABLED;
+static volatile bool autoStopEnabled = VAD_AUTO_STOP_ENABLED;
+static AutomaticGainControl agc;
+static volatile bool agcEnabled = AGC_ENABLED;
+static NoiseSuppressor noiseSuppressor;
+static bool nsReady = false;
+static volatile bool nsEnabled = NS_ENABLED;
+
+// Echo cancellation against the speaker feed. Both sides count uplink-rate
+// samples: uplinkPosition is the next sample into the canceller, and the
+// playback path queues its reference relative to it.
+static EchoCanceller echoCanceller;
+static Resampler referenceResampler;
+static uint32_t referenceRate = AUDIO_QUALITY_SPEAKER; // the speaker port's clock
+static SemaphoreHandle_t aecLock = NULL;
+static int16_t *referenceMono = NULL;
+static int16_t *referenceFrame = NULL;
+static volatile bool aecReady = false;
+static volatile uint32_t uplinkPosition = 0;
+static volatile bool bargeInDetected = false;
+static const size_t REFERENCE_CHUNK_FRAMES = 256;
+
+// Wake word: between turns the spotter listens to the cleaned-up uplink,
+// resampled to the model's rate. Models are swapped in by the sender.
+static KeywordSpotter keywordSpotter;
+static Resampler kwsResampler;
+static int16_t *kwsFrame = NULL;
+static const KwsModel *volatile pendingKwsModel = NULL;
+static const KwsModel *activeKwsModel = NULL;
+static volatile bool kwsReady = false;
+static volatile bool wakeWordEnabled = WAKE_WORD_ENABLED;
+static volatile bool wakeWordDetected = false;
+static volatile UplinkCodec uplinkCodec = UPLINK_CODEC_DEFAULT;
+static AdpcmEncoder adpcmEncoder;
+static uint8_t *encodedFrame = NULL;
+static volatile uint32_t recordingSession = 0;
+static volatile bool endpointDetected = false;
+
+uint32_t micSampleClock()
+{
+  return capturedSamples;
+}
+
+// The sample clock as it read at esp_timer time `timeUs`, for events that
+// were stamped before the caller got to them
+uint32_t micSampleAt(int64_t timeUs)
 {
+#if AUDIO_HAL_I2S_STD
+  // The DMA block times say when the newest sample was captured, not read
+  int64_t ageUs = capturedAtUs - timeUs;
+#else
+  int64_t ageUs = esp_timer_get_time() - timeUs;
+#endif
+  if (ageUs < 0)
+  {
+    ageUs = 0;
+  }
+  return capturedSamples - (uint32_t)(ageUs * AUDIO_QUALITY_MIC / 1000000);
+}
+
+// Stamps the turn boundary at ring sample `sample`, normally read with
+// micSampleClock() the moment the press or release was seen
+void setRecordingAt(bool recording, uint32_t sample)
+{
+  if (recording)
+  {
+    turnStart = sample - (uint32_t)((uint64_t)MIC_PREROLL_MS * AUDIO_QUALITY_MIC / 1000);
+    micStats.ringPeakBytes = 0;
+    micStats.dspPeakUs = 0;
+    endpointDetected = false;
+    bargeInDetected = false;
+    wakeWordDetected = false;
+    micStats.kwsPeakUs = 0;
+    micStats.beamPeakUs = 0;
+    recordingSession++;
+  }
+  else if (isRecording)
+  {
+    sendUntil = sample;
+  }
   isRecording = recording;
 }
 
-void detectSound(int16_t *buffer, size_t length)
+void setRecording(bool recording)
+{
+  setRecordingAt(recording, capturedSamples);
+}
+
+void setVadOptions(bool dtx, bool autoStop)
+{
+  dtxEnabled = dtx;
+  autoStopEnabled = autoStop;
+}
+
+void setAgcEnabled(bool enabled)
+{
+  agcEnabled = enabled;
+}
+
+// Switching on starts from silence; the noise estimate learned so far is kept
+void setNoiseSuppressionEnabled(bool enabled)
+{
+  nsEnabled = enabled;
+}
+
+// Takes effect at the next recording, when the sender re-announces it
+void setUplinkCodec(UplinkCodec codec)
+{
+  uplinkCodec = codec;
+}
+
+UplinkCodec getUplinkCodec()
+{
+  return uplinkCodec;
+}
+
+const char *uplinkCodecName(UplinkCodec codec)
+{
+  return codec == UPLINK_IMA_ADPCM ? "ima_adpcm" : "pcm16";
+}
+
+// Takes effect at the next recording, like the codec. Rates above the mic
+// rate or that do not give whole 20 ms frames are rejected.
+bool setUplinkSampleRate(uint32_t rate)
+{
+  if (rate == 0 || rate > AUDIO_QUALITY_MIC || (rate * VAD_FRAME_MS) % 1000 != 0)
+  {
+    return false;
+  }
+  uplinkRate = rate;
+  return true;
+}
+
+uint32_t getUplinkSampleRate()
+{
+  return uplinkRate;
+}
+
+// Runs on the sender (or before it starts); the spotter and its buffers are
+// only touched there
+static void applyWakeWordModel(const KwsModel *model)
+{
+  activeKwsModel = model;
+  kwsReady = false;
+  free(kwsFrame);
+  kwsFrame = NULL;
+  if (!model)
+  {
+    return;
+  }
+
+  if (!keywordSpotter.begin(model, WAKE_WORD_THRESHOLD) || !kwsResampler.begin(uplinkRate, model->sampleRate))
+  {
+    Serial.printf("Wake word model %s rejected\n", model->name);
+    return;
+  }
+  kwsFrame = (int16_t *)audio_malloc(kwsResampler.maxOutput(MIC_FRAME_SAMPLES + 1) * sizeof(int16_t));
+  if (!kwsFrame)
+  {
+    Serial.println("No memory for the wake word frame");
+    return;
+  }
+  kwsReady = true;
+  Serial.printf("Wake word model %s: %u Hz, %u B\n", model->name, (unsigned)model->sampleRate,
+                (unsigned)keywordSpotter.memoryBytes());
+}
+
+// NULL turns hands-free mode off. Picked up by the sender within one frame.
+void setWakeWordModel(const KwsModel *model)
+{
+  pendingKwsModel = model;
+}
+
+void setWakeWordEnabled(bool enabled)
+{
+  wakeWordEnabled = enabled;
+}
+
+bool micWakeWordDetected()
+{
+  return wakeWordDetected;
+}
+
+static bool applyUplinkRate(uint32_t rate)
+{
+  if (!uplinkResampler.begin(AUDIO_QUALITY_MIC, rate))
+  {
+    Serial.printf("Uplink resampler init failed for %u Hz\n", (unsigned)rate);
+    return false;
+  }
+  uplinkFrameSamples = (size_t)rate * VAD_FRAME_MS / 1000;
+  vad.setFrameSamples(uplinkFrameSamples);
+
+  AgcConfig config;
+  config.sampleRate = rate;
+  config.frameMs = VAD_FRAME_MS;
+  config.targetRms = AGC_TARGET_RMS;
+  config.maxGainDb = AGC_MAX_GAIN_DB;
+  config.minGainDb = AGC_MIN_GAIN_DB;
+  config.attackMs = AGC_ATTACK_MS;
+  config.releaseMs = AGC_RELEASE_MS;
+  config.limitThreshold = AGC_LIMIT_THRESHOLD;
+  config.lookaheadMs = AGC_LOOKAHEAD_MS;
+  config.limiterReleaseMs = AGC_LIMITER_RELEASE_MS;
+  agc.begin(config);
+
+  // Two hops per VAD frame
+  nsReady = noiseSuppressor.begin(rate, VAD_FRAME_MS / 2, NS_MIN_GAIN_DB);
+  if (!nsReady)
+  {
+    Serial.println("Noise suppressor init failed, uplink goes unfiltered");
+  }
+
+  if (AEC_ENABLED && aecLock)
+  {
+    xSemaphoreTake(aecLock, portMAX_DELAY);
+    aecReady = referenceResampler.begin(referenceRate, rate) &&
+               echoCanceller.begin(rate, AEC_FILTER_MS, AEC_MAX_DELAY_MS);
+    xSemaphoreGive(aecLock);
+    if (!aecReady)
+    {
+      Serial.println("Echo canceller init failed, falling back to half-duplex");
+    }
+  }
+
+  if (activeKwsModel)
+  {
+    applyWakeWordModel(activeKwsModel);
+  }
+  return true;
+}
+
+// Buffers for the reference path, sized for the highest uplink rate and
+// the lowest speaker rate
+static void initEchoCanceller()
+{
+  if (!AEC_ENABLED || aecLock)
+  {
+    return;
+  }
+
+  size_t frameCapacity = (REFERENCE_CHUNK_FRAMES * AUDIO_QUALITY_MIC + AUDIO_QUALITY_SPEAKER - 1) / AUDIO_QUALITY_SPEAKER + 1;
+  referenceMono = (int16_t *)audio_malloc(REFERENCE_CHUNK_FRAMES * sizeof(int16_t));
+  referenceFrame = (int16_t *)audio_malloc(frameCapacity * sizeof(int16_t));
+  if (!referenceMono || !referenceFrame)
+  {
+    Serial.println("Echo canceller buffers unavailable, staying half-duplex");
+    return;
+  }
+  aecLock = xSemaphoreCreateMutex();
+}
+
+bool micFullDuplex()
+{
+  return aecReady;
+}
+
+// The mic keeps capturing between turns for the pre-roll, barge-in or the
+// wake word
+bool micAlwaysOn()
+{
+  return MIC_PREROLL_MS > 0 || aecReady || (kwsReady && wakeWordEnabled);
+}
+
+bool micBargeInDetected()
+{
+  return bargeInDetected;
+}
+
+// Where the mic capture is now on the uplink clock: what the sender has
+// processed plus what is still waiting in the ring
+static uint32_t captureNow()
+{
+  return uplinkPosition + (uint32_t)((uint64_t)micRing.available() * uplinkRate / AUDIO_QUALITY_MIC);
+}
+
+// Called by the playback path right before samples go to the speaker DMA.
+// Interleaved frames at the speaker rate are downmixed and resampled onto
+// the uplink clock.
+void pushEchoReference(const int16_t *samples, size_t frames, uint8_t channels)
+{
+  if (!aecReady || !samples || channels == 0 || xSemaphoreTake(aecLock, 0) != pdTRUE)
+  {
+    return;
+  }
+
+  uint32_t now = captureNow();
+  while (frames > 0 && aecReady)
+  {
+    size_t chunk = min(frames, REFERENCE_CHUNK_FRAMES);
+    for (size_t i = 0; i < chunk; i++)
+    {
+      int32_t sum = 0;
+      for (uint8_t c = 0; c < channels; c++)
+      {
+        sum += samples[i * channels + c];
+      }
+      referenceMono[i] = (int16_t)(sum / channels);
+    }
+    size_t produced = referenceResampler.process(referenceMono, chunk, referenceFrame);
+    echoCanceller.pushReference(referenceFrame, produced, now);
+    samples += chunk * channels;
+    frames -= chunk;
+  }
+  xSemaphoreGive(aecLock);
+}
+
+// The speaker port was reclocked; the reference follows it onto the uplink
+// clock. The speaker never runs below AUDIO_QUALITY_SPEAKER, which the
+// reference buffers are sized for.
+void setEchoReferenceRate(uint32_t speakerRate)
+{
+  if (!aecLock || speakerRate < AUDIO_QUALITY_SPEAKER)
+  {
+    return;
+  }
+  xSemaphoreTake(aecLock, portMAX_DELAY);
+  referenceRate = speakerRate;
+  if (aecReady)
+  {
+    aecReady = referenceResampler.begin(referenceRate, uplinkRate);
+    if (!aecReady)
+    {
+      Serial.println("Echo reference resampler init failed, falling back to half-duplex");
+    }
+  }
+  xSemaphoreGive(aecLock);
+}
+
+// Playback was cut short: whatever was queued will not reach the speaker
+void cancelEchoReference()
+{
+  if (!aecReady || xSemaphoreTake(aecLock, portMAX_DELAY) != pdTRUE)
+  {
+    return;
+  }
+  echoCanceller.cancelReference(captureNow());
+  referenceResampler.reset();
+  xSemaphoreGive(aecLock);
+}
+
+bool micEndpointDetected()
+{
+  return endpointDetected;
+}
+
+static void initVad()
+{
+  if (vadReady)
+  {
+    return;
+  }
+
+  VadConfig config;
+  config.frameSamples = uplinkFrameSamples;
+  config.hangoverFrames = VAD_HANGOVER_MS / VAD_FRAME_MS;
+  config.speechRatio = VAD_SPEECH_RATIO;
+  config.minEnergy = VAD_MIN_ENERGY;
+  config.maxZcrPerMille = VAD_MAX_ZCR;
+  vad.begin(config);
+  initEchoCanceller();
+  vadReady = applyUplinkRate(uplinkRate);
+}
+
+void detectSound(const int16_t *buffer, size_t length)
 {
   if (!buffer || length == 0)
   {
@@ -59,18 +499,181 @@ void detectSound(int16_t *buffer, size_t length)
   // sendBinaryData(buffer, length * sizeof(int16_t));
 }
 
-esp_err_t setupMicrophone()
+#if MIC_BEAMFORMING
+// Splits interleaved slots: the first stays in place, compacted, the second
+// goes to `second`. Safe in place because slot i is read before index i is
+// written.
+template <typename T>
+static void deinterleave(T *interleaved, T *second, size_t frames)
+{
+  for (size_t i = 0; i < frames; i++)
+  {
+    T first = interleaved[2 * i];
+    second[i] = interleaved[2 * i + 1];
+    interleaved[i] = first;
+  }
+}
+
+// Steers only while the room is not full of our own playback, which would
+// pull the beam towards the speaker and move the echo path under the AEC
+static void beamform(int16_t *out, size_t frames)
+{
+  int64_t start = esp_timer_get_time();
+  bool adapt = millis() - lastSpkrActivity >= BEAM_SPEAKER_HOLDOFF_MS;
+  beamformer.process(beamFirst, beamSecond, out, frames, adapt);
+  uint32_t elapsed = (uint32_t)(esp_timer_get_time() - start);
+  if (elapsed > micStats.beamPeakUs)
+  {
+    micStats.beamPeakUs = elapsed;
+  }
+}
+
+// Interleaved slots of `frames` frames into mono: both mics converted, then
+// beamformed. raw is deinterleaved in place.
+static void convertMicFrames(MicSlot *raw, int16_t *out, size_t frames)
+{
+#if SAMPLE_BITS == 32
+  deinterleave(raw, rawSecond, frames);
+  micConverter.process(raw, beamFirst, frames);
+  secondConverter.process(rawSecond, beamSecond, frames);
+#else
+  deinterleave(raw, beamSecond, frames);
+  memcpy(beamFirst, raw, frames * sizeof(int16_t));
+#endif
+  if (beamReady)
+  {
+    beamform(out, frames);
+  }
+  else
+  {
+    memcpy(out, beamFirst, frames * sizeof(int16_t));
+  }
+}
+#else
+// 32-bit slots are extracted, DC-blocked and scaled in a single pass
+static void convertMicFrames(MicSlot *raw, int16_t *out, size_t frames)
+{
+#if SAMPLE_BITS == 32
+  micConverter.process(raw, out, frames);
+#else
+  memcpy(out, raw, frames * sizeof(int16_t));
+#endif
+}
+#endif
+
+#if AUDIO_HAL_I2S_STD
+static AudioChannel micChannel;
+static AudioBlock micBlock;          // DMA buffer being converted
+static size_t micBlockOffset = 0;    // frames of it already taken
+static bool micBlockHeld = false;
+static volatile int64_t micReadEndUs = 0; // when the last frame read was captured
+
+// Converts straight out of the DMA buffers the channel lends, in chunks
+// the DSP scratch buffers can take. A block can span calls.
+static esp_err_t readMicSamples(int16_t *out, size_t samples, size_t *samplesRead, TickType_t timeout)
+{
+  esp_err_t result = ESP_OK;
+  size_t total = 0;
+  while (total < samples)
+  {
+    if (micBlockHeld && !micChannel.inTime(micBlock))
+    {
+      // Lapped while held across calls: its frames are gone
+      micChannel.release(micBlock);
+      micBlockHeld = false;
+    }
+    if (!micBlockHeld)
+    {
+      if (!micChannel.acquire(&micBlock, timeout))
+      {
+        result = ESP_ERR_TIMEOUT;
+        break;
+      }
+      micBlockHeld = true;
+      micBlockOffset = 0;
+    }
+    size_t got = min(min(samples - total, (size_t)MIC_READ_SAMPLES), micBlock.frames - micBlockOffset);
+    convertMicFrames((MicSlot *)micBlock.data + micBlockOffset * MIC_SLOTS, out + total, got);
+    micBlockOffset += got;
+    total += got;
+    micReadEndUs = micBlock.timeUs + (int64_t)micBlockOffset * 1000000 / AUDIO_QUALITY_MIC;
+    if (micBlockOffset == micBlock.frames)
+    {
+      micChannel.release(micBlock);
+      micBlockHeld = false;
+    }
+  }
+  *samplesRead = total;
+  return result;
+}
+#else
+// Reads 16-bit samples from the mic. With 32-bit slots or both mics the
+// DMA block is read into rawBuffer and converted from there.
+static esp_err_t readMicSamples(int16_t *out, size_t samples, size_t *samplesRead, TickType_t timeout)
+{
+#if SAMPLE_BITS == 32 || MIC_BEAMFORMING
+  esp_err_t result = ESP_OK;
+  size_t total = 0;
+  while (total < samples)
+  {
+    size_t chunk = min(samples - total, (size_t)MIC_READ_SAMPLES);
+    size_t bytesIn = 0;
+    result = i2s_read(I2S_PORT_MIC, rawBuffer, chunk * MIC_SLOTS * sizeof(rawBuffer[0]), &bytesIn, timeout);
+    size_t got = bytesIn / (MIC_SLOTS * sizeof(rawBuffer[0]));
+    convertMicFrames(rawBuffer, out + total, got);
+    total += got;
+    if (result != ESP_OK || got < chunk)
+    {
+      break;
+    }
+  }
+  *samplesRead = total;
+  return result;
+#else
+  size_t bytesIn = 0;
+  esp_err_t result = i2s_read(I2S_PORT_MIC, out, samples * sizeof(int16_t), &bytesIn, timeout);
+  *samplesRead = bytesIn / sizeof(int16_t);
+  return result;
+#endif
+}
+#endif
+
+#if AUDIO_HAL_I2S_STD
+// Starts the capture channel; micChannel keeps the DMA health counters
+static esp_err_t installMicDriver(const DmaGeometry &geometry)
+{
+  AudioPins pins = {I2S_SCK, I2S_WS, -1, I2S_SD};
+  esp_err_t result = micChannel.begin(AudioChannel::RX, I2S_PORT_MIC, AUDIO_QUALITY_MIC, SAMPLE_BITS, MIC_BEAMFORMING,
+                                      geometry, pins);
+  if (result != ESP_OK)
+  {
+    Serial.printf("Error starting I2S channel: %s\n", esp_err_to_name(result));
+    return result;
+  }
+  micChannel.setActive(true);
+  return ESP_OK;
+}
+
+static AudioChannel &micHealth = micChannel;
+#else
+// Counts DMA overruns: the capture task fell a whole ring behind
+static I2sMonitor micMonitor;
+
+static esp_err_t installMicDriver(const DmaGeometry &geometry)
 {
-  // i2s_driver_uninstall(I2S_PORT_MIC);
   i2s_config_t i2s_config = {
       .mode = i2s_mode_t(I2S_MODE_MASTER | I2S_MODE_RX),
       .sample_rate = AUDIO_QUALITY_MIC,
-      .bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT,
+      .bits_per_sample = i2s_bits_per_sample_t(SAMPLE_BITS),
+#if MIC_BEAMFORMING
+      .channel_format = I2S_CHANNEL_FMT_RIGHT_LEFT,
+#else
       .channel_format = I2S_CHANNEL_FMT_ONLY_LEFT,
+#endif
       .communication_format = i2s_comm_format_t(I2S_COMM_FORMAT_STAND_I2S),
       .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
-      .dma_buf_count = 8,
-      .dma_buf_len = 64,
+      .dma_buf_count = geometry.count,
+      .dma_buf_len = geometry.frames,
       .use_apll = false,
       .tx_desc_auto_clear = false,
       .fixed_mclk = 0};
@@ -81,14 +684,12 @@ esp_err_t setupMicrophone()
       .data_out_num = I2S_PIN_NO_CHANGE,
       .data_in_num = I2S_SD};
 
-  // Validate I2S port
-  if (I2S_PORT_MIC < I2S_NUM_0 || I2S_PORT_MIC >= I2S_NUM_MAX)
+  if (!micMonitor.begin("mic events", I2S_MONITOR_PRIORITY, MIC_CAPTURE_CORE))
   {
-    Serial.println("Invalid I2S port number");
-    return ESP_ERR_INVALID_ARG;
+    return ESP_ERR_NO_MEM;
   }
-
-  esp_err_t result = i2s_driver_install(I2S_PORT_MIC, &i2s_config, 0, NULL);
+  QueueHandle_t events = NULL;
+  esp_err_t result = i2s_driver_install(I2S_PORT_MIC, &i2s_config, I2S_EVENT_QUEUE_LENGTH, &events);
   if (result != ESP_OK)
   {
     Serial.printf("Error installing I2S driver: %s\n", esp_err_to_name(result));
@@ -102,14 +703,74 @@ esp_err_t setupMicrophone()
     i2s_driver_uninstall(I2S_PORT_MIC);
     return result;
   }
+  micMonitor.setActive(true);
+  micMonitor.attach(events);
+  return ESP_OK;
+}
 
-  Serial.println("I2S microphone initialized successfully");
+static I2sMonitor &micHealth = micMonitor;
+#endif
+
+static DmaGeometry micDma = {0, 0};
+
+esp_err_t setupMicrophone()
+{
+  // Validate I2S port
+  if (I2S_PORT_MIC < I2S_NUM_0 || I2S_PORT_MIC >= I2S_NUM_MAX)
+  {
+    Serial.println("Invalid I2S port number");
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  micDma = dmaGeometry(MIC_LATENCY_PROFILE, false, AUDIO_QUALITY_MIC, (SAMPLE_BITS / 8) * (MIC_BEAMFORMING ? 2 : 1));
+  esp_err_t result = installMicDriver(micDma);
+  if (result != ESP_OK)
+  {
+    return result;
+  }
+
+#if SAMPLE_BITS == 32
+  micConverter.begin(MIC_GAIN_SHIFT, MIC_DC_BLOCK_SHIFT);
+#if MIC_BEAMFORMING
+  secondConverter.begin(MIC_GAIN_SHIFT, MIC_DC_BLOCK_SHIFT);
+#endif
+#endif
+#if MIC_BEAMFORMING
+  beamReady = beamformer.begin(AUDIO_QUALITY_MIC, MIC_SPACING_MM);
+  if (!beamReady)
+  {
+    Serial.println("Beamformer setup failed, using the first mic only");
+  }
+#endif
+
+  Serial.printf("I2S microphone initialized successfully, DMA %u x %u frames, %u ms (%s)\n", (unsigned)micDma.count,
+                (unsigned)micDma.frames, (unsigned)dmaLatencyMs(micDma, AUDIO_QUALITY_MIC),
+                latencyProfileName(MIC_LATENCY_PROFILE));
   return ESP_OK;
 }
 
+// Pauses the mic port while the speaker has the bus; what the DMA holds
+// is dropped, so a resumed capture starts fresh
+void setMicPortRunning(bool running)
+{
+#if AUDIO_HAL_I2S_STD
+  micChannel.setRunning(running);
+#else
+  if (running)
+  {
+    i2s_start(I2S_PORT_MIC);
+  }
+  else
+  {
+    i2s_stop(I2S_PORT_MIC);
+    i2s_zero_dma_buffer(I2S_PORT_MIC);
+  }
+#endif
+}
+
 esp_err_t handleMicrophone()
 {
-  size_t bytes_read = 0;
+  size_t samples_read = 0;
   const size_t bufferSize = bufferLen;
   int16_t *buffer = (int16_t *)audio_malloc(bufferSize * sizeof(int16_t));
 
@@ -119,40 +780,531 @@ esp_err_t handleMicrophone()
     return ESP_ERR_NO_MEM;
   }
 
-  esp_err_t result = i2s_read(I2S_PORT_MIC, buffer, bufferSize * sizeof(int16_t), &bytes_read, portMAX_DELAY);
-  if (result == ESP_OK && bytes_read > 0)
+  esp_err_t result = readMicSamples(buffer, bufferSize, &samples_read, portMAX_DELAY);
+  if (result == ESP_OK && samples_read > 0)
   {
-    detectSound(buffer, bytes_read / sizeof(int16_t));
+    detectSound(buffer, samples_read);
   }
 
   free(buffer);
   return result;
 }
 
-void micTask(void *parameter) {
-    while (true) {
-        vTaskDelay(pdMS_TO_TICKS(1));
-        
-        if (isRecording) {
-            size_t bytesIn = 0;
-            esp_err_t result = i2s_read(I2S_PORT_MIC, &soundBuffer, bufferLen, &bytesIn, portMAX_DELAY);
-            
-            if (result == ESP_OK) {
-                detectSound(soundBuffer, bytesIn / sizeof(int16_t));
-                if (isWebSocketConnected) {
-                    sendBinaryData(soundBuffer, bytesIn);
-                }
-            } else {
-                Serial.printf("I2S read error: %d\n", result);
-                delay(100);  // Add delay on error
-            }
-            
-            esp_task_wdt_reset();
-            vTaskDelay(pdMS_TO_TICKS(1));
-        } else {
-            vTaskDelay(pdMS_TO_TICKS(10));
+// Measures the background level before any task reads the mic, so the
+// first utterance after boot is judged against the room, not a guess.
+esp_err_t calibrateMicNoiseFloor(uint32_t durationMs)
+{
+  initVad();
+
+  int16_t *frame = (int16_t *)audio_malloc(MIC_FRAME_SAMPLES * sizeof(int16_t));
+  int16_t *decimated = (int16_t *)audio_malloc(uplinkResampler.maxOutput(MIC_FRAME_SAMPLES) * sizeof(int16_t));
+  if (!frame || !decimated)
+  {
+    free(frame);
+    free(decimated);
+    return ESP_ERR_NO_MEM;
+  }
+
+  esp_err_t result = ESP_OK;
+  for (uint32_t elapsed = 0; elapsed < durationMs; elapsed += VAD_FRAME_MS)
+  {
+    size_t samplesIn = 0;
+    result = readMicSamples(frame, MIC_FRAME_SAMPLES, &samplesIn, pdMS_TO_TICKS(100));
+    if (result != ESP_OK || samplesIn < MIC_FRAME_SAMPLES)
+    {
+      break;
+    }
+    uplinkResampler.process(frame, MIC_FRAME_SAMPLES, decimated);
+    // Also gives the suppressor a head start on the noise estimate
+    if (nsReady && nsEnabled)
+    {
+      noiseSuppressor.process(decimated, uplinkFrameSamples);
+    }
+    vad.calibrate(decimated);
+  }
+  vad.finishCalibration();
+  uplinkResampler.reset();
+  noiseSuppressor.reset();
+  free(frame);
+  free(decimated);
+
+  Serial.printf("Mic noise floor: %u\n", (unsigned)vad.noiseFloor());
+  return result;
+}
+
+esp_err_t startMicTasks()
+{
+  initVad();
+
+  if (!micRing.begin((size_t)AUDIO_QUALITY_MIC * MIC_RING_MS / 1000, AudioRing::DROP_NEWEST))
+  {
+    return ESP_ERR_NO_MEM;
+  }
+
+  // Uplink buffers are sized for the mic rate so any later rate fits
+  frameScratch = (int16_t *)audio_malloc(MIC_FRAME_SAMPLES * sizeof(int16_t));
+  uplinkFrame = (int16_t *)audio_malloc(UPLINK_CAPACITY * sizeof(int16_t));
+  paddingFrame = (int16_t *)audio_malloc(UPLINK_CAPACITY * sizeof(int16_t));
+  encodedFrame = (uint8_t *)audio_malloc(adpcmBlockBytes(UPLINK_CAPACITY));
+  prerollFrames = (int16_t *)audio_malloc(PREROLL_FRAMES * UPLINK_CAPACITY * sizeof(int16_t));
+  if (!frameScratch || !uplinkFrame || !paddingFrame || !encodedFrame || !prerollFrames)
+  {
+    return ESP_ERR_NO_MEM;
+  }
+
+  xTaskCreatePinnedToCore(micCaptureTask, "micCapture", 4096, NULL, MIC_CAPTURE_PRIORITY, NULL, MIC_CAPTURE_CORE);
+  xTaskCreatePinnedToCore(micSenderTask, "micSender", 8192, NULL, MIC_SENDER_PRIORITY, NULL, MIC_SENDER_CORE);
+  Serial.printf("Mic pipeline started, ring %u samples, uplink %u Hz\n", (unsigned)micRing.capacity(), (unsigned)uplinkResampler.outputRate());
+  return ESP_OK;
+}
+
+// Only moves samples from I2S DMA into the ring; never touches the network,
+// so a stalled socket cannot back up into the DMA buffers.
+void micCaptureTask(void *parameter)
+{
+  while (true)
+  {
+    if (!isRecording && !micAlwaysOn())
+    {
+      vTaskDelay(pdMS_TO_TICKS(10));
+      continue;
+    }
+
+    // Land samples straight in the ring when a whole block fits, otherwise
+    // read into scratch and let the ring drop what it cannot take
+    int16_t *span;
+    bool zeroCopy = micRing.reserve(&span, MIC_READ_SAMPLES) == MIC_READ_SAMPLES;
+    int16_t *target = zeroCopy ? span : soundBuffer;
+
+    size_t samplesIn = 0;
+    esp_err_t result = readMicSamples(target, MIC_READ_SAMPLES, &samplesIn, portMAX_DELAY);
+    if (result != ESP_OK)
+    {
+      micStats.readErrors++;
+      Serial.printf("I2S read error: %d\n", result);
+      vTaskDelay(pdMS_TO_TICKS(100));
+      continue;
+    }
+
+    size_t queued = samplesIn;
+    if (zeroCopy)
+    {
+      micRing.commit(samplesIn);
+    }
+    else
+    {
+      // Also taken when the free space wraps the ring's end; only a short
+      // write is an overrun
+      queued = micRing.write(soundBuffer, samplesIn);
+      if (queued < samplesIn)
+      {
+        micStats.captureOverruns++;
+        micStats.captureDroppedBytes += (samplesIn - queued) * sizeof(int16_t);
+      }
+    }
+    // Counts what entered the ring, the same samples the sender consumes
+    capturedSamples += queued;
+#if AUDIO_HAL_I2S_STD
+    capturedAtUs = micReadEndUs;
+#endif
+
+    size_t depth = micRing.available() * sizeof(int16_t);
+    if (depth > micStats.ringPeakBytes)
+    {
+      micStats.ringPeakBytes = depth;
+    }
+
+    esp_task_wdt_reset();
+  }
+}
+
+static void sendAudio(const int16_t *samples, size_t count, UplinkCodec codec)
+{
+  const void *payload = samples;
+  size_t bytesOut = count * sizeof(int16_t);
+  if (codec == UPLINK_IMA_ADPCM)
+  {
+    bytesOut = adpcmEncoder.encodeBlock(samples, count, encodedFrame);
+    payload = encodedFrame;
+  }
+
+  if (isWebSocketConnected && sendBinaryData(payload, bytesOut))
+  {
+    micStats.bytesSent += bytesOut;
+  }
+  else
+  {
+    micStats.sendFailures++;
+    micStats.senderDroppedBytes += bytesOut;
+  }
+}
+
+// Decimates mic-rate samples into uplinkFrame, cancels speaker echo,
+// denoises them and tracks the worst-case cost
+static size_t preprocess(const int16_t *samples, size_t count)
+{
+  int64_t start = esp_timer_get_time();
+  size_t produced = uplinkResampler.process(samples, count, uplinkFrame);
+  if (aecReady)
+  {
+    echoCanceller.process(uplinkFrame, produced, uplinkPosition);
+  }
+  uplinkPosition += produced;
+  consumedSamples += count;
+  if (nsReady && nsEnabled)
+  {
+    noiseSuppressor.process(uplinkFrame, produced);
+  }
+  uint32_t elapsed = (uint32_t)(esp_timer_get_time() - start);
+  if (elapsed > micStats.dspPeakUs)
+  {
+    micStats.dspPeakUs = elapsed;
+  }
+  return produced;
+}
+
+// Feeds one uplink frame to the keyword spotter. The network only runs
+// while the VAD hears something; the budget is tracked like the DSP's.
+static void listenForWakeWord(bool speech)
+{
+  if (!kwsReady || !wakeWordEnabled)
+  {
+    return;
+  }
+  // Without echo cancellation the answer itself could say the keyword
+  if (!aecReady && millis() - lastSpkrActivity < WAKE_WORD_SPEAKER_HOLDOFF_MS)
+  {
+    speech = false;
+  }
+
+  int64_t start = esp_timer_get_time();
+  size_t produced = kwsResampler.process(uplinkFrame, uplinkFrameSamples, kwsFrame);
+  if (keywordSpotter.process(kwsFrame, produced, speech))
+  {
+    wakeWordDetected = true;
+  }
+  uint32_t elapsed = (uint32_t)(esp_timer_get_time() - start);
+  if (elapsed > micStats.kwsPeakUs)
+  {
+    micStats.kwsPeakUs = elapsed;
+  }
+}
+
+static void sendSilenceMarker(uint32_t ms)
+{
+  char message[48];
+  snprintf(message, sizeof(message), "{\"type\":\"silence\",\"ms\":%u}", (unsigned)ms);
+  sendMessage(message);
+}
+
+// DTX and endpointing state of the turn being sent
+struct TurnState
+{
+  UplinkCodec codec;
+  uint32_t silenceMs;
+  uint32_t trailingMs;
+  bool heardSpeech;
+  bool hasPadding;
+};
+
+// How many of a frame's uplink samples belong to the turn. The frame starts
+// at ring sample `start`; while recording everything from turnStart on
+// counts, after the release only what came before sendUntil.
+static size_t turnSamples(uint32_t start, size_t micCount, size_t uplinkCount, bool recording)
+{
+  if ((int32_t)(start + micCount - turnStart) <= 0)
+  {
+    return 0;
+  }
+  if (recording)
+  {
+    return uplinkCount;
+  }
+  int32_t left = (int32_t)(sendUntil - start);
+  if (left <= 0)
+  {
+    return 0;
+  }
+  if ((size_t)left >= micCount)
+  {
+    return uplinkCount;
+  }
+  return (size_t)((uint64_t)left * uplinkCount / micCount);
+}
+
+// Levels and sends one frame of a turn. Silent frames are replaced by a
+// silence marker (DTX), keeping the last one as padding so word onsets are
+// not clipped.
+static void sendTurnFrame(TurnState &turn, int16_t *samples, size_t count, bool speech)
+{
+  // VAD judged the raw level; AGC levels what is sent
+  if (agcEnabled)
+  {
+    agc.process(samples, count, speech);
+  }
+
+  if (speech || !dtxEnabled)
+  {
+    if (turn.silenceMs > 0)
+    {
+      sendSilenceMarker(turn.silenceMs);
+      turn.silenceMs = 0;
+    }
+    if (turn.hasPadding)
+    {
+      sendAudio(paddingFrame, uplinkFrameSamples, turn.codec);
+      turn.hasPadding = false;
+    }
+    sendAudio(samples, count, turn.codec);
+  }
+  else
+  {
+    if (turn.hasPadding)
+    {
+      turn.silenceMs += VAD_FRAME_MS;
+      micStats.suppressedBytes += uplinkFrameSamples * sizeof(int16_t);
+    }
+    // A short last frame is only padding; it never precedes more speech
+    if (count == uplinkFrameSamples)
+    {
+      memcpy(paddingFrame, samples, count * sizeof(int16_t));
+      turn.hasPadding = true;
+    }
+  }
+
+  // Endpointing: trailing silence after some speech ends the turn
+  if (speech)
+  {
+    turn.heardSpeech = true;
+    turn.trailingMs = 0;
+  }
+  else if (turn.heardSpeech)
+  {
+    turn.trailingMs += VAD_FRAME_MS;
+    if (autoStopEnabled && isRecording && turn.trailingMs >= VAD_ENDPOINT_MS)
+    {
+      endpointDetected = true;
+    }
+  }
+}
+
+static void keepPreroll(uint32_t start, bool speech)
+{
+  if (MIC_PREROLL_MS == 0)
+  {
+    return;
+  }
+  memcpy(prerollFrames + prerollHead * UPLINK_CAPACITY, uplinkFrame, uplinkFrameSamples * sizeof(int16_t));
+  prerollStamps[prerollHead] = start;
+  prerollSpeech[prerollHead] = speech;
+  prerollHead = (prerollHead + 1) % PREROLL_FRAMES;
+  if (prerollCount < PREROLL_FRAMES)
+  {
+    prerollCount++;
+  }
+}
+
+// Opens a turn with the kept frames that fall after turnStart, oldest first
+static void flushPreroll(TurnState &turn)
+{
+  for (size_t i = 0; i < prerollCount; i++)
+  {
+    size_t slot = (prerollHead + PREROLL_FRAMES - prerollCount + i) % PREROLL_FRAMES;
+    if ((int32_t)(prerollStamps[slot] + MIC_FRAME_SAMPLES - turnStart) > 0)
+    {
+      sendTurnFrame(turn, prerollFrames + slot * UPLINK_CAPACITY, uplinkFrameSamples, prerollSpeech[slot]);
+    }
+  }
+  prerollCount = 0;
+}
+
+// Drains the ring one VAD frame at a time, decimating straight from ring
+// memory to the uplink rate. Frames inside the turn are sent; the rest feed
+// the pre-roll, barge-in and wake word listeners. Blocking here only grows
+// the ring.
+void micSenderTask(void *parameter)
+{
+  uint32_t session = recordingSession;
+  TurnState turn = {uplinkCodec, 0, 0, false, false};
+  bool turnOpen = false;
+  uint32_t bargeInMs = 0;
+
+  while (true)
+  {
+    if (pendingKwsModel != activeKwsModel)
+    {
+      applyWakeWordModel(pendingKwsModel);
+    }
+
+    if (session != recordingSession)
+    {
+      session = recordingSession;
+      bool rateChanged = uplinkRate != uplinkResampler.outputRate();
+      if (rateChanged)
+      {
+        applyUplinkRate(uplinkRate);
+        prerollCount = 0; // kept at the old rate
+      }
+      if (turn.codec != uplinkCodec || rateChanged)
+      {
+        sendHello();
+      }
+      // An always-on mic keeps one continuous stream through the front end
+      if (!micAlwaysOn())
+      {
+        uplinkResampler.reset();
+        noiseSuppressor.reset();
+      }
+      agc.reset();
+      adpcmEncoder.reset();
+      vad.reset();
+      keywordSpotter.reset();
+      TurnState fresh = {uplinkCodec, 0, 0, false, false};
+      turn = fresh;
+      turnOpen = true;
+      bargeInMs = 0;
+      flushPreroll(turn);
+    }
+
+    // The release stamp has been reached: nothing more goes out this turn
+    if (turnOpen && !isRecording && (int32_t)(consumedSamples - sendUntil) >= 0)
+    {
+      turnOpen = false;
+    }
+
+    if (!micRing.waitForData(MIC_FRAME_SAMPLES, 50))
+    {
+      // Less than a frame left after release: ship it if we were talking.
+      // An always-on capture never pauses, so whole frames keep coming.
+      size_t tail = micRing.available();
+      if (!isRecording && !micAlwaysOn() && tail > 0 && tail < MIC_FRAME_SAMPLES)
+      {
+        isSending = true;
+        uint32_t start = consumedSamples;
+        micRing.read(frameScratch, tail);
+        size_t produced = preprocess(frameScratch, tail);
+        size_t count = turnOpen ? turnSamples(start, tail, produced, false) : 0;
+        if (count > 0)
+        {
+          sendTurnFrame(turn, uplinkFrame, count, vad.inSpeech());
         }
+        isSending = false;
+      }
+      continue;
     }
+
+    isSending = true;
+    // A session that changed under us is picked up at the top of the next
+    // round, after its pre-roll; until then this frame is not part of it
+    bool recording = isRecording && session == recordingSession;
+    uint32_t start = consumedSamples;
+    const int16_t *frame;
+    bool zeroCopy = micRing.peek(&frame, MIC_FRAME_SAMPLES) == MIC_FRAME_SAMPLES;
+    if (!zeroCopy)
+    {
+      // Frame straddles the end of the ring
+      micRing.read(frameScratch, MIC_FRAME_SAMPLES);
+      frame = frameScratch;
+    }
+
+    // Whole 20 ms frames decimate to exactly uplinkFrameSamples
+    preprocess(frame, MIC_FRAME_SAMPLES);
+    if (zeroCopy)
+    {
+      micRing.release(MIC_FRAME_SAMPLES);
+    }
+
+    bool speech = vad.process(uplinkFrame);
+    digitalWrite(LED_MIC, speech ? HIGH : LOW);
+
+    size_t count = turnOpen ? turnSamples(start, MIC_FRAME_SAMPLES, uplinkFrameSamples, recording) : 0;
+    if (count == 0)
+    {
+      // Between turns the mic only listens for the user talking over the
+      // answer; what is left after echo cancellation is near-end speech
+      bool overPlayback = speech && echoCanceller.referenceActive(uplinkPosition);
+      bargeInMs = overPlayback ? bargeInMs + VAD_FRAME_MS : 0;
+      if (bargeInMs >= BARGE_IN_MS)
+      {
+        bargeInDetected = true;
+      }
+      listenForWakeWord(speech);
+      keepPreroll(start, speech);
+      isSending = false;
+      continue;
+    }
+
+    sendTurnFrame(turn, uplinkFrame, count, speech);
+    isSending = false;
+  }
+}
+
+bool waitMicDrained(uint32_t timeoutMs)
+{
+  unsigned long start = millis();
+  while ((int32_t)(sendUntil - consumedSamples) > 0 || isSending)
+  {
+    if (millis() - start >= timeoutMs)
+    {
+      return false;
+    }
+    vTaskDelay(pdMS_TO_TICKS(2));
+  }
+  return true;
+}
+
+MicStats getMicStats()
+{
+  MicStats stats;
+  stats.captureOverruns = micStats.captureOverruns;
+  stats.captureDroppedBytes = micStats.captureDroppedBytes;
+  stats.readErrors = micStats.readErrors;
+  stats.senderDroppedBytes = micStats.senderDroppedBytes;
+  stats.sendFailures = micStats.sendFailures;
+  stats.bytesSent = micStats.bytesSent;
+  stats.suppressedBytes = micStats.suppressedBytes;
+  stats.ringPeakBytes = micStats.ringPeakBytes;
+  stats.dspPeakUs = micStats.dspPeakUs;
+#if SAMPLE_BITS == 32 && MIC_BEAMFORMING
+  stats.clippedSamples = micConverter.clippedSamples() + secondConverter.clippedSamples();
+#elif SAMPLE_BITS == 32
+  stats.clippedSamples = micConverter.clippedSamples();
+#else
+  stats.clippedSamples = 0;
+#endif
+  stats.agcGainDb10 = agcEnabled ? agc.gainDb10() : 0;
+  stats.nsGain = nsReady && nsEnabled ? noiseSuppressor.lastGain() : 32767;
+  stats.limitedSamples = agc.limiter().limitedSamples();
+  stats.aecErleDb10 = aecReady ? echoCanceller.erleDb10() : 0;
+  stats.aecDelayMs = aecReady ? (uint16_t)(echoCanceller.delay() * 1000 / uplinkRate) : 0;
+  stats.kwsPeakUs = micStats.kwsPeakUs;
+  I2sHealthStats health = micHealth.stats();
+  stats.dmaOverruns = health.overruns;
+  stats.dmaMaxGapUs = health.maxIntervalUs;
+  stats.kwsInferences = keywordSpotter.inferences();
+#if MIC_BEAMFORMING
+  stats.beamAngleDeg = beamformer.angleDegrees();
+  stats.beamCoherence = beamformer.coherence();
+#else
+  stats.beamAngleDeg = 0;
+  stats.beamCoherence = 0;
+#endif
+  stats.beamPeakUs = micStats.beamPeakUs;
+  return stats;
+}
+
+void logMicStats()
+{
+  MicStats stats = getMicStats();
+  Serial.printf("Mic: sent %u B, suppressed %u B, overruns %u (%u B), read errors %u, send failures %u (%u B), ring peak %u/%u B, DSP peak %u us, clipped %u, AGC %.1f dB (limited %u), NS gain %.2f, AEC %.1f dB at %u ms, KWS peak %u us (%u runs), beam %d deg (coherence %u%%, peak %u us), DMA overruns %u (max gap %u us)\n",
+                (unsigned)stats.bytesSent, (unsigned)stats.suppressedBytes, (unsigned)stats.captureOverruns, (unsigned)stats.captureDroppedBytes,
+                (unsigned)stats.readErrors, (unsigned)stats.sendFailures, (unsigned)stats.senderDroppedBytes,
+                (unsigned)stats.ringPeakBytes, (unsigned)(micRing.capacity() * sizeof(int16_t)), (unsigned)stats.dspPeakUs, (unsigned)stats.clippedSamples,
+                stats.agcGainDb10 / 10.0f, (unsigned)stats.limitedSamples, stats.nsGain / 32768.0f,
+                stats.aecErleDb10 / 10.0f, (unsigned)stats.aecDelayMs, (unsigned)stats.kwsPeakUs, (unsigned)stats.kwsInferences,
+                stats.beamAngleDeg, (unsigned)stats.beamCoherence, (unsigned)stats.beamPeakUs,
+                (unsigned)stats.dmaOverruns, (unsigned)stats.dmaMaxGapUs);
+  micHealth.resetPeaks();
 }
 // void micTask(void *parameter)
 // {
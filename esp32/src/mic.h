@@ -3,10 +3,74 @@
 
 #include <Arduino.h>
 
-void detectSound(int16_t *buffer, size_t length);
+struct KwsModel;
+
+// Encoding of uplink audio messages, announced to the server in the hello
+enum UplinkCodec
+{
+  UPLINK_PCM16,
+  UPLINK_IMA_ADPCM
+};
+
+// Counters shared by the capture and sender tasks
+struct MicStats
+{
+  uint32_t captureOverruns;     // capture blocks that did not fit in the ring
+  uint32_t captureDroppedBytes; // bytes lost to those overruns
+  uint32_t readErrors;          // failed i2s_read calls
+  uint32_t senderDroppedBytes;  // bytes drained but not delivered to the socket
+  uint32_t sendFailures;        // failed WebSocket sends
+  uint32_t bytesSent;            // bytes on the wire, after encoding
+  uint32_t suppressedBytes;     // silent audio replaced by silence markers
+  size_t ringPeakBytes;         // high-water mark of the ring since the last reset
+  uint32_t dspPeakUs;           // slowest frame through resampler and suppressor since the last reset
+  uint32_t clippedSamples;      // samples saturated by the capture gain shift
+  int16_t agcGainDb10;          // current AGC gain in tenths of a dB
+  uint16_t nsGain;              // noise suppressor mean gain of the last hop, Q15
+  uint32_t limitedSamples;      // samples the AGC limiter had to pull down
+  int16_t aecErleDb10;          // echo return loss enhancement, tenths of a dB
+  uint16_t aecDelayMs;          // estimated speaker-to-mic bulk delay
+  uint32_t kwsPeakUs;           // slowest frame through the keyword spotter since the last reset
+  uint32_t kwsInferences;       // keyword network runs since the model was loaded
+  int8_t beamAngleDeg;          // beamformer steering, degrees from broadside
+  uint8_t beamCoherence;        // inter-mic correlation at that steering, percent
+  uint32_t beamPeakUs;          // slowest capture block through the beamformer since the last reset
+  uint32_t dmaOverruns;         // I2S DMA ring full before the capture task read it
+  uint32_t dmaMaxGapUs;         // longest gap between DMA completions since the last reset
+};
+
+void detectSound(const int16_t *buffer, size_t length);
 esp_err_t setupMicrophone();
+void setMicPortRunning(bool running);
 esp_err_t handleMicrophone();
-void micTask(void *parameter);
+esp_err_t calibrateMicNoiseFloor(uint32_t durationMs);
+esp_err_t startMicTasks();
+void micCaptureTask(void *parameter);
+void micSenderTask(void *parameter);
 void setRecording(bool recording);
+void setRecordingAt(bool recording, uint32_t sample);
+uint32_t micSampleClock();
+uint32_t micSampleAt(int64_t timeUs);
+bool waitMicDrained(uint32_t timeoutMs);
+void setVadOptions(bool dtx, bool autoStop);
+void setAgcEnabled(bool enabled);
+void setNoiseSuppressionEnabled(bool enabled);
+void setUplinkCodec(UplinkCodec codec);
+UplinkCodec getUplinkCodec();
+const char *uplinkCodecName(UplinkCodec codec);
+bool setUplinkSampleRate(uint32_t rate);
+uint32_t getUplinkSampleRate();
+bool micEndpointDetected();
+bool micFullDuplex();
+bool micBargeInDetected();
+bool micAlwaysOn();
+void setWakeWordModel(const KwsModel *model);
+void setWakeWordEnabled(bool enabled);
+bool micWakeWordDetected();
+void pushEchoReference(const int16_t *samples, size_t frames, uint8_t channels);
+void cancelEchoReference();
+void setEchoReferenceRate(uint32_t speakerRate);
+MicStats getMicStats();
+void logMicStats();
 
 #endif
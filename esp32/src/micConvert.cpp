@@ -0,0 +1,53 @@
+#include "micConvert.h"
+
+static const uint8_t FRACTION_BITS = 4;
+
+MicSampleConverter::MicSampleConverter()
+    : outShift(8), dcShift(8), prevIn(0), prevOut(0), clipped(0) {
+}
+
+void MicSampleConverter::begin(uint8_t gain, uint8_t dc) {
+    setGainShift(gain);
+    dcShift = dc > 0 && dc < 16 ? dc : 8;
+    clipped = 0;
+    reset();
+}
+
+void MicSampleConverter::reset() {
+    prevIn = 0;
+    prevOut = 0;
+}
+
+void MicSampleConverter::setGainShift(uint8_t gain) {
+    outShift = 8 - (gain > 8 ? 8 : gain);
+}
+
+void MicSampleConverter::process(const int32_t *raw, int16_t *out, size_t count) {
+    int32_t x1 = prevIn;
+    int32_t y1 = prevOut;
+    uint32_t clips = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        // 24-bit sample in the top of the slot, kept with 4 fraction bits so
+        // the filter's rounding leaves no residual DC; the sign survives
+        int32_t x = raw[i] >> (8 - FRACTION_BITS);
+        // y = x - x[n-1] + (1 - 2^-k) y[n-1], stays within 29 bits
+        int32_t y = x - x1 + y1 - (y1 >> dcShift);
+        x1 = x;
+        y1 = y;
+
+        int32_t s = y >> (outShift + FRACTION_BITS);
+        if (s > 32767) {
+            s = 32767;
+            clips++;
+        } else if (s < -32768) {
+            s = -32768;
+            clips++;
+        }
+        out[i] = (int16_t)s;
+    }
+
+    prevIn = x1;
+    prevOut = y1;
+    clipped += clips;
+}
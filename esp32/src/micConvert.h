@@ -0,0 +1,34 @@
+#ifndef MIC_CONVERT_H
+#define MIC_CONVERT_H
+
+#include <cstdint>
+#include <cstddef>
+
+// Converts native 32-bit I2S slots from a 24-bit MEMS mic (INMP441) to
+// 16-bit PCM in one pass: extract the left-justified 24-bit sample, remove
+// DC with a one-pole high-pass, apply a power-of-two gain and saturate.
+// Shift-only arithmetic, state carried across blocks.
+class MicSampleConverter {
+public:
+    MicSampleConverter();
+
+    // gainShift: extra bits of gain over plain 24 -> 16 truncation (0..8)
+    // dcShift: high-pass pole at 1 - 2^-dcShift (8 is ~27 Hz at 44.1 kHz)
+    void begin(uint8_t gainShift, uint8_t dcShift);
+    void reset();
+    void setGainShift(uint8_t gainShift);
+
+    void process(const int32_t *raw, int16_t *out, size_t count);
+
+    uint8_t gainShift() const { return 8 - outShift; }
+    uint32_t clippedSamples() const { return clipped; }
+
+private:
+    uint8_t outShift;
+    uint8_t dcShift;
+    int32_t prevIn;
+    int32_t prevOut;
+    uint32_t clipped;
+};
+
+#endif // MIC_CONVERT_H
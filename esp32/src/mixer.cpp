@@ -0,0 +1,159 @@
+#include "mixer.h"
+#include <Arduino.h>
+#include "utils.h"
+
+static const int32_t Q15_ONE = 32767;
+static const uint16_t MAX_GAIN_Q12 = 8192; // Q15 gain times a full-scale sample stays inside int32
+
+static int32_t rampStep(uint32_t sampleRate, uint16_t ms) {
+    uint32_t frames = sampleRate * ms / 1000;
+    return frames > 0 ? (int32_t)(Q15_ONE / frames) + 1 : Q15_ONE;
+}
+
+AudioMixer::AudioMixer()
+    : count(0), capacity(0), sum(NULL), scratch(NULL), duckFloor(Q15_ONE), attackStep(Q15_ONE),
+      releaseStep(Q15_ONE) {
+}
+
+AudioMixer::~AudioMixer() {
+    release();
+}
+
+void AudioMixer::release() {
+    free(sum);
+    free(scratch);
+    sum = NULL;
+    scratch = NULL;
+    capacity = 0;
+}
+
+// Sources stay registered across a re-begin at another rate
+bool AudioMixer::begin(uint32_t sampleRate, size_t maxFrames, int8_t duckDb, uint16_t attackMs, uint16_t releaseMs) {
+    if (sampleRate == 0 || maxFrames == 0) {
+        return false;
+    }
+    if (maxFrames != capacity) {
+        release();
+        sum = (int32_t *)audio_malloc(maxFrames * 2 * sizeof(int32_t));
+        scratch = (int16_t *)audio_malloc(maxFrames * 2 * sizeof(int16_t));
+        if (!sum || !scratch) {
+            release();
+            return false;
+        }
+        capacity = maxFrames;
+    }
+    duckFloor = (int32_t)(powf(10.0f, (duckDb < 0 ? duckDb : 0) / 20.0f) * Q15_ONE);
+    attackStep = rampStep(sampleRate, attackMs);
+    releaseStep = rampStep(sampleRate, releaseMs);
+    for (uint8_t s = 0; s < count; s++) {
+        sources[s].duck = Q15_ONE;
+        sources[s].lastFrames = 0;
+    }
+    return true;
+}
+
+int AudioMixer::addSource(const char *name, MixerFill fill, void *context, uint8_t priority, uint16_t gainQ12) {
+    if (!fill || count >= MAX_SOURCES) {
+        return -1;
+    }
+    Source &source = sources[count];
+    source.name = name;
+    source.fill = fill;
+    source.context = context;
+    source.priority = priority;
+    source.gainQ12 = gainQ12 > MAX_GAIN_Q12 ? MAX_GAIN_Q12 : gainQ12;
+    source.duck = Q15_ONE;
+    source.lastFrames = 0;
+    return count++;
+}
+
+void AudioMixer::setGain(int id, uint16_t gainQ12) {
+    if (id >= 0 && id < count) {
+        sources[id].gainQ12 = gainQ12 > MAX_GAIN_Q12 ? MAX_GAIN_Q12 : gainQ12;
+    }
+}
+
+size_t AudioMixer::lastFrames(int id) const {
+    return id >= 0 && id < count ? sources[id].lastFrames : 0;
+}
+
+uint16_t AudioMixer::duckGain(int id) const {
+    return id >= 0 && id < count ? (uint16_t)sources[id].duck : 0;
+}
+
+const char *AudioMixer::sourceName(int id) const {
+    return id >= 0 && id < count ? sources[id].name : "";
+}
+
+size_t AudioMixer::mix(int16_t *out, size_t frames) {
+    if (!sum || !out) {
+        return 0;
+    }
+    if (frames > capacity) {
+        frames = capacity;
+    }
+    memset(sum, 0, frames * 2 * sizeof(int32_t));
+
+    // Highest priority first, so a source knows whether anything above it
+    // plays in this very block
+    bool done[MAX_SOURCES] = {false};
+    int activePriority = -1;
+    size_t longest = 0;
+    for (uint8_t pass = 0; pass < count; pass++) {
+        int pick = -1;
+        for (uint8_t s = 0; s < count; s++) {
+            if (!done[s] && (pick < 0 || sources[s].priority > sources[pick].priority)) {
+                pick = s;
+            }
+        }
+        done[pick] = true;
+        Source &source = sources[pick];
+
+        size_t produced = source.fill(source.context, scratch, frames);
+        if (produced > frames) {
+            produced = frames;
+        }
+        source.lastFrames = produced;
+
+        int32_t target = activePriority > source.priority ? duckFloor : Q15_ONE;
+        int32_t step = target < source.duck ? attackStep : releaseStep;
+        int32_t duck = source.duck;
+        int32_t gain = source.gainQ12;
+        for (size_t i = 0; i < produced; i++) {
+            if (duck < target) {
+                duck = duck + step < target ? duck + step : target;
+            } else if (duck > target) {
+                duck = duck - step > target ? duck - step : target;
+            }
+            int32_t g = (gain * duck) >> 12;
+            sum[2 * i] += ((int32_t)scratch[2 * i] * g) >> 15;
+            sum[2 * i + 1] += ((int32_t)scratch[2 * i + 1] * g) >> 15;
+        }
+        // A silent source still moves toward its target, so it does not
+        // come back at the wrong level
+        if (produced < frames) {
+            int32_t remaining = step * (int32_t)(frames - produced);
+            if (duck < target) {
+                duck = target - duck < remaining ? target : duck + remaining;
+            } else if (duck > target) {
+                duck = duck - target < remaining ? target : duck - remaining;
+            }
+        }
+        source.duck = duck;
+
+        if (produced > 0) {
+            if (source.priority > activePriority) {
+                activePriority = source.priority;
+            }
+            if (produced > longest) {
+                longest = produced;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < longest * 2; i++) {
+        int32_t v = sum[i];
+        out[i] = (int16_t)(v > 32767 ? 32767 : (v < -32768 ? -32768 : v));
+    }
+    return longest;
+}
@@ -0,0 +1,67 @@
+#ifndef MIXER_H
+#define MIXER_H
+
+#include <cstdint>
+#include <cstddef>
+
+// Fills up to `frames` interleaved stereo frames at the mixer rate and
+// returns how many it wrote; 0 when the source has nothing to play
+typedef size_t (*MixerFill)(void *context, int16_t *out, size_t frames);
+
+// Fixed-point mixer for the speaker port. Sources are pulled once per
+// block, scaled by their own Q12 gain and summed in 32 bits with one
+// saturation at the end. While a source plays, every source of lower
+// priority is ducked by duckDb; the duck gain ramps linearly per sample,
+// fast down and slow back up, so speech over the radio does not click.
+// The block is as long as the longest source wrote; shorter ones count as
+// silence after their end. Buffers are allocated once in begin().
+class AudioMixer {
+public:
+    static const uint8_t MAX_SOURCES = 6;
+
+    AudioMixer();
+    ~AudioMixer();
+
+    bool begin(uint32_t sampleRate, size_t maxFrames, int8_t duckDb, uint16_t attackMs, uint16_t releaseMs);
+
+    // Returns the source id, or -1 when the table is full. Not safe while
+    // mix() runs; register everything before the playback task starts.
+    int addSource(const char *name, MixerFill fill, void *context, uint8_t priority, uint16_t gainQ12);
+    void setGain(int id, uint16_t gainQ12);
+
+    size_t mix(int16_t *out, size_t frames);
+
+    // Frames each source contributed to the last block
+    size_t lastFrames(int id) const;
+    // Current duck gain of a source, Q15
+    uint16_t duckGain(int id) const;
+    const char *sourceName(int id) const;
+    uint8_t sourceCount() const { return count; }
+
+private:
+    struct Source {
+        const char *name;
+        MixerFill fill;
+        void *context;
+        uint8_t priority;
+        volatile uint16_t gainQ12;
+        int32_t duck;       // Q15
+        size_t lastFrames;
+    };
+
+    void release();
+
+    Source sources[MAX_SOURCES];
+    uint8_t count;
+    size_t capacity;     // frames
+    int32_t *sum;        // capacity * 2
+    int16_t *scratch;    // capacity * 2
+    int32_t duckFloor;   // Q15
+    int32_t attackStep;  // Q15 per frame
+    int32_t releaseStep; // Q15 per frame
+
+    AudioMixer(const AudioMixer &);
+    AudioMixer &operator=(const AudioMixer &);
+};
+
+#endif // MIXER_H
@@ -0,0 +1,203 @@
+#include "noiseSuppressor.h"
+#include <Arduino.h>
+#include <float.h>
+#include "utils.h"
+
+// Minimum tracked over SUBWINDOWS sub-windows of SUBWINDOW_MS each
+static const uint8_t SUBWINDOWS = 8;
+static const uint16_t SUBWINDOW_MS = 192;
+static const float SMOOTHING = 0.85f;   // power smoothing per hop
+static const float MIN_BIAS = 1.8f;     // minimum of a smoothed periodogram underestimates the mean
+static const float DD_WEIGHT = 0.97f;   // decision-directed a priori SNR weight
+// Extra fraction bits through the FFT; 16-bit input plus log2(n) <= 11 of
+// growth still fits int32
+static const uint8_t PRECISION_BITS = 4;
+
+NoiseSuppressor::NoiseSuppressor()
+    : hop(0), bins(0), pos(0), gainFloor(0.0f), window(NULL), input(NULL), output(NULL), overlap(NULL), re(NULL), im(NULL),
+      smoothed(NULL), noise(NULL), cleanPower(NULL), currentMin(NULL), subwindowMin(NULL), hopsPerSubwindow(1), hopsInSubwindow(0),
+      subwindow(0), warmedUp(false), meanGain(32767) {
+}
+
+NoiseSuppressor::~NoiseSuppressor() {
+    release();
+}
+
+void NoiseSuppressor::release() {
+    free(window);
+    free(input);
+    free(output);
+    free(overlap);
+    free(re);
+    free(im);
+    free(smoothed);
+    free(noise);
+    free(cleanPower);
+    free(currentMin);
+    free(subwindowMin);
+    window = input = output = NULL;
+    overlap = re = im = NULL;
+    smoothed = noise = cleanPower = currentMin = subwindowMin = NULL;
+}
+
+bool NoiseSuppressor::begin(uint32_t sampleRate, uint16_t hopMs, int8_t minGainDb) {
+    release();
+    hop = (uint16_t)(sampleRate * hopMs / 1000);
+    if (hop == 0 || hopMs == 0) {
+        return false;
+    }
+    hopsPerSubwindow = SUBWINDOW_MS / hopMs > 0 ? SUBWINDOW_MS / hopMs : 1;
+
+    uint8_t log2Size = 1;
+    while ((1u << log2Size) < 2u * hop) {
+        log2Size++;
+    }
+    if (log2Size > 11 || !fft.begin(log2Size)) {
+        return false;
+    }
+    uint16_t n = fft.size();
+    bins = n / 2 + 1;
+    gainFloor = powf(10.0f, minGainDb / 20.0f);
+
+    window = (int16_t *)audio_malloc(2 * hop * sizeof(int16_t));
+    input = (int16_t *)audio_malloc(2 * hop * sizeof(int16_t));
+    output = (int16_t *)audio_malloc(hop * sizeof(int16_t));
+    overlap = (int32_t *)audio_malloc(hop * sizeof(int32_t));
+    re = (int32_t *)audio_malloc(n * sizeof(int32_t));
+    im = (int32_t *)audio_malloc(n * sizeof(int32_t));
+    smoothed = (float *)audio_malloc(bins * sizeof(float));
+    noise = (float *)audio_malloc(bins * sizeof(float));
+    cleanPower = (float *)audio_malloc(bins * sizeof(float));
+    currentMin = (float *)audio_malloc(bins * sizeof(float));
+    subwindowMin = (float *)audio_malloc(SUBWINDOWS * bins * sizeof(float));
+    if (!window || !input || !output || !overlap || !re || !im || !smoothed || !noise || !cleanPower ||
+        !currentMin || !subwindowMin) {
+        release();
+        return false;
+    }
+
+    // sqrt of a periodic Hann: analysis times synthesis sums to one at 50% overlap
+    for (uint16_t i = 0; i < 2 * hop; i++) {
+        window[i] = (int16_t)lrintf(sinf(PI * i / (2 * hop)) * 32767.0f);
+    }
+
+    for (uint16_t k = 0; k < bins; k++) {
+        smoothed[k] = 0.0f;
+        noise[k] = 0.0f;
+        cleanPower[k] = 0.0f;
+        currentMin[k] = FLT_MAX;
+    }
+    for (uint32_t i = 0; i < (uint32_t)SUBWINDOWS * bins; i++) {
+        subwindowMin[i] = FLT_MAX;
+    }
+    hopsInSubwindow = 0;
+    subwindow = 0;
+    warmedUp = false;
+    reset();
+    return true;
+}
+
+// Clears buffered audio but keeps the noise estimate for the next utterance
+void NoiseSuppressor::reset() {
+    if (!window) {
+        return;
+    }
+    memset(input, 0, 2 * hop * sizeof(int16_t));
+    memset(output, 0, hop * sizeof(int16_t));
+    memset(overlap, 0, hop * sizeof(int32_t));
+    pos = 0;
+    meanGain = 32767;
+}
+
+void NoiseSuppressor::process(int16_t *samples, size_t count) {
+    if (!window) {
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        int16_t sample = samples[i];
+        samples[i] = output[pos];
+        input[hop + pos] = sample;
+        if (++pos == hop) {
+            processHop();
+            pos = 0;
+        }
+    }
+}
+
+void NoiseSuppressor::processHop() {
+    uint16_t n = fft.size();
+    uint16_t frame = 2 * hop;
+
+    for (uint16_t i = 0; i < frame; i++) {
+        re[i] = ((int32_t)input[i] * window[i]) >> (15 - PRECISION_BITS);
+        im[i] = 0;
+    }
+    for (uint16_t i = frame; i < n; i++) {
+        re[i] = 0;
+        im[i] = 0;
+    }
+    memmove(input, input + hop, hop * sizeof(int16_t));
+
+    fft.forward(re, im);
+
+    float gainSum = 0.0f;
+    for (uint16_t k = 0; k < bins; k++) {
+        float power = (float)re[k] * re[k] + (float)im[k] * im[k];
+
+        // Minimum statistics on the smoothed periodogram
+        smoothed[k] = warmedUp ? SMOOTHING * smoothed[k] + (1.0f - SMOOTHING) * power : power;
+        if (smoothed[k] < currentMin[k]) {
+            currentMin[k] = smoothed[k];
+        }
+        float minimum = currentMin[k];
+        for (uint8_t u = 0; u < SUBWINDOWS; u++) {
+            float candidate = subwindowMin[u * bins + k];
+            if (candidate < minimum) {
+                minimum = candidate;
+            }
+        }
+        noise[k] = MIN_BIAS * minimum + 1.0f;
+
+        // Decision-directed a priori SNR, Wiener gain with a floor
+        float posteriori = power / noise[k];
+        float instant = posteriori > 1.0f ? posteriori - 1.0f : 0.0f;
+        float priori = DD_WEIGHT * cleanPower[k] / noise[k] + (1.0f - DD_WEIGHT) * instant;
+        float gain = priori / (1.0f + priori);
+        if (gain < gainFloor) {
+            gain = gainFloor;
+        }
+        cleanPower[k] = gain * gain * power;
+        gainSum += gain;
+
+        // Same real gain on the mirrored bin keeps the spectrum Hermitian
+        int32_t g = (int32_t)(gain * 32767.0f);
+        re[k] = (int32_t)(((int64_t)re[k] * g) >> 15);
+        im[k] = (int32_t)(((int64_t)im[k] * g) >> 15);
+        if (k > 0 && k < n / 2) {
+            re[n - k] = (int32_t)(((int64_t)re[n - k] * g) >> 15);
+            im[n - k] = (int32_t)(((int64_t)im[n - k] * g) >> 15);
+        }
+    }
+    meanGain = (uint16_t)(gainSum / bins * 32767.0f);
+    warmedUp = true;
+
+    // Rotate sub-windows so the tracked minimum forgets after
+    // SUBWINDOWS * SUBWINDOW_MS and rising noise is followed
+    if (++hopsInSubwindow >= hopsPerSubwindow) {
+        memcpy(subwindowMin + subwindow * bins, currentMin, bins * sizeof(float));
+        memcpy(currentMin, smoothed, bins * sizeof(float));
+        subwindow = (subwindow + 1) % SUBWINDOWS;
+        hopsInSubwindow = 0;
+    }
+
+    fft.inverse(re, im);
+
+    // Synthesis window and overlap-add; the inverse FFT is scaled by n
+    uint8_t shift = fft.log2Size() + PRECISION_BITS;
+    for (uint16_t i = 0; i < hop; i++) {
+        int32_t first = (int32_t)(((int64_t)re[i] * window[i]) >> 15) >> shift;
+        int32_t sum = overlap[i] + first;
+        output[i] = (int16_t)(sum > 32767 ? 32767 : (sum < -32768 ? -32768 : sum));
+        overlap[i] = (int32_t)(((int64_t)re[hop + i] * window[hop + i]) >> 15) >> shift;
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef NOISE_SUPPRESSOR_H
+#define NOISE_SUPPRESSOR_H
+
+#include <cstdint>
+#include <cstddef>
+#include "fft.h"
+
+// Streaming spectral noise suppressor. Weighted overlap-add STFT with
+// sqrt-Hann windows and 50% overlap on the fixed-point FFT; per bin a
+// minimum-statistics noise estimate (minimum of the smoothed power over
+// about a second and a half) and a decision-directed Wiener gain with a
+// floor against musical noise. Output lags input by two hops.
+class NoiseSuppressor {
+public:
+    NoiseSuppressor();
+    ~NoiseSuppressor();
+
+    bool begin(uint32_t sampleRate, uint16_t hopMs, int8_t minGainDb);
+    void reset();
+
+    // In place, any block size
+    void process(int16_t *samples, size_t count);
+
+    uint16_t latency() const { return 2 * hop; }
+    // Mean gain of the last hop, Q15
+    uint16_t lastGain() const { return meanGain; }
+
+private:
+    void processHop();
+    void release();
+
+    FixedFft fft;
+    uint16_t hop;
+    uint16_t bins;
+    uint16_t pos;
+    float gainFloor;
+    int16_t *window;    // 2 * hop, sqrt-Hann, Q15
+    int16_t *input;     // last 2 * hop input samples
+    int16_t *output;    // next hop of output
+    int32_t *overlap;   // second half of the previous synthesis frame
+    int32_t *re;
+    int32_t *im;
+    float *smoothed;    // per-bin smoothed power
+    float *noise;
+    float *cleanPower;  // previous hop's gain^2 * power, for decision-directed SNR
+    float *currentMin;
+    float *subwindowMin; // SUBWINDOWS x bins
+    uint16_t hopsPerSubwindow;
+    uint16_t hopsInSubwindow;
+    uint8_t subwindow;
+    bool warmedUp;
+    uint16_t meanGain;
+
+    NoiseSuppressor(const NoiseSuppressor &);
+    NoiseSuppressor &operator=(const NoiseSuppressor &);
+};
+
+#endif // NOISE_SUPPRESSOR_H
@@ -0,0 +1,248 @@
+#include "resampler.h"
+#include <Arduino.h>
+#include "utils.h"
+
+// Sub-sample resolution of the phase accumulator
+static const uint32_t ACC_SCALE_BITS = 8;
+static const float KAISER_BETA = 6.0f; // ~60 dB stopband
+static const float PASSBAND = 0.90f;   // cutoff relative to the lower Nyquist
+static const int32_t MAX_TRIM_PPM = 10000;
+
+static uint32_t gcd(uint32_t a, uint32_t b) {
+    while (b) {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Zeroth-order modified Bessel function, for the Kaiser window
+static float besselI0(float x) {
+    float sum = 1.0f;
+    float term = 1.0f;
+    float half = x * 0.5f;
+    for (int k = 1; k < 25; k++) {
+        term *= (half / k) * (half / k);
+        sum += term;
+        if (term < sum * 1e-9f) {
+            break;
+        }
+    }
+    return sum;
+}
+
+Resampler::Resampler()
+    : inRate(0), outRate(0), taps(0), phases(0), phaseWidth(1), denom(1), step(1), acc(0), trimmable(false),
+      trim(0), coefs(NULL), history(NULL), writePos(0) {
+}
+
+Resampler::~Resampler() {
+    release();
+}
+
+void Resampler::release() {
+    free(coefs);
+    free(history);
+    coefs = NULL;
+    history = NULL;
+}
+
+bool Resampler::begin(uint32_t inputRate, uint32_t outputRate, uint16_t tapCount, bool canTrim) {
+    if (inputRate == 0 || outputRate == 0) {
+        return false;
+    }
+
+    release();
+    inRate = inputRate;
+    outRate = outputRate;
+    trimmable = canTrim;
+    trim = 0;
+    if (isPassthrough()) {
+        return true;
+    }
+
+    // A trimmed ratio lands between phases, so it gets all of them
+    uint32_t g = gcd(inRate, outRate);
+    uint32_t upFactor = outRate / g;
+    phases = upFactor <= MAX_PHASES && !trimmable ? upFactor : MAX_PHASES;
+    denom = outRate << ACC_SCALE_BITS;
+    step = inRate << ACC_SCALE_BITS;
+    phaseWidth = denom / phases;
+
+    // Longer filters when decimating, so the transition band stays narrow
+    // relative to the output Nyquist
+    float ratio = outRate < inRate ? (float)inRate / outRate : 1.0f;
+    if (tapCount == 0) {
+        tapCount = (uint16_t)(24.0f * ratio);
+    }
+    taps = (tapCount + 3) & ~3;
+    if (taps > 128) {
+        taps = 128;
+    }
+
+    coefs = (int16_t *)audio_malloc((phases + 1) * taps * sizeof(int16_t));
+    history = (int16_t *)audio_malloc(2 * taps * sizeof(int16_t));
+    if (!coefs || !history) {
+        release();
+        return false;
+    }
+
+    // Tap k of phase p weights input n-k for an output at n - taps/2 + p/phases.
+    // Every phase is normalised to unity DC gain; its L1 norm stays well
+    // under 2, so an int32 accumulator cannot overflow.
+    float cutoff = PASSBAND * 0.5f / ratio; // cycles per input sample
+    float center = taps / 2.0f;
+    float windowNorm = besselI0(KAISER_BETA);
+    float bank[128];
+    for (uint32_t p = 0; p <= phases; p++) {
+        float sum = 0.0f;
+        for (uint16_t k = 0; k < taps; k++) {
+            float t = k - center + (float)p / phases;
+            float x = t / center;
+            float window = x * x < 1.0f ? besselI0(KAISER_BETA * sqrtf(1.0f - x * x)) / windowNorm : 0.0f;
+            float sinc = t == 0.0f ? 1.0f : sinf(2.0f * PI * cutoff * t) / (PI * t * 2.0f * cutoff);
+            bank[k] = 2.0f * cutoff * sinc * window;
+            sum += bank[k];
+        }
+        for (uint16_t k = 0; k < taps; k++) {
+            int32_t q = (int32_t)lrintf(bank[k] / sum * 32768.0f);
+            coefs[p * taps + (taps - 1 - k)] = (int16_t)(q > 32767 ? 32767 : (q < -32768 ? -32768 : q));
+        }
+    }
+
+    reset();
+    return true;
+}
+
+bool Resampler::setTrimPpm(int32_t ppm) {
+    if (!trimmable) {
+        return false;
+    }
+    trim = ppm < -MAX_TRIM_PPM ? -MAX_TRIM_PPM : (ppm > MAX_TRIM_PPM ? MAX_TRIM_PPM : ppm);
+    int64_t nominal = (int64_t)inRate << ACC_SCALE_BITS;
+    step = (uint32_t)(nominal + (nominal * trim + (trim >= 0 ? 500000 : -500000)) / 1000000);
+    return true;
+}
+
+void Resampler::reset() {
+    acc = 0;
+    writePos = 0;
+    if (history) {
+        memset(history, 0, 2 * taps * sizeof(int16_t));
+    }
+}
+
+size_t Resampler::maxOutput(size_t inputCount) const {
+    if (isPassthrough()) {
+        return inputCount;
+    }
+    return (size_t)(((uint64_t)inputCount * denom + step - 1) / step) + 1;
+}
+
+int32_t Resampler::dot(const int16_t *window, uint32_t phase) const {
+    const int16_t *c = coefs + phase * taps;
+    int32_t sum = 0;
+    for (uint16_t k = 0; k < taps; k += 4) {
+        sum += window[k] * c[k];
+        sum += window[k + 1] * c[k + 1];
+        sum += window[k + 2] * c[k + 2];
+        sum += window[k + 3] * c[k + 3];
+    }
+    return sum;
+}
+
+static inline int16_t saturate(int32_t value) {
+    return (int16_t)(value > 32767 ? 32767 : (value < -32768 ? -32768 : value));
+}
+
+// The output at the current accumulator position, between the two nearest
+// phases when the ratio has more than MAX_PHASES
+inline int32_t Resampler::interpolate(const int16_t *window) const {
+    uint32_t phase = acc / phaseWidth;
+    uint32_t remainder = acc - phase * phaseWidth;
+    int32_t y = (dot(window, phase) + (1 << 14)) >> 15;
+    if (remainder) {
+        int32_t next = (dot(window, phase + 1) + (1 << 14)) >> 15;
+        int32_t frac = (int32_t)((remainder << 15) / phaseWidth);
+        y += (int32_t)(((int64_t)(next - y) * frac) >> 15);
+    }
+    return y;
+}
+
+// Second copy keeps the newest `taps` samples contiguous
+inline void Resampler::pushHistory(int16_t sample) {
+    history[writePos] = sample;
+    history[writePos + taps] = sample;
+    if (++writePos == taps) {
+        writePos = 0;
+    }
+}
+
+size_t Resampler::process(const int16_t *input, size_t count, int16_t *out) {
+    if (isPassthrough()) {
+        if (out != input) {
+            memmove(out, input, count * sizeof(int16_t));
+        }
+        return count;
+    }
+    if (!coefs) {
+        return 0;
+    }
+
+    size_t produced = 0;
+    for (size_t i = 0; i < count; i++) {
+        pushHistory(input[i]);
+        const int16_t *window = history + writePos;
+        while (acc < denom) {
+            out[produced++] = saturate(interpolate(window));
+            acc += step;
+        }
+        acc -= denom;
+    }
+    return produced;
+}
+
+static inline int16_t downmix(const int16_t *frame, uint8_t channels) {
+    return channels == 1 ? frame[0] : (int16_t)(((int32_t)frame[0] + frame[1]) >> 1);
+}
+
+static inline int16_t applyGain(int32_t sample, int32_t gainQ12) {
+    return saturate((sample * gainQ12 + (1 << 11)) >> 12);
+}
+
+size_t Resampler::renderStereo(const int16_t *input, size_t frames, uint8_t channels, int32_t gainQ12, int16_t *out,
+                               size_t maxFrames, size_t *consumed) {
+    size_t produced = 0;
+    size_t i = 0;
+    if (isPassthrough()) {
+        for (; i < frames && i < maxFrames; i++) {
+            int16_t y = applyGain(downmix(input + i * channels, channels), gainQ12);
+            out[2 * i] = y;
+            out[2 * i + 1] = y;
+        }
+        *consumed = i;
+        return i;
+    }
+    if (!coefs) {
+        *consumed = frames;
+        return 0;
+    }
+
+    // Most outputs one input sample can release
+    size_t burst = (denom + step - 1) / step;
+    for (; i < frames && produced + burst <= maxFrames; i++) {
+        pushHistory(downmix(input + i * channels, channels));
+        const int16_t *window = history + writePos;
+        while (acc < denom) {
+            int16_t y = applyGain(saturate(interpolate(window)), gainQ12);
+            out[2 * produced] = y;
+            out[2 * produced + 1] = y;
+            produced++;
+            acc += step;
+        }
+        acc -= denom;
+    }
+    *consumed = i;
+    return produced;
+}
@@ -0,0 +1,76 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <cstdint>
+#include <cstddef>
+
+// Streaming polyphase FIR sample-rate converter with Q15 coefficients.
+//
+// The ratio is kept as an exact fraction in/out, so 44100 -> 16000 or
+// 24000 never drifts. Each phase of the filter bank is a Kaiser-windowed
+// sinc, low-passed at the lower of the two Nyquist rates. With up to
+// MAX_PHASES phases every output lands exactly on a phase and costs one
+// dot product; ratios needing more phases interpolate between the two
+// nearest ones. State (delay line and phase) carries across process()
+// calls, so blocks can be any size.
+//
+// A trimmable resampler always keeps MAX_PHASES phases, even at equal
+// rates, so the ratio can be nudged by a few ppm for clock drift without
+// dropping or repeating samples.
+class Resampler {
+public:
+    static const uint32_t MAX_PHASES = 256;
+
+    Resampler();
+    ~Resampler();
+
+    // taps = 0 picks a length from the ratio
+    bool begin(uint32_t inRate, uint32_t outRate, uint16_t taps = 0, bool trimmable = false);
+    void reset();
+
+    // Consumes all of input; out must hold maxOutput(count) samples
+    size_t process(const int16_t *input, size_t count, int16_t *out);
+    size_t maxOutput(size_t inputCount) const;
+
+    // The playback kernel in one pass: downmixes `channels`-interleaved
+    // frames, resamples, applies a Q12 gain and writes each sample to both
+    // slots of a stereo frame. Stops before out would pass maxFrames;
+    // *consumed is the number of input frames used.
+    size_t renderStereo(const int16_t *input, size_t frames, uint8_t channels, int32_t gainQ12, int16_t *out,
+                        size_t maxFrames, size_t *consumed);
+
+    // Positive ppm consumes input faster than the nominal ratio. Returns
+    // false on a resampler begun without trimmable.
+    bool setTrimPpm(int32_t ppm);
+    int32_t trimPpm() const { return trim; }
+
+    uint32_t inputRate() const { return inRate; }
+    uint32_t outputRate() const { return outRate; }
+    bool isPassthrough() const { return inRate == outRate && !trimmable; }
+    bool isTrimmable() const { return trimmable; }
+
+private:
+    int32_t dot(const int16_t *window, uint32_t phase) const;
+    int32_t interpolate(const int16_t *window) const;
+    void pushHistory(int16_t sample);
+    void release();
+
+    uint32_t inRate;
+    uint32_t outRate;
+    uint16_t taps;
+    uint32_t phases;
+    uint32_t phaseWidth; // accumulator units per phase
+    uint32_t denom;      // accumulator units per input sample
+    uint32_t step;       // accumulator units per output sample
+    uint32_t acc;        // position of the next output past the newest input
+    bool trimmable;
+    int32_t trim;        // ppm applied to step
+    int16_t *coefs;      // (phases + 1) x taps, reversed to match the window
+    int16_t *history;    // delay line, stored twice for a contiguous window
+    uint16_t writePos;
+
+    Resampler(const Resampler &);
+    Resampler &operator=(const Resampler &);
+};
+
+#endif // RESAMPLER_H
@@ -0,0 +1,141 @@
+#include "scheduledPlayout.h"
+#include <cstring>
+#include <math.h>
+
+static const int32_t UNITY_Q12 = 4096;
+
+ScheduledPlayout::ScheduledPlayout()
+    : rate(0), state(IDLE), pts(0), anchorLocal(0), anchorServer(0), position(0), skew(0), driftTrim(0),
+      stageStart(0), stageCount(0), resync(false), locked(false), lastError(0), lastTrim(0), resyncs(0), dropped(0),
+      silent(0) {
+}
+
+bool ScheduledPlayout::begin(uint32_t sampleRate) {
+    state = IDLE;
+    rate = sampleRate;
+    return resampler.begin(sampleRate, sampleRate, 0, true);
+}
+
+void ScheduledPlayout::start(int64_t ptsUs) {
+    pts = ptsUs;
+    position = 0;
+    stageStart = 0;
+    stageCount = 0;
+    resampler.reset();
+    locked = false;
+    state = WAITING;
+}
+
+void ScheduledPlayout::stop() {
+    state = IDLE;
+    stageCount = 0;
+}
+
+void ScheduledPlayout::setAnchor(int64_t localUs, int64_t serverUs) {
+    anchorLocal = localUs;
+    anchorServer = serverUs;
+}
+
+void ScheduledPlayout::setClock(int32_t skewPpm, int32_t driftTrimPpm) {
+    skew = skewPpm;
+    driftTrim = driftTrimPpm;
+}
+
+int64_t ScheduledPlayout::dueUs(uint64_t frame) const {
+    int64_t serverUs = pts + (int64_t)(frame * 1000000 / rate);
+    return anchorLocal + (int64_t)llround((double)(serverUs - anchorServer) / (1.0 + skew * 1e-6));
+}
+
+// Staged frames first, then straight from the buffer
+size_t ScheduledPlayout::skip(JitterBuffer &buffer, size_t frames) {
+    size_t staged = frames < stageCount ? frames : stageCount;
+    stageStart += staged;
+    stageCount -= staged;
+    size_t done = staged + buffer.discard((frames - staged) * 2) / 2;
+    position += done;
+    return done;
+}
+
+size_t ScheduledPlayout::render(JitterBuffer &buffer, int16_t *out, size_t frames, int64_t playAtUs) {
+    if (state == IDLE || frames == 0 || rate == 0) {
+        return 0;
+    }
+    int64_t error = playAtUs - dueUs(position);
+    int64_t blockUs = (int64_t)frames * 1000000 / rate;
+    if (state == WAITING && error <= -blockUs) {
+        return 0;
+    }
+    lastError = (int32_t)(error > INT32_MAX ? INT32_MAX : (error < INT32_MIN ? INT32_MIN : error));
+
+    size_t produced = 0;
+    if (state == WAITING || resync || error > RESYNC_US || error < -RESYNC_US) {
+        if (locked) {
+            resyncs++;
+        }
+        state = PLAYING;
+        resync = false;
+        locked = false;
+        if (error < 0) {
+            produced = (size_t)(-error * rate / 1000000);
+            produced = produced < frames ? produced : frames;
+            memset(out, 0, produced * 2 * sizeof(int16_t));
+            silent += produced;
+        } else {
+            dropped += skip(buffer, (size_t)(error * rate / 1000000));
+        }
+        error = 0;
+    } else {
+        locked = true;
+    }
+
+    int32_t servo = (int32_t)(error * SERVO_PPM_PER_MS / 1000);
+    servo = servo < -MAX_SERVO_PPM ? -MAX_SERVO_PPM : (servo > MAX_SERVO_PPM ? MAX_SERVO_PPM : servo);
+    lastTrim = driftTrim + servo;
+    resampler.setTrimPpm(lastTrim);
+
+    while (produced < frames) {
+        if (stageCount == 0) {
+            stageStart = 0;
+            stageCount = buffer.take(stage, STAGE_FRAMES * 2) / 2;
+            if (stageCount == 0) {
+                break;
+            }
+        }
+        size_t used = 0;
+        produced += resampler.renderStereo(stage + stageStart * 2, stageCount, 2, UNITY_Q12, out + produced * 2,
+                                           frames - produced, &used);
+        stageStart += used;
+        stageCount -= used;
+        position += used;
+        if (used == 0) {
+            // Less room left than one input frame can release
+            return produced;
+        }
+    }
+
+    if (produced < frames) {
+        if (buffer.drained()) {
+            if (produced == 0) {
+                state = IDLE;
+            }
+            return produced;
+        }
+        // Dry mid-stream: the timeline moves on, and whatever is late by
+        // the next block is skipped then
+        memset(out + produced * 2, 0, (frames - produced) * 2 * sizeof(int16_t));
+        silent += frames - produced;
+        produced = frames;
+        resync = true;
+    }
+    return produced;
+}
+
+ScheduleStats ScheduledPlayout::stats() const {
+    ScheduleStats s;
+    s.errorUs = lastError;
+    s.trimPpm = lastTrim;
+    s.resyncs = resyncs;
+    s.droppedFrames = dropped;
+    s.silentFrames = silent;
+    return s;
+}
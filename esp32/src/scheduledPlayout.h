@@ -0,0 +1,91 @@
+#ifndef SCHEDULED_PLAYOUT_H
+#define SCHEDULED_PLAYOUT_H
+
+#include <cstdint>
+#include <cstddef>
+#include "jitterBuffer.h"
+#include "resampler.h"
+
+struct ScheduleStats {
+    int32_t errorUs;        // last block: positive when playing late
+    int32_t trimPpm;        // ratio trim of the last block, servo included
+    uint32_t resyncs;       // errors too large to slew, jumped instead
+    uint32_t droppedFrames; // late audio skipped
+    uint32_t silentFrames;  // waited: before the start, early, or buffer dry
+};
+
+// Plays a stream against a timeline rather than on arrival, so speakers
+// fed the same stream sound as one. Frame m of the stream is due at server
+// time pts + m / rate. The server clock is mapped to ours through the
+// latest anchor, a pair of readings of the two clocks, and the skew, so a
+// refined clock estimate moves the timeline as the stream plays. The
+// caller says when each block it asks for will be on the wire.
+//
+// The start, and any error over RESYNC_US, is made good at once: silence
+// while early, skipping audio while late. Smaller errors are slewed out by
+// trimming the ratio of a fractional-delay resampler, a proportional
+// servo on top of the drift trim the caller passes in, so alignment holds
+// without clicks. A buffer that runs dry is played as silence and the
+// audio that arrives late is skipped, so the timeline never slips.
+//
+// Samples are interleaved stereo frames at the output rate, read from the
+// playout buffer with take(). Runs on the playback task only.
+class ScheduledPlayout {
+public:
+    ScheduledPlayout();
+
+    bool begin(uint32_t sampleRate);
+    // Frame 0 is due at server time ptsUs
+    void start(int64_t ptsUs);
+    void stop();
+    bool active() const { return state != IDLE; }
+
+    // The two clocks read at the same moment, and the server's skew
+    // against ours; drift trim is the ratio change that keeps pace with
+    // the server on this speaker clock
+    void setAnchor(int64_t localUs, int64_t serverUs);
+    void setClock(int32_t skewPpm, int32_t driftTrimPpm);
+
+    // Fills up to `frames`, the first of which plays at playAtUs. Returns
+    // 0 while nothing is due in the block, and once the stream has played
+    // out, after which it is no longer active.
+    size_t render(JitterBuffer &buffer, int16_t *out, size_t frames, int64_t playAtUs);
+
+    ScheduleStats stats() const;
+
+private:
+    enum State { IDLE, WAITING, PLAYING };
+    static const size_t STAGE_FRAMES = 128;
+    static const int32_t RESYNC_US = 10000;
+    static const int32_t SERVO_PPM_PER_MS = 200; // ~5 s to slew out an error
+    static const int32_t MAX_SERVO_PPM = 1000;
+
+    int64_t dueUs(uint64_t frame) const;
+    size_t skip(JitterBuffer &buffer, size_t frames);
+
+    Resampler resampler;
+    uint32_t rate;
+    volatile State state;
+    int64_t pts;
+    int64_t anchorLocal;
+    int64_t anchorServer;
+    uint64_t position; // frames of the stream consumed
+    int32_t skew;
+    int32_t driftTrim;
+    int16_t stage[STAGE_FRAMES * 2]; // taken from the buffer, not yet consumed
+    size_t stageStart;
+    size_t stageCount;
+    bool resync; // make good the next error at once, after a gap
+    bool locked; // the last block was slewed, not jumped
+
+    volatile int32_t lastError;
+    volatile int32_t lastTrim;
+    volatile uint32_t resyncs;
+    volatile uint32_t dropped;
+    volatile uint32_t silent;
+
+    ScheduledPlayout(const ScheduledPlayout &);
+    ScheduledPlayout &operator=(const ScheduledPlayout &);
+};
+
+#endif // SCHEDULED_PLAYOUT_H
@@ -0,0 +1,190 @@
+#include "timeStretch.h"
+#include <Arduino.h>
+#include "utils.h"
+
+static const uint16_t MIN_SPEED = 50;
+static const uint16_t MAX_SPEED = 200;
+
+TimeStretcher::TimeStretcher()
+    : channels(1), hop(0), search(0), speedPercent(100), window(NULL), input(NULL), capacity(0), filled(0),
+      previousStart(0), targetQ16(0), output(NULL), outputRead(0), outputFilled(0) {
+}
+
+TimeStretcher::~TimeStretcher() {
+    release();
+}
+
+void TimeStretcher::release() {
+    free(window);
+    free(input);
+    free(output);
+    window = input = output = NULL;
+}
+
+bool TimeStretcher::begin(uint32_t sampleRate, uint8_t channelCount, uint16_t frameMs, uint16_t searchMs) {
+    release();
+    if (sampleRate == 0 || channelCount == 0 || frameMs < 2) {
+        return false;
+    }
+    channels = channelCount;
+    hop = (uint16_t)(sampleRate * frameMs / 2000);
+    search = (uint16_t)(sampleRate * searchMs / 1000);
+    if (hop == 0) {
+        return false;
+    }
+    // The furthest a segment can reach: the previous segment's tail, a
+    // hop advanced at MAX_SPEED, the search and a full frame, with room
+    // for a write between compactions
+    capacity = 2 * hop + (size_t)hop * MAX_SPEED / 100 + 2 * search + 4 * hop;
+
+    window = (int16_t *)audio_malloc(2 * hop * sizeof(int16_t));
+    input = (int16_t *)audio_malloc(capacity * channels * sizeof(int16_t));
+    output = (int16_t *)audio_malloc((size_t)hop * channels * sizeof(int16_t));
+    if (!window || !input || !output) {
+        release();
+        return false;
+    }
+    // Periodic Hann: w[i] + w[i + hop] == 1, so overlapped segments keep their level
+    for (uint16_t i = 0; i < 2 * hop; i++) {
+        window[i] = (int16_t)lrintf((0.5f - 0.5f * cosf(PI * i / hop)) * 32767.0f);
+    }
+    reset();
+    return true;
+}
+
+void TimeStretcher::reset() {
+    if (!input) {
+        return;
+    }
+    // Start from a frame of silence, so the first segment fades in
+    memset(input, 0, 2 * hop * channels * sizeof(int16_t));
+    filled = 2 * hop;
+    previousStart = 0;
+    targetQ16 = (uint64_t)(2 * hop) << 16;
+    outputRead = 0;
+    outputFilled = 0;
+}
+
+void TimeStretcher::setSpeed(uint16_t percent) {
+    speedPercent = percent < MIN_SPEED ? MIN_SPEED : (percent > MAX_SPEED ? MAX_SPEED : percent);
+}
+
+size_t TimeStretcher::space() const {
+    return input ? capacity - filled : 0;
+}
+
+size_t TimeStretcher::write(const int16_t *frames, size_t count) {
+    if (!input) {
+        return 0;
+    }
+    compact();
+    size_t take = count < capacity - filled ? count : capacity - filled;
+    memcpy(input + filled * channels, frames, take * channels * sizeof(int16_t));
+    filled += take;
+    return take;
+}
+
+// Drops input no future segment can reach
+void TimeStretcher::compact() {
+    size_t target = (size_t)(targetQ16 >> 16);
+    size_t keep = previousStart + hop;
+    if (target > search && target - search < keep) {
+        keep = target - search;
+    } else if (target <= search) {
+        keep = 0;
+    }
+    if (keep == 0) {
+        return;
+    }
+    memmove(input, input + keep * channels, (filled - keep) * channels * sizeof(int16_t));
+    filled -= keep;
+    previousStart -= keep;
+    targetQ16 -= (uint64_t)keep << 16;
+}
+
+// Offset in [low, high] whose first hop best matches the natural
+// continuation at `natural`, by normalised cross-correlation
+size_t TimeStretcher::bestOffset(size_t natural, size_t low, size_t high, size_t step) const {
+    const int16_t *reference = input + natural * channels;
+    size_t stride = step * channels;
+    size_t best = low;
+    float bestScore = -2.0f;
+    for (size_t c = low; c <= high; c += step) {
+        const int16_t *candidate = input + c * channels;
+        int64_t xy = 0;
+        int64_t yy = 1;
+        for (size_t i = 0; i < (size_t)hop * channels; i += stride) {
+            xy += (int32_t)reference[i] * candidate[i];
+            yy += (int32_t)candidate[i] * candidate[i];
+        }
+        float score = (float)xy / sqrtf((float)yy);
+        if (score > bestScore) {
+            bestScore = score;
+            best = c;
+        }
+    }
+    return best;
+}
+
+bool TimeStretcher::produceHop() {
+    size_t natural = previousStart + hop;
+    size_t start;
+    if (speedPercent == 100) {
+        // Real time: the natural continuation is the input itself
+        if (natural + hop > filled) {
+            return false;
+        }
+        memcpy(output, input + natural * channels, (size_t)hop * channels * sizeof(int16_t));
+        previousStart = natural;
+        targetQ16 = (uint64_t)(natural + hop) << 16;
+        outputRead = 0;
+        outputFilled = hop;
+        return true;
+    }
+
+    size_t target = (size_t)(targetQ16 >> 16);
+    size_t low = target > search ? target - search : 0;
+    size_t high = target + search;
+    if (high + 2 * hop > filled || natural + hop > filled) {
+        return false;
+    }
+    start = bestOffset(natural, low, high, 2);
+    size_t refineLow = start > low ? start - 1 : low;
+    size_t refineHigh = start < high ? start + 1 : high;
+    start = bestOffset(natural, refineLow, refineHigh, 1);
+
+    // Fade the previous segment's tail into the new segment's head
+    const int16_t *tail = input + natural * channels;
+    const int16_t *head = input + start * channels;
+    for (uint16_t i = 0; i < hop; i++) {
+        int32_t fadeIn = window[i];
+        int32_t fadeOut = window[i + hop];
+        for (uint8_t ch = 0; ch < channels; ch++) {
+            size_t k = (size_t)i * channels + ch;
+            output[k] = (int16_t)((tail[k] * fadeOut + head[k] * fadeIn + (1 << 14)) >> 15);
+        }
+    }
+    previousStart = start;
+    targetQ16 += ((uint64_t)hop * speedPercent << 16) / 100;
+    outputRead = 0;
+    outputFilled = hop;
+    return true;
+}
+
+size_t TimeStretcher::read(int16_t *out, size_t count) {
+    if (!input) {
+        return 0;
+    }
+    size_t done = 0;
+    while (done < count) {
+        if (outputRead == outputFilled && !produceHop()) {
+            break;
+        }
+        size_t take = outputFilled - outputRead;
+        take = take < count - done ? take : count - done;
+        memcpy(out + done * channels, output + outputRead * channels, take * channels * sizeof(int16_t));
+        outputRead += take;
+        done += take;
+    }
+    return done;
+}
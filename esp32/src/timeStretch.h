@@ -0,0 +1,59 @@
+#ifndef TIME_STRETCH_H
+#define TIME_STRETCH_H
+
+#include <cstdint>
+#include <cstddef>
+
+// Streaming WSOLA time-scale modification: changes playback speed without
+// changing pitch. Output is built from Hann-windowed segments overlapped
+// by half a frame; each next segment is taken near its nominal input
+// position (advancing by speed x hop) at the offset, within +-searchMs,
+// whose waveform best continues the previous one. The search is coarse
+// (every other lag and sample) and then refined at full resolution. At
+// exactly 1x the input is copied through untouched.
+//
+// Works on interleaved frames; alignment is decided on the first channel.
+// All memory is allocated in begin().
+class TimeStretcher {
+public:
+    TimeStretcher();
+    ~TimeStretcher();
+
+    bool begin(uint32_t sampleRate, uint8_t channels, uint16_t frameMs = 20, uint16_t searchMs = 5);
+    void reset();
+
+    // Speed in percent of real time; 100 plays unchanged
+    void setSpeed(uint16_t percent);
+    uint16_t speed() const { return speedPercent; }
+
+    // Frames write() would take now
+    size_t space() const;
+    size_t write(const int16_t *frames, size_t count);
+    // Up to `count` frames of output; fewer when more input is needed
+    size_t read(int16_t *out, size_t count);
+
+private:
+    bool produceHop();
+    size_t bestOffset(size_t natural, size_t low, size_t high, size_t step) const;
+    void compact();
+    void release();
+
+    uint8_t channels;
+    uint16_t hop;         // synthesis hop, half a frame
+    uint16_t search;      // +- frames around the nominal position
+    uint16_t speedPercent;
+    int16_t *window;      // 2 * hop, Hann, Q15
+    int16_t *input;       // capacity frames
+    size_t capacity;
+    size_t filled;
+    size_t previousStart; // start of the last segment used
+    uint64_t targetQ16;   // nominal start of the next segment
+    int16_t *output;      // one hop
+    size_t outputRead;
+    size_t outputFilled;
+
+    TimeStretcher(const TimeStretcher &);
+    TimeStretcher &operator=(const TimeStretcher &);
+};
+
+#endif // TIME_STRETCH_H
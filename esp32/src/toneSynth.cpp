@@ -0,0 +1,135 @@
+#include "toneSynth.h"
+
+// sin(pi/2 * i / 64) in Q15
+static const int16_t QUARTER_SINE[65] = {
+    0, 804, 1608, 2410, 3212, 4011, 4808, 5602,
+    6393, 7179, 7962, 8739, 9512, 10278, 11039, 11793,
+    12539, 13279, 14010, 14732, 15446, 16151, 16846, 17530,
+    18204, 18868, 19519, 20159, 20787, 21403, 22005, 22594,
+    23170, 23731, 24279, 24811, 25329, 25832, 26319, 26790,
+    27245, 27683, 28105, 28510, 28898, 29268, 29621, 29956,
+    30273, 30571, 30852, 31113, 31356, 31580, 31785, 31971,
+    32137, 32285, 32412, 32521, 32609, 32678, 32728, 32757,
+    32767};
+
+static const uint8_t REQUEST_QUEUE_LENGTH = 2;
+
+int16_t ncoSine(uint32_t phase) {
+    uint32_t quadrant = phase >> 30;
+    uint32_t x = (phase >> 14) & 0xFFFF; // position within the quadrant, 16 bits
+    if (quadrant & 1) {
+        x = 0x10000 - x;
+    }
+    uint32_t index = x >> 10;
+    int32_t value = QUARTER_SINE[index];
+    if (index < 64) {
+        int32_t frac = (int32_t)(x & 0x3FF);
+        value += ((QUARTER_SINE[index + 1] - value) * frac) >> 10;
+    }
+    return (int16_t)(quadrant & 2 ? -value : value);
+}
+
+ToneSynth::ToneSynth()
+    : rate(0), requests(NULL), sequence(NULL), stepCount(0), stepIndex(0), stepFrames(0), stepPosition(0),
+      rampFrames(0), phase(0), phaseStep(0), level(0) {
+}
+
+ToneSynth::~ToneSynth() {
+    if (requests) {
+        vQueueDelete(requests);
+    }
+}
+
+// Safe to call again at another rate; a sequence in progress is dropped
+bool ToneSynth::begin(uint32_t sampleRate) {
+    if (sampleRate == 0) {
+        return false;
+    }
+    if (!requests) {
+        requests = xQueueCreate(REQUEST_QUEUE_LENGTH, sizeof(Request));
+        if (!requests) {
+            return false;
+        }
+    }
+    rate = sampleRate;
+    rampFrames = rate * RAMP_MS / 1000;
+    sequence = NULL;
+    return true;
+}
+
+bool ToneSynth::play(const ToneStep *steps, uint8_t count, uint8_t levelPercent) {
+    if (!requests || !steps || count == 0) {
+        return false;
+    }
+    Request request = {steps, count, levelPercent > 100 ? (uint8_t)100 : levelPercent};
+    return xQueueSend(requests, &request, 0) == pdTRUE;
+}
+
+void ToneSynth::stop() {
+    if (!requests) {
+        return;
+    }
+    Request request = {NULL, 0, 0};
+    xQueueSend(requests, &request, 0);
+}
+
+void ToneSynth::startStep() {
+    const ToneStep &step = sequence[stepIndex];
+    stepFrames = (uint32_t)step.ms * rate / 1000;
+    stepPosition = 0;
+    phase = 0;
+    phaseStep = ncoStep(step.frequencyHz, rate);
+}
+
+size_t ToneSynth::fillSource(void *synth, int16_t *out, size_t frames) {
+    return static_cast<ToneSynth *>(synth)->fill(out, frames);
+}
+
+size_t ToneSynth::fill(int16_t *out, size_t frames) {
+    Request request;
+    while (requests && xQueueReceive(requests, &request, 0) == pdTRUE) {
+        sequence = request.steps;
+        stepCount = request.count;
+        stepIndex = 0;
+        level = (int32_t)request.level * 32767 / 100;
+        if (sequence) {
+            startStep();
+        }
+    }
+
+    size_t written = 0;
+    while (sequence && written < frames) {
+        if (stepPosition >= stepFrames) {
+            if (++stepIndex >= stepCount) {
+                sequence = NULL;
+                break;
+            }
+            startStep();
+            continue;
+        }
+        size_t run = stepFrames - stepPosition;
+        if (run > frames - written) {
+            run = frames - written;
+        }
+        int16_t *o = out + written * 2;
+        if (phaseStep == 0) {
+            for (size_t i = 0; i < run * 2; i++) {
+                o[i] = 0;
+            }
+        } else {
+            for (size_t i = 0; i < run; i++) {
+                // Linear fade over the first and last rampFrames of the note
+                uint32_t position = stepPosition + i;
+                uint32_t edge = position < stepFrames - position ? position : stepFrames - position;
+                int32_t gain = edge < rampFrames ? (int32_t)(level * (int32_t)edge / (int32_t)rampFrames) : level;
+                int16_t s = (int16_t)((ncoSine(phase) * gain) >> 15);
+                phase += phaseStep;
+                o[2 * i] = s;
+                o[2 * i + 1] = s;
+            }
+        }
+        stepPosition += run;
+        written += run;
+    }
+    return written;
+}
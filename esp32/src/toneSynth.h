@@ -0,0 +1,71 @@
+#ifndef TONE_SYNTH_H
+#define TONE_SYNTH_H
+
+#include <cstdint>
+#include <cstddef>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+
+// Q15 sine of a phase where 2^32 is one full turn: a quarter-wave table
+// with linear interpolation, no floating point
+int16_t ncoSine(uint32_t phase);
+
+// Phase increment per sample for a numerically controlled oscillator
+inline uint32_t ncoStep(uint32_t frequencyHz, uint32_t sampleRate) {
+    return sampleRate ? (uint32_t)(((uint64_t)frequencyHz << 32) / sampleRate) : 0;
+}
+
+// One note of an earcon; frequency 0 is a rest
+struct ToneStep {
+    uint16_t frequencyHz;
+    uint16_t ms;
+};
+
+// Earcon generator: plays a short sequence of NCO tones into the mixer.
+// Each note fades in and out over a few milliseconds so it does not click.
+// play() may be called from any task; the request is queued and picked up
+// at the next fill(), which runs on the playback task. Sequences are
+// referenced, not copied, so they must outlive playback (const tables).
+class ToneSynth {
+public:
+    static const uint8_t RAMP_MS = 4;
+
+    ToneSynth();
+    ~ToneSynth();
+
+    bool begin(uint32_t sampleRate);
+    // Replaces whatever is playing
+    bool play(const ToneStep *steps, uint8_t count, uint8_t levelPercent);
+    void stop();
+    bool active() const { return sequence != NULL; }
+
+    // Stereo frames; returns 0 when idle. Matches MixerFill through fillSource().
+    size_t fill(int16_t *out, size_t frames);
+    static size_t fillSource(void *synth, int16_t *out, size_t frames);
+
+private:
+    struct Request {
+        const ToneStep *steps;
+        uint8_t count;
+        uint8_t level;
+    };
+
+    void startStep();
+
+    uint32_t rate;
+    QueueHandle_t requests;
+    const ToneStep *sequence;
+    uint8_t stepCount;
+    uint8_t stepIndex;
+    uint32_t stepFrames;
+    uint32_t stepPosition;
+    uint32_t rampFrames;
+    uint32_t phase;
+    uint32_t phaseStep;
+    int32_t level; // Q15
+
+    ToneSynth(const ToneSynth &);
+    ToneSynth &operator=(const ToneSynth &);
+};
+
+#endif // TONE_SYNTH_H
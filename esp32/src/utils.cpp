@@ -16,7 +16,8 @@ float calculateRMS(int32_t *samples, size_t count)
   float sum = 0;
   for (size_t i = 0; i < count; i++)
   {
-    sum += samples[i] * samples[i];
+    float sample = samples[i];
+    sum += sample * sample;
   }
   return sqrt(sum / count);
 }
@@ -0,0 +1,112 @@
+#include "vad.h"
+
+VoiceActivityDetector::VoiceActivityDetector()
+    : floorEnergy(1), energy(0), zcr(0), dcOffset(0), hangover(0), speech(false),
+      calibrationSum(0), calibrationFrames(0) {
+    cfg.frameSamples = 0;
+    cfg.hangoverFrames = 0;
+    cfg.speechRatio = 4;
+    cfg.minEnergy = 1;
+    cfg.maxZcrPerMille = 500;
+}
+
+void VoiceActivityDetector::begin(const VadConfig &config) {
+    cfg = config;
+    floorEnergy = cfg.minEnergy > 0 ? cfg.minEnergy : 1;
+    dcOffset = 0;
+    calibrationSum = 0;
+    calibrationFrames = 0;
+    reset();
+}
+
+// Drops speech state but keeps the learned noise floor
+void VoiceActivityDetector::reset() {
+    hangover = 0;
+    speech = false;
+}
+
+void VoiceActivityDetector::analyze(const int16_t *frame) {
+    int64_t sum = 0;
+    uint64_t sumSquares = 0;
+    uint32_t crossings = 0;
+    bool wasPositive = frame[0] >= dcOffset;
+
+    for (size_t i = 0; i < cfg.frameSamples; i++) {
+        int32_t s = frame[i];
+        sum += s;
+        sumSquares += (uint64_t)(s * s);
+
+        bool positive = s >= dcOffset;
+        crossings += positive != wasPositive;
+        wasPositive = positive;
+    }
+
+    // Variance rather than raw power, so a mic DC offset does not read as sound
+    int32_t mean = (int32_t)(sum / (int64_t)cfg.frameSamples);
+    uint64_t meanSquare = sumSquares / cfg.frameSamples;
+    uint64_t dcPower = (uint64_t)((int64_t)mean * mean);
+    energy = meanSquare > dcPower ? (uint32_t)(meanSquare - dcPower) : 0;
+    zcr = (uint16_t)(crossings * 1000 / cfg.frameSamples);
+    dcOffset = mean;
+}
+
+bool VoiceActivityDetector::process(const int16_t *frame) {
+    if (!frame || cfg.frameSamples == 0) {
+        return speech;
+    }
+
+    analyze(frame);
+
+    uint64_t threshold = (uint64_t)floorEnergy * cfg.speechRatio;
+    bool loud = energy >= cfg.minEnergy && energy > threshold;
+    bool hiss = zcr > cfg.maxZcrPerMille;
+    bool active = loud && (!hiss || energy > threshold * 4);
+
+    if (active) {
+        hangover = cfg.hangoverFrames;
+        speech = true;
+    } else if (hangover > 0) {
+        hangover--;
+    } else {
+        speech = false;
+    }
+
+    // Track the floor quickly downwards and slowly upwards; while talking
+    // only creep up so a step in background noise is eventually learned.
+    if (!active) {
+        if (energy < floorEnergy) {
+            floorEnergy -= (floorEnergy - energy) >> 2;
+        } else {
+            floorEnergy += (energy - floorEnergy) >> 5;
+        }
+    } else if (energy > floorEnergy) {
+        floorEnergy += (energy - floorEnergy) >> 10;
+    }
+    if (floorEnergy == 0) {
+        floorEnergy = 1;
+    }
+
+    return speech;
+}
+
+void VoiceActivityDetector::calibrate(const int16_t *frame) {
+    if (!frame || cfg.frameSamples == 0) {
+        return;
+    }
+    analyze(frame);
+    calibrationSum += energy;
+    calibrationFrames++;
+}
+
+void VoiceActivityDetector::finishCalibration() {
+    if (calibrationFrames > 0) {
+        uint32_t measured = (uint32_t)(calibrationSum / calibrationFrames);
+        floorEnergy = measured > cfg.minEnergy ? measured : cfg.minEnergy;
+    }
+    if (floorEnergy == 0) {
+        floorEnergy = 1;
+    }
+    calibrationSum = 0;
+    calibrationFrames = 0;
+    reset();
+}
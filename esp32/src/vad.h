@@ -0,0 +1,54 @@
+#ifndef VAD_H
+#define VAD_H
+
+#include <cstdint>
+#include <cstddef>
+
+struct VadConfig {
+    size_t frameSamples;     // samples per analysis frame
+    uint16_t hangoverFrames; // frames kept as speech after the last loud frame
+    uint16_t speechRatio;    // frame energy must exceed noise floor by this factor
+    uint32_t minEnergy;      // absolute mean-square floor, rejects digital silence
+    uint16_t maxZcrPerMille; // zero crossings per 1000 samples above which a
+                             // frame only counts when it is much louder
+};
+
+// Frame-based voice activity detector: energy against an adaptive noise
+// floor, zero-crossing rate to reject hiss and clicks, and a hangover so
+// word endings and short pauses are kept. Integer-only, no allocation.
+class VoiceActivityDetector {
+public:
+    VoiceActivityDetector();
+
+    void begin(const VadConfig &config);
+    void reset();
+    // Keeps the learned floor; energy is per sample, so it carries over
+    void setFrameSamples(size_t frameSamples) { cfg.frameSamples = frameSamples; }
+
+    // Returns true while in speech (including hangover)
+    bool process(const int16_t *frame);
+
+    // Boot-time noise floor measurement: feed frames, then finish
+    void calibrate(const int16_t *frame);
+    void finishCalibration();
+
+    bool inSpeech() const { return speech; }
+    uint32_t noiseFloor() const { return floorEnergy; }
+    uint32_t lastEnergy() const { return energy; }
+    uint16_t lastZcr() const { return zcr; }
+
+private:
+    void analyze(const int16_t *frame);
+
+    VadConfig cfg;
+    uint32_t floorEnergy;
+    uint32_t energy;
+    uint16_t zcr;
+    int32_t dcOffset;
+    uint16_t hangover;
+    bool speech;
+    uint64_t calibrationSum;
+    uint32_t calibrationFrames;
+};
+
+#endif // VAD_H
@@ -0,0 +1,62 @@
+#include "wavHeader.h"
+#include <cstring>
+
+static const uint16_t WAV_FORMAT_PCM = 1;
+static const uint16_t WAV_FORMAT_EXTENSIBLE = 0xFFFE;
+
+static inline uint16_t readLe16(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t readLe32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+bool isWavHeader(const uint8_t *data, size_t length) {
+    return data && length >= 12 && memcmp(data, "RIFF", 4) == 0 && memcmp(data + 8, "WAVE", 4) == 0;
+}
+
+bool parseWavHeader(const uint8_t *data, size_t length, WavInfo *info) {
+    if (!info || !isWavHeader(data, length)) {
+        return false;
+    }
+    bool haveFormat = false;
+    size_t offset = 12;
+    while (offset + 8 <= length) {
+        const uint8_t *chunk = data + offset;
+        uint32_t size = readLe32(chunk + 4);
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            if (size < 16 || offset + 8 + 16 > length) {
+                return false;
+            }
+            info->format = readLe16(chunk + 8);
+            info->channels = (uint8_t)readLe16(chunk + 10);
+            info->sampleRate = readLe32(chunk + 12);
+            info->bitsPerSample = readLe16(chunk + 22);
+            // Extensible headers carry the real format in the sub-format GUID
+            if (info->format == WAV_FORMAT_EXTENSIBLE && size >= 40 && offset + 8 + 26 <= length) {
+                info->format = readLe16(chunk + 8 + 24);
+            }
+            haveFormat = true;
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            if (!haveFormat) {
+                return false;
+            }
+            info->dataOffset = offset + 8;
+            info->dataBytes = size;
+            return true;
+        }
+        // Chunks are padded to an even size; one running past the buffer
+        // means the data chunk is not in it
+        if (size >= length - offset - 8) {
+            return false;
+        }
+        offset += 8 + (size_t)size + (size & 1);
+    }
+    return false;
+}
+
+bool wavIsPcm16(const WavInfo &info) {
+    return info.format == WAV_FORMAT_PCM && info.bitsPerSample == 16 && info.channels >= 1 && info.channels <= 2 &&
+           info.sampleRate > 0;
+}
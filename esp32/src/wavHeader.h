@@ -0,0 +1,30 @@
+#ifndef WAV_HEADER_H
+#define WAV_HEADER_H
+
+#include <cstdint>
+#include <cstddef>
+
+// What a RIFF/WAVE header says about the samples after it
+struct WavInfo {
+    uint16_t format;        // 1 = PCM, 0xFFFE = extensible
+    uint8_t channels;
+    uint32_t sampleRate;
+    uint16_t bitsPerSample;
+    size_t dataOffset;      // bytes from the start of the buffer to the first sample
+    uint32_t dataBytes;     // as declared; streamed files often leave 0 or 0xFFFFFFFF
+};
+
+static const size_t WAV_MIN_HEADER_BYTES = 44;
+
+// True when the buffer starts with "RIFF....WAVE"
+bool isWavHeader(const uint8_t *data, size_t length);
+
+// Walks the chunks up to "data", skipping any (LIST, fact, ...) in between.
+// Fails if the header is cut off before the data chunk or has no "fmt ".
+// Plain C++ so it builds on a host.
+bool parseWavHeader(const uint8_t *data, size_t length, WavInfo *info);
+
+// 16-bit integer PCM, the only layout the playback path takes as is
+bool wavIsPcm16(const WavInfo &info);
+
+#endif // WAV_HEADER_H
@@ -0,0 +1,145 @@
+// IMA-ADPCM blocks as the mic sends them: a server recording through the
+// encoder and back must keep its length and most of its SNR, and every
+// block must decode on its own. The fixed block at the top is shared with
+// server/src/adpcm.test.ts so the two codecs stay bit-compatible.
+// Run with `pio test -e native`.
+
+#include <unity.h>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "adpcm.h"
+#include "hostWav.h"
+
+#ifndef ADPCM_SPEECH_WAV
+#define ADPCM_SPEECH_WAV "../server/recording-cfyvnrh8ofb.wav"
+#endif
+
+static const int16_t SHARED_SAMPLES[7] = {0, 300, 900, 1500, 1200, 400, -600};
+static const uint8_t SHARED_BLOCK[8] = {0x00, 0x00, 0x00, 0x01, 0x70, 0x77, 0x47, 0x0f};
+static const int16_t SHARED_DECODED[7] = {0, 11, 41, 104, 240, 416, 61};
+
+static const double MIN_SNR_DB = 20.0;
+
+static double snrDb(const int16_t *reference, const int16_t *decoded, size_t count) {
+    double signal = 0.0;
+    double error = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        double e = (double)decoded[i] - reference[i];
+        signal += (double)reference[i] * reference[i];
+        error += e * e;
+    }
+    return 10.0 * log10(signal / error);
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_matches_the_shared_block() {
+    AdpcmEncoder encoder;
+    uint8_t block[sizeof(SHARED_BLOCK)];
+    TEST_ASSERT_EQUAL_UINT32(sizeof(SHARED_BLOCK), encoder.encodeBlock(SHARED_SAMPLES, 7, block));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(SHARED_BLOCK, block, sizeof(SHARED_BLOCK));
+
+    AdpcmDecoder decoder;
+    int16_t decoded[8];
+    TEST_ASSERT_EQUAL_UINT32(7, decoder.decodeBlock(block, sizeof(block), decoded));
+    TEST_ASSERT_EQUAL_INT16_ARRAY(SHARED_DECODED, decoded, 7);
+}
+
+// The pad nibble of an odd block is not a sample; blocks from encoders
+// that predate the flag still decode to every nibble
+void test_odd_blocks_keep_their_length() {
+    int16_t ramp[20];
+    for (size_t i = 0; i < 20; i++) {
+        ramp[i] = (int16_t)(i * 100);
+    }
+    AdpcmEncoder encoder;
+    AdpcmDecoder decoder;
+    uint8_t block[16];
+    int16_t decoded[20];
+    for (size_t count = 1; count <= 20; count++) {
+        size_t bytes = encoder.encodeBlock(ramp, count, block);
+        TEST_ASSERT_EQUAL_UINT32(adpcmBlockBytes(count), bytes);
+        TEST_ASSERT_EQUAL_UINT8(count & 1 ? ADPCM_FLAG_PADDED : 0, block[3]);
+        TEST_ASSERT_EQUAL_UINT32(count, decoder.decodeBlock(block, bytes, decoded));
+    }
+
+    memcpy(block, SHARED_BLOCK, sizeof(SHARED_BLOCK));
+    block[3] = 0;
+    TEST_ASSERT_EQUAL_UINT32(8, decoder.decodeBlock(block, sizeof(SHARED_BLOCK), decoded));
+    TEST_ASSERT_EQUAL_INT16_ARRAY(SHARED_DECODED, decoded, 7);
+}
+
+void test_speech_round_trip() {
+    HostWav wav;
+    if (!readWav(ADPCM_SPEECH_WAV, wav) || wav.channels != 1 || wav.samples.empty()) {
+        TEST_IGNORE_MESSAGE("no recording at " ADPCM_SPEECH_WAV);
+    }
+    // 20 ms blocks as the mic sends them, with an odd one every few
+    size_t frame = wav.sampleRate / 50;
+    AdpcmEncoder encoder;
+    AdpcmDecoder decoder;
+    std::vector<uint8_t> block(adpcmBlockBytes(frame + 1));
+    std::vector<int16_t> decoded(wav.samples.size());
+    size_t out = 0;
+    for (size_t at = 0, n = 0; at < wav.samples.size(); n++) {
+        size_t count = frame + (n % 3 == 1 ? 1 : 0);
+        if (count > wav.samples.size() - at) {
+            count = wav.samples.size() - at;
+        }
+        size_t bytes = encoder.encodeBlock(&wav.samples[at], count, &block[0]);
+        TEST_ASSERT_LESS_OR_EQUAL(block.size(), bytes);
+        size_t got = decoder.decodeBlock(&block[0], bytes, &decoded[out]);
+        TEST_ASSERT_EQUAL_UINT32(count, got);
+        at += count;
+        out += got;
+    }
+    TEST_ASSERT_EQUAL_UINT32(wav.samples.size(), out);
+
+    double snr = snrDb(&wav.samples[0], &decoded[0], out);
+    char line[96];
+    snprintf(line, sizeof(line), "%u samples at %u Hz, round trip SNR %.1f dB", (unsigned)out,
+             (unsigned)wav.sampleRate, snr);
+    TEST_MESSAGE(line);
+    TEST_ASSERT_TRUE_MESSAGE(snr > MIN_SNR_DB, line);
+}
+
+// The header carries the state, so a block decodes the same after a lost
+// message as in sequence
+void test_blocks_decode_on_their_own() {
+    int16_t samples[3][160];
+    for (size_t b = 0; b < 3; b++) {
+        for (size_t i = 0; i < 160; i++) {
+            samples[b][i] = (int16_t)(8000.0 * sin((b * 160 + i) * 2.0 * M_PI * 440.0 / 16000.0));
+        }
+    }
+    AdpcmEncoder encoder;
+    uint8_t blocks[3][84];
+    for (size_t b = 0; b < 3; b++) {
+        TEST_ASSERT_EQUAL_UINT32(sizeof(blocks[b]), encoder.encodeBlock(samples[b], 160, blocks[b]));
+    }
+
+    AdpcmDecoder inSequence;
+    int16_t expected[160];
+    for (size_t b = 0; b < 3; b++) {
+        inSequence.decodeBlock(blocks[b], sizeof(blocks[b]), expected);
+    }
+    AdpcmDecoder afterLoss;
+    int16_t decoded[160];
+    afterLoss.decodeBlock(blocks[0], sizeof(blocks[0]), decoded);
+    TEST_ASSERT_EQUAL_UINT32(160, afterLoss.decodeBlock(blocks[2], sizeof(blocks[2]), decoded));
+    TEST_ASSERT_EQUAL_INT16_ARRAY(expected, decoded, 160);
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_matches_the_shared_block);
+    RUN_TEST(test_odd_blocks_keep_their_length);
+    RUN_TEST(test_speech_round_trip);
+    RUN_TEST(test_blocks_decode_on_their_own);
+    return UNITY_END();
+}
@@ -0,0 +1,217 @@
+// Two-mic beamformer on stereo input: a server recording played to two
+// capsules, one a few samples behind the other, each with its own noise.
+// The steering must find the delay and the sum must gain the 3 dB that
+// averaging uncorrelated noise gives. Build with
+// -DBEAM_STEREO_WAV='"capture.wav"' to also steer on a real two-mic capture.
+// Run with `pio test -e native`.
+
+#include <unity.h>
+#include <cmath>
+#include <string>
+#include <vector>
+#include "beamformer.h"
+#include "hostWav.h"
+
+#ifndef BEAM_TALKER_WAV
+#define BEAM_TALKER_WAV "../server/recording-cfyvnrh8ofb.wav"
+#endif
+
+static const uint16_t SPACING_MM = 60; // MIC_SPACING_MM
+static const size_t READ_SAMPLES = 256; // per channel, as the capture task reads
+static const double INPUT_SNR_DB = 10.0; // over the whole file, pauses included
+
+// splitmix64: a plain LCG's successive draws correlate, which would put a
+// false peak in the cross-correlation of the two noises
+struct Random {
+    uint64_t state;
+    double uniform() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        z ^= z >> 31;
+        return ((z >> 11) + 0.5) / 9007199254740992.0;
+    }
+    // Box-Muller
+    double gaussian() {
+        return sqrt(-2.0 * log(uniform())) * cos(2.0 * M_PI * uniform());
+    }
+};
+
+static int16_t clip(double value) {
+    return (int16_t)(value > 32767.0 ? 32767 : (value < -32768.0 ? -32768 : lrint(value)));
+}
+
+static std::vector<int16_t> talker;
+static uint32_t talkerRate = 0;
+
+// The talker as a stereo capture: the second capsule hears it `lag`
+// samples after the first (before it when negative), each adds noise
+static HostWav twoMicCapture(int lag, double noiseRms, Random &random) {
+    HostWav wav;
+    wav.sampleRate = talkerRate;
+    wav.channels = 2;
+    wav.samples.resize(talker.size() * 2);
+    size_t late = (size_t)abs(lag);
+    for (size_t i = 0; i < talker.size(); i++) {
+        double now = talker[i];
+        double delayed = i >= late ? talker[i - late] : 0.0;
+        wav.samples[2 * i] = clip((lag >= 0 ? now : delayed) + noiseRms * random.gaussian());
+        wav.samples[2 * i + 1] = clip((lag >= 0 ? delayed : now) + noiseRms * random.gaussian());
+    }
+    return wav;
+}
+
+// Splits the slots and runs them through in capture-task reads
+static std::vector<int16_t> beamform(Beamformer &beamformer, const HostWav &wav) {
+    size_t frames = wav.samples.size() / 2;
+    std::vector<int16_t> first(frames);
+    std::vector<int16_t> second(frames);
+    for (size_t i = 0; i < frames; i++) {
+        first[i] = wav.samples[2 * i];
+        second[i] = wav.samples[2 * i + 1];
+    }
+    std::vector<int16_t> out(frames);
+    for (size_t at = 0; at < frames; at += READ_SAMPLES) {
+        size_t count = frames - at < READ_SAMPLES ? frames - at : READ_SAMPLES;
+        beamformer.process(&first[at], &second[at], &out[at], count, true);
+    }
+    return out;
+}
+
+// Against the talker as the later capsule heard it, after a second of
+// steering
+static double snrDb(const std::vector<int16_t> &signal, size_t delay, const int16_t *noisy, size_t stride) {
+    double clean = 0.0;
+    double error = 0.0;
+    for (size_t i = talkerRate; i < signal.size(); i++) {
+        double s = talker[i - delay];
+        double e = noisy[i * stride] - s;
+        clean += s * s;
+        error += e * e;
+    }
+    return 10.0 * log10(clean / error);
+}
+
+void setUp() {
+    if (talkerRate == 0) {
+        HostWav wav;
+        if (readWav(BEAM_TALKER_WAV, wav) && wav.channels == 1 && wav.samples.size() > wav.sampleRate * 2) {
+            talker = wav.samples;
+            talkerRate = wav.sampleRate;
+        }
+    }
+}
+
+void tearDown() {
+}
+
+void test_rejects_spacing_beyond_the_lag_limit() {
+    Beamformer beamformer;
+    TEST_ASSERT_FALSE(beamformer.begin(16000, 0));
+    TEST_ASSERT_FALSE(beamformer.begin(48000, 1000));
+    // Unconfigured, the first channel passes through
+    int16_t first[4] = {1, 2, 3, 4};
+    int16_t second[4] = {9, 9, 9, 9};
+    int16_t out[4];
+    beamformer.process(first, second, out, 4, true);
+    TEST_ASSERT_EQUAL_INT16_ARRAY(first, out, 4);
+}
+
+void test_steers_to_the_delay_and_gains_3_db() {
+    if (talkerRate == 0) {
+        TEST_IGNORE_MESSAGE("no talker recording at " BEAM_TALKER_WAV);
+    }
+    double power = 0.0;
+    for (size_t i = 0; i < talker.size(); i++) {
+        power += (double)talker[i] * talker[i];
+    }
+    double noiseRms = sqrt(power / talker.size() / pow(10.0, INPUT_SNR_DB / 10.0));
+
+    Beamformer beamformer;
+    TEST_ASSERT_TRUE(beamformer.begin(talkerRate, SPACING_MM));
+    const int lags[] = {0, 1, -1, 2, -2, 5, -7};
+    for (size_t c = 0; c < sizeof(lags) / sizeof(lags[0]); c++) {
+        Random random = {c + 1};
+        int lag = lags[c];
+        HostWav capture = twoMicCapture(lag, noiseRms, random);
+        beamformer.reset();
+        std::vector<int16_t> out = beamform(beamformer, capture);
+
+        char line[128];
+        size_t late = (size_t)abs(lag);
+        double in = snrDb(out, lag >= 0 ? 0 : late, &capture.samples[0], 2);
+        double gain = snrDb(out, late, &out[0], 1) - in;
+        snprintf(line, sizeof(line), "lag %+d: steered %+d (%+d deg, coherence %u%%), SNR %.1f dB in, %+.1f dB", lag,
+                 beamformer.steeringLag(), beamformer.angleDegrees(), (unsigned)beamformer.coherence(), in, gain);
+        TEST_MESSAGE(line);
+        TEST_ASSERT_EQUAL_INT_MESSAGE(lag, beamformer.steeringLag(), line);
+        TEST_ASSERT_TRUE_MESSAGE(lag == 0 || (lag > 0) == (beamformer.angleDegrees() > 0), line);
+        TEST_ASSERT_TRUE_MESSAGE(gain > 2.5 && gain < 3.5, line);
+    }
+}
+
+// Room noise alone, uncorrelated between the capsules, is no talker to
+// steer to, however loud
+void test_noise_alone_does_not_steer() {
+    Random random = {42};
+    Beamformer beamformer;
+    TEST_ASSERT_TRUE(beamformer.begin(44100, SPACING_MM));
+    std::vector<int16_t> first(44100 * 3);
+    std::vector<int16_t> second(first.size());
+    for (size_t i = 0; i < first.size(); i++) {
+        first[i] = clip(300.0 * random.gaussian());
+        second[i] = clip(300.0 * random.gaussian());
+    }
+    std::vector<int16_t> out(first.size());
+    beamformer.process(&first[0], &second[0], &out[0], first.size(), true);
+    TEST_ASSERT_EQUAL_INT(0, beamformer.steeringLag());
+}
+
+// Steering only moves while adapting, as during playback
+void test_holds_steering_without_adapting() {
+    if (talkerRate == 0) {
+        TEST_IGNORE_MESSAGE("no talker recording at " BEAM_TALKER_WAV);
+    }
+    Random random = {99};
+    Beamformer beamformer;
+    TEST_ASSERT_TRUE(beamformer.begin(talkerRate, SPACING_MM));
+    beamform(beamformer, twoMicCapture(3, 100.0, random));
+    TEST_ASSERT_EQUAL_INT(3, beamformer.steeringLag());
+
+    HostWav other = twoMicCapture(-3, 100.0, random);
+    std::vector<int16_t> first(other.samples.size() / 2);
+    std::vector<int16_t> second(first.size());
+    for (size_t i = 0; i < first.size(); i++) {
+        first[i] = other.samples[2 * i];
+        second[i] = other.samples[2 * i + 1];
+    }
+    std::vector<int16_t> out(first.size());
+    beamformer.process(&first[0], &second[0], &out[0], first.size(), false);
+    TEST_ASSERT_EQUAL_INT(3, beamformer.steeringLag());
+}
+
+#ifdef BEAM_STEREO_WAV
+void test_real_capture() {
+    HostWav wav;
+    TEST_ASSERT_TRUE_MESSAGE(readWav(BEAM_STEREO_WAV, wav) && wav.channels == 2, BEAM_STEREO_WAV);
+    Beamformer beamformer;
+    TEST_ASSERT_TRUE(beamformer.begin(wav.sampleRate, SPACING_MM));
+    beamform(beamformer, wav);
+    char line[96];
+    snprintf(line, sizeof(line), "steered %+d samples, %+d deg, coherence %u%%", beamformer.steeringLag(),
+             beamformer.angleDegrees(), (unsigned)beamformer.coherence());
+    TEST_MESSAGE(line);
+}
+#endif
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_rejects_spacing_beyond_the_lag_limit);
+    RUN_TEST(test_steers_to_the_delay_and_gains_3_db);
+    RUN_TEST(test_noise_alone_does_not_steer);
+    RUN_TEST(test_holds_steering_without_adapting);
+#ifdef BEAM_STEREO_WAV
+    RUN_TEST(test_real_capture);
+#endif
+    return UNITY_END();
+}
@@ -0,0 +1,259 @@
+// Wake word front end and network on the host: scores the recordings the
+// server keeps (server/recording-*.wav) and checks the spotter's memory and
+// compute budget. Run with `pio test -e native`.
+//
+// The reference model is a hand-set loudness detector, not a wake word: the
+// keyword logit is the mean c0 over the window above a level that only loud
+// speech reaches. It stands in for a trained model so the whole path
+// (resampler, MFCC front end, int8 layers, smoothing) runs against real
+// audio. Build with -DWAKE_WORD_MODEL_HEADER='"wakeWordModel.h"' to score
+// and budget a generated model as well.
+
+#include <unity.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "hostWav.h"
+#include "keywordSpotter.h"
+#include "resampler.h"
+#ifdef WAKE_WORD_MODEL_HEADER
+#include WAKE_WORD_MODEL_HEADER
+#endif
+
+#ifndef KWS_CORPUS_DIR
+#define KWS_CORPUS_DIR "../server"
+#endif
+
+// What the spotter may cost the device between turns: heap plus weights,
+// and multiply-accumulates per second of audio for the front end and net
+static const size_t KWS_MEMORY_BUDGET_BYTES = 64 * 1024;
+static const uint32_t KWS_MACS_PER_SECOND_BUDGET = 4000000;
+static const uint8_t THRESHOLD_PERCENT = 85;
+
+static const uint8_t FRAMES = 49;
+static const uint8_t COEFFS = 10;
+static const uint8_t BLOCKS = 7; // of FRAMES / BLOCKS frames each
+// c0 of loud speech in Q7 (about 13000) at int8 scale 1/160
+static const int32_t LOUD_C0_INT8 = 81;
+
+static int8_t blockWeights[BLOCKS * FRAMES * COEFFS];
+static int32_t blockBias[BLOCKS];
+static int8_t classWeights[2 * BLOCKS];
+static int32_t classBias[2];
+static KwsLayer referenceLayers[2];
+static KwsModel referenceModel;
+
+// Hidden unit j is the summed c0 of block j less the loud level, so the
+// keyword logit follows how far the window's mean c0 is above it
+static void buildReferenceModel() {
+    const uint8_t perBlock = FRAMES / BLOCKS;
+    memset(blockWeights, 0, sizeof(blockWeights));
+    for (uint8_t j = 0; j < BLOCKS; j++) {
+        for (uint8_t f = 0; f < perBlock; f++) {
+            blockWeights[j * FRAMES * COEFFS + (j * perBlock + f) * COEFFS] = 1;
+        }
+        blockBias[j] = -perBlock * LOUD_C0_INT8;
+        classWeights[j] = 0;          // background
+        classWeights[BLOCKS + j] = 1; // keyword
+    }
+    classBias[0] = 0;
+    classBias[1] = 0;
+
+    const int32_t half = 1 << 30; // multiplier of 0.5
+    KwsLayer blocks = {FRAMES * COEFFS, BLOCKS, blockWeights, blockBias, half, 2, false};
+    KwsLayer classes = {BLOCKS, 2, classWeights, classBias, half, 1, false};
+    referenceLayers[0] = blocks;
+    referenceLayers[1] = classes;
+
+    referenceModel.name = "reference loudness";
+    referenceModel.sampleRate = 16000;
+    referenceModel.windowMs = 30;
+    referenceModel.hopMs = 20;
+    referenceModel.melBands = 40;
+    referenceModel.coeffs = COEFFS;
+    referenceModel.frames = FRAMES;
+    referenceModel.inputMultiplier = 32768 / 160;
+    referenceModel.layerCount = 2;
+    referenceModel.layers = referenceLayers;
+    referenceModel.outputScale = 0.5f;
+    referenceModel.keywordClass = 1;
+}
+
+struct Score {
+    std::string name;
+    float seconds;
+    uint8_t peak;
+    uint32_t detections;
+};
+
+// Feeds audio in 20 ms blocks, as the mic task does, listening throughout
+static Score scoreSamples(KeywordSpotter &spotter, const std::vector<int16_t> &audio, uint32_t rate) {
+    Score score = {"", (float)audio.size() / rate, 0, 0};
+    size_t block = rate / 50;
+    for (size_t at = 0; at < audio.size(); at += block) {
+        size_t count = audio.size() - at < block ? audio.size() - at : block;
+        score.detections += spotter.process(&audio[at], count, true) ? 1 : 0;
+        if (spotter.score() > score.peak) {
+            score.peak = spotter.score();
+        }
+    }
+    return score;
+}
+
+// Each recording, mixed to mono and resampled to the model's rate
+static std::vector<Score> scoreCorpus(const KwsModel &model) {
+    std::vector<Score> scores;
+    KeywordSpotter spotter;
+    TEST_ASSERT_TRUE(spotter.begin(&model, THRESHOLD_PERCENT));
+    std::vector<std::string> files = listFiles(KWS_CORPUS_DIR, "recording-", ".wav");
+    for (size_t i = 0; i < files.size(); i++) {
+        HostWav wav;
+        TEST_ASSERT_TRUE_MESSAGE(readWav(files[i], wav), files[i].c_str());
+        std::vector<int16_t> mono(wav.samples.size() / wav.channels);
+        for (size_t s = 0; s < mono.size(); s++) {
+            int32_t sum = 0;
+            for (uint8_t c = 0; c < wav.channels; c++) {
+                sum += wav.samples[s * wav.channels + c];
+            }
+            mono[s] = (int16_t)(sum / wav.channels);
+        }
+        Resampler resampler;
+        TEST_ASSERT_TRUE(resampler.begin(wav.sampleRate, model.sampleRate));
+        std::vector<int16_t> audio(resampler.maxOutput(mono.size()) + 1);
+        audio.resize(mono.empty() ? 0 : resampler.process(&mono[0], mono.size(), &audio[0]));
+
+        spotter.reset();
+        Score score = scoreSamples(spotter, audio, model.sampleRate);
+        score.name = files[i].substr(files[i].find_last_of('/') + 1);
+        char line[160];
+        snprintf(line, sizeof(line), "%s: %s %.2f s, peak %u%%, %u detections", model.name, score.name.c_str(),
+                 score.seconds, (unsigned)score.peak, (unsigned)score.detections);
+        TEST_MESSAGE(line);
+        scores.push_back(score);
+    }
+    return scores;
+}
+
+// Multiply-accumulates per second: a windowed FFT, the filterbank and DCT
+// every hop, the network every second hop (the spotter's duty cycle while
+// the VAD hears speech)
+static uint32_t macsPerSecond(const KwsModel &model) {
+    uint32_t window = model.sampleRate * model.windowMs / 1000;
+    uint32_t fftSize = 1;
+    uint32_t stages = 0;
+    while (fftSize < window) {
+        fftSize <<= 1;
+        stages++;
+    }
+    uint32_t frontEnd = 2 * fftSize * stages + (fftSize / 2 + 1) * 2 + (uint32_t)model.melBands * model.coeffs;
+    uint32_t network = 0;
+    for (uint8_t l = 0; l < model.layerCount; l++) {
+        network += (uint32_t)model.layers[l].inputs * model.layers[l].outputs;
+    }
+    uint32_t hopsPerSecond = 1000 / model.hopMs;
+    return hopsPerSecond * frontEnd + hopsPerSecond / 2 * network;
+}
+
+static void checkBudget(const KwsModel &model) {
+    KeywordSpotter spotter;
+    TEST_ASSERT_TRUE(spotter.begin(&model, THRESHOLD_PERCENT));
+    TEST_ASSERT_LESS_OR_EQUAL(KWS_MEMORY_BUDGET_BYTES, spotter.memoryBytes());
+    TEST_ASSERT_LESS_OR_EQUAL(KWS_MACS_PER_SECOND_BUDGET, macsPerSecond(model));
+
+    // Ten seconds of noise, for the host's time per hop next to the device's
+    // DSP peak in logMicStats
+    std::vector<int16_t> noise(model.sampleRate * 10);
+    uint32_t seed = 1;
+    for (size_t i = 0; i < noise.size(); i++) {
+        seed = seed * 1664525u + 1013904223u;
+        noise[i] = (int16_t)((int32_t)(seed >> 16) - 32768) / 4;
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    scoreSamples(spotter, noise, model.sampleRate);
+    double elapsedUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    char line[160];
+    snprintf(line, sizeof(line), "%s: %u B, %u MAC/s, %u inferences, %.1f us per hop on this host", model.name,
+             (unsigned)spotter.memoryBytes(), (unsigned)macsPerSecond(model), (unsigned)spotter.inferences(),
+             elapsedUs / (10000 / model.hopMs));
+    TEST_MESSAGE(line);
+}
+
+void setUp() {
+    buildReferenceModel();
+}
+
+void tearDown() {
+}
+
+void test_rejects_a_model_whose_layers_do_not_chain() {
+    KwsModel broken = referenceModel;
+    KwsLayer layers[2] = {referenceLayers[0], referenceLayers[1]};
+    layers[1].inputs = BLOCKS + 1;
+    broken.layers = layers;
+    KeywordSpotter spotter;
+    TEST_ASSERT_FALSE(spotter.begin(&broken, THRESHOLD_PERCENT));
+    TEST_ASSERT_FALSE(spotter.process(NULL, 0, true));
+}
+
+void test_silence_never_fires() {
+    KeywordSpotter spotter;
+    TEST_ASSERT_TRUE(spotter.begin(&referenceModel, THRESHOLD_PERCENT));
+    std::vector<int16_t> silence(referenceModel.sampleRate * 5, 0);
+    Score score = scoreSamples(spotter, silence, referenceModel.sampleRate);
+    TEST_ASSERT_EQUAL_UINT32(0, score.detections);
+    TEST_ASSERT_EQUAL_UINT32(0, score.peak);
+    TEST_ASSERT_GREATER_THAN(0, spotter.inferences());
+}
+
+void test_reference_model_scores_corpus() {
+    std::vector<Score> scores = scoreCorpus(referenceModel);
+    if (scores.empty()) {
+        TEST_IGNORE_MESSAGE("no recordings in " KWS_CORPUS_DIR);
+    }
+    uint32_t firing = 0;
+    uint32_t audible = 0;
+    for (size_t i = 0; i < scores.size(); i++) {
+        // Nothing can be detected before the one-second window has filled
+        if (scores[i].seconds < 1.0f) {
+            TEST_ASSERT_EQUAL_UINT32(0, scores[i].detections);
+            continue;
+        }
+        audible++;
+        firing += scores[i].detections > 0 ? 1 : 0;
+        // A detection is followed by a second of refractory period
+        TEST_ASSERT_LESS_OR_EQUAL((uint32_t)scores[i].seconds, scores[i].detections);
+    }
+    // Loud recordings fire, quiet ones do not
+    TEST_ASSERT_GREATER_THAN(0, firing);
+    TEST_ASSERT_LESS_THAN(audible, firing);
+
+    // Scoring is deterministic, so a model change shows up as a diff
+    std::vector<Score> again = scoreCorpus(referenceModel);
+    for (size_t i = 0; i < scores.size(); i++) {
+        TEST_ASSERT_EQUAL_UINT32(scores[i].peak, again[i].peak);
+        TEST_ASSERT_EQUAL_UINT32(scores[i].detections, again[i].detections);
+    }
+}
+
+void test_reference_model_within_budget() {
+    checkBudget(referenceModel);
+}
+
+#ifdef WAKE_WORD_MODEL_HEADER
+void test_configured_model() {
+    checkBudget(wakeWordModel);
+    scoreCorpus(wakeWordModel);
+}
+#endif
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_rejects_a_model_whose_layers_do_not_chain);
+    RUN_TEST(test_silence_never_fires);
+    RUN_TEST(test_reference_model_scores_corpus);
+    RUN_TEST(test_reference_model_within_budget);
+#ifdef WAKE_WORD_MODEL_HEADER
+    RUN_TEST(test_configured_model);
+#endif
+    return UNITY_END();
+}
@@ -0,0 +1,257 @@
+// Two speakers, one stream: each syncs its own clock to the server's over a
+// jittery network and plays the stream on the server's timeline. Their
+// crystals run at +40 and -40 ppm and their I2S dividers are off as well;
+// what they play must stay within a couple of milliseconds of each other.
+// Run with `pio test -e native`.
+
+#include <unity.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "clockSync.h"
+#include "jitterBuffer.h"
+#include "scheduledPlayout.h"
+
+static const uint32_t RATE = 24000;
+static const size_t BLOCK = 240;         // 10 ms DMA blocks
+static const size_t CHUNK = 480;         // 20 ms network chunks
+static const double LEAD_US = 500000;    // pts ahead of the first chunk
+static const double STREAM_US = 120e6;
+static const double SYNC_EVERY_US = 2e6; // CLOCK_SYNC_INTERVAL_MS
+static const double ALIGNMENT_US = 2000;
+
+// Reproducible on every host, unlike the standard distributions
+struct Random {
+    uint32_t state;
+    double next() {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) / 16777216.0;
+    }
+};
+
+struct Device {
+    Device(double crystal, double divider, double offset, double dmaPhase)
+        : crystalPpm(crystal), dividerPpm(divider), offsetUs(offset), dmaPhaseUs(dmaPhase), stallFromUs(0),
+          stallUs(0), nextBlockUs(0) {
+    }
+
+    double crystalPpm; // local clock against true time
+    double dividerPpm; // I2S frame rate against the local clock
+    double offsetUs;   // local clock at true time 0
+    double dmaPhaseUs;
+    double stallFromUs; // into the stream: a second of it arrives stallUs late
+    double stallUs;
+
+    JitterBuffer buffer;
+    ScheduledPlayout playout;
+    ClockSync clock;
+    double nextBlockUs; // true time the next block plays
+    std::vector<std::pair<double, double> > played; // true time, stream position
+
+    double local(double trueUs) const { return trueUs * (1 + crystalPpm * 1e-6) + offsetUs; }
+    double frameUs() const { return 1e6 / (RATE * (1 + crystalPpm * 1e-6) * (1 + dividerPpm * 1e-6)); }
+};
+
+// A sawtooth of one step per frame, so what plays can be traced back to
+// its position in the stream through the resampler's interpolation
+static const int32_t SAW_PERIOD = 20000;
+
+static void fillChunk(int16_t *out, size_t chunk) {
+    for (size_t i = 0; i < CHUNK; i++) {
+        out[2 * i] = out[2 * i + 1] = (int16_t)((chunk * CHUNK + i) % SAW_PERIOD - SAW_PERIOD / 2);
+    }
+}
+
+// When the device played stream position m, interpolated between samples
+static double playedAt(const Device &device, double m) {
+    std::vector<std::pair<double, double> >::const_iterator next =
+        std::lower_bound(device.played.begin(), device.played.end(), std::make_pair(-INFINITY, m),
+                         [](const std::pair<double, double> &a, const std::pair<double, double> &b) {
+                             return a.second < b.second;
+                         });
+    if (next == device.played.begin() || next == device.played.end()) {
+        return NAN;
+    }
+    const std::pair<double, double> &before = *(next - 1);
+    // Across a sawtooth wrap or a skip
+    if (next->second - before.second > 50) {
+        return NAN;
+    }
+    return before.first + (m - before.second) / (next->second - before.second) * (next->first - before.first);
+}
+
+// One time_sync exchange starting at true time t, 2-8 ms each way and
+// uneven, as on Wi-Fi
+static void exchange(Device &device, double t, Random &random) {
+    double up = 2000 + 6000 * random.next() * random.next();
+    double down = 2000 + 6000 * random.next() * random.next();
+    double t0 = device.local(t);
+    double t1 = t + up;
+    double t2 = t1 + 100;
+    double t3 = device.local(t2 + down);
+    device.clock.addSample((int64_t)t0, (int64_t)t1, (int64_t)t2, (int64_t)t3);
+    int64_t now = (int64_t)t3;
+    device.playout.setAnchor(now, device.clock.toServer(now));
+}
+
+// Runs both devices on one true timeline, 1 ms a step. The server clock is
+// true time. Returns the worst offset between them after the first second.
+static double playStream(Device *devices, size_t count, Random &random) {
+    const double syncedAtUs = 60e6;
+    const double streamAtUs = syncedAtUs + 1e6;
+    const double pts = streamAtUs + LEAD_US;
+    const size_t chunks = (size_t)(STREAM_US * RATE / 1e6 / CHUNK);
+    const size_t frames = chunks * CHUNK;
+
+    std::vector<std::vector<double> > arrivals(count);
+    for (size_t k = 0; k < count; k++) {
+        Device &device = devices[k];
+        TEST_ASSERT_TRUE(device.buffer.begin(RATE, 2, 3000, 40, 1000, 40));
+        TEST_ASSERT_TRUE(device.playout.begin(RATE));
+        // Burst after connecting, then the regular exchanges
+        for (int i = 0; i < 8; i++) {
+            exchange(device, i * 250e3, random);
+        }
+        for (double t = 4e6; t < syncedAtUs; t += SYNC_EVERY_US) {
+            exchange(device, t, random);
+        }
+        TEST_ASSERT_TRUE(device.clock.skewKnown());
+        // The server's clock over ours, minus one
+        double trueSkewPpm = (1 / (1 + device.crystalPpm * 1e-6) - 1) * 1e6;
+        TEST_ASSERT_INT_WITHIN(10, (int32_t)lround(trueSkewPpm), device.clock.skewPpm());
+
+        // Sent in real time, delayed 3-43 ms, in order as TCP delivers
+        double latest = 0;
+        for (size_t c = 0; c < chunks; c++) {
+            double sent = streamAtUs + c * CHUNK * 1e6 / RATE;
+            double at = sent + 3000 + 40000 * pow(random.next(), 4);
+            if (device.stallUs > 0 && sent - streamAtUs >= device.stallFromUs &&
+                sent - streamAtUs < device.stallFromUs + 1e6) {
+                at += device.stallUs;
+            }
+            latest = std::max(latest, at);
+            arrivals[k].push_back(latest);
+        }
+        device.buffer.startStream();
+        device.playout.start((int64_t)pts);
+        device.nextBlockUs = streamAtUs + device.dmaPhaseUs;
+        device.played.clear();
+    }
+
+    std::vector<int16_t> chunk(CHUNK * 2);
+    std::vector<int16_t> block(BLOCK * 2);
+    std::vector<size_t> nextChunk(count, 0);
+    for (double t = streamAtUs; t < streamAtUs + STREAM_US + 2e6; t += 1000) {
+        for (size_t k = 0; k < count; k++) {
+            Device &device = devices[k];
+            if (fmod(t - streamAtUs, SYNC_EVERY_US) == 1000.0 * k) {
+                exchange(device, t, random);
+            }
+            while (nextChunk[k] < chunks && arrivals[k][nextChunk[k]] <= t) {
+                fillChunk(&chunk[0], nextChunk[k]);
+                device.buffer.push(&chunk[0], chunk.size(), (uint32_t)(t / 1000));
+                if (++nextChunk[k] == chunks) {
+                    device.buffer.endStream();
+                }
+            }
+            // Each block is mixed 20 ms before it reaches the wire, with the
+            // drift trim lib_speaker derives: server skew less the divider
+            while (device.nextBlockUs - 20000 <= t) {
+                int32_t skew = device.clock.skewPpm();
+                device.playout.setClock(skew, skew - (int32_t)device.dividerPpm);
+                size_t played = device.playout.render(device.buffer, &block[0], BLOCK,
+                                                      (int64_t)llround(device.local(device.nextBlockUs)));
+                for (size_t i = 0; i < played; i += 12) {
+                    // Silence is not the stream
+                    if (block[2 * i] == 0) {
+                        continue;
+                    }
+                    // The sawtooth repeats every 0.8 s, far more than any error
+                    double playUs = device.nextBlockUs + i * device.frameUs();
+                    double expected = (playUs - pts) * RATE / 1e6;
+                    double value = block[2 * i] + SAW_PERIOD / 2;
+                    double position = value + SAW_PERIOD * floor((expected - value) / SAW_PERIOD + 0.5);
+                    device.played.push_back(std::make_pair(playUs, position));
+                }
+                device.nextBlockUs += (played ? played : BLOCK) * device.frameUs();
+            }
+        }
+    }
+
+    // The same frames played on both, once the first second has settled
+    double worst = 0;
+    size_t compared = 0;
+    for (size_t m = RATE + 100; m < frames; m += RATE / 10) {
+        double a = playedAt(devices[0], m);
+        double b = playedAt(devices[1], m);
+        if (std::isnan(a) || std::isnan(b)) {
+            continue;
+        }
+        worst = std::max(worst, fabs(a - b));
+        compared++;
+    }
+    TEST_ASSERT_GREATER_THAN(frames / (RATE / 10) * 9 / 10, compared);
+    char line[96];
+    snprintf(line, sizeof(line), "worst offset between the devices %.0f us over %u checks", worst, (unsigned)compared);
+    TEST_MESSAGE(line);
+    return worst;
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_devices_with_opposite_skews_stay_aligned() {
+    Random random = {7};
+    Device devices[2] = {{40, -20, 123456789, 333}, {-40, 5, 987654, 1333}};
+    double worst = playStream(devices, 2, random);
+    TEST_ASSERT_LESS_THAN(ALIGNMENT_US, worst);
+    for (size_t k = 0; k < 2; k++) {
+        ScheduleStats stats = devices[k].playout.stats();
+        // Locked from the start: trimmed, never jumped
+        TEST_ASSERT_EQUAL_UINT32(0, stats.resyncs);
+        TEST_ASSERT_EQUAL_UINT32(0, stats.droppedFrames);
+        TEST_ASSERT_INT_WITHIN(ALIGNMENT_US, 0, stats.errorUs);
+        TEST_ASSERT_FALSE(devices[k].playout.active());
+    }
+}
+
+void test_a_stalled_device_skips_back_into_line() {
+    Random random = {11};
+    Device devices[2] = {{40, -20, 123456789, 333}, {-40, 5, 987654, 1333}};
+    devices[1].stallFromUs = 40e6;
+    devices[1].stallUs = 900000;
+    double worst = playStream(devices, 2, random);
+    TEST_ASSERT_LESS_THAN(ALIGNMENT_US, worst);
+    ScheduleStats stalled = devices[1].playout.stats();
+    TEST_ASSERT_GREATER_OR_EQUAL(1, stalled.resyncs);
+    TEST_ASSERT_GREATER_THAN(0, stalled.droppedFrames);
+    TEST_ASSERT_EQUAL_UINT32(0, devices[0].playout.stats().resyncs);
+}
+
+// A restarted server steps its clock; two fast exchanges off the line reset
+// the fit, one alone is a fluke
+void test_clock_sync_follows_a_server_step() {
+    ClockSync clock;
+    for (int64_t i = 0; i < 10; i++) {
+        int64_t t0 = i * 1000000;
+        TEST_ASSERT_TRUE(clock.addSample(t0, t0 + 5000 + 2000, t0 + 5100 + 2000, t0 + 4100));
+    }
+    TEST_ASSERT_INT_WITHIN(100, 5000, clock.toServer(10000000) - 10000000);
+    int64_t t0 = 10000000;
+    TEST_ASSERT_FALSE(clock.addSample(t0, t0 + 2000 - 3000000, t0 + 2100 - 3000000, t0 + 4100));
+    t0 += 1000000;
+    TEST_ASSERT_TRUE(clock.addSample(t0, t0 + 2000 - 3000000, t0 + 2100 - 3000000, t0 + 4100));
+    TEST_ASSERT_EQUAL_UINT32(1, clock.stats().resets);
+    TEST_ASSERT_INT_WITHIN(100, -3000000, clock.toServer(t0) - t0);
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_devices_with_opposite_skews_stay_aligned);
+    RUN_TEST(test_a_stalled_device_skips_back_into_line);
+    RUN_TEST(test_clock_sync_follows_a_server_step);
+    return UNITY_END();
+}
@@ -0,0 +1,82 @@
+// Round trip of the IMA-ADPCM blocks the device sends and the server sends
+// back. Run with `npm test`.
+import { test } from "node:test";
+import assert from "node:assert/strict";
+import { createAdpcmState, decodeImaAdpcmBlock, decodeUplinkAudio, encodeImaAdpcmBlock } from "./adpcm";
+
+// Shared with esp32/test/test_adpcm, so the two codecs stay bit-compatible
+const SHARED_SAMPLES = [0, 300, 900, 1500, 1200, 400, -600];
+const SHARED_BLOCK = Buffer.from([0x00, 0x00, 0x00, 0x01, 0x70, 0x77, 0x47, 0x0f]);
+const SHARED_DECODED = [0, 11, 41, 104, 240, 416, 61];
+
+function pcm(samples: number[]): Buffer {
+    const out = Buffer.alloc(samples.length * 2);
+    samples.forEach((s, i) => out.writeInt16LE(s, i * 2));
+    return out;
+}
+
+function samplesOf(buffer: Buffer): number[] {
+    const out: number[] = [];
+    for (let i = 0; i + 1 < buffer.length; i += 2) {
+        out.push(buffer.readInt16LE(i));
+    }
+    return out;
+}
+
+test("matches the device's block", () => {
+    assert.deepEqual(encodeImaAdpcmBlock(pcm(SHARED_SAMPLES), createAdpcmState()), SHARED_BLOCK);
+    assert.deepEqual(samplesOf(decodeImaAdpcmBlock(SHARED_BLOCK)), SHARED_DECODED);
+});
+
+test("odd blocks keep their length", () => {
+    const state = createAdpcmState();
+    for (let count = 1; count <= 20; count++) {
+        const ramp = Array.from({ length: count }, (_, i) => i * 100);
+        const block = encodeImaAdpcmBlock(pcm(ramp), state);
+        assert.equal(block.length, 4 + ((count + 1) >> 1));
+        assert.equal(decodeImaAdpcmBlock(block).length, count * 2);
+    }
+    // Blocks from encoders that predate the padding flag decode every nibble
+    const legacy = Buffer.from(SHARED_BLOCK);
+    legacy[3] = 0;
+    assert.deepEqual(samplesOf(decodeImaAdpcmBlock(legacy)).slice(0, 7), SHARED_DECODED);
+    assert.equal(decodeImaAdpcmBlock(legacy).length, 16);
+});
+
+test("round trip keeps a tone above 20 dB SNR", () => {
+    const rate = 16000;
+    const state = createAdpcmState();
+    const input: number[] = [];
+    const output: number[] = [];
+    // 20 ms blocks, every third one odd
+    for (let n = 0; n < 50; n++) {
+        const count = 320 + (n % 3 === 1 ? 1 : 0);
+        const block: number[] = [];
+        for (let i = 0; i < count; i++) {
+            const t = input.length + i;
+            block.push(Math.round(8000 * Math.sin((2 * Math.PI * 440 * t) / rate) + 3000 * Math.sin((2 * Math.PI * 1330 * t) / rate)));
+        }
+        input.push(...block);
+        output.push(...samplesOf(decodeUplinkAudio(encodeImaAdpcmBlock(pcm(block), state), "ima_adpcm")));
+    }
+    assert.equal(output.length, input.length);
+    let signal = 0;
+    let error = 0;
+    input.forEach((s, i) => {
+        signal += s * s;
+        error += (output[i] - s) ** 2;
+    });
+    assert.ok(10 * Math.log10(signal / error) > 20);
+});
+
+test("each header carries the state the previous block ended in", () => {
+    const state = createAdpcmState();
+    const blocks = [0, 1, 2].map((b) =>
+        encodeImaAdpcmBlock(pcm(Array.from({ length: 160 }, (_, i) => Math.round(8000 * Math.sin(((b * 160 + i) * 2 * Math.PI * 440) / 16000)))), state)
+    );
+    // So a block decodes the same after a lost message as in sequence
+    for (let b = 1; b < blocks.length; b++) {
+        const previous = samplesOf(decodeImaAdpcmBlock(blocks[b - 1]));
+        assert.equal(blocks[b].readInt16LE(0), previous[previous.length - 1]);
+    }
+});
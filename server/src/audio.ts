@@ -109,6 +109,26 @@ export class AudioManager {
         }
     }
 
+    // Uplink rate announced in the device hello; applies to the next recording
+    public setSampleRate(sampleRate: number): void {
+        if (sampleRate > 0) {
+            this.config = { ...this.config, sampleRate };
+        }
+    }
+
+    public getSampleRate(): number {
+        return this.config.sampleRate;
+    }
+
+    // The device replaces silent frames with a "silence N ms" marker;
+    // put the gap back so the recording keeps its timing.
+    public handleSilence(durationMs: number): void {
+        const samples = Math.round(this.config.sampleRate * durationMs / 1000) * this.config.channels;
+        if (samples > 0) {
+            this.handleAudioBuffer(Buffer.alloc(samples * this.config.bitDepth / 8));
+        }
+    }
+
     private processAndWriteBufferSimple(): void {
         if (!this.fileWriter || this.audioBuffer.length === 0 || this.isProcessing) return;
 
@@ -0,0 +1,14 @@
+// Server side of the device clock sync (see esp32/src/clockSync.h). The
+// device fits a line through these timestamps, so they come from a
+// monotonic source: the process start in wall time plus performance.now(),
+// which a wall-clock adjustment does not step.
+
+export function serverClockUs(): number {
+    return Math.round((performance.timeOrigin + performance.now()) * 1000);
+}
+
+// The reply to {"type":"time_sync","t0":...}: t1 when the request arrived,
+// t2 as the reply goes out
+export function timeSyncReply(t0: number, receivedUs: number): string {
+    return JSON.stringify({ type: "time_sync", t0, t1: receivedUs, t2: serverClockUs() });
+}
@@ -14,6 +14,8 @@ import fs from 'fs';
 import { AudioManager, SampleRate } from './audio';
 import { createOpenAICompletion, createOpenAICompletionStream } from './openai';
 import { base64ToWavBuffer } from './speech';
+import { AdpcmState, UplinkCodec, createAdpcmState, decodeUplinkAudio, encodeImaAdpcmBlock } from './adpcm';
+import { serverClockUs, timeSyncReply } from './clock';
 
 const WS_PORT = parseInt(process.env.WS_PORT || "8888");
 const MONITOR_WS_PORT = parseInt(process.env.MONITOR_WS_PORT || "8899");
@@ -39,6 +41,35 @@ const monitorWsServer = new WebSocketServer({
 let deviceClients: WebSocket[] = [];
 let monitorClients: WebSocket[] = [];
 let recording: boolean = false;
+// The device whose button opened the recording; only its audio goes in
+let recordingDevice: WebSocket | null = null;
+
+// Encoding and rate of the audio each device announced in its hello
+interface DeviceUplink {
+  codec: UplinkCodec;
+  rate: number;
+}
+const deviceUplinks = new Map<WebSocket, DeviceUplink>();
+
+// Downlink codecs each device announced in its hello, and the state of the
+// response stream currently going out to it
+interface DeviceStream {
+  codec: "pcm16" | "ima_adpcm";
+  adpcm: AdpcmState;
+  pending: Buffer;
+}
+const deviceDownlinkCaps = new Map<WebSocket, string[]>();
+const deviceStreams = new Map<WebSocket, DeviceStream>();
+// Devices whose user talked over the current response; they get no more of it
+const interruptedDevices = new Set<WebSocket>();
+const STREAM_SAMPLE_RATE = SampleRate.RATE_24000; // OpenAI pcm16 output
+const ADPCM_BLOCK_SAMPLES = 1024;
+// Devices sharing a response play it from the same server time, this far
+// after its first audio: room for the network and the device's playout
+// buffer. A lone device gets no presentation time and plays on arrival,
+// unless SYNC_PLAYBACK=1 asks for the shared timeline anyway.
+const STREAM_LEAD_US = 500000;
+const SYNC_PLAYBACK = process.env.SYNC_PLAYBACK === "1";
 
 const audioManager = new AudioManager();
 
@@ -46,7 +77,7 @@ async function handleButtonStateChange(ws: WebSocket, buttonState: boolean) {
   notifyButtonStateChange(ws, buttonState);
   
   if (buttonState) {
-    startRecordingSession();
+    startRecordingSession(ws);
   } else {
     if (recording) {
       await stopRecordingAndProcessAudioAsStream();
@@ -63,8 +94,10 @@ function notifyButtonStateChange(ws: WebSocket, buttonState: boolean) {
   }));
 }
 
-function startRecordingSession() {
+function startRecordingSession(ws: WebSocket) {
   recording = true;
+  recordingDevice = ws;
+  audioManager.setSampleRate(deviceUplinks.get(ws)?.rate ?? SampleRate.RATE_44100);
   audioManager.startRecording();
 }
 
@@ -107,16 +140,25 @@ async function processAudioWithOpenAIStream(buffer: Buffer) {
         const stream = await createOpenAICompletionStream(buffer);
         console.log('Starting to process audio stream from OpenAI');
         
+        // Opened on the first audio, so the shared start time is not spent
+        // waiting for the model
+        let started = false;
         for await (const chunk of stream) {
             const audioData = extractAudioFromChunk(chunk);
             if (audioData) {
+                if (!started) {
+                    startDeviceStreams();
+                    started = true;
+                }
                 broadcastStreamAudioToClients(audioData);
             }
         }
+        endDeviceStreams();
         
         return null; // Streaming mode - no buffer return needed
     } catch (error) {
         console.error('Error creating OpenAI completion stream:', error);
+        endDeviceStreams();
         return null;
     }
 }
@@ -131,9 +173,9 @@ function extractAudioFromChunk(chunk: any): Buffer | null {
     return Buffer.from(delta.audio.data, 'base64');
 }
 
-function handleAudioData(data: Buffer) {
-  if (recording) {
-    audioManager.handleAudioBuffer(data);
+function handleAudioData(ws: WebSocket, data: Buffer) {
+  if (recording && ws === recordingDevice) {
+    audioManager.handleAudioBuffer(decodeUplinkAudio(data, deviceUplinks.get(ws)?.codec ?? "pcm16"));
   }
 }
 
@@ -154,13 +196,57 @@ function broadcastAudioToClients(buffer: Buffer) {
     }
   });
 }
+// Announce the stream format to each device: ADPCM when it can decode it,
+// raw PCM otherwise. When several devices share the stream they all get the
+// same presentation time, so those with a synced clock play in step.
+function startDeviceStreams() {
+  interruptedDevices.clear();
+  const listeners = deviceClients.filter(client => client.readyState === WebSocket.OPEN);
+  const pts = listeners.length > 1 || SYNC_PLAYBACK ? serverClockUs() + STREAM_LEAD_US : undefined;
+  listeners.forEach(client => {
+    const caps = deviceDownlinkCaps.get(client) ?? [];
+    const codec = caps.includes("ima_adpcm") ? "ima_adpcm" : "pcm16";
+    deviceStreams.set(client, { codec, adpcm: createAdpcmState(), pending: Buffer.alloc(0) });
+    client.send(JSON.stringify({ type: "stream_start", codec, rate: STREAM_SAMPLE_RATE, channels: 1, pts }));
+  });
+}
+
+function endDeviceStreams() {
+  deviceStreams.forEach((stream, client) => {
+    if (client.readyState === WebSocket.OPEN) {
+      const tail = stream.pending.subarray(0, stream.pending.length & ~1);
+      if (tail.length > 0) {
+        client.send(encodeImaAdpcmBlock(tail, stream.adpcm));
+      }
+      client.send(JSON.stringify({ type: "stream_end" }));
+    }
+  });
+  deviceStreams.clear();
+}
+
+function sendStreamAudio(client: WebSocket, buffer: Buffer) {
+  const stream = deviceStreams.get(client);
+  if (!stream || stream.codec === "pcm16") {
+    client.send(buffer);
+    return;
+  }
+
+  // One self-contained ADPCM block per message
+  stream.pending = Buffer.concat([stream.pending, buffer]);
+  const blockBytes = ADPCM_BLOCK_SAMPLES * 2;
+  while (stream.pending.length >= blockBytes) {
+    client.send(encodeImaAdpcmBlock(stream.pending.subarray(0, blockBytes), stream.adpcm));
+    stream.pending = stream.pending.subarray(blockBytes);
+  }
+}
+
 function broadcastStreamAudioToClients(buffer: Buffer) {
   const CHUNK_SIZE = 2048; // Send 1KB chunks
   const DELAY_MS = 10; // 50ms delay between chunks
 
   deviceClients.forEach(client => {
-    if (client.readyState === WebSocket.OPEN) {
-      client.send(buffer);
+    if (client.readyState === WebSocket.OPEN && !interruptedDevices.has(client)) {
+      sendStreamAudio(client, buffer);
       // Split buffer into chunks and send with delay
       // for (let i = 0; i < buffer.length; i += CHUNK_SIZE) {
       //   const chunk = buffer.slice(i, i + CHUNK_SIZE);
@@ -176,21 +262,54 @@ wsServer.on("connection", (ws: WebSocket, req) => {
   console.log("Device Connected");
   deviceClients.push(ws);
 
-  ws.on("message", async (data) => {
-    if (data instanceof Buffer) {
+  ws.on("message", async (data, isBinary) => {
+    // Before anything else, as close to the request's arrival as this gets
+    const receivedUs = serverClockUs();
+    // ws delivers text frames as Buffers too, so go by the frame type
+    if (isBinary && data instanceof Buffer) {
       if (data.length === 1) {
         // Handle button state change - 0 means released, 1 means pressed
         const buttonState = data.readUInt8(0) === 1;
         handleButtonStateChange(ws, buttonState);
       } else if (recording) {
         // Only process audio data if we're recording
-        handleAudioData(data);
+        handleAudioData(ws, data);
       }
     } else {
       // Handle text/JSON messages
       try {
         const message = JSON.parse(data.toString());
-        console.log("Received message:", message);
+        if (message.type === "time_sync") {
+          ws.send(timeSyncReply(Number(message.t0), receivedUs));
+        } else if (message.type === "hello") {
+          // Device capabilities and the encoding of the audio that follows
+          deviceUplinks.set(ws, {
+            codec: message.uplink?.codec === "ima_adpcm" ? "ima_adpcm" : "pcm16",
+            rate: Number(message.uplink?.rate) || SampleRate.RATE_44100,
+          });
+          deviceDownlinkCaps.set(ws, Array.isArray(message.caps?.downlink) ? message.caps.downlink : []);
+          console.log("Device hello:", JSON.stringify(message));
+        } else if (message.type === "silence") {
+          if (recording && ws === recordingDevice) {
+            audioManager.handleSilence(Number(message.ms) || 0);
+          }
+        } else if (message.type === "cancel_turn") {
+          // The turn was the first tap of a double press: keep the file,
+          // answer nothing
+          if (recording && ws === recordingDevice) {
+            audioManager.closeFile();
+            recording = false;
+            recordingDevice = null;
+          }
+          console.log("Device cancelled the turn");
+        } else if (message.type === "barge_in") {
+          // The device already cut playback; stop feeding it this response
+          interruptedDevices.add(ws);
+          deviceStreams.delete(ws);
+          console.log("Device barge-in");
+        } else {
+          console.log("Received message:", message);
+        }
       } catch (err) {
         console.error("Error parsing message:", err);
       }
@@ -208,9 +327,13 @@ wsServer.on("connection", (ws: WebSocket, req) => {
 
   // Close file when connection ends
   ws.on("close", () => {
-    if (recording) {
+    deviceUplinks.delete(ws);
+    deviceDownlinkCaps.delete(ws);
+    deviceStreams.delete(ws);
+    if (recording && ws === recordingDevice) {
       audioManager.closeFile();
       recording = false;
+      recordingDevice = null;
     }
   });
 });
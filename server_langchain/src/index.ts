@@ -14,6 +14,7 @@ import { sessionManager, SessionData } from "./lib/session";
 import { environmentalContextManager } from "./lib/environmental";
 import { storyGenerationEngine } from "./lib/story";
 import { sessionStorage } from "./lib/storage";
+import { assetLibrary } from "./lib/assets";
 
 // 타입 정의
 interface Context {
@@ -38,6 +39,18 @@ app.use("/", serveStatic({ path: "./static/test-client.html" }));
 app.use("/static/*", serveStatic({ root: "./" }));
 app.use("/test-client.html", serveStatic({ path: "./static/test-client.html" }));
 
+// Prompt assets for the device cache, by content hash
+app.get("/assets/:file", (c: Context) => {
+  const hash = c.req.param("file").replace(/\.wav$/, "");
+  const data = assetLibrary.get(hash);
+  if (!data) {
+    return c.json({ error: "asset not found" }, 404);
+  }
+  return new Response(data, {
+    headers: { "Content-Type": "audio/wav", "Content-Length": String(data.length) },
+  });
+});
+
 // 세션 관리 API 엔드포인트
 app.get("/api/sessions", (c: Context) => {
   const stats = sessionManager.getSessionStats();
@@ -0,0 +1,49 @@
+// IMA-ADPCM block decoder matching esp32/src/adpcm.cpp.
+// Block layout: int16 predictor (LE) | uint8 step index | uint8 flags | nibbles (low first)
+// Flag bit 0: an odd last sample was padded with a 0 nibble, which is not audio
+
+const STEP_TABLE = [
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31,
+    34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143,
+    157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658,
+    724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024,
+    3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+];
+
+const INDEX_TABLE = [-1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8];
+
+const HEADER_BYTES = 4;
+const FLAG_PADDED = 0x01;
+
+export type UplinkCodec = "pcm16" | "ima_adpcm";
+
+export function decodeImaAdpcmBlock(block: Buffer): Buffer {
+    if (block.length <= HEADER_BYTES) {
+        return Buffer.alloc(0);
+    }
+
+    let predictor = block.readInt16LE(0);
+    let index = Math.min(Math.max(block.readUInt8(2), 0), 88);
+    const count = (block.length - HEADER_BYTES) * 2 - (block.readUInt8(3) & FLAG_PADDED);
+    const out = Buffer.alloc(count * 2);
+
+    for (let i = 0; i < count; i++) {
+        const byte = block[HEADER_BYTES + (i >> 1)];
+        const nibble = i & 1 ? byte >> 4 : byte & 0x0f;
+        const step = STEP_TABLE[index];
+        let delta = step >> 3;
+        if (nibble & 4) delta += step;
+        if (nibble & 2) delta += step >> 1;
+        if (nibble & 1) delta += step >> 2;
+        predictor = nibble & 8 ? predictor - delta : predictor + delta;
+        predictor = Math.min(Math.max(predictor, -32768), 32767);
+        index = Math.min(Math.max(index + INDEX_TABLE[nibble], 0), 88);
+        out.writeInt16LE(predictor, i * 2);
+    }
+    return out;
+}
+
+export function decodeUplinkAudio(data: Buffer, codec: UplinkCodec): Buffer {
+    return codec === "ima_adpcm" ? decodeImaAdpcmBlock(data) : data;
+}
@@ -8,6 +8,8 @@ import decodeAudio from 'audio-decode';
 import WebSocket from "ws";
 import { OpenAIWebSocketConnection } from "./connections";
 import { VoiceToolExecutor } from "./executor";
+import { assetLibrary } from "./assets";
+import { serverClockUs, timeSyncReply } from "./clock";
 
 // Constants
 const EVENTS_TO_IGNORE = [
@@ -105,7 +107,7 @@ export class OpenAIVoiceReactAgent {
                 return;
             }
 
-            const base64 = convertAudioToPCM16(buffer);
+            const base64 = convertAudioToPCM16(buffer, this.audioManager.getSampleRate());
             await this.sendAudioEvent(base64);
 
         } catch (error) {
@@ -194,11 +196,53 @@ export class OpenAIVoiceReactAgent {
     }
 
     private setupBinaryMessageHandler(ws: WebSocket): void {
-        ws.on('message', async (data) => {
+        // Realtime audio is 24 kHz PCM both ways; ask once, the device
+        // answers with a hello carrying what it applied
+        let configSent = false;
+        ws.on('message', async (data, isBinary) => {
+            // Before anything else, for the clock sync's t1
+            const receivedUs = serverClockUs();
             console.log('===Received binary message:', {
                 type: data instanceof Buffer ? 'Buffer' : 'ArrayBuffer',
                 size: Buffer.isBuffer(data) ? data.length : data.byteLength
             });
+            if (!isBinary) {
+                // Text frames arrive as Buffers too; only the silence marker concerns audio
+                try {
+                    const message = JSON.parse(data.toString());
+                    if (message.type === "time_sync") {
+                        ws.send(timeSyncReply(Number(message.t0), receivedUs));
+                    } else if (message.type === "hello") {
+                        this.connection.setUplinkCodec(message.uplink?.codec === "ima_adpcm" ? "ima_adpcm" : "pcm16");
+                        this.audioManager.setSampleRate(Number(message.uplink?.rate) || 44100);
+                        if (!configSent) {
+                            configSent = true;
+                            ws.send(JSON.stringify({
+                                type: "config",
+                                uplink: { rate: 24000 },
+                                downlink: { codec: "pcm16", rate: 24000, channels: 1 }
+                            }));
+                            // Devices fetch what they lack in the background
+                            for (const hash of assetLibrary.hashes()) {
+                                ws.send(JSON.stringify({ type: "cache_asset", hash }));
+                            }
+                        }
+                    } else if (message.type === "silence") {
+                        this.connection.handleIncomingSilence(Number(message.ms) || 0);
+                    } else if (message.type === "asset_missing") {
+                        console.log("device has no cached asset", message.hash);
+                    } else if (message.type === "cancel_turn") {
+                        // The first tap of a double press: nothing to answer
+                        this.connection.sendEvent({ type: "input_audio_buffer.clear" });
+                    } else if (message.type === "barge_in") {
+                        // The device cut playback; stop generating the rest of the answer
+                        this.connection.sendEvent({ type: "response.cancel" });
+                    }
+                } catch (e) {
+                    // START_RECORD/STOP_RECORD and other plain text
+                }
+                return;
+            }
             if (data instanceof Buffer || data instanceof ArrayBuffer) {
                 const buffer = data instanceof ArrayBuffer ? Buffer.from(data) : data;
                 await this.connection.handleIncomingAudio(buffer);
@@ -0,0 +1,50 @@
+// Canned prompts the device keeps in flash (see esp32/src/assetCache.h).
+// Each is a PCM16 WAV named by the SHA-256 of the whole file, which is how
+// the device asks for it and checks what it downloaded.
+import fs from "fs";
+import path from "path";
+import crypto from "crypto";
+
+const HASH_PATTERN = /^[0-9a-f]{64}$/;
+
+export class AssetLibrary {
+    private byHash = new Map<string, Buffer>();
+    private byName = new Map<string, string>();
+
+    constructor(private dir: string = "./data/assets") {
+        this.load();
+    }
+
+    // Files can have any name; the hash is computed here
+    load(): void {
+        this.byHash.clear();
+        this.byName.clear();
+        if (!fs.existsSync(this.dir)) {
+            return;
+        }
+        for (const file of fs.readdirSync(this.dir)) {
+            if (!file.endsWith(".wav")) {
+                continue;
+            }
+            const data = fs.readFileSync(path.join(this.dir, file));
+            const hash = crypto.createHash("sha256").update(data).digest("hex");
+            this.byHash.set(hash, data);
+            this.byName.set(path.basename(file, ".wav"), hash);
+        }
+        console.log(`Loaded ${this.byHash.size} prompt assets`);
+    }
+
+    get(hash: string): Buffer | undefined {
+        return HASH_PATTERN.test(hash) ? this.byHash.get(hash) : undefined;
+    }
+
+    hashOf(name: string): string | undefined {
+        return this.byName.get(name);
+    }
+
+    hashes(): string[] {
+        return [...this.byHash.keys()];
+    }
+}
+
+export const assetLibrary = new AssetLibrary();
@@ -1,4 +1,5 @@
 import { AudioConfig, AudioManager } from "./audio";
+import { UplinkCodec, decodeUplinkAudio } from "./adpcm";
 import { convertAudioToPCM16, createStreamFromWebsocket } from "./utils";
 import WebSocket from "ws";
 
@@ -18,6 +19,7 @@ class OpenAIWebSocketConnection {
     audioConfig: AudioConfig;
     private isRecording: boolean = true;
     private audioManager: AudioManager;
+    private uplinkCodec: UplinkCodec = "pcm16";
 
     constructor(params: {
         url?: string;
@@ -106,8 +108,16 @@ class OpenAIWebSocketConnection {
         }
     }
 
+    setUplinkCodec(codec: UplinkCodec) {
+        this.uplinkCodec = codec;
+    }
+
     handleIncomingAudio(data: Buffer) {
-        this.audioManager.handleAudioBuffer(data);
+        this.audioManager.handleAudioBuffer(decodeUplinkAudio(data, this.uplinkCodec));
+    }
+
+    handleIncomingSilence(durationMs: number) {
+        this.audioManager.handleSilence(durationMs);
     }
 }
 